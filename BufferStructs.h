@@ -1,10 +1,103 @@
 #pragma once
 #include <DirectXMath.h>
-struct VertexShaderExternalData
+#include "ConstantBufferLayout.h"
+#include "Lights.h"
+
+// --------------------------------------------------------
+// C++ copies of the cbuffers the C++ side fills in whole.
+// The layout is checked at compile time against HLSL's
+// packing rules, and the layout & register against each
+// shader's reflection when it's first drawn with, so the two
+// can't drift apart.  Registers follow NewInclude.hlsli.
+// --------------------------------------------------------
+
+// FrameData (b0) of VertexShader.hlsl & VertexShaderWithNormalMaps.hlsl
+struct alignas(16) VertexFrameData
+{
+	DirectX::XMFLOAT4X4 View;
+	DirectX::XMFLOAT4X4 Projection;
+	DirectX::XMFLOAT4X4 LightView;
+	DirectX::XMFLOAT4X4 LightProjection;
+
+	static const char* GetBufferName() { return "FrameData"; }
+	static unsigned int GetBufferRegister() { return 0; }
+	static const ConstantBufferField* GetFields(unsigned int& count)
+	{
+		static const ConstantBufferField fields[] =
+		{
+			CONSTANT_BUFFER_FIELD(VertexFrameData, View, "view"),
+			CONSTANT_BUFFER_FIELD(VertexFrameData, Projection, "proj"),
+			CONSTANT_BUFFER_FIELD(VertexFrameData, LightView, "lightView"),
+			CONSTANT_BUFFER_FIELD(VertexFrameData, LightProjection, "lightProjection"),
+		};
+		count = sizeof(fields) / sizeof(fields[0]);
+		return fields;
+	}
+};
+
+// FrameData (b0) of ShadowMapVertexShader.hlsl - the light's view
+struct alignas(16) ShadowFrameData
+{
+	DirectX::XMFLOAT4X4 View;
+	DirectX::XMFLOAT4X4 Projection;
+
+	static const char* GetBufferName() { return "FrameData"; }
+	static unsigned int GetBufferRegister() { return 0; }
+	static const ConstantBufferField* GetFields(unsigned int& count)
+	{
+		static const ConstantBufferField fields[] =
+		{
+			CONSTANT_BUFFER_FIELD(ShadowFrameData, View, "view"),
+			CONSTANT_BUFFER_FIELD(ShadowFrameData, Projection, "projection"),
+		};
+		count = sizeof(fields) / sizeof(fields[0]);
+		return fields;
+	}
+};
+
+// ObjectData (b3) of every vertex shader.  The shadow shaders only
+// read World, which is fine: a shader may leave fields out.
+// Doubles as the per-instance vertex data (see RenderList.h).
+struct alignas(16) ObjectData
+{
+	DirectX::XMFLOAT4X4 World;
+	DirectX::XMFLOAT4X4 WorldInverseTranspose;
+
+	static const char* GetBufferName() { return "ObjectData"; }
+	static unsigned int GetBufferRegister() { return 3; }
+	static const ConstantBufferField* GetFields(unsigned int& count)
+	{
+		static const ConstantBufferField fields[] =
+		{
+			CONSTANT_BUFFER_FIELD(ObjectData, World, "world"),
+			CONSTANT_BUFFER_FIELD(ObjectData, WorldInverseTranspose, "worldInvTranspose"),
+		};
+		count = sizeof(fields) / sizeof(fields[0]);
+		return fields;
+	}
+};
+
+// FrameData (b0) of the lit pixel shaders.  PixelShader.hlsl has no
+// IBL, and just leaves the register slot SpecularIBLMipLevels is in empty.
+struct alignas(16) PixelFrameData
 {
-	DirectX::XMFLOAT4 colorTint;
-	DirectX::XMFLOAT4X4 worldMatrix;
-	DirectX::XMFLOAT4X4 viewMatrix;
-	DirectX::XMFLOAT4X4 projMatrix;
+	DirectX::XMFLOAT3 CameraPosition;
+	int SpecularIBLMipLevels;
+	Light DirectionalLights[MAX_DIRECTIONAL_LIGHTS];
+	Light PointLights[MAX_POINT_LIGHTS];
 
-};
\ No newline at end of file
+	static const char* GetBufferName() { return "FrameData"; }
+	static unsigned int GetBufferRegister() { return 0; }
+	static const ConstantBufferField* GetFields(unsigned int& count)
+	{
+		static const ConstantBufferField fields[] =
+		{
+			CONSTANT_BUFFER_FIELD(PixelFrameData, CameraPosition, "cameraPosition"),
+			CONSTANT_BUFFER_FIELD(PixelFrameData, SpecularIBLMipLevels, "specularIBLMipLevels"),
+			CONSTANT_BUFFER_FIELD(PixelFrameData, DirectionalLights, "directionalLights"),
+			CONSTANT_BUFFER_FIELD(PixelFrameData, PointLights, "pointLights"),
+		};
+		count = sizeof(fields) / sizeof(fields[0]);
+		return fields;
+	}
+};
@@ -41,6 +41,13 @@ Transform Camera::GetTransform()
 	return transform;
 }
 
+Frustum Camera::GetFrustum()
+{
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection, XMLoadFloat4x4(&viewMatrix) * XMLoadFloat4x4(&projectionMatrix));
+	return FrustumCuller::ExtractFrustum(viewProjection);
+}
+
 float Camera::getFOV()
 {
 	return fieldOfViewInRadians;
@@ -1,6 +1,7 @@
 #pragma once
 #include "Input.h"
 #include "Transform.h"
+#include "FrustumCuller.h"
 
 class Camera
 {
@@ -13,6 +14,8 @@ public:
 	DirectX::XMFLOAT4X4 GetProjectionMatrix();
 	Transform GetTransform();
 	float getFOV();
+	// The six planes of view * projection, for culling
+	Frustum GetFrustum();
 
 	void UpdateProjectionMatrix(float aspectRatio, float fov);
 	void UpdateViewMatrix();
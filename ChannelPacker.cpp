@@ -0,0 +1,194 @@
+#include "ChannelPacker.h"
+#include <algorithm>
+#include <climits>
+
+ChannelPacker::ChannelPacker(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	std::shared_ptr<ResourceCache> resources) :
+	device(device),
+	context(context),
+	resources(resources)
+{
+}
+
+ChannelPacker::~ChannelPacker()
+{
+}
+
+// --------------------------------------------------------
+// Loads the metal, roughness and (optional) AO maps and
+// interleaves them into one texture, keyed by the sources'
+// contents so packing the same maps twice is free.
+//
+// The output takes the smallest map's size and larger maps
+// are box filtered down to it, so the packed texture is never
+// bigger than its inputs.  For bronze that's 128x128 RGBA
+// (64 KB) in place of a 128x128 RGBA metal map (64 KB) and a
+// 1024x1024 R8 roughness map (1 MB) - roughness loses detail
+// in exchange.
+// --------------------------------------------------------
+ResourceHandle ChannelPacker::PackMetalRoughnessAO(std::wstring metalPath, std::wstring roughnessPath, std::wstring aoPath)
+{
+	// Only the top mip gets read, so don't bother building chains
+	ResourceHandle sources[3] = {
+		resources->LoadTexture(metalPath, false),
+		resources->LoadTexture(roughnessPath, false),
+		aoPath.empty() ? ResourceHandle() : resources->LoadTexture(aoPath, false) };
+	if (!sources[0] || !sources[1])
+		return ResourceHandle();
+
+	unsigned long long hash = ResourceCache::HashBytes("metal-roughness-ao", 18);
+	for (const ResourceHandle& source : sources)
+	{
+		std::string key = source ? source->Key : "white";
+		hash = ResourceCache::HashBytes(key.data(), key.size(), hash);
+	}
+	std::string packedKey = ResourceCache::HashToKey("mra:", hash);
+
+	ResourceHandle existing = resources->Find(packedKey);
+	if (existing)
+		return existing;
+
+	Channel channels[3];
+	for (int c = 0; c < 3; c++)
+	{
+		if (sources[c] && !ReadChannel(sources[c], channels[c]))
+			return ResourceHandle();
+	}
+
+	unsigned int width = UINT_MAX;
+	unsigned int height = UINT_MAX;
+	for (int c = 0; c < 3; c++)
+	{
+		if (!sources[c])
+			continue;
+		width = (std::min)(width, channels[c].Width);
+		height = (std::min)(height, channels[c].Height);
+	}
+	std::vector<unsigned char> texels((size_t)width * height * 4);
+	for (unsigned int y = 0; y < height; y++)
+	{
+		unsigned char* row = &texels[(size_t)y * width * 4];
+		for (unsigned int x = 0; x < width; x++)
+		{
+			row[x * 4 + 0] = AverageChannel(channels[0], x, y, width, height);
+			row[x * 4 + 1] = AverageChannel(channels[1], x, y, width, height);
+			row[x * 4 + 2] = sources[2] ? AverageChannel(channels[2], x, y, width, height) : 255;
+			row[x * 4 + 3] = 255;
+		}
+	}
+
+	// Full mip chain, same as the WIC loader builds for regular
+	// textures, so this lands in the same arrays as those do
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = width;
+	desc.Height = height;
+	desc.MipLevels = 0;
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	if (FAILED(device->CreateTexture2D(&desc, 0, texture.GetAddressOf())))
+		return ResourceHandle();
+	context->UpdateSubresource(texture.Get(), 0, 0, texels.data(), width * 4, 0);
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	device->CreateShaderResourceView(texture.Get(), 0, srv.GetAddressOf());
+	context->GenerateMips(srv.Get());
+
+	return resources->AddTexture(packedKey, RESOURCE_TYPE_TEXTURE, texture, srv);
+}
+
+// --------------------------------------------------------
+// Copies a texture's top mip back to the CPU and keeps its
+// red channel.  Grayscale PNGs come out of WIC as R8 or R16,
+// anything with color as RGBA/BGRA.
+// --------------------------------------------------------
+bool ChannelPacker::ReadChannel(ResourceHandle texture, Channel& channel)
+{
+	D3D11_TEXTURE2D_DESC desc = {};
+	texture->Texture->GetDesc(&desc);
+
+	unsigned int texelBytes = 0;
+	unsigned int offset = 0;
+	switch (desc.Format)
+	{
+	case DXGI_FORMAT_R8_UNORM:
+		texelBytes = 1;
+		break;
+	case DXGI_FORMAT_R16_UNORM:
+		texelBytes = 2;
+		offset = 1; // High byte
+		break;
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		texelBytes = 4;
+		break;
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8X8_UNORM:
+		texelBytes = 4;
+		offset = 2;
+		break;
+	default:
+		return false;
+	}
+
+	D3D11_TEXTURE2D_DESC stagingDesc = desc;
+	stagingDesc.MipLevels = 1;
+	stagingDesc.Usage = D3D11_USAGE_STAGING;
+	stagingDesc.BindFlags = 0;
+	stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	stagingDesc.MiscFlags = 0;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> staging;
+	if (FAILED(device->CreateTexture2D(&stagingDesc, 0, staging.GetAddressOf())))
+		return false;
+	context->CopySubresourceRegion(staging.Get(), 0, 0, 0, 0, texture->Texture.Get(), 0, 0);
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(staging.Get(), 0, D3D11_MAP_READ, 0, &mapped)))
+		return false;
+
+	channel.Width = desc.Width;
+	channel.Height = desc.Height;
+	channel.Values.resize((size_t)desc.Width * desc.Height);
+	for (unsigned int y = 0; y < desc.Height; y++)
+	{
+		const unsigned char* row = (const unsigned char*)mapped.pData + (size_t)y * mapped.RowPitch;
+		for (unsigned int x = 0; x < desc.Width; x++)
+			channel.Values[(size_t)y * desc.Width + x] = row[x * texelBytes + offset];
+	}
+
+	context->Unmap(staging.Get(), 0);
+	return true;
+}
+
+// --------------------------------------------------------
+// Average of every channel texel under output texel (x, y).
+// The output is never bigger than the channel, so each
+// output texel covers at least one source texel, and a
+// channel the same size gets its own texels back exactly.
+// --------------------------------------------------------
+unsigned char ChannelPacker::AverageChannel(const Channel& channel, unsigned int x, unsigned int y, unsigned int width, unsigned int height)
+{
+	unsigned int x0 = (unsigned int)((unsigned long long)x * channel.Width / width);
+	unsigned int y0 = (unsigned int)((unsigned long long)y * channel.Height / height);
+	unsigned int x1 = (std::max)(x0 + 1, (unsigned int)((unsigned long long)(x + 1) * channel.Width / width));
+	unsigned int y1 = (std::max)(y0 + 1, (unsigned int)((unsigned long long)(y + 1) * channel.Height / height));
+
+	unsigned int sum = 0;
+	for (unsigned int sy = y0; sy < y1; sy++)
+	{
+		const unsigned char* row = &channel.Values[(size_t)sy * channel.Width];
+		for (unsigned int sx = x0; sx < x1; sx++)
+			sum += row[sx];
+	}
+	unsigned int count = (x1 - x0) * (y1 - y0);
+	return (unsigned char)((sum + count / 2) / count);
+}
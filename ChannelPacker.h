@@ -0,0 +1,44 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
+#include <string>
+#include <vector>
+#include <memory>
+#include "ResourceCache.h"
+
+// --------------------------------------------------------
+// Import step that merges single-channel PBR maps into one
+// RGBA texture, so the shader samples them all at once:
+//   R = metalness, G = roughness, B = ambient occlusion
+//
+// The result is a regular mipmapped R8G8B8A8 texture, so it
+// can be handed to the TextureArrayPacker like any file.
+// --------------------------------------------------------
+class ChannelPacker
+{
+public:
+	ChannelPacker(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::shared_ptr<ResourceCache> resources);
+	~ChannelPacker();
+
+	// An empty ao path means "no occlusion" (all white)
+	ResourceHandle PackMetalRoughnessAO(std::wstring metalPath, std::wstring roughnessPath, std::wstring aoPath = L"");
+
+private:
+	// The first channel of a texture's top mip, one byte per texel
+	struct Channel
+	{
+		unsigned int Width = 0;
+		unsigned int Height = 0;
+		std::vector<unsigned char> Values;
+	};
+
+	bool ReadChannel(ResourceHandle texture, Channel& channel);
+	static unsigned char AverageChannel(const Channel& channel, unsigned int x, unsigned int y, unsigned int width, unsigned int height);
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::shared_ptr<ResourceCache> resources;
+};
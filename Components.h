@@ -0,0 +1,38 @@
+#pragma once
+#include "Mesh.h"
+#include "Material.h"
+
+// --------------------------------------------------------
+// Components the game hangs off entities in its registry.
+// Position, rotation & scale are a TransformHandle component;
+// the data itself stays in the TransformSystem.
+// --------------------------------------------------------
+
+// Anything drawn with a mesh & material.  Handles into the
+// game's pools rather than shared_ptrs, so copying one of
+// these around never touches a reference count.
+struct MeshRenderer
+{
+	MeshHandle RenderMesh;
+	MaterialHandle RenderMaterial;
+};
+
+// Big, solid things that hide what's behind them.  Drawn into
+// the CPU occlusion buffer with their own (usually simpler) mesh.
+struct Occluder
+{
+	MeshHandle OcclusionMesh;
+};
+
+// Scenery that never moves once it's placed.  The StaticBatcher
+// bakes these into shared meshes by material & cell.
+struct Static
+{
+};
+
+// What a merged static entity drew with before batching took
+// its MeshRenderer away, so the batch can be undone & rebuilt
+struct StaticBatched
+{
+	MeshRenderer Original;
+};
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <type_traits>
+
+// --------------------------------------------------------
+// One member of a C++ struct that mirrors an HLSL cbuffer,
+// with the name the shader gives it.  A struct lists these
+// from a static GetFields(), next to a static GetBufferName()
+// and the GetBufferRegister() it's meant to be bound to, and
+// ISimpleShader checks them against reflection once.
+// --------------------------------------------------------
+struct ConstantBufferField
+{
+	const char* Name;
+	unsigned int ByteOffset;
+	unsigned int Size;
+};
+
+// HLSL packs cbuffers into 16-byte registers: nothing smaller than a
+// register may straddle two, and anything a register or bigger (matrices,
+// arrays, structs) starts a new one
+constexpr bool PacksIntoRegisters(size_t byteOffset, size_t size)
+{
+	return size >= 16 ?
+		byteOffset % 16 == 0 :
+		byteOffset / 16 == (byteOffset + size - 1) / 16;
+}
+
+// Only compiles for fields that pass the check above
+template<bool Packed>
+struct PackedConstantBufferField
+{
+	static ConstantBufferField Make(const char* name, size_t byteOffset, size_t size)
+	{
+		static_assert(Packed, "This member doesn't sit where HLSL would pack it - move it or add padding");
+		return ConstantBufferField{ name, (unsigned int)byteOffset, (unsigned int)size };
+	}
+};
+
+// Lists a member of Struct under its HLSL name
+#define CONSTANT_BUFFER_FIELD(Struct, Member, hlslName) \
+	PackedConstantBufferField<PacksIntoRegisters(offsetof(Struct, Member), sizeof(Struct::Member))>::Make( \
+		hlslName, offsetof(Struct, Member), sizeof(Struct::Member))
+
+// What every cbuffer struct has to be before it's worth checking by name
+template<typename T>
+struct ConstantBufferStructCheck
+{
+	static_assert(alignof(T) == 16, "Declare constant buffer structs alignas(16)");
+	static_assert(sizeof(T) % 16 == 0, "Constant buffer structs are a whole number of 16-byte registers");
+	static_assert(std::is_trivially_copyable<T>::value, "Constant buffer structs are copied with memcpy");
+	static const bool Value = true;
+};
+
+// --------------------------------------------------------
+// A cbuffer of one shader that's been checked against T.
+// Look it up once with ISimpleShader::GetTypedBuffer<T>(),
+// then set the whole buffer from a T in one copy.
+// --------------------------------------------------------
+template<typename T>
+struct TypedBufferHandle
+{
+	int Index = -1;
+	bool IsValid() const { return Index >= 0; }
+};
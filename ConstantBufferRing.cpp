@@ -0,0 +1,102 @@
+#include "ConstantBufferRing.h"
+#include <algorithm>
+#include <cstring>
+
+ConstantBufferRing::ConstantBufferRing() :
+	mapped(nullptr),
+	supported(false),
+	noOverwriteSupported(false),
+	wrapped(false)
+{
+}
+
+void ConstantBufferRing::Init(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	unsigned int capacity)
+{
+	this->device = device;
+	allocator.Reset(RingAllocator::AlignUp(capacity, CONSTANT_RING_ALIGNMENT));
+
+	// Offsets need the 11.1 context & driver support; writing without
+	// overwrite is a separate cap, and without it every frame discards
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	supported =
+		SUCCEEDED(context.As(&this->context)) &&
+		SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) &&
+		options.ConstantBufferOffsetting;
+	noOverwriteSupported = supported && options.MapNoOverwriteOnDynamicConstantBuffer;
+}
+
+bool ConstantBufferRing::IsSupported() { return supported; }
+
+bool ConstantBufferRing::Begin(unsigned int bytesNeeded)
+{
+	if (!supported)
+		return false;
+
+	// Keep room for two frames, so most of them can go without
+	// overwrite.  Grows by doubling, so a settled scene stops growing.
+	if (!buffer || bytesNeeded > allocator.GetCapacity() / 2)
+	{
+		unsigned int capacity = buffer ? allocator.GetCapacity() * 2 : allocator.GetCapacity();
+		capacity = RingAllocator::AlignUp((std::max)(capacity, bytesNeeded * 2), CONSTANT_RING_ALIGNMENT);
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = capacity;
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		buffer.Reset();
+		if (FAILED(device->CreateBuffer(&desc, 0, buffer.GetAddressOf())))
+			return false;
+		allocator.Reset(capacity);
+	}
+
+	// Discarding throws away the old contents, so start from the top
+	if (!noOverwriteSupported)
+		allocator.Reset(allocator.GetCapacity());
+	wrapped = allocator.BeginFrame(bytesNeeded, CONSTANT_RING_ALIGNMENT);
+
+	D3D11_MAPPED_SUBRESOURCE map = {};
+	if (FAILED(context->Map(buffer.Get(), 0, wrapped ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 0, &map)))
+		return false;
+	mapped = (unsigned char*)map.pData;
+	return true;
+}
+
+unsigned int ConstantBufferRing::Write(const void* data, unsigned int size)
+{
+	if (!mapped)
+		return RING_ALLOCATION_FAILED;
+
+	unsigned int offset = allocator.Allocate(RingAllocator::AlignUp(size, CONSTANT_RING_ALIGNMENT), CONSTANT_RING_ALIGNMENT);
+	if (offset != RING_ALLOCATION_FAILED)
+		memcpy(mapped + offset, data, size);
+	return offset;
+}
+
+void ConstantBufferRing::End()
+{
+	if (!mapped)
+		return;
+
+	context->Unmap(buffer.Get(), 0);
+	mapped = nullptr;
+}
+
+void ConstantBufferRing::BindVS(PipelineStateCache& stateCache, unsigned int slot, unsigned int offset, unsigned int size)
+{
+	stateCache.SetConstantBuffer(PIPELINE_STAGE_VERTEX, slot, buffer.Get(),
+		offset / 16, RingAllocator::AlignUp(size, CONSTANT_RING_ALIGNMENT) / 16);
+}
+
+void ConstantBufferRing::BindPS(PipelineStateCache& stateCache, unsigned int slot, unsigned int offset, unsigned int size)
+{
+	stateCache.SetConstantBuffer(PIPELINE_STAGE_PIXEL, slot, buffer.Get(),
+		offset / 16, RingAllocator::AlignUp(size, CONSTANT_RING_ALIGNMENT) / 16);
+}
+
+unsigned int ConstantBufferRing::GetCapacity() { return allocator.GetCapacity(); }
+unsigned int ConstantBufferRing::GetBytesWritten() { return allocator.GetFrameUsed(); }
+bool ConstantBufferRing::GetWrapped() { return wrapped; }
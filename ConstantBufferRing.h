@@ -0,0 +1,61 @@
+#pragma once
+#include <d3d11_1.h>
+#include <wrl/client.h>
+#include "RingAllocator.h"
+#include "PipelineStateCache.h"
+
+// Constant buffer offsets are counted in 16-byte constants and
+// have to land on multiples of 16 of them
+#define CONSTANT_RING_ALIGNMENT 256
+
+// --------------------------------------------------------
+// One big dynamic constant buffer that a whole frame's
+// per-draw constants are written into, each at its own
+// offset, then bound by offset with *SetConstantBuffers1.
+//
+// Begin() maps it once for the frame - without overwrite, or
+// discarding when the RingAllocator wraps - and End() unmaps
+// it before anything draws.  So everything the frame needs
+// has to be written up front.
+//
+// Needs D3D 11.1's constant buffer offsetting; IsSupported()
+// says whether the device has it.
+// --------------------------------------------------------
+class ConstantBufferRing
+{
+public:
+	ConstantBufferRing();
+
+	void Init(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		unsigned int capacity);
+	bool IsSupported();
+
+	// Maps room for this many bytes, growing the buffer if need be
+	bool Begin(unsigned int bytesNeeded);
+	// Byte offset the data went to, or RING_ALLOCATION_FAILED
+	unsigned int Write(const void* data, unsigned int size);
+	void End();
+
+	// Through the cache, so it knows the slot no longer holds
+	// whatever buffer a shader bound there
+	void BindVS(PipelineStateCache& stateCache, unsigned int slot, unsigned int offset, unsigned int size);
+	void BindPS(PipelineStateCache& stateCache, unsigned int slot, unsigned int offset, unsigned int size);
+
+	// From the last Begin()
+	unsigned int GetCapacity();
+	unsigned int GetBytesWritten();
+	bool GetWrapped();
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	RingAllocator allocator;
+	unsigned char* mapped;
+
+	bool supported;
+	bool noOverwriteSupported;
+	bool wrapped;
+};
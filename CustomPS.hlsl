@@ -1,5 +1,5 @@
 // Constant buffer defined here
-cbuffer ExternalData : register(b0)
+cbuffer MaterialData : register(b2)
 {
     float4 colorTint;
 }
@@ -31,5 +31,9 @@ struct VertexToPixel
 // --------------------------------------------------------
 float4 main(VertexToPixel input) : SV_TARGET
 {
-    return input.screenPosition  * colorTint * frac(sin(dot(input.uv, float2(12.9898, 78.233))) * 43758.5453123);
+    float noise = frac(sin(dot(input.uv, float2(12.9898, 78.233))) * 43758.5453123);
+    float3 color = (input.screenPosition * colorTint).rgb * noise;
+
+    // Alpha comes straight from the tint so blending is predictable
+    return float4(color, colorTint.a);
 }
\ No newline at end of file
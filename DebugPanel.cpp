@@ -0,0 +1,87 @@
+#include "DebugPanel.h"
+#include "ImGui/imgui.h"
+#include <stdarg.h>
+#include <stdio.h>
+
+void DebugPanel::AddSelfTest(std::string label, std::function<bool()> test)
+{
+	Entry entry = {};
+	entry.Label = label;
+	entry.IsSelfTest = true;
+	entry.SelfTest = test;
+	entries.push_back(entry);
+}
+
+void DebugPanel::AddBenchmark(std::string label, std::function<std::vector<std::string>()> benchmark)
+{
+	Entry entry = {};
+	entry.Label = label;
+	entry.IsSelfTest = false;
+	entry.Benchmark = benchmark;
+	entries.push_back(entry);
+}
+
+// Runs one entry and keeps what it reported
+void DebugPanel::Run(Entry& entry)
+{
+	if (!entry.IsSelfTest)
+	{
+		entry.Results = entry.Benchmark();
+		return;
+	}
+
+	bool passed = entry.SelfTest();
+	entry.Results.assign(1, passed ? "passed" : "FAILED");
+	entry.Failed = !passed;
+}
+
+void DebugPanel::Draw()
+{
+	if (!ImGui::CollapsingHeader("Self tests & benchmarks"))
+		return;
+
+	if (ImGui::Button("Run all self tests"))
+	{
+		for (Entry& entry : entries)
+		{
+			if (entry.IsSelfTest)
+				Run(entry);
+		}
+	}
+
+	// Whatever's been run so far, together or one at a time
+	unsigned int run = 0;
+	unsigned int failed = 0;
+	for (const Entry& entry : entries)
+	{
+		if (entry.IsSelfTest && !entry.Results.empty())
+		{
+			run++;
+			if (entry.Failed)
+				failed++;
+		}
+	}
+	if (run)
+	{
+		ImGui::SameLine();
+		ImGui::Text("%u run, %u failed", run, failed);
+	}
+
+	for (Entry& entry : entries)
+	{
+		if (ImGui::Button(entry.Label.c_str()))
+			Run(entry);
+		for (const std::string& line : entry.Results)
+			ImGui::Text("  %s", line.c_str());
+	}
+}
+
+std::string DebugPanel::Format(const char* format, ...)
+{
+	char buffer[512];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+	return buffer;
+}
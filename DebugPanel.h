@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+
+// --------------------------------------------------------
+// The self tests & benchmarks, in one collapsible ImGui
+// section.  Each one is registered once with a label and a
+// function to run; the panel draws a button per entry, keeps
+// the lines its last run produced, and can run every self
+// test at once.
+// --------------------------------------------------------
+class DebugPanel
+{
+public:
+	// A check that passes or fails
+	void AddSelfTest(std::string label, std::function<bool()> test);
+
+	// Anything else - returns the lines to show under its button
+	void AddBenchmark(std::string label, std::function<std::vector<std::string>()> benchmark);
+
+	// Call once per frame, between ImGui's NewFrame() and Render()
+	void Draw();
+
+	// printf into a std::string, for building benchmark lines
+	static std::string Format(const char* format, ...);
+
+private:
+	struct Entry
+	{
+		std::string Label;
+		bool IsSelfTest;
+		std::function<bool()> SelfTest;
+		std::function<std::vector<std::string>()> Benchmark;
+		std::vector<std::string> Results;
+		bool Failed;
+	};
+
+	void Run(Entry& entry);
+
+	std::vector<Entry> entries;
+};
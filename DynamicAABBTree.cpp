@@ -0,0 +1,541 @@
+#include "DynamicAABBTree.h"
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+using namespace DirectX;
+
+DynamicAABBTree::DynamicAABBTree() :
+	root(AABB_TREE_NULL),
+	freeList(AABB_TREE_NULL),
+	proxyCount(0)
+{
+}
+
+// --------------------------------------------------------
+// Proxies
+// --------------------------------------------------------
+int DynamicAABBTree::CreateProxy(const AABB& box, unsigned int userData)
+{
+	int proxy = AllocateNode();
+	Node& node = nodes[proxy];
+	node.Box.Min = XMFLOAT3(box.Min.x - AABB_TREE_MARGIN, box.Min.y - AABB_TREE_MARGIN, box.Min.z - AABB_TREE_MARGIN);
+	node.Box.Max = XMFLOAT3(box.Max.x + AABB_TREE_MARGIN, box.Max.y + AABB_TREE_MARGIN, box.Max.z + AABB_TREE_MARGIN);
+	node.Height = 0;
+	node.UserData = userData;
+
+	InsertLeaf(proxy);
+	proxyCount++;
+	return proxy;
+}
+
+void DynamicAABBTree::DestroyProxy(int proxy)
+{
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+	proxyCount--;
+}
+
+// --------------------------------------------------------
+// Cheap as long as the new bounds still fit in the fat box.
+// Otherwise the leaf is reinserted with a new fat box, grown by
+// the margin plus a couple of frames of the same movement so
+// something moving steadily isn't reinserted every frame.
+// --------------------------------------------------------
+bool DynamicAABBTree::MoveProxy(int proxy, const AABB& box)
+{
+	AABB fat = nodes[proxy].Box;
+	if (Contains(fat, box))
+		return false;
+
+	XMFLOAT3 displacement(
+		AABB_TREE_DISPLACEMENT_MULTIPLIER * ((box.Min.x + box.Max.x) - (fat.Min.x + fat.Max.x)) * 0.5f,
+		AABB_TREE_DISPLACEMENT_MULTIPLIER * ((box.Min.y + box.Max.y) - (fat.Min.y + fat.Max.y)) * 0.5f,
+		AABB_TREE_DISPLACEMENT_MULTIPLIER * ((box.Min.z + box.Max.z) - (fat.Min.z + fat.Max.z)) * 0.5f);
+
+	RemoveLeaf(proxy);
+
+	AABB& moved = nodes[proxy].Box;
+	moved.Min = XMFLOAT3(box.Min.x - AABB_TREE_MARGIN, box.Min.y - AABB_TREE_MARGIN, box.Min.z - AABB_TREE_MARGIN);
+	moved.Max = XMFLOAT3(box.Max.x + AABB_TREE_MARGIN, box.Max.y + AABB_TREE_MARGIN, box.Max.z + AABB_TREE_MARGIN);
+	if (displacement.x < 0.0f) moved.Min.x += displacement.x; else moved.Max.x += displacement.x;
+	if (displacement.y < 0.0f) moved.Min.y += displacement.y; else moved.Max.y += displacement.y;
+	if (displacement.z < 0.0f) moved.Min.z += displacement.z; else moved.Max.z += displacement.z;
+
+	InsertLeaf(proxy);
+	return true;
+}
+
+unsigned int DynamicAABBTree::GetUserData(int proxy) { return nodes[proxy].UserData; }
+const AABB& DynamicAABBTree::GetFatAABB(int proxy) { return nodes[proxy].Box; }
+unsigned int DynamicAABBTree::GetProxyCount() { return proxyCount; }
+int DynamicAABBTree::GetHeight() { return root == AABB_TREE_NULL ? 0 : nodes[root].Height; }
+
+// --------------------------------------------------------
+// Node storage - freed nodes are chained through Next
+// --------------------------------------------------------
+int DynamicAABBTree::AllocateNode()
+{
+	int index;
+	if (freeList != AABB_TREE_NULL)
+	{
+		index = freeList;
+		freeList = nodes[index].Next;
+	}
+	else
+	{
+		index = (int)nodes.size();
+		nodes.push_back(Node());
+	}
+
+	Node& node = nodes[index];
+	node.Parent = AABB_TREE_NULL;
+	node.Child1 = AABB_TREE_NULL;
+	node.Child2 = AABB_TREE_NULL;
+	node.Height = 0;
+	node.Next = AABB_TREE_NULL;
+	node.UserData = 0;
+	return index;
+}
+
+void DynamicAABBTree::FreeNode(int node)
+{
+	nodes[node].Height = -1;
+	nodes[node].Next = freeList;
+	freeList = node;
+}
+
+// --------------------------------------------------------
+// Walks down from the root towards the sibling that makes the
+// tree's total surface area grow the least, pairs the leaf up
+// with it under a new parent, then refits & rebalances every
+// ancestor on the way back up
+// --------------------------------------------------------
+void DynamicAABBTree::InsertLeaf(int leaf)
+{
+	if (root == AABB_TREE_NULL)
+	{
+		root = leaf;
+		nodes[root].Parent = AABB_TREE_NULL;
+		return;
+	}
+
+	AABB leafBox = nodes[leaf].Box;
+	int index = root;
+	while (!nodes[index].IsLeaf())
+	{
+		const Node& node = nodes[index];
+		int child1 = node.Child1;
+		int child2 = node.Child2;
+
+		float area = SurfaceArea(node.Box);
+		float combinedArea = SurfaceArea(Union(node.Box, leafBox));
+
+		// Making a new parent for this node & the leaf
+		float cost = 2.0f * combinedArea;
+
+		// Going any deeper grows this node no matter what
+		float inheritanceCost = 2.0f * (combinedArea - area);
+
+		float cost1 = SurfaceArea(Union(nodes[child1].Box, leafBox)) + inheritanceCost;
+		if (!nodes[child1].IsLeaf())
+			cost1 -= SurfaceArea(nodes[child1].Box);
+
+		float cost2 = SurfaceArea(Union(nodes[child2].Box, leafBox)) + inheritanceCost;
+		if (!nodes[child2].IsLeaf())
+			cost2 -= SurfaceArea(nodes[child2].Box);
+
+		if (cost < cost1 && cost < cost2)
+			break;
+
+		index = cost1 < cost2 ? child1 : child2;
+	}
+
+	int sibling = index;
+	int oldParent = nodes[sibling].Parent;
+	int newParent = AllocateNode();
+	nodes[newParent].Parent = oldParent;
+	nodes[newParent].Box = Union(leafBox, nodes[sibling].Box);
+	nodes[newParent].Height = nodes[sibling].Height + 1;
+	nodes[newParent].Child1 = sibling;
+	nodes[newParent].Child2 = leaf;
+	nodes[sibling].Parent = newParent;
+	nodes[leaf].Parent = newParent;
+
+	if (oldParent == AABB_TREE_NULL)
+		root = newParent;
+	else if (nodes[oldParent].Child1 == sibling)
+		nodes[oldParent].Child1 = newParent;
+	else
+		nodes[oldParent].Child2 = newParent;
+
+	index = nodes[leaf].Parent;
+	while (index != AABB_TREE_NULL)
+	{
+		index = Balance(index);
+
+		Node& node = nodes[index];
+		node.Height = 1 + (std::max)(nodes[node.Child1].Height, nodes[node.Child2].Height);
+		node.Box = Union(nodes[node.Child1].Box, nodes[node.Child2].Box);
+		index = node.Parent;
+	}
+}
+
+// --------------------------------------------------------
+// The leaf's parent goes away and its sibling takes its place
+// --------------------------------------------------------
+void DynamicAABBTree::RemoveLeaf(int leaf)
+{
+	if (leaf == root)
+	{
+		root = AABB_TREE_NULL;
+		return;
+	}
+
+	int parent = nodes[leaf].Parent;
+	int grandParent = nodes[parent].Parent;
+	int sibling = nodes[parent].Child1 == leaf ? nodes[parent].Child2 : nodes[parent].Child1;
+
+	FreeNode(parent);
+	nodes[leaf].Parent = AABB_TREE_NULL;
+
+	if (grandParent == AABB_TREE_NULL)
+	{
+		root = sibling;
+		nodes[sibling].Parent = AABB_TREE_NULL;
+		return;
+	}
+
+	if (nodes[grandParent].Child1 == parent)
+		nodes[grandParent].Child1 = sibling;
+	else
+		nodes[grandParent].Child2 = sibling;
+	nodes[sibling].Parent = grandParent;
+
+	int index = grandParent;
+	while (index != AABB_TREE_NULL)
+	{
+		index = Balance(index);
+
+		Node& node = nodes[index];
+		node.Height = 1 + (std::max)(nodes[node.Child1].Height, nodes[node.Child2].Height);
+		node.Box = Union(nodes[node.Child1].Box, nodes[node.Child2].Box);
+		index = node.Parent;
+	}
+}
+
+// --------------------------------------------------------
+// If one of A's subtrees (B & C) is more than a level taller
+// than the other, rotates the taller one up into A's place.
+// Say that's C, with children F & G: C takes A as a child and
+// keeps the taller of F & G, and A keeps B and gets the other.
+//
+// Returns whichever node now sits where A was
+// --------------------------------------------------------
+int DynamicAABBTree::Balance(int iA)
+{
+	Node& A = nodes[iA];
+	if (A.IsLeaf() || A.Height < 2)
+		return iA;
+
+	int iB = A.Child1;
+	int iC = A.Child2;
+	Node& B = nodes[iB];
+	Node& C = nodes[iC];
+	int balance = C.Height - B.Height;
+
+	// Rotate C up
+	if (balance > 1)
+	{
+		int iF = C.Child1;
+		int iG = C.Child2;
+		Node& F = nodes[iF];
+		Node& G = nodes[iG];
+
+		C.Child1 = iA;
+		C.Parent = A.Parent;
+		A.Parent = iC;
+
+		if (C.Parent == AABB_TREE_NULL)
+			root = iC;
+		else if (nodes[C.Parent].Child1 == iA)
+			nodes[C.Parent].Child1 = iC;
+		else
+			nodes[C.Parent].Child2 = iC;
+
+		if (F.Height > G.Height)
+		{
+			C.Child2 = iF;
+			A.Child2 = iG;
+			G.Parent = iA;
+			A.Box = Union(B.Box, G.Box);
+			C.Box = Union(A.Box, F.Box);
+			A.Height = 1 + (std::max)(B.Height, G.Height);
+			C.Height = 1 + (std::max)(A.Height, F.Height);
+		}
+		else
+		{
+			C.Child2 = iG;
+			A.Child2 = iF;
+			F.Parent = iA;
+			A.Box = Union(B.Box, F.Box);
+			C.Box = Union(A.Box, G.Box);
+			A.Height = 1 + (std::max)(B.Height, F.Height);
+			C.Height = 1 + (std::max)(A.Height, G.Height);
+		}
+		return iC;
+	}
+
+	// Rotate B up - the mirror image
+	if (balance < -1)
+	{
+		int iD = B.Child1;
+		int iE = B.Child2;
+		Node& D = nodes[iD];
+		Node& E = nodes[iE];
+
+		B.Child1 = iA;
+		B.Parent = A.Parent;
+		A.Parent = iB;
+
+		if (B.Parent == AABB_TREE_NULL)
+			root = iB;
+		else if (nodes[B.Parent].Child1 == iA)
+			nodes[B.Parent].Child1 = iB;
+		else
+			nodes[B.Parent].Child2 = iB;
+
+		if (D.Height > E.Height)
+		{
+			B.Child2 = iD;
+			A.Child1 = iE;
+			E.Parent = iA;
+			A.Box = Union(C.Box, E.Box);
+			B.Box = Union(A.Box, D.Box);
+			A.Height = 1 + (std::max)(C.Height, E.Height);
+			B.Height = 1 + (std::max)(A.Height, D.Height);
+		}
+		else
+		{
+			B.Child2 = iE;
+			A.Child1 = iD;
+			D.Parent = iA;
+			A.Box = Union(C.Box, D.Box);
+			B.Box = Union(A.Box, E.Box);
+			A.Height = 1 + (std::max)(C.Height, D.Height);
+			B.Height = 1 + (std::max)(A.Height, E.Height);
+		}
+		return iB;
+	}
+
+	return iA;
+}
+
+// --------------------------------------------------------
+// Box helpers
+// --------------------------------------------------------
+bool DynamicAABBTree::Overlaps(const AABB& a, const AABB& b)
+{
+	return a.Min.x <= b.Max.x && a.Max.x >= b.Min.x &&
+		a.Min.y <= b.Max.y && a.Max.y >= b.Min.y &&
+		a.Min.z <= b.Max.z && a.Max.z >= b.Min.z;
+}
+
+bool DynamicAABBTree::Contains(const AABB& outer, const AABB& inner)
+{
+	return outer.Min.x <= inner.Min.x && outer.Min.y <= inner.Min.y && outer.Min.z <= inner.Min.z &&
+		outer.Max.x >= inner.Max.x && outer.Max.y >= inner.Max.y && outer.Max.z >= inner.Max.z;
+}
+
+AABB DynamicAABBTree::Union(const AABB& a, const AABB& b)
+{
+	AABB result;
+	result.Min = XMFLOAT3((std::min)(a.Min.x, b.Min.x), (std::min)(a.Min.y, b.Min.y), (std::min)(a.Min.z, b.Min.z));
+	result.Max = XMFLOAT3((std::max)(a.Max.x, b.Max.x), (std::max)(a.Max.y, b.Max.y), (std::max)(a.Max.z, b.Max.z));
+	return result;
+}
+
+// Half of it, really - only ever compared against other areas
+float DynamicAABBTree::SurfaceArea(const AABB& box)
+{
+	float x = box.Max.x - box.Min.x;
+	float y = box.Max.y - box.Min.y;
+	float z = box.Max.z - box.Min.z;
+	return x * y + y * z + z * x;
+}
+
+bool DynamicAABBTree::OverlapsSphere(const AABB& box, XMFLOAT3 center, float radius)
+{
+	// Distance from the center to the closest point in the box
+	float x = center.x - (std::max)(box.Min.x, (std::min)(center.x, box.Max.x));
+	float y = center.y - (std::max)(box.Min.y, (std::min)(center.y, box.Max.y));
+	float z = center.z - (std::max)(box.Min.z, (std::min)(center.z, box.Max.z));
+	return x * x + y * y + z * z <= radius * radius;
+}
+
+// --------------------------------------------------------
+// Slab test: the ray is inside the box between the latest of
+// its three entry distances and the earliest of its exits.
+// Starting inside the box counts as entering at 0.
+// --------------------------------------------------------
+float DynamicAABBTree::IntersectRay(const AABB& box, XMFLOAT3 origin, XMFLOAT3 inverseDirection)
+{
+	float x1 = (box.Min.x - origin.x) * inverseDirection.x;
+	float x2 = (box.Max.x - origin.x) * inverseDirection.x;
+	float y1 = (box.Min.y - origin.y) * inverseDirection.y;
+	float y2 = (box.Max.y - origin.y) * inverseDirection.y;
+	float z1 = (box.Min.z - origin.z) * inverseDirection.z;
+	float z2 = (box.Max.z - origin.z) * inverseDirection.z;
+
+	float enter = (std::max)((std::max)((std::min)(x1, x2), (std::min)(y1, y2)), (std::max)((std::min)(z1, z2), 0.0f));
+	float exit = (std::min)((std::min)((std::max)(x1, x2), (std::max)(y1, y2)), (std::max)(z1, z2));
+	return enter <= exit ? enter : -1.0f;
+}
+
+// --------------------------------------------------------
+// Benchmark
+// --------------------------------------------------------
+namespace
+{
+	// Deterministic, so every run moves the same boxes
+	struct SpatialRandom
+	{
+		unsigned int state;
+		float Next(float low, float high)
+		{
+			state = state * 1664525u + 1013904223u;
+			return low + (high - low) * ((state >> 8) * (1.0f / 16777216.0f));
+		}
+	};
+
+	AABB MakeBox(XMFLOAT3 center, float halfSize)
+	{
+		AABB box;
+		box.Min = XMFLOAT3(center.x - halfSize, center.y - halfSize, center.z - halfSize);
+		box.Max = XMFLOAT3(center.x + halfSize, center.y + halfSize, center.z + halfSize);
+		return box;
+	}
+}
+
+SpatialBenchmarkResult DynamicAABBTree::Benchmark(unsigned int count)
+{
+	SpatialBenchmarkResult result = {};
+	result.Count = count;
+	result.Matches = true;
+	if (count == 0)
+		return result;
+
+	// Objects spread through a volume that grows with the count, so
+	// the density - and the number of hits per query - stays the same
+	SpatialRandom random = { 2024 };
+	float worldSize = std::cbrt((float)count) * 10.0f;
+	std::vector<XMFLOAT3> centers(count);
+	std::vector<AABB> boxes(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		centers[i] = XMFLOAT3(random.Next(0.0f, worldSize), random.Next(0.0f, worldSize), random.Next(0.0f, worldSize));
+		boxes[i] = MakeBox(centers[i], 1.0f);
+	}
+
+	DynamicAABBTree tree;
+	std::vector<int> proxies(count);
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < count; i++)
+		proxies[i] = tree.CreateProxy(boxes[i], i);
+	auto end = std::chrono::high_resolution_clock::now();
+	result.BuildMilliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+	result.Height = tree.GetHeight();
+
+	// Moving workload: every 10th box keeps a steady velocity, and every
+	// frame a few of them also get knocked in a new direction
+	std::vector<XMFLOAT3> velocities(count);
+	for (unsigned int i = 0; i < count; i += 10)
+		velocities[i] = XMFLOAT3(random.Next(-0.1f, 0.1f), random.Next(-0.1f, 0.1f), random.Next(-0.1f, 0.1f));
+
+	const unsigned int frames = 30;
+	unsigned int reinserted = 0;
+	start = std::chrono::high_resolution_clock::now();
+	for (unsigned int frame = 0; frame < frames; frame++)
+	{
+		for (unsigned int i = 0; i < count; i += 10)
+		{
+			if (random.Next(0.0f, 1.0f) < 0.05f)
+				velocities[i] = XMFLOAT3(random.Next(-0.1f, 0.1f), random.Next(-0.1f, 0.1f), random.Next(-0.1f, 0.1f));
+
+			centers[i].x += velocities[i].x;
+			centers[i].y += velocities[i].y;
+			centers[i].z += velocities[i].z;
+			boxes[i] = MakeBox(centers[i], 1.0f);
+			if (tree.MoveProxy(proxies[i], boxes[i]))
+				reinserted++;
+		}
+	}
+	end = std::chrono::high_resolution_clock::now();
+	result.MoveMilliseconds = std::chrono::duration<float, std::milli>(end - start).count() / frames;
+	result.ReinsertedPerFrame = (float)reinserted / frames;
+
+	// Small box queries, checked against testing every real box
+	const unsigned int queries = 1000;
+	std::vector<AABB> queryBoxes(queries);
+	for (unsigned int q = 0; q < queries; q++)
+		queryBoxes[q] = MakeBox(XMFLOAT3(random.Next(0.0f, worldSize), random.Next(0.0f, worldSize), random.Next(0.0f, worldSize)), 3.0f);
+
+	std::vector<unsigned int> treeHits(queries), linearHits(queries);
+	start = std::chrono::high_resolution_clock::now();
+	for (unsigned int q = 0; q < queries; q++)
+	{
+		const AABB& query = queryBoxes[q];
+		tree.QueryAABB(query, [&](int proxy)
+			{
+				if (Overlaps(boxes[tree.GetUserData(proxy)], query))
+					treeHits[q]++;
+			});
+	}
+	end = std::chrono::high_resolution_clock::now();
+	result.TreeQueryMicroseconds = std::chrono::duration<float, std::micro>(end - start).count() / queries;
+
+	start = std::chrono::high_resolution_clock::now();
+	for (unsigned int q = 0; q < queries; q++)
+	{
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (Overlaps(boxes[i], queryBoxes[q]))
+				linearHits[q]++;
+		}
+	}
+	end = std::chrono::high_resolution_clock::now();
+	result.LinearQueryMicroseconds = std::chrono::duration<float, std::micro>(end - start).count() / queries;
+
+	for (unsigned int q = 0; q < queries; q++)
+	{
+		if (treeHits[q] != linearHits[q])
+			result.Matches = false;
+	}
+
+	// Closest hits along rays from one side of the volume to the other
+	volatile float sink = 0.0f;
+	start = std::chrono::high_resolution_clock::now();
+	for (unsigned int q = 0; q < queries; q++)
+	{
+		XMFLOAT3 origin(0.0f, random.Next(0.0f, worldSize), random.Next(0.0f, worldSize));
+		XMFLOAT3 target(worldSize, random.Next(0.0f, worldSize), random.Next(0.0f, worldSize));
+		XMVECTOR direction = XMVector3Normalize(XMVectorSubtract(XMLoadFloat3(&target), XMLoadFloat3(&origin)));
+		XMFLOAT3 rayDirection;
+		XMStoreFloat3(&rayDirection, direction);
+		XMFLOAT3 inverseDirection(1.0f / rayDirection.x, 1.0f / rayDirection.y, 1.0f / rayDirection.z);
+
+		float closest = worldSize * 2.0f;
+		tree.RayCast(origin, rayDirection, closest, [&](int proxy, float)
+			{
+				float distance = IntersectRay(boxes[tree.GetUserData(proxy)], origin, inverseDirection);
+				if (distance >= 0.0f && distance < closest)
+					closest = distance;
+				return closest;
+			});
+		sink = sink + closest;
+	}
+	end = std::chrono::high_resolution_clock::now();
+	result.RayMicroseconds = std::chrono::duration<float, std::micro>(end - start).count() / queries;
+
+	return result;
+}
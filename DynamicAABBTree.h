@@ -0,0 +1,224 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "FrustumCuller.h"
+
+// Marks "no node" for parents, children & the root
+#define AABB_TREE_NULL -1
+
+// How far a leaf's box is grown past the real bounds, so small
+// moves don't need a reinsert
+#define AABB_TREE_MARGIN 0.1f
+
+// A moving leaf's box is also stretched this many frames ahead
+// along its last displacement
+#define AABB_TREE_DISPLACEMENT_MULTIPLIER 2.0f
+
+struct AABB
+{
+	DirectX::XMFLOAT3 Min;
+	DirectX::XMFLOAT3 Max;
+};
+
+// Timings from DynamicAABBTree::Benchmark()
+struct SpatialBenchmarkResult
+{
+	unsigned int Count;
+	float BuildMilliseconds;			// Inserting every box one at a time
+	int Height;
+	float TreeQueryMicroseconds;		// Average small box query
+	float LinearQueryMicroseconds;		// The same query testing every box
+	float RayMicroseconds;				// Average closest-hit ray cast
+	float MoveMilliseconds;				// Average frame with 10% of the boxes moving (the tree's side only)
+	float ReinsertedPerFrame;			// How many of those actually left their fat box
+	bool Matches;						// Tree & linear queries found the same boxes
+};
+
+// --------------------------------------------------------
+// Bounding volume hierarchy that's kept up to date one object
+// at a time instead of being rebuilt.
+//
+// Every proxy is a leaf holding a slightly enlarged ("fat") box.
+// Moving a proxy only touches the tree when the real bounds
+// leave the fat box; the leaf is then pulled out and inserted
+// again wherever it adds the least surface area.  Ancestors
+// are refit on the way back up, and AVL-style rotations keep
+// the height - and so query cost - logarithmic.
+//
+// Queries call func(int proxy) for every leaf whose fat box
+// passes, so they can report a few extra near misses.
+// --------------------------------------------------------
+class DynamicAABBTree
+{
+public:
+	DynamicAABBTree();
+
+	// Returns the proxy ID, which stays the same until it's destroyed
+	int CreateProxy(const AABB& box, unsigned int userData);
+	void DestroyProxy(int proxy);
+
+	// True if the proxy had to be reinserted
+	bool MoveProxy(int proxy, const AABB& box);
+
+	unsigned int GetUserData(int proxy);
+	const AABB& GetFatAABB(int proxy);
+	unsigned int GetProxyCount();
+	int GetHeight();
+
+	template<typename Func> void QueryAABB(const AABB& box, Func func);
+	template<typename Func> void QuerySphere(DirectX::XMFLOAT3 center, float radius, Func func);
+	template<typename Func> void QueryFrustum(const Frustum& frustum, Func func);
+
+	// func(int proxy, float distance) is given every leaf the ray enters
+	// before maxDistance, with the distance it enters at.  It returns the
+	// new maxDistance - the exact hit distance to look for the closest,
+	// a negative number to stop, or the same value to keep everything.
+	template<typename Func> void RayCast(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, Func func);
+
+	// Build, query & moving object timings, with a brute force
+	// scan over the same boxes for comparison
+	static SpatialBenchmarkResult Benchmark(unsigned int count);
+
+	// Box helpers
+	static bool Overlaps(const AABB& a, const AABB& b);
+	static bool Contains(const AABB& outer, const AABB& inner);
+	static AABB Union(const AABB& a, const AABB& b);
+	static float SurfaceArea(const AABB& box);
+	static bool OverlapsSphere(const AABB& box, DirectX::XMFLOAT3 center, float radius);
+
+	// Distance along the ray where it enters the box, or a negative
+	// number if it misses.  Takes 1 / direction.
+	static float IntersectRay(const AABB& box, DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 inverseDirection);
+
+private:
+	struct Node
+	{
+		AABB Box;
+		int Parent;
+		int Child1;
+		int Child2;
+		int Height;		// 0 for leaves, -1 for free nodes
+		int Next;		// Free list
+		unsigned int UserData;
+
+		bool IsLeaf() const { return Child1 == AABB_TREE_NULL; }
+	};
+
+	int AllocateNode();
+	void FreeNode(int node);
+	void InsertLeaf(int leaf);
+	void RemoveLeaf(int leaf);
+	int Balance(int node);
+
+	// Walks the tree, going into every node that passes the test
+	template<typename Test, typename Func> void Traverse(Test test, Func func);
+
+	std::vector<Node> nodes;
+	int root;
+	int freeList;
+	unsigned int proxyCount;
+
+	// Traversal stack, kept around to avoid reallocating
+	std::vector<int> stack;
+};
+
+template<typename Test, typename Func>
+void DynamicAABBTree::Traverse(Test test, Func func)
+{
+	if (root == AABB_TREE_NULL)
+		return;
+
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		int index = stack.back();
+		stack.pop_back();
+
+		const Node& node = nodes[index];
+		if (!test(node.Box))
+			continue;
+
+		if (node.IsLeaf())
+		{
+			func(index);
+		}
+		else
+		{
+			stack.push_back(node.Child1);
+			stack.push_back(node.Child2);
+		}
+	}
+}
+
+template<typename Func>
+void DynamicAABBTree::QueryAABB(const AABB& box, Func func)
+{
+	Traverse([&](const AABB& nodeBox) { return Overlaps(nodeBox, box); }, func);
+}
+
+template<typename Func>
+void DynamicAABBTree::QuerySphere(DirectX::XMFLOAT3 center, float radius, Func func)
+{
+	Traverse([&](const AABB& nodeBox) { return OverlapsSphere(nodeBox, center, radius); }, func);
+}
+
+template<typename Func>
+void DynamicAABBTree::QueryFrustum(const Frustum& frustum, Func func)
+{
+	Traverse([&](const AABB& nodeBox)
+		{
+			return FrustumCuller::IsAABBVisible(frustum,
+				(nodeBox.Min.x + nodeBox.Max.x) * 0.5f,
+				(nodeBox.Min.y + nodeBox.Max.y) * 0.5f,
+				(nodeBox.Min.z + nodeBox.Max.z) * 0.5f,
+				(nodeBox.Max.x - nodeBox.Min.x) * 0.5f,
+				(nodeBox.Max.y - nodeBox.Min.y) * 0.5f,
+				(nodeBox.Max.z - nodeBox.Min.z) * 0.5f);
+		}, func);
+}
+
+template<typename Func>
+void DynamicAABBTree::RayCast(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, Func func)
+{
+	if (root == AABB_TREE_NULL)
+		return;
+
+	// Divisions by zero give infinities, which the slab test handles
+	DirectX::XMFLOAT3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		int index = stack.back();
+		stack.pop_back();
+
+		const Node& node = nodes[index];
+		float distance = IntersectRay(node.Box, origin, inverseDirection);
+		if (distance < 0.0f || distance > maxDistance)
+			continue;
+
+		if (node.IsLeaf())
+		{
+			maxDistance = func(index, distance);
+			if (maxDistance < 0.0f)
+				return;
+			continue;
+		}
+
+		// Nearer child on top, so closest-hit searches shrink maxDistance sooner
+		float distance1 = IntersectRay(nodes[node.Child1].Box, origin, inverseDirection);
+		float distance2 = IntersectRay(nodes[node.Child2].Box, origin, inverseDirection);
+		if (distance1 >= 0.0f && (distance2 < 0.0f || distance1 <= distance2))
+		{
+			stack.push_back(node.Child2);
+			stack.push_back(node.Child1);
+		}
+		else
+		{
+			stack.push_back(node.Child1);
+			stack.push_back(node.Child2);
+		}
+	}
+}
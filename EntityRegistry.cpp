@@ -0,0 +1,381 @@
+#include "EntityRegistry.h"
+#include "Transform.h"
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+EntityRegistry::EntityRegistry() :
+	aliveCount(0)
+{
+	// Archetype 0 is "no components", where new entities start
+	FindOrCreateArchetype(0);
+}
+
+EntityRegistry::~EntityRegistry()
+{
+	// Components can own things, so they need proper destruction
+	for (Archetype& archetype : archetypes)
+	{
+		while (!archetype.Chunks.empty())
+		{
+			Chunk& last = archetype.Chunks.back();
+			RemoveRow((unsigned int)(&archetype - &archetypes[0]), (unsigned int)archetype.Chunks.size() - 1, last.Count - 1);
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Entity lifetime
+// --------------------------------------------------------
+Entity EntityRegistry::Create()
+{
+	unsigned int index;
+	if (!freeIndices.empty())
+	{
+		index = freeIndices.back();
+		freeIndices.pop_back();
+	}
+	else
+	{
+		index = (unsigned int)records.size();
+		records.push_back(Record{ 0, false, 0, 0, 0 });
+	}
+
+	Record& record = records[index];
+	record.Alive = true;
+	record.ArchetypeIndex = 0;
+	AllocateRow(0, record.ChunkIndex, record.Row);
+
+	Entity entity = { index, record.Generation };
+	Archetype& empty = archetypes[0];
+	GetEntities(empty, empty.Chunks[record.ChunkIndex])[record.Row] = entity;
+
+	aliveCount++;
+	return entity;
+}
+
+void EntityRegistry::Destroy(Entity entity)
+{
+	if (!IsAlive(entity))
+		return;
+
+	Record& record = records[entity.Index];
+	RemoveRow(record.ArchetypeIndex, record.ChunkIndex, record.Row);
+	record.Alive = false;
+	record.Generation++;
+	freeIndices.push_back(entity.Index);
+	aliveCount--;
+}
+
+bool EntityRegistry::IsAlive(Entity entity)
+{
+	return entity.Index < records.size() &&
+		records[entity.Index].Alive &&
+		records[entity.Index].Generation == entity.Generation;
+}
+
+unsigned int EntityRegistry::GetEntityCount() { return aliveCount; }
+unsigned int EntityRegistry::GetArchetypeCount() { return (unsigned int)archetypes.size(); }
+
+unsigned int EntityRegistry::GetChunkCount()
+{
+	size_t chunks = 0;
+	for (Archetype& archetype : archetypes)
+		chunks += archetype.Chunks.size();
+	return (unsigned int)chunks;
+}
+
+// --------------------------------------------------------
+// Component types are shared by every registry, so the same
+// type always has the same ID (and mask bit)
+// --------------------------------------------------------
+std::vector<EntityRegistry::ComponentInfo>& EntityRegistry::GetComponentInfos()
+{
+	static std::vector<ComponentInfo> infos;
+	return infos;
+}
+
+unsigned int EntityRegistry::RegisterComponent(ComponentInfo info)
+{
+	std::vector<ComponentInfo>& infos = GetComponentInfos();
+	if (infos.size() >= ENTITY_MAX_COMPONENT_TYPES)
+		throw std::length_error("Too many component types for one mask");
+
+	infos.push_back(info);
+	return (unsigned int)infos.size() - 1;
+}
+
+// --------------------------------------------------------
+// Archetypes & chunk layout
+//
+// A chunk is [entities][column 0][column 1]..., each column
+// aligned for its type.  The row count is picked so the whole
+// thing comes out at about ENTITY_CHUNK_BYTES.
+// --------------------------------------------------------
+unsigned int EntityRegistry::FindOrCreateArchetype(unsigned long long mask)
+{
+	auto found = archetypeOfMask.find(mask);
+	if (found != archetypeOfMask.end())
+		return found->second;
+
+	const std::vector<ComponentInfo>& infos = GetComponentInfos();
+
+	Archetype archetype;
+	archetype.Mask = mask;
+	std::fill(archetype.Column, archetype.Column + ENTITY_MAX_COMPONENT_TYPES, -1);
+
+	size_t rowBytes = sizeof(Entity);
+	for (unsigned int type = 0; type < ENTITY_MAX_COMPONENT_TYPES; type++)
+	{
+		if (mask & (1ull << type))
+		{
+			archetype.Column[type] = (int)archetype.Types.size();
+			archetype.Types.push_back(type);
+			rowBytes += infos[type].Size;
+		}
+	}
+	archetype.Capacity = (unsigned int)(std::max)((size_t)ENTITY_CHUNK_BYTES / rowBytes, (size_t)1);
+
+	size_t offset = sizeof(Entity) * archetype.Capacity;
+	for (unsigned int type : archetype.Types)
+	{
+		size_t alignment = infos[type].Alignment;
+		offset = (offset + alignment - 1) / alignment * alignment;
+		archetype.Offsets.push_back(offset);
+		offset += infos[type].Size * archetype.Capacity;
+	}
+	archetype.ChunkBytes = offset;
+
+	unsigned int index = (unsigned int)archetypes.size();
+	archetypes.push_back(std::move(archetype));
+	archetypeOfMask[mask] = index;
+	return index;
+}
+
+Entity* EntityRegistry::GetEntities(Archetype& archetype, Chunk& chunk)
+{
+	return reinterpret_cast<Entity*>(chunk.Data.get());
+}
+
+void* EntityRegistry::GetComponentData(const Record& record, unsigned int type)
+{
+	Archetype& archetype = archetypes[record.ArchetypeIndex];
+	int column = archetype.Column[type];
+	if (column < 0)
+		return nullptr;
+
+	Chunk& chunk = archetype.Chunks[record.ChunkIndex];
+	return chunk.Data.get() + archetype.Offsets[column] + GetComponentInfos()[type].Size * record.Row;
+}
+
+// --------------------------------------------------------
+// Rows are only ever added to the last chunk, and removal
+// always backfills from the end, so every chunk but the last
+// is full
+// --------------------------------------------------------
+void EntityRegistry::AllocateRow(unsigned int archetypeIndex, unsigned int& chunk, unsigned int& row)
+{
+	Archetype& archetype = archetypes[archetypeIndex];
+	if (archetype.Chunks.empty() || archetype.Chunks.back().Count == archetype.Capacity)
+	{
+		Chunk newChunk;
+		newChunk.Data.reset(new unsigned char[archetype.ChunkBytes]);
+		newChunk.Count = 0;
+		archetype.Chunks.push_back(std::move(newChunk));
+	}
+
+	chunk = (unsigned int)archetype.Chunks.size() - 1;
+	row = archetype.Chunks.back().Count++;
+}
+
+// --------------------------------------------------------
+// Destroys whatever's left in a row, then moves the
+// archetype's last row into the gap
+// --------------------------------------------------------
+void EntityRegistry::RemoveRow(unsigned int archetypeIndex, unsigned int chunkIndex, unsigned int row)
+{
+	const std::vector<ComponentInfo>& infos = GetComponentInfos();
+	Archetype& archetype = archetypes[archetypeIndex];
+	Chunk& chunk = archetype.Chunks[chunkIndex];
+	Chunk& last = archetype.Chunks.back();
+	unsigned int lastRow = last.Count - 1;
+	bool isLast = (&chunk == &last) && row == lastRow;
+
+	for (size_t c = 0; c < archetype.Types.size(); c++)
+	{
+		const ComponentInfo& info = infos[archetype.Types[c]];
+		unsigned char* column = chunk.Data.get() + archetype.Offsets[c];
+		info.Destroy(column + info.Size * row);
+
+		if (!isLast)
+		{
+			unsigned char* lastColumn = last.Data.get() + archetype.Offsets[c];
+			info.MoveConstruct(column + info.Size * row, lastColumn + info.Size * lastRow);
+			info.Destroy(lastColumn + info.Size * lastRow);
+		}
+	}
+
+	if (!isLast)
+	{
+		Entity moved = GetEntities(archetype, last)[lastRow];
+		GetEntities(archetype, chunk)[row] = moved;
+		records[moved.Index].ChunkIndex = chunkIndex;
+		records[moved.Index].Row = row;
+	}
+
+	if (--last.Count == 0)
+		archetype.Chunks.pop_back();
+}
+
+// --------------------------------------------------------
+// Moves an entity's components into another archetype.  Types
+// only the old archetype has get destroyed; types only the new
+// one has are left unconstructed for the caller to fill in.
+// --------------------------------------------------------
+void EntityRegistry::MoveEntity(Entity entity, unsigned int archetypeIndex)
+{
+	Record& record = records[entity.Index];
+	if (record.ArchetypeIndex == archetypeIndex)
+		return;
+
+	const std::vector<ComponentInfo>& infos = GetComponentInfos();
+	unsigned int chunkIndex, row;
+	AllocateRow(archetypeIndex, chunkIndex, row);
+
+	Archetype& source = archetypes[record.ArchetypeIndex];
+	Archetype& destination = archetypes[archetypeIndex];
+	Chunk& sourceChunk = source.Chunks[record.ChunkIndex];
+	Chunk& destinationChunk = destination.Chunks[chunkIndex];
+
+	for (size_t c = 0; c < destination.Types.size(); c++)
+	{
+		unsigned int type = destination.Types[c];
+		int sourceColumn = source.Column[type];
+		if (sourceColumn < 0)
+			continue;
+
+		size_t size = infos[type].Size;
+		infos[type].MoveConstruct(
+			destinationChunk.Data.get() + destination.Offsets[c] + size * row,
+			sourceChunk.Data.get() + source.Offsets[sourceColumn] + size * record.Row);
+	}
+	GetEntities(destination, destinationChunk)[row] = entity;
+
+	// Moved-from leftovers get destroyed along with the old row
+	RemoveRow(record.ArchetypeIndex, record.ChunkIndex, record.Row);
+
+	record.ArchetypeIndex = archetypeIndex;
+	record.ChunkIndex = chunkIndex;
+	record.Row = row;
+}
+
+// --------------------------------------------------------
+// Benchmark
+// --------------------------------------------------------
+namespace
+{
+	struct BenchmarkPosition { float X, Y, Z; };
+	struct BenchmarkVelocity { float X, Y, Z; };
+	struct BenchmarkRenderer
+	{
+		std::shared_ptr<int> Mesh;
+		std::shared_ptr<int> Material;
+	};
+
+	// Laid out like a GameEntity that owned its Transform
+	struct BenchmarkObject
+	{
+		Transform transform;
+		BenchmarkPosition position;
+		BenchmarkVelocity velocity;
+		std::shared_ptr<int> mesh;
+		std::shared_ptr<int> material;
+	};
+}
+
+EntityBenchmarkResult EntityRegistry::Benchmark(unsigned int count)
+{
+	EntityBenchmarkResult result = {};
+	result.Count = count;
+	volatile float sink = 0.0f;
+
+	std::shared_ptr<int> mesh = std::make_shared<int>(0);
+	std::shared_ptr<int> material = std::make_shared<int>(1);
+
+	std::vector<BenchmarkObject> objects(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		objects[i].position = BenchmarkPosition{ (float)i, 0.0f, 0.0f };
+		objects[i].velocity = BenchmarkVelocity{ 1.0f, 2.0f, 3.0f };
+		objects[i].mesh = mesh;
+		objects[i].material = material;
+	}
+
+	EntityRegistry registry;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		Entity entity = registry.Create();
+		registry.Add(entity, BenchmarkPosition{ (float)i, 0.0f, 0.0f });
+		registry.Add(entity, BenchmarkVelocity{ 1.0f, 2.0f, 3.0f });
+		registry.Add(entity, BenchmarkRenderer{ mesh, material });
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	result.CreateMilliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+
+	// Same work each time: position += velocity * dt
+	const float dt = 0.016f;
+
+	start = std::chrono::high_resolution_clock::now();
+	for (BenchmarkObject& object : objects)
+	{
+		object.position.X += object.velocity.X * dt;
+		object.position.Y += object.velocity.Y * dt;
+		object.position.Z += object.velocity.Z * dt;
+	}
+	end = std::chrono::high_resolution_clock::now();
+	result.ObjectMilliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+
+	start = std::chrono::high_resolution_clock::now();
+	registry.ForEach<BenchmarkPosition, BenchmarkVelocity>(
+		[dt](Entity, BenchmarkPosition& position, BenchmarkVelocity& velocity)
+		{
+			position.X += velocity.X * dt;
+			position.Y += velocity.Y * dt;
+			position.Z += velocity.Z * dt;
+		});
+	end = std::chrono::high_resolution_clock::now();
+	result.ForEachMilliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+
+	start = std::chrono::high_resolution_clock::now();
+	registry.ForEachChunk<BenchmarkPosition, BenchmarkVelocity>(
+		[dt](unsigned int rows, const Entity*, BenchmarkPosition* positions, BenchmarkVelocity* velocities)
+		{
+			for (unsigned int i = 0; i < rows; i++)
+			{
+				positions[i].X += velocities[i].X * dt;
+				positions[i].Y += velocities[i].Y * dt;
+				positions[i].Z += velocities[i].Z * dt;
+			}
+		});
+	end = std::chrono::high_resolution_clock::now();
+	result.ChunkMilliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+
+	// Only one column gets pulled into cache here
+	float total = 0.0f;
+	start = std::chrono::high_resolution_clock::now();
+	registry.ForEachChunk<BenchmarkPosition>(
+		[&total](unsigned int rows, const Entity*, BenchmarkPosition* positions)
+		{
+			for (unsigned int i = 0; i < rows; i++)
+				total += positions[i].X;
+		});
+	end = std::chrono::high_resolution_clock::now();
+	result.SingleColumnMilliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+
+	sink = sink + total;
+	if (count > 0)
+		sink = sink + objects[count / 2].position.X;
+	return result;
+}
@@ -0,0 +1,261 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <new>
+#include <utility>
+
+// Roughly how much memory each archetype chunk gets
+#define ENTITY_CHUNK_BYTES 16384
+
+// Component masks are one 64-bit word
+#define ENTITY_MAX_COMPONENT_TYPES 64
+
+// Index into the registry plus a generation, so a handle to
+// something destroyed never finds whatever reused its slot
+struct Entity
+{
+	unsigned int Index;
+	unsigned int Generation;
+};
+
+// Timings from EntityRegistry::Benchmark()
+struct EntityBenchmarkResult
+{
+	unsigned int Count;
+	float CreateMilliseconds;		// Creating everything & adding 3 components
+	float ObjectMilliseconds;		// Vector of GameEntity-style objects
+	float ForEachMilliseconds;		// ForEach() over the same data
+	float ChunkMilliseconds;		// ForEachChunk() over the same data
+	float SingleColumnMilliseconds;	// ForEachChunk() touching only one component
+};
+
+// --------------------------------------------------------
+// Archetype-based entity/component storage.
+//
+// Every distinct set of components is an archetype, and all
+// entities with that set live together in fixed-size chunks.
+// Inside a chunk each component type is its own tightly packed
+// column, so a query only pulls in the columns it asks for.
+//
+// Adding or removing a component moves the entity to another
+// archetype; removing an entity fills its row with the last
+// one in the archetype, which keeps the chunks dense.
+//
+// Components can be any movable type.  Don't add, remove or
+// destroy while iterating - rows move around when that happens.
+// --------------------------------------------------------
+class EntityRegistry
+{
+public:
+	EntityRegistry();
+	~EntityRegistry();
+
+	Entity Create();
+	void Destroy(Entity entity);
+	bool IsAlive(Entity entity);
+
+	// Replaces the component if the entity already has one
+	template<typename T> T* Add(Entity entity, T component);
+	template<typename T> void Remove(Entity entity);
+	template<typename T> bool Has(Entity entity);
+
+	// Null if the entity is dead or doesn't have one.  Pointers
+	// are only good until the next add/remove/destroy.
+	template<typename T> T* Get(Entity entity);
+
+	// func(unsigned int count, const Entity* entities, Ts*... columns)
+	// once for every chunk holding all of Ts
+	template<typename... Ts, typename Func> void ForEachChunk(Func func);
+
+	// func(Entity entity, Ts&... components) for every match
+	template<typename... Ts, typename Func> void ForEach(Func func);
+
+	unsigned int GetEntityCount();
+	unsigned int GetArchetypeCount();
+	unsigned int GetChunkCount();
+
+	// Creation & iteration timings, compared against a plain
+	// vector of entity objects
+	static EntityBenchmarkResult Benchmark(unsigned int count);
+
+	// Every component type gets an ID the first time it's used
+	template<typename T> static unsigned int GetComponentID();
+
+private:
+	// How to handle a component without knowing its type
+	struct ComponentInfo
+	{
+		size_t Size;
+		size_t Alignment;
+		void (*MoveConstruct)(void* destination, void* source);
+		void (*Destroy)(void* component);
+	};
+
+	struct Chunk
+	{
+		std::unique_ptr<unsigned char[]> Data;
+		unsigned int Count;
+	};
+
+	struct Archetype
+	{
+		unsigned long long Mask;
+		unsigned int Capacity;						// Rows per chunk
+		std::vector<unsigned int> Types;			// Component IDs, ascending
+		std::vector<size_t> Offsets;				// Where each type's column starts in a chunk
+		size_t ChunkBytes;
+		int Column[ENTITY_MAX_COMPONENT_TYPES];		// Component ID -> index into Types, or -1
+		std::vector<Chunk> Chunks;
+	};
+
+	// Where each entity currently lives
+	struct Record
+	{
+		unsigned int Generation;
+		bool Alive;
+		unsigned int ArchetypeIndex;
+		unsigned int ChunkIndex;
+		unsigned int Row;
+	};
+
+	static std::vector<ComponentInfo>& GetComponentInfos();
+	static unsigned int RegisterComponent(ComponentInfo info);
+	template<typename T> static void MoveConstructComponent(void* destination, void* source);
+	template<typename T> static void DestroyComponent(void* component);
+
+	// Variadic helpers - folds the IDs of Ts into one mask
+	static unsigned long long MaskOf() { return 0; }
+	template<typename T, typename... Rest> static unsigned long long MaskOf(T*, Rest*... rest);
+
+	unsigned int FindOrCreateArchetype(unsigned long long mask);
+	void AllocateRow(unsigned int archetype, unsigned int& chunk, unsigned int& row);
+	void RemoveRow(unsigned int archetype, unsigned int chunk, unsigned int row);
+	void MoveEntity(Entity entity, unsigned int archetype);
+	void* GetComponentData(const Record& record, unsigned int type);
+
+	static Entity* GetEntities(Archetype& archetype, Chunk& chunk);
+	template<typename T> static T* GetColumn(Archetype& archetype, Chunk& chunk);
+
+	std::vector<Archetype> archetypes;
+	std::unordered_map<unsigned long long, unsigned int> archetypeOfMask;
+
+	std::vector<Record> records;
+	std::vector<unsigned int> freeIndices;
+	unsigned int aliveCount;
+};
+
+// --------------------------------------------------------
+// Component type bookkeeping
+// --------------------------------------------------------
+template<typename T>
+unsigned int EntityRegistry::GetComponentID()
+{
+	static const unsigned int id = RegisterComponent(ComponentInfo{
+		sizeof(T),
+		alignof(T),
+		&EntityRegistry::MoveConstructComponent<T>,
+		&EntityRegistry::DestroyComponent<T> });
+	return id;
+}
+
+template<typename T>
+void EntityRegistry::MoveConstructComponent(void* destination, void* source)
+{
+	new (destination) T(std::move(*static_cast<T*>(source)));
+}
+
+template<typename T>
+void EntityRegistry::DestroyComponent(void* component)
+{
+	static_cast<T*>(component)->~T();
+}
+
+template<typename T, typename... Rest>
+unsigned long long EntityRegistry::MaskOf(T*, Rest*... rest)
+{
+	return (1ull << GetComponentID<T>()) | MaskOf(rest...);
+}
+
+template<typename T>
+T* EntityRegistry::GetColumn(Archetype& archetype, Chunk& chunk)
+{
+	int column = archetype.Column[GetComponentID<T>()];
+	return reinterpret_cast<T*>(chunk.Data.get() + archetype.Offsets[column]);
+}
+
+// --------------------------------------------------------
+// Per-entity access
+// --------------------------------------------------------
+template<typename T>
+T* EntityRegistry::Add(Entity entity, T component)
+{
+	if (!IsAlive(entity))
+		return nullptr;
+
+	unsigned int type = GetComponentID<T>();
+	T* existing = static_cast<T*>(GetComponentData(records[entity.Index], type));
+	if (existing)
+	{
+		*existing = std::move(component);
+		return existing;
+	}
+
+	// Move everything else over, then construct the new one in its empty slot
+	unsigned long long mask = archetypes[records[entity.Index].ArchetypeIndex].Mask | (1ull << type);
+	MoveEntity(entity, FindOrCreateArchetype(mask));
+	void* slot = GetComponentData(records[entity.Index], type);
+	return new (slot) T(std::move(component));
+}
+
+template<typename T>
+void EntityRegistry::Remove(Entity entity)
+{
+	if (!Has<T>(entity))
+		return;
+
+	unsigned long long mask = archetypes[records[entity.Index].ArchetypeIndex].Mask & ~(1ull << GetComponentID<T>());
+	MoveEntity(entity, FindOrCreateArchetype(mask));
+}
+
+template<typename T>
+bool EntityRegistry::Has(Entity entity)
+{
+	return IsAlive(entity) &&
+		(archetypes[records[entity.Index].ArchetypeIndex].Mask & (1ull << GetComponentID<T>())) != 0;
+}
+
+template<typename T>
+T* EntityRegistry::Get(Entity entity)
+{
+	if (!IsAlive(entity))
+		return nullptr;
+	return static_cast<T*>(GetComponentData(records[entity.Index], GetComponentID<T>()));
+}
+
+// --------------------------------------------------------
+// Queries
+// --------------------------------------------------------
+template<typename... Ts, typename Func>
+void EntityRegistry::ForEachChunk(Func func)
+{
+	unsigned long long required = MaskOf(static_cast<Ts*>(nullptr)...);
+	for (Archetype& archetype : archetypes)
+	{
+		if ((archetype.Mask & required) != required)
+			continue;
+
+		for (Chunk& chunk : archetype.Chunks)
+			func(chunk.Count, GetEntities(archetype, chunk), GetColumn<Ts>(archetype, chunk)...);
+	}
+}
+
+template<typename... Ts, typename Func>
+void EntityRegistry::ForEach(Func func)
+{
+	ForEachChunk<Ts...>([&](unsigned int count, const Entity* entities, Ts*... columns)
+		{
+			for (unsigned int i = 0; i < count; i++)
+				func(entities[i], columns[i]...);
+		});
+}
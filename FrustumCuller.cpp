@@ -0,0 +1,301 @@
+#include "FrustumCuller.h"
+#include <vector>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Gribb/Hartmann: with row vectors, clip = v * M, so each plane
+// is the 4th column plus or minus another.  D3D's clip depth
+// runs 0 to w, so near is just the 3rd column.
+// --------------------------------------------------------
+Frustum FrustumCuller::ExtractFrustum(XMFLOAT4X4 m)
+{
+	XMFLOAT4 column1(m._11, m._21, m._31, m._41);
+	XMFLOAT4 column2(m._12, m._22, m._32, m._42);
+	XMFLOAT4 column3(m._13, m._23, m._33, m._43);
+	XMFLOAT4 column4(m._14, m._24, m._34, m._44);
+
+	XMVECTOR c1 = XMLoadFloat4(&column1);
+	XMVECTOR c2 = XMLoadFloat4(&column2);
+	XMVECTOR c3 = XMLoadFloat4(&column3);
+	XMVECTOR c4 = XMLoadFloat4(&column4);
+
+	XMVECTOR planes[FRUSTUM_PLANE_COUNT] = {
+		XMVectorAdd(c4, c1),		// Left
+		XMVectorSubtract(c4, c1),	// Right
+		XMVectorAdd(c4, c2),		// Bottom
+		XMVectorSubtract(c4, c2),	// Top
+		c3,							// Near
+		XMVectorSubtract(c4, c3) };	// Far
+
+	Frustum frustum;
+	for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+		XMStoreFloat4(&frustum.Planes[p], XMPlaneNormalize(planes[p]));
+	return frustum;
+}
+
+// --------------------------------------------------------
+// Scalar reference - the SIMD loops below must match these
+// operation for operation
+// --------------------------------------------------------
+bool FrustumCuller::IsSphereVisible(const Frustum& frustum, float x, float y, float z, float radius)
+{
+	for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+	{
+		const XMFLOAT4& plane = frustum.Planes[p];
+		float distance = x * plane.x + y * plane.y;
+		distance = distance + z * plane.z;
+		distance = distance + plane.w;
+		if (!(distance >= -radius))
+			return false;
+	}
+	return true;
+}
+
+bool FrustumCuller::IsAABBVisible(const Frustum& frustum, float x, float y, float z, float extentX, float extentY, float extentZ)
+{
+	for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+	{
+		const XMFLOAT4& plane = frustum.Planes[p];
+		float distance = x * plane.x + y * plane.y;
+		distance = distance + z * plane.z;
+		distance = distance + plane.w;
+
+		// How far the box reaches towards the plane's normal
+		float reach = extentX * fabsf(plane.x) + extentY * fabsf(plane.y);
+		reach = reach + extentZ * fabsf(plane.z);
+		if (!(distance >= -reach))
+			return false;
+	}
+	return true;
+}
+
+// --------------------------------------------------------
+// Four spheres per iteration: every plane component is
+// splatted once, then each plane costs 3 multiplies, 3 adds
+// and a compare for all four
+// --------------------------------------------------------
+void FrustumCuller::CullSpheres(
+	const Frustum& frustum,
+	const float* centerX, const float* centerY, const float* centerZ, const float* radius,
+	unsigned int count,
+	unsigned char* visible)
+{
+	XMVECTOR planeX[FRUSTUM_PLANE_COUNT], planeY[FRUSTUM_PLANE_COUNT], planeZ[FRUSTUM_PLANE_COUNT], planeW[FRUSTUM_PLANE_COUNT];
+	for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+	{
+		planeX[p] = XMVectorReplicate(frustum.Planes[p].x);
+		planeY[p] = XMVectorReplicate(frustum.Planes[p].y);
+		planeZ[p] = XMVectorReplicate(frustum.Planes[p].z);
+		planeW[p] = XMVectorReplicate(frustum.Planes[p].w);
+	}
+
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		XMVECTOR x = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(centerX + i));
+		XMVECTOR y = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(centerY + i));
+		XMVECTOR z = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(centerZ + i));
+		XMVECTOR negativeRadius = XMVectorNegate(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(radius + i)));
+
+		XMVECTOR inside = XMVectorTrueInt();
+		for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+		{
+			XMVECTOR distance = XMVectorAdd(XMVectorMultiply(x, planeX[p]), XMVectorMultiply(y, planeY[p]));
+			distance = XMVectorAdd(distance, XMVectorMultiply(z, planeZ[p]));
+			distance = XMVectorAdd(distance, planeW[p]);
+			inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(distance, negativeRadius));
+		}
+
+		uint32_t mask[4];
+		XMStoreInt4(mask, inside);
+		visible[i + 0] = mask[0] ? 1 : 0;
+		visible[i + 1] = mask[1] ? 1 : 0;
+		visible[i + 2] = mask[2] ? 1 : 0;
+		visible[i + 3] = mask[3] ? 1 : 0;
+	}
+
+	for (; i < count; i++)
+		visible[i] = IsSphereVisible(frustum, centerX[i], centerY[i], centerZ[i], radius[i]) ? 1 : 0;
+}
+
+void FrustumCuller::CullAABBs(
+	const Frustum& frustum,
+	const float* centerX, const float* centerY, const float* centerZ,
+	const float* extentX, const float* extentY, const float* extentZ,
+	unsigned int count,
+	unsigned char* visible)
+{
+	XMVECTOR planeX[FRUSTUM_PLANE_COUNT], planeY[FRUSTUM_PLANE_COUNT], planeZ[FRUSTUM_PLANE_COUNT], planeW[FRUSTUM_PLANE_COUNT];
+	XMVECTOR absX[FRUSTUM_PLANE_COUNT], absY[FRUSTUM_PLANE_COUNT], absZ[FRUSTUM_PLANE_COUNT];
+	for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+	{
+		planeX[p] = XMVectorReplicate(frustum.Planes[p].x);
+		planeY[p] = XMVectorReplicate(frustum.Planes[p].y);
+		planeZ[p] = XMVectorReplicate(frustum.Planes[p].z);
+		planeW[p] = XMVectorReplicate(frustum.Planes[p].w);
+		absX[p] = XMVectorAbs(planeX[p]);
+		absY[p] = XMVectorAbs(planeY[p]);
+		absZ[p] = XMVectorAbs(planeZ[p]);
+	}
+
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		XMVECTOR x = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(centerX + i));
+		XMVECTOR y = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(centerY + i));
+		XMVECTOR z = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(centerZ + i));
+		XMVECTOR ex = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(extentX + i));
+		XMVECTOR ey = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(extentY + i));
+		XMVECTOR ez = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(extentZ + i));
+
+		XMVECTOR inside = XMVectorTrueInt();
+		for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+		{
+			XMVECTOR distance = XMVectorAdd(XMVectorMultiply(x, planeX[p]), XMVectorMultiply(y, planeY[p]));
+			distance = XMVectorAdd(distance, XMVectorMultiply(z, planeZ[p]));
+			distance = XMVectorAdd(distance, planeW[p]);
+
+			XMVECTOR reach = XMVectorAdd(XMVectorMultiply(ex, absX[p]), XMVectorMultiply(ey, absY[p]));
+			reach = XMVectorAdd(reach, XMVectorMultiply(ez, absZ[p]));
+			inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(distance, XMVectorNegate(reach)));
+		}
+
+		uint32_t mask[4];
+		XMStoreInt4(mask, inside);
+		visible[i + 0] = mask[0] ? 1 : 0;
+		visible[i + 1] = mask[1] ? 1 : 0;
+		visible[i + 2] = mask[2] ? 1 : 0;
+		visible[i + 3] = mask[3] ? 1 : 0;
+	}
+
+	for (; i < count; i++)
+		visible[i] = IsAABBVisible(frustum, centerX[i], centerY[i], centerZ[i], extentX[i], extentY[i], extentZ[i]) ? 1 : 0;
+}
+
+// --------------------------------------------------------
+// Self test & benchmark
+// --------------------------------------------------------
+namespace
+{
+	// Deterministic, so every run tests the same volumes
+	struct CullingRandom
+	{
+		unsigned int state;
+		float Next(float low, float high)
+		{
+			state = state * 1664525u + 1013904223u;
+			return low + (high - low) * ((state >> 8) * (1.0f / 16777216.0f));
+		}
+	};
+
+	struct CullingVolumes
+	{
+		std::vector<float> X, Y, Z, RadiusOrExtentX, ExtentY, ExtentZ;
+
+		CullingVolumes(unsigned int count, unsigned int seed)
+		{
+			CullingRandom random = { seed };
+			X.resize(count); Y.resize(count); Z.resize(count);
+			RadiusOrExtentX.resize(count); ExtentY.resize(count); ExtentZ.resize(count);
+			for (unsigned int i = 0; i < count; i++)
+			{
+				X[i] = random.Next(-100.0f, 100.0f);
+				Y[i] = random.Next(-100.0f, 100.0f);
+				Z[i] = random.Next(-100.0f, 100.0f);
+				RadiusOrExtentX[i] = random.Next(0.0f, 5.0f);
+				ExtentY[i] = random.Next(0.0f, 5.0f);
+				ExtentZ[i] = random.Next(0.0f, 5.0f);
+			}
+		}
+	};
+
+	// Camera at the origin looking down +Z, like the game's cameras
+	Frustum MakeTestFrustum()
+	{
+		XMMATRIX view = XMMatrixLookToLH(XMVectorZero(), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0));
+		XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 50.0f);
+		XMFLOAT4X4 viewProjection;
+		XMStoreFloat4x4(&viewProjection, view * projection);
+		return FrustumCuller::ExtractFrustum(viewProjection);
+	}
+}
+
+bool FrustumCuller::SelfTest()
+{
+	Frustum frustum = MakeTestFrustum();
+
+	// Known answers
+	bool passed =
+		IsSphereVisible(frustum, 0, 0, 10, 1) &&		// Straight ahead
+		!IsSphereVisible(frustum, 0, 0, -10, 1) &&		// Behind
+		!IsSphereVisible(frustum, 0, 0, 60, 1) &&		// Past the far plane
+		IsSphereVisible(frustum, 0, 0, 50.5f, 1) &&		// Straddling the far plane
+		!IsSphereVisible(frustum, 100, 0, 10, 1) &&		// Off to the side
+		IsAABBVisible(frustum, 0, 0, -1, 1, 1, 2) &&	// Box poking through the near plane
+		!IsAABBVisible(frustum, 0, 50, 10, 1, 1, 1);	// Above
+
+	// Every volume count from 0 to 9 covers the 4-wide loop plus each
+	// leftover count, then a big batch for everything else
+	unsigned int counts[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10007 };
+	for (unsigned int count : counts)
+	{
+		CullingVolumes volumes(count, 12345 + count);
+		std::vector<unsigned char> spheres(count), boxes(count);
+		CullSpheres(frustum, volumes.X.data(), volumes.Y.data(), volumes.Z.data(), volumes.RadiusOrExtentX.data(), count, spheres.data());
+		CullAABBs(frustum, volumes.X.data(), volumes.Y.data(), volumes.Z.data(),
+			volumes.RadiusOrExtentX.data(), volumes.ExtentY.data(), volumes.ExtentZ.data(), count, boxes.data());
+
+		for (unsigned int i = 0; i < count; i++)
+		{
+			bool sphere = IsSphereVisible(frustum, volumes.X[i], volumes.Y[i], volumes.Z[i], volumes.RadiusOrExtentX[i]);
+			bool box = IsAABBVisible(frustum, volumes.X[i], volumes.Y[i], volumes.Z[i],
+				volumes.RadiusOrExtentX[i], volumes.ExtentY[i], volumes.ExtentZ[i]);
+			if ((spheres[i] != 0) != sphere || (boxes[i] != 0) != box)
+				passed = false;
+		}
+	}
+	return passed;
+}
+
+CullingBenchmarkResult FrustumCuller::Benchmark(unsigned int count)
+{
+	CullingBenchmarkResult result = {};
+	result.Count = count;
+	result.SelfTestPassed = SelfTest();
+	if (count == 0)
+		return result;
+
+	Frustum frustum = MakeTestFrustum();
+	CullingVolumes volumes(count, 1);
+	std::vector<unsigned char> visible(count);
+	volatile unsigned int sink = 0;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < count; i++)
+		visible[i] = IsSphereVisible(frustum, volumes.X[i], volumes.Y[i], volumes.Z[i], volumes.RadiusOrExtentX[i]) ? 1 : 0;
+	auto end = std::chrono::high_resolution_clock::now();
+	float microseconds = std::chrono::duration<float, std::micro>(end - start).count();
+	result.ScalarSpheresPerMicrosecond = count / (std::max)(microseconds, 0.001f);
+	sink = sink + visible[count / 2];
+
+	start = std::chrono::high_resolution_clock::now();
+	CullSpheres(frustum, volumes.X.data(), volumes.Y.data(), volumes.Z.data(), volumes.RadiusOrExtentX.data(), count, visible.data());
+	end = std::chrono::high_resolution_clock::now();
+	microseconds = std::chrono::duration<float, std::micro>(end - start).count();
+	result.SpheresPerMicrosecond = count / (std::max)(microseconds, 0.001f);
+	sink = sink + visible[count / 2];
+
+	start = std::chrono::high_resolution_clock::now();
+	CullAABBs(frustum, volumes.X.data(), volumes.Y.data(), volumes.Z.data(),
+		volumes.RadiusOrExtentX.data(), volumes.ExtentY.data(), volumes.ExtentZ.data(), count, visible.data());
+	end = std::chrono::high_resolution_clock::now();
+	microseconds = std::chrono::duration<float, std::micro>(end - start).count();
+	result.AABBsPerMicrosecond = count / (std::max)(microseconds, 0.001f);
+	sink = sink + visible[count / 2];
+
+	return result;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <DirectXMath.h>
+
+#define FRUSTUM_PLANE_COUNT 6
+
+// --------------------------------------------------------
+// Six planes (left, right, bottom, top, near, far) as
+// ax + by + cz + d, normalized, with the inside positive
+// --------------------------------------------------------
+struct Frustum
+{
+	DirectX::XMFLOAT4 Planes[FRUSTUM_PLANE_COUNT];
+};
+
+// Results from FrustumCuller::Benchmark()
+struct CullingBenchmarkResult
+{
+	unsigned int Count;
+	float ScalarSpheresPerMicrosecond;
+	float SpheresPerMicrosecond;
+	float AABBsPerMicrosecond;
+	bool SelfTestPassed;
+};
+
+// --------------------------------------------------------
+// Tests bounding volumes against a frustum four at a time.
+//
+// Inputs are structure-of-arrays so each component loads
+// straight into a vector.  The SIMD paths do exactly the same
+// multiplies and adds, in the same order, as the scalar
+// reference, so both always agree bit for bit - the result
+// for a given frustum & volume never depends on its position
+// in the array.
+//
+// Conservative: a volume is only culled when it's completely
+// outside one plane.
+// --------------------------------------------------------
+class FrustumCuller
+{
+public:
+	// Planes from any row-vector view * projection (perspective or ortho)
+	static Frustum ExtractFrustum(DirectX::XMFLOAT4X4 viewProjection);
+
+	// visible[i] = 1 if sphere i touches the frustum, 0 if not
+	static void CullSpheres(
+		const Frustum& frustum,
+		const float* centerX, const float* centerY, const float* centerZ, const float* radius,
+		unsigned int count,
+		unsigned char* visible);
+
+	// Boxes as center & half-size
+	static void CullAABBs(
+		const Frustum& frustum,
+		const float* centerX, const float* centerY, const float* centerZ,
+		const float* extentX, const float* extentY, const float* extentZ,
+		unsigned int count,
+		unsigned char* visible);
+
+	// One at a time, for reference & leftovers
+	static bool IsSphereVisible(const Frustum& frustum, float x, float y, float z, float radius);
+	static bool IsAABBVisible(const Frustum& frustum, float x, float y, float z, float extentX, float extentY, float extentZ);
+
+	// Known cases, plus the SIMD paths against the scalar ones on random
+	// volumes.  Needs no GPU.
+	static bool SelfTest();
+
+	static CullingBenchmarkResult Benchmark(unsigned int count);
+};
@@ -5,6 +5,10 @@
 #include "BufferStructs.h"
 #include "SimpleShader.h"
 #include "WICTextureLoader.h"
+#include "TextureArrayPacker.h"
+#include "ChannelPacker.h"
+#include <chrono>
+#include <algorithm>
 
 
 // Needed for a helper function to load pre-compiled shader files
@@ -14,6 +18,15 @@
 // For the DirectX Math library
 using namespace DirectX;
 
+// Skies that can be swapped between at runtime
+#define SKY_COUNT 4
+static const char* skyNames[SKY_COUNT] = { "Default", "Clouds Blue", "Cold Sunset", "Planet" };
+static const wchar_t* skyFolders[SKY_COUNT] = {
+	L"../../Assets/Textures/",
+	L"../../Assets/Textures/Skies/Clouds Blue/",
+	L"../../Assets/Textures/Skies/Cold Sunset/",
+	L"../../Assets/Textures/Skies/Planet/" };
+
 // --------------------------------------------------------
 // Constructor
 //
@@ -52,6 +65,37 @@ Game::Game(HINSTANCE hInstance)
 	shadowViewMatrix = XMFLOAT4X4();
 	shadowProjectionMatrix = XMFLOAT4X4();
 	shadowMapResolution = 1024;
+	srvBindCount = 0;
+	srvChangeCount = 0;
+	extractMilliseconds = 0.0f;
+	shadowPassMilliseconds = 0.0f;
+	mainPassMilliseconds = 0.0f;
+	sortDraws = true;
+	cullDraws = true;
+	occlusionCulling = true;
+	instanceDraws = true;
+	constantBufferBytes = 0;
+	constantBufferUploads = 0;
+	constantBufferSkips = 0;
+	filterState = true;
+	memset(stateSubmitted, 0, sizeof(stateSubmitted));
+	memset(stateFiltered, 0, sizeof(stateFiltered));
+	shaderLoadMilliseconds = 0.0f;
+	activeDirectionalLights = MAX_DIRECTIONAL_LIGHTS;
+	activePointLights = MAX_POINT_LIGHTS;
+	shadows = true;
+	bakeShadersOnly = false;
+	staticBatching = true;
+	drawCallCount = 0;
+	instanceCapacity = 0;
+	ringConstants = true;
+	shaderChangeCount = 0;
+	materialChangeCount = 0;
+	meshChangeCount = 0;
+	textureArrayCount = 0;
+	iblMaps = {};
+	bakeIBLOnly = false;
+	currentSky = 0;
 
 }
 
@@ -69,6 +113,9 @@ Game::~Game()
 	// Call Release() on any Direct3D objects made within this class
 	// - Note: this is unnecessary for D3D objects stored in ComPtrs
 
+	// The shaders outlive this, and mustn't keep using the cache
+	ISimpleShader::StateCache = 0;
+
 	// ImGui clean up
 	ImGui_ImplDX11_Shutdown();
 	ImGui_ImplWin32_Shutdown();
@@ -84,14 +131,23 @@ void Game::Init()
 	// Helper methods for loading shaders, creating some basic
 	// geometry to draw and some simple camera matrices.
 	//  - You'll be expanding and/or replacing these later
+	auto shaderStart = std::chrono::high_resolution_clock::now();
 	LoadShaders();
+	auto shaderEnd = std::chrono::high_resolution_clock::now();
+	shaderLoadMilliseconds = std::chrono::duration<float, std::milli>(shaderEnd - shaderStart).count();
+
+	// Every entity's position, rotation & scale lives in here
+	transforms = std::make_shared<TransformSystem>();
+	registry = std::make_shared<EntityRegistry>();
 
-	textureSubresources.push_back(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>());
-	textureSubresources.push_back(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>());
-	textureSubresources.push_back(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>());
-	textureSubresources.push_back(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>());
-	textureSubresources.push_back(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>());
-	textureSubresources.push_back(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>());
+	// Every texture & sampler goes through the cache so nothing
+	// gets loaded onto the GPU twice
+	resources = std::make_shared<ResourceCache>(device, context);
+
+	// Textures get packed into Texture2DArrays by size & format so
+	// materials that only differ by texture bind the same SRVs
+	TextureArrayPacker texturePacker(device, context, resources);
+	std::vector<unsigned int> textureTickets;
 
 
 
@@ -101,15 +157,34 @@ void Game::Init()
 	//CreateWICTextureFromFile(device.Get(), context.Get(), FixPath(L"../../Assets/Textures/TCom_Gore_512_ao.tif").c_str(), nullptr, textureSubresources[1].GetAddressOf());
 	//CreateWICTextureFromFile(device.Get(), context.Get(), FixPath(L"../../Assets/Textures/TCom_Gore_512_normal.tif").c_str(), nullptr, textureSubresources[2].GetAddressOf());
 
-	CreateWICTextureFromFile(device.Get(), context.Get(), FixPath(L"../../Assets/Textures/PBR/bronze_albedo.png").c_str(), nullptr, textureSubresources[0].GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), FixPath(L"../../Assets/Textures/PBR/bronze_metal.png").c_str(), nullptr, textureSubresources[1].GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), FixPath(L"../../Assets/Textures/PBR/bronze_normals.png").c_str(), nullptr, textureSubresources[2].GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), FixPath(L"../../Assets/Textures/PBR/bronze_roughness.png").c_str(), nullptr, textureSubresources[3].GetAddressOf());
+	// Metalness & roughness are single channel, so they share one
+	// texture instead of taking up two full RGBA ones
+	ChannelPacker channelPacker(device, context, resources);
+
+	textureTickets.push_back(texturePacker.AddTexture(FixPath(L"../../Assets/Textures/PBR/bronze_albedo.png")));
+	textureTickets.push_back(texturePacker.AddTexture(channelPacker.PackMetalRoughnessAO(
+		FixPath(L"../../Assets/Textures/PBR/bronze_metal.png"),
+		FixPath(L"../../Assets/Textures/PBR/bronze_roughness.png"))));
+	textureTickets.push_back(texturePacker.AddTexture(FixPath(L"../../Assets/Textures/PBR/bronze_normals.png")));
+
+	textureTickets.push_back(texturePacker.AddTexture(FixPath(L"../../Assets/Textures/tiles.png")));
+	textureTickets.push_back(texturePacker.AddTexture(FixPath(L"../../Assets/Textures/tiles_specular.png")));
 
-	CreateWICTextureFromFile(device.Get(), context.Get(), FixPath(L"../../Assets/Textures/tiles.png").c_str(), nullptr, textureSubresources[4].GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), FixPath(L"../../Assets/Textures/tiles_specular.png").c_str(), nullptr, textureSubresources[5].GetAddressOf());
+	texturePacker.Pack();
+	textureArrayCount = (unsigned int)texturePacker.GetArrayCount();
+	for (unsigned int ticket : textureTickets)
+	{
+		// A file that didn't load has no array - sample plain white instead
+		PackedTexture packed = texturePacker.GetPackedTexture(ticket);
+		if (!packed.Array)
+		{
+			printf("Texture %u failed to load, using the fallback texture\n", ticket);
+			packed.Array = resources->GetFallbackTexture();
+			packed.Slice = 0;
+		}
+		packedTextures.push_back(packed);
+	}
 
-	samplerStates.push_back(Microsoft::WRL::ComPtr<ID3D11SamplerState>());
 	D3D11_SAMPLER_DESC sampleDescription0 = {};
 
 	sampleDescription0.AddressU = D3D11_TEXTURE_ADDRESS_WRAP; // Each dimension can
@@ -118,7 +193,7 @@ void Game::Init()
 	sampleDescription0.Filter = D3D11_FILTER_ANISOTROPIC;
 	sampleDescription0.MaxAnisotropy = 16;
 	sampleDescription0.MaxLOD = D3D11_FLOAT32_MAX; // Maximum mip level
-	device->CreateSamplerState(&sampleDescription0, samplerStates[0].GetAddressOf());
+	basicSampler = resources->GetSampler(sampleDescription0);
 
 	// shadow sampleR
 	D3D11_SAMPLER_DESC shadowSampDesc = {};
@@ -128,31 +203,73 @@ void Game::Init()
 	shadowSampDesc.AddressV = D3D11_TEXTURE_ADDRESS_BORDER;
 	shadowSampDesc.AddressW = D3D11_TEXTURE_ADDRESS_BORDER;
 	shadowSampDesc.BorderColor[0] = 1.0f; // Only need the first component
-	device->CreateSamplerState(&shadowSampDesc, &shadowSampler);
+	shadowSampler = resources->GetSampler(shadowSampDesc);
+
+	// Clamped so the BRDF look-up table doesn't bleed across its edges
+	D3D11_SAMPLER_DESC clampSampDesc = {};
+	clampSampDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	clampSampDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	clampSampDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	clampSampDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	clampSampDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	clampSampler = resources->GetSampler(clampSampDesc);
 
 	// Change this back to the standard pixel and vertex shader
-	materials.push_back(std::make_shared<Material>(XMFLOAT4(1, 0, 0, 1), 0.75f, pixelShaderNormalMapping, vertexShaderNormalMapping));
-	materials.push_back(std::make_shared<Material>(XMFLOAT4(0, 1, 0, 1), 0.5f, pixelShader, vertexShader));
-	materials.push_back(std::make_shared<Material>(XMFLOAT4(0, 0, 1, 1), 0.01f, pixelShader, vertexShader));
-	materials.push_back(std::make_shared<Material>(XMFLOAT4(1, 0, 1, 0.5f), 0.5f, customPixelShader, vertexShader));
+	materials.push_back(materialPool.Create(XMFLOAT4(1, 0, 0, 1), 0.75f, pixelShaderPackedPBR, vertexShaderNormalMapping));
+	materials.push_back(materialPool.Create(XMFLOAT4(0, 1, 0, 1), 0.5f, pixelShader, vertexShader));
+	materials.push_back(materialPool.Create(XMFLOAT4(0, 0, 1, 1), 0.01f, pixelShader, vertexShader));
+	materials.push_back(materialPool.Create(XMFLOAT4(1, 0, 1, 0.5f), 0.5f, customPixelShader, vertexShader));
 
-	materials[0].get()->AddTextureSRV("Albedo", textureSubresources[0]);
-	materials[0].get()->AddTextureSRV("MetalnessMap", textureSubresources[1]);
+	materialPool.Get(materials[0])->AddTexture("Albedo", packedTextures[0].Array);
+	materialPool.Get(materials[0])->AddTextureSlice("albedoSlice", packedTextures[0].Slice);
+	materialPool.Get(materials[0])->AddTexture("MetalRoughnessAOMap", packedTextures[1].Array);
+	materialPool.Get(materials[0])->AddTextureSlice("metalRoughnessAOSlice", packedTextures[1].Slice);
 
 	// TODO: Find/create a specular map?
-	// materials[0].get()->AddTextureSRV("SpecularTexture", textureSubresources[1]);
-	materials[0].get()->AddTextureSRV("NormalMap", textureSubresources[2]);
-	materials[0].get()->AddTextureSRV("RoughnessMap", textureSubresources[3]);
-
-	materials[0].get()->AddTextureSR("BasicSampler", samplerStates[0]);
-	materials[0].get()->AddTextureSR("ShadowSampler", shadowSampler);
-
-
-	materials[1].get()->AddTextureSRV("Albedo", textureSubresources[4]);
-	materials[1].get()->AddTextureSRV("SpecularTexture", textureSubresources[5]);
-	materials[1].get()->AddTextureSR("BasicSampler", samplerStates[0]);
-	materials[1].get()->AddTextureSR("ShadowSampler", shadowSampler);
-
+	// materialPool.Get(materials[0])->AddTexture("SpecularTexture", packedTextures[1].Array);
+	materialPool.Get(materials[0])->AddTexture("NormalMap", packedTextures[2].Array);
+	materialPool.Get(materials[0])->AddTextureSlice("normalSlice", packedTextures[2].Slice);
+
+	materialPool.Get(materials[0])->AddSampler("BasicSampler", basicSampler);
+	materialPool.Get(materials[0])->AddSampler("ShadowSampler", shadowSampler);
+	materialPool.Get(materials[0])->AddSampler("ClampSampler", clampSampler);
+
+
+	materialPool.Get(materials[1])->AddTexture("Albedo", packedTextures[3].Array);
+	materialPool.Get(materials[1])->AddTextureSlice("albedoSlice", packedTextures[3].Slice);
+	materialPool.Get(materials[1])->AddTexture("SpecularTexture", packedTextures[4].Array);
+	materialPool.Get(materials[1])->AddTextureSlice("specularSlice", packedTextures[4].Slice);
+	materialPool.Get(materials[1])->AddSampler("BasicSampler", basicSampler);
+	materialPool.Get(materials[1])->AddSampler("ShadowSampler", shadowSampler);
+
+	// The alpha 0.5 material gets blended in after everything solid
+	materialPool.Get(materials[3])->SetTransparent(true);
+
+	// Standard "over" blending; transparent draws still depth test
+	// against the opaque ones but don't write, so they can't hide
+	// each other
+	D3D11_BLEND_DESC blendDesc = {};
+	blendDesc.RenderTarget[0].BlendEnable = true;
+	blendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_SRC_ALPHA;
+	blendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+	blendDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+	blendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+	blendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_INV_SRC_ALPHA;
+	blendDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+	blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	device->CreateBlendState(&blendDesc, transparentBlendState.GetAddressOf());
+
+	D3D11_DEPTH_STENCIL_DESC transparentDepthDesc = {};
+	transparentDepthDesc.DepthEnable = true;
+	transparentDepthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	transparentDepthDesc.DepthFunc = D3D11_COMPARISON_LESS;
+	device->CreateDepthStencilState(&transparentDepthDesc, transparentDepthState.GetAddressOf());
+
+	// Starts with room for a thousand or so draws, and grows from there
+	objectConstants.Init(device, context, 1024 * CONSTANT_RING_ALIGNMENT);
+
+	stateCache.Init(std::make_shared<ContextStateTarget>(context));
+	ISimpleShader::StateCache = &stateCache;
 
 	CreateGeometry();
 
@@ -188,18 +305,6 @@ void Game::Init()
 		//ImGui::StyleColorsLight();
 		//ImGui::StyleColorsClassic();
 
-		// create constant buffer
-		// Get size as the next multiple of 16 (instead of hardcoding a size here!)
-		unsigned int size = sizeof(VertexShaderExternalData);
-		size = (size + 15) / 16 * 16; // This will work even if the struct size changes
-
-		// Describe the constant buffer
-		D3D11_BUFFER_DESC cbDesc = {}; // Sets struct to all zeros
-		cbDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-		cbDesc.ByteWidth = size; // Must be a multiple of 16
-		cbDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-		cbDesc.Usage = D3D11_USAGE_DYNAMIC;
-
 		// set up editable features
 		color = XMFLOAT4(1.0f, 0.0f, 0.5f, 1.0f);
 		worldMatrix = XMFLOAT4X4(
@@ -333,6 +438,7 @@ void Game::Init()
 	XMStoreFloat4x4(&shadowViewMatrix, lightViewMatrix);
 	XMStoreFloat4x4(&shadowProjectionMatrix, lightProjectionMatrix);
 
+	RegisterDebugChecks();
 }
 
 // --------------------------------------------------------
@@ -357,10 +463,65 @@ void Game::LoadShaders()
 		FixPath(L"PixelShader.cso").c_str());
 	pixelShaderNormalMapping = std::make_shared<SimplePixelShader>(device, context,
 		FixPath(L"PixelShaderWithNormalMaps.cso").c_str());
+	pixelShaderPackedPBR = std::make_shared<SimplePixelShader>(device, context,
+		FixPath(L"PixelShaderPackedPBR.cso").c_str());
 	pixelShaderSky = std::make_shared<SimplePixelShader>(device, context,
 		FixPath(L"PixelShaderSkybox.cso").c_str());
 	customPixelShader = std::make_shared<SimplePixelShader>(device, context,
 		FixPath(L"CustomPS.cso").c_str());
+
+	// The same vertex shaders built with INSTANCED, reading their world
+	// matrices from the instance buffer instead of the constant buffer
+	vertexShaderInstanced = std::make_shared<SimpleVertexShader>(device, context,
+		FixPath(L"VertexShaderInstanced.cso").c_str());
+	vertexShaderNormalMappingInstanced = std::make_shared<SimpleVertexShader>(device, context,
+		FixPath(L"VertexShaderWithNormalMapsInstanced.cso").c_str());
+	shadowVSInstanced = std::make_shared<SimpleVertexShader>(device, context,
+		FixPath(L"ShadowMapVertexShaderInstanced.cso").c_str());
+
+	// Only trust a variant whose reflected layout really has per-instance inputs
+	if (vertexShaderInstanced->GetPerInstanceCompatible())
+		instancedVariants[vertexShader.get()] = vertexShaderInstanced.get();
+	if (vertexShaderNormalMappingInstanced->GetPerInstanceCompatible())
+		instancedVariants[vertexShaderNormalMapping.get()] = vertexShaderNormalMappingInstanced.get();
+
+	// Looking the handles up checks the typed cbuffers against each
+	// shader, so a struct that's drifted from its HLSL shows up now
+	// instead of as garbage on screen
+	for (SimpleVertexShader* vs : { vertexShader.get(), vertexShaderNormalMapping.get(), shadowVS.get(),
+		vertexShaderInstanced.get(), vertexShaderNormalMappingInstanced.get(), shadowVSInstanced.get() })
+		GetHandles(vs);
+	for (SimplePixelShader* ps : { pixelShader.get(), pixelShaderNormalMapping.get(), pixelShaderPackedPBR.get(), customPixelShader.get() })
+		GetHandles(ps);
+
+	// Variants of the lit pixel shaders.  Only the -bakeshaders build
+	// step reads their sources (next to the project) and compiles them;
+	// a normal run loads what it baked, and without a bake just uses
+	// the .cso files above.
+	pixelShaderPermutations = std::make_shared<ShaderPermutations>(device, context,
+		FixPath(L"../../PixelShader.hlsl"));
+	normalMapPermutations = std::make_shared<ShaderPermutations>(device, context,
+		FixPath(L"../../PixelShaderWithNormalMaps.hlsl"));
+	if (bakeShadersOnly)
+	{
+		unsigned int baked = 0;
+		if (pixelShaderPermutations->Load())
+			baked += pixelShaderPermutations->Bake();
+		if (normalMapPermutations->Load())
+			baked += normalMapPermutations->Bake();
+		printf("Baked %u shader variants (%u compiled in %.1f ms)\n", baked,
+			pixelShaderPermutations->GetCompileCount() + normalMapPermutations->GetCompileCount(),
+			pixelShaderPermutations->GetCompileMilliseconds() + normalMapPermutations->GetCompileMilliseconds());
+		return;
+	}
+
+	if (pixelShaderPermutations->LoadBaked())
+		permutedShaders[pixelShader.get()] = { pixelShaderPermutations.get(), 0 };
+	if (normalMapPermutations->LoadBaked())
+	{
+		permutedShaders[pixelShaderNormalMapping.get()] = { normalMapPermutations.get(), 0 };
+		permutedShaders[pixelShaderPackedPBR.get()] = { normalMapPermutations.get(), normalMapPermutations->GetKeyword("PACKED_PBR") };
+	}
 }
 
 
@@ -431,13 +592,13 @@ void Game::CreateGeometry()
 	//square = std::make_shared<Mesh>(squareVertices, 6, squareIndices, 6, device, context);
 	//diamond = std::make_shared<Mesh>(diamondVertices, 6, diamondIndices, 6, device, context);
 
-	cube = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/cube.objectFile").c_str(), device, context);
-	cylinder = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/cylinder.objectFile").c_str(), device, context);
-	helix = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/helix.objectFile").c_str(), device, context);
-	quad = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/quad.objectFile").c_str(), device, context);
-	quad_double_sided = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/quad_double_sided.objectFile").c_str(), device, context);
-	sphere = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/sphere.objectFile").c_str(), device, context);
-	torus = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/torus.objectFile").c_str(), device, context);
+	cube = meshPool.Create(FixPath(L"../../Assets/Models/cube.objectFile").c_str(), device, context);
+	cylinder = meshPool.Create(FixPath(L"../../Assets/Models/cylinder.objectFile").c_str(), device, context);
+	helix = meshPool.Create(FixPath(L"../../Assets/Models/helix.objectFile").c_str(), device, context);
+	quad = meshPool.Create(FixPath(L"../../Assets/Models/quad.objectFile").c_str(), device, context);
+	quad_double_sided = meshPool.Create(FixPath(L"../../Assets/Models/quad_double_sided.objectFile").c_str(), device, context);
+	sphere = meshPool.Create(FixPath(L"../../Assets/Models/sphere.objectFile").c_str(), device, context);
+	torus = meshPool.Create(FixPath(L"../../Assets/Models/torus.objectFile").c_str(), device, context);
 	/*square = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/sphere.objectFile").c_str(), device);
 	diamond = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/sphere.objectFile").c_str(), device);*/
 
@@ -447,28 +608,40 @@ void Game::CreateGeometry()
 	gameEntities.push_back(GameEntity(square, materials[0]));
 	gameEntities.push_back(GameEntity(square, materials[1]));*/
 
-	gameEntities.push_back(GameEntity(cube, materials[1]));
-	gameEntities.push_back(GameEntity(cylinder, materials[0]));
-	gameEntities[1].GetTransform()->MoveAbsolute(XMFLOAT3(5.0f, 0.0f, 0.0f));
+	gameEntities.push_back(CreateEntity(cube, materials[1]));
+	gameEntities.push_back(CreateEntity(cylinder, materials[0]));
+	registry->Get<TransformHandle>(gameEntities[1])->MoveAbsolute(XMFLOAT3(5.0f, 0.0f, 0.0f));
+
+	gameEntities.push_back(CreateEntity(helix, materials[1]));
+	registry->Get<TransformHandle>(gameEntities[2])->MoveAbsolute(XMFLOAT3(10.0f, 0.0f, 0.0f));
 
-	gameEntities.push_back(GameEntity(helix, materials[1]));
-	gameEntities[2].GetTransform()->MoveAbsolute(XMFLOAT3(10.0f, 0.0f, 0.0f));
+	gameEntities.push_back(CreateEntity(quad, materials[1]));
+	TransformHandle* floorTransform = registry->Get<TransformHandle>(gameEntities[3]);
+	floorTransform->MoveAbsolute(XMFLOAT3(15.0f, -2.0f, 2.0f));
+	floorTransform->Scale(XMFLOAT3(20.0f, 20.0f, 20.0f));
+	floorTransform->Rotate(31.0f, 0.0f, 0.0f);
+	registry->Add(gameEntities[3], Occluder{ quad });
 
-	gameEntities.push_back(GameEntity(quad, materials[1]));
-	gameEntities[3].GetTransform()->MoveAbsolute(XMFLOAT3(15.0f, -2.0f, 2.0f));
-	gameEntities[3].GetTransform()->Scale(XMFLOAT3(20.0f, 20.0f, 20.0f));
-	gameEntities[3].GetTransform()->Rotate(31.0f, 0.0f, 0.0f);
 
 
+	gameEntities.push_back(CreateEntity(quad_double_sided, materials[2]));
+	registry->Get<TransformHandle>(gameEntities[4])->MoveAbsolute(XMFLOAT3(20.0f, 0.0f, 0.0f));
 
-	gameEntities.push_back(GameEntity(quad_double_sided, materials[2]));
-	gameEntities[4].GetTransform()->MoveAbsolute(XMFLOAT3(20.0f, 0.0f, 0.0f));
+	// The sphere rides along with the quad - its position is relative to it
+	gameEntities.push_back(CreateEntity(sphere, materials[2]));
+	TransformHandle* sphereTransform = registry->Get<TransformHandle>(gameEntities[5]);
+	sphereTransform->SetParent(registry->Get<TransformHandle>(gameEntities[4]));
+	sphereTransform->MoveAbsolute(XMFLOAT3(5.0f, 0.0f, 0.0f));
 
-	gameEntities.push_back(GameEntity(sphere, materials[2]));
-	gameEntities[5].GetTransform()->MoveAbsolute(XMFLOAT3(25.0f, 0.0f, 0.0f));
+	gameEntities.push_back(CreateEntity(torus, materials[3]));
+	registry->Get<TransformHandle>(gameEntities[6])->MoveAbsolute(XMFLOAT3(30.0f, 0.0f, 0.0f));
 
-	gameEntities.push_back(GameEntity(torus, materials[3]));
-	gameEntities[6].GetTransform()->MoveAbsolute(XMFLOAT3(30.0f, 0.0f, 0.0f));
+	// The floor & torus never move.  The floor gets baked into a static
+	// batch; the torus is transparent, so the batcher leaves it be.
+	registry->Add(gameEntities[3], Static{});
+	registry->Add(gameEntities[6], Static{});
+	transforms->UpdateMatrices();
+	staticBatcher.Build(*registry, *transforms, meshPool, materialPool, device, context);
 
 
 	/*gameEntities.push_back(GameEntity(square, materials[1]));
@@ -476,21 +649,149 @@ void Game::CreateGeometry()
 	gameEntities.push_back(GameEntity(square, materials[0]));
 	gameEntities.push_back(GameEntity(square, materials[1]));*/
 
+	LoadSky(skyFolders[currentSky]);
+	if (bakeIBLOnly || bakeShadersOnly)
+		PostQuitMessage(0);
+}
+
+// --------------------------------------------------------
+// Every drawable entity is a transform plus a mesh renderer
+// --------------------------------------------------------
+Entity Game::CreateEntity(MeshHandle mesh, MaterialHandle material)
+{
+	Entity entity = registry->Create();
+	TransformHandle* transform = registry->Add(entity, transforms->Create());
+	registry->Add(entity, MeshRenderer{ mesh, material });
+
+	Mesh* renderMesh = meshPool.Get(mesh);
+	spatialIndex.Add(entity, transform->GetID(), renderMesh->GetAABBCenter(), renderMesh->GetAABBExtents());
+	return entity;
+}
+
+// --------------------------------------------------------
+// Name lookups happen here once per shader, instead of on
+// every Set call in the draw loop
+// --------------------------------------------------------
+const VertexShaderHandles& Game::GetHandles(SimpleVertexShader* shader)
+{
+	auto existing = vertexShaderHandles.find(shader);
+	if (existing != vertexShaderHandles.end())
+		return existing->second;
+
+	// The shadow shaders' FrameData holds the light's view instead
+	VertexShaderHandles handles;
+	if (shader == shadowVS.get() || shader == shadowVSInstanced.get())
+		handles.ShadowFrame = shader->GetTypedBuffer<ShadowFrameData>();
+	else
+		handles.Frame = shader->GetTypedBuffer<VertexFrameData>();
+	handles.Object = shader->GetTypedBuffer<ObjectData>();
+
+	const SimpleConstantBuffer* objectData = shader->GetBufferInfo("ObjectData");
+	if (objectData)
+		handles.ObjectDataSlot = (int)objectData->BindIndex;
+	return vertexShaderHandles[shader] = handles;
+}
+
+const PixelShaderHandles& Game::GetHandles(SimplePixelShader* shader)
+{
+	auto existing = pixelShaderHandles.find(shader);
+	if (existing != pixelShaderHandles.end())
+		return existing->second;
+
+	PixelShaderHandles handles;
+	handles.Frame = shader->GetTypedBuffer<PixelFrameData>();
+	handles.ColorTint = shader->GetVariableHandle("colorTint");
+	handles.Roughness = shader->GetVariableHandle("roughness");
+	handles.AmbientSH = shader->GetVariableHandle("ambientSH");
+	return pixelShaderHandles[shader] = handles;
+}
+
+// --------------------------------------------------------
+// The instance buffer is dynamic and rewritten every frame.
+// It only ever grows, doubling, so a scene that's settled
+// stops reallocating.
+// --------------------------------------------------------
+void Game::UploadInstances()
+{
+	if (instances.empty())
+		return;
+
+	if (instances.size() > instanceCapacity)
+	{
+		instanceCapacity = (std::max)(instanceCapacity * 2, (unsigned int)instances.size());
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = sizeof(InstanceData) * instanceCapacity;
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		instanceBuffer.Reset();
+		device->CreateBuffer(&desc, 0, instanceBuffer.GetAddressOf());
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(instanceBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+	memcpy(mapped.pData, instances.data(), sizeof(InstanceData) * instances.size());
+	context->Unmap(instanceBuffer.Get(), 0);
+
+	stateCache.SetVertexBuffer(1, instanceBuffer.Get(), sizeof(InstanceData), 0);
+}
+
+// --------------------------------------------------------
+// Writes every instance's matrices into the constant buffer
+// ring, one slot each, before anything draws - the ring is
+// only mapped once a frame.  InstanceData is laid out like
+// ObjectData, and the shadow shader's just reads the world
+// matrix off the front.  False if the draws have to set
+// their own matrices this frame.
+// --------------------------------------------------------
+bool Game::UploadObjectConstants()
+{
+	if (!ringConstants || instances.empty())
+		return false;
+	if (!objectConstants.Begin((unsigned int)instances.size() * CONSTANT_RING_ALIGNMENT))
+		return false;
+
+	bool written = true;
+	instanceConstantOffsets.resize(instances.size());
+	for (size_t i = 0; i < instances.size(); i++)
+	{
+		instanceConstantOffsets[i] = objectConstants.Write(&instances[i], sizeof(InstanceData));
+		written = written && instanceConstantOffsets[i] != RING_ALLOCATION_FAILED;
+	}
+	objectConstants.End();
+	return written;
+}
+
+// --------------------------------------------------------
+// Loads the 6 faces in a folder as the sky, then refreshes the
+// lighting that comes from it.  Safe to call mid-run: the SH
+// ambient is re-projected every time, and the heavy specular
+// integration only runs the first time a sky is seen - after
+// that the results come straight off disk.
+// --------------------------------------------------------
+void Game::LoadSky(const std::wstring& folder)
+{
+	skyCubemap = CreateCubemap(
+		FixPath(folder + L"right.png").c_str(),
+		FixPath(folder + L"left.png").c_str(),
+		FixPath(folder + L"up.png").c_str(),
+		FixPath(folder + L"down.png").c_str(),
+		FixPath(folder + L"front.png").c_str(),
+		FixPath(folder + L"back.png").c_str());
+
 	skybox = Sky(
-		cube,
-		samplerStates[0],
+		meshPool.Get(cube),
+		basicSampler->Sampler,
 		device,
 		vertexShaderSky,
 		pixelShaderSky,
-		CreateCubemap(
-			FixPath(L"../../Assets/Textures/right.png").c_str(),
-			FixPath(L"../../Assets/Textures/left.png").c_str(),
-			FixPath(L"../../Assets/Textures/up.png").c_str(),
-			FixPath(L"../../Assets/Textures/down.png").c_str(),
-			FixPath(L"../../Assets/Textures/front.png").c_str(),
-			FixPath(L"../../Assets/Textures/back.png").c_str()
-			)
+		skyCubemap->SRV
 		);
+
+	IBLPrefilter iblPrefilter(device, context, resources);
+	iblMaps = iblPrefilter.LoadOrBake(skyCubemap, bakeIBLOnly);
 }
 
 void Game::FeedInputsToImGui(float deltaTime)
@@ -529,6 +830,126 @@ void Game::OnResize()
 	}
 }
 
+// --------------------------------------------------------
+// Turns the run into an offline bake: Init() prefilters the
+// sky from scratch, writes the IBL cache files and quits
+// --------------------------------------------------------
+void Game::SetBakeIBLOnly(bool bakeOnly)
+{
+	bakeIBLOnly = bakeOnly;
+}
+
+// --------------------------------------------------------
+// Same for shaders: LoadShaders() compiles every variant the
+// permuted sources declare, and lists them for LoadBaked(),
+// then Init() quits.  The project runs this after every build;
+// it's the only place variants get compiled.
+// --------------------------------------------------------
+void Game::SetBakeShadersOnly(bool bakeOnly)
+{
+	bakeShadersOnly = bakeOnly;
+}
+
+// --------------------------------------------------------
+// Every self test & benchmark, in the order the debug panel
+// lists them.  Each benchmark turns its results into lines
+// here, since only Game knows how it wants them shown.
+// --------------------------------------------------------
+void Game::RegisterDebugChecks()
+{
+	debugPanel.AddSelfTest("Test constant buffer uploads", [] { return ISimpleShader::SelfTest(); });
+	debugPanel.AddSelfTest("Test state cache", [] { return PipelineStateCache::SelfTest(); });
+	debugPanel.AddSelfTest("Test reflection sidecar", [] { return ShaderReflectionData::SelfTest(FixPath(L"reflection_selftest.refl")); });
+	debugPanel.AddSelfTest("Test ring allocator", [] { return RingAllocator::SelfTest(); });
+	debugPanel.AddSelfTest("Test SH projection", [] { return SphericalHarmonics::SelfTest(); });
+	debugPanel.AddSelfTest("Test transforms", [] { return TransformSystem::SelfTest(); });
+
+	debugPanel.AddBenchmark("Benchmark shader setters", [this]
+	{
+		std::vector<std::string> lines;
+		ISimpleShader* shaders[] = { vertexShaderNormalMapping.get(), pixelShaderNormalMapping.get() };
+		for (ISimpleShader* shader : shaders)
+		{
+			SetterBenchmarkResult result = ISimpleShader::BenchmarkSetters(*shader, 100000);
+			lines.push_back(DebugPanel::Format("%u variables x %u: %.1f ns/set by name, %.1f ns/set by handle, same bytes both ways: %s",
+				result.VariableCount, result.VariableCount ? result.SetCount / result.VariableCount : 0,
+				result.NameNanoseconds, result.HandleNanoseconds, result.SetsMatch ? "yes" : "NO"));
+		}
+		return lines;
+	});
+	debugPanel.AddBenchmark("Benchmark draw sorting", []
+	{
+		std::vector<std::string> lines;
+		for (unsigned int count : { 10000u, 100000u, 1000000u })
+		{
+			SortBenchmarkResult result = RenderList::BenchmarkSort(count);
+			lines.push_back(DebugPanel::Format("%u draws: %.3f ms radix, %.3f ms std::stable_sort%s",
+				result.Count, result.RadixMilliseconds, result.StdSortMilliseconds, result.Matches ? "" : " (MISMATCH)"));
+		}
+		return lines;
+	});
+	debugPanel.AddBenchmark("Benchmark culling", []
+	{
+		std::vector<std::string> lines;
+		for (unsigned int count : { 100000u, 1000000u })
+		{
+			CullingBenchmarkResult result = FrustumCuller::Benchmark(count);
+			lines.push_back(DebugPanel::Format("%u volumes: %.1f spheres/us scalar, %.1f spheres/us SIMD, %.1f AABBs/us SIMD, self test %s",
+				result.Count, result.ScalarSpheresPerMicrosecond, result.SpheresPerMicrosecond, result.AABBsPerMicrosecond,
+				result.SelfTestPassed ? "passed" : "FAILED"));
+		}
+		return lines;
+	});
+	debugPanel.AddBenchmark("Benchmark occlusion culling", []
+	{
+		std::vector<std::string> lines;
+		for (unsigned int count : { 10000u, 100000u })
+		{
+			OcclusionBenchmarkResult result = OcclusionCuller::Benchmark(count);
+			lines.push_back(DebugPanel::Format("%u boxes: %u triangles rasterized in %.3f ms, tested in %.3f ms on %u threads / %.3f ms on one, %u occluded, self test %s",
+				result.Count, result.OccluderTriangles, result.RasterizeMilliseconds,
+				result.TestMilliseconds, result.ThreadCount, result.SingleThreadTestMilliseconds, result.OccludedCount,
+				result.SelfTestPassed ? "passed" : "FAILED"));
+		}
+		return lines;
+	});
+	debugPanel.AddBenchmark("Benchmark spatial index", []
+	{
+		std::vector<std::string> lines;
+		for (unsigned int count : { 10000u, 100000u })
+		{
+			SpatialBenchmarkResult result = DynamicAABBTree::Benchmark(count);
+			lines.push_back(DebugPanel::Format("%u boxes: %.1f ms build (height %d), box query %.2f us tree / %.2f us linear, ray %.2f us, %.3f ms/frame with 10%% moving (%.0f reinserted)%s",
+				result.Count, result.BuildMilliseconds, result.Height,
+				result.TreeQueryMicroseconds, result.LinearQueryMicroseconds, result.RayMicroseconds,
+				result.MoveMilliseconds, result.ReinsertedPerFrame, result.Matches ? "" : " (MISMATCH)"));
+		}
+		return lines;
+	});
+	debugPanel.AddBenchmark("Benchmark transforms", []
+	{
+		std::vector<std::string> lines;
+		for (unsigned int count : { 10000u, 100000u, 1000000u })
+		{
+			TransformBenchmarkResult result = TransformSystem::Benchmark(count);
+			lines.push_back(DebugPanel::Format("%u transforms: %.2f ms Euler + inverse, %.2f ms one at a time, %.2f ms batched, %.2f ms batched w/ 10%% dirty (max error %g)",
+				result.Count, result.EulerInverseMilliseconds, result.ObjectMilliseconds, result.BatchedMilliseconds, result.TenPercentMilliseconds, result.MaxError));
+		}
+		return lines;
+	});
+	debugPanel.AddBenchmark("Benchmark entities", []
+	{
+		std::vector<std::string> lines;
+		for (unsigned int count : { 100000u, 1000000u })
+		{
+			EntityBenchmarkResult result = EntityRegistry::Benchmark(count);
+			lines.push_back(DebugPanel::Format("%u entities: %.2f ms create, update %.2f ms objects / %.2f ms ForEach / %.2f ms chunks, %.2f ms one column",
+				result.Count, result.CreateMilliseconds, result.ObjectMilliseconds, result.ForEachMilliseconds, result.ChunkMilliseconds, result.SingleColumnMilliseconds));
+		}
+		return lines;
+	});
+}
+
 // --------------------------------------------------------
 // Update your game here - user input, move objects, AI, etc.
 // --------------------------------------------------------
@@ -542,6 +963,149 @@ void Game::Update(float deltaTime, float totalTime)
 	ImGui::Text("Framerate: %f", ImGui::GetIO().Framerate);
 	ImGui::Text("Window Width: %lu", windowWidth);
 	ImGui::Text("Window Height: %lu", windowHeight);
+	ImGui::Text("Texture arrays: %u (from %u textures)", textureArrayCount, (unsigned int)packedTextures.size());
+	ImGui::Text("SRV binds last frame: %u (%u actually changed a slot)", srvBindCount, srvChangeCount);
+	{
+		float draws = (float)(std::max)(renderList.GetCount(), 1u);
+		ImGui::Text("Draw packets: %u, %.3f ms extract, %.3f ms shadow pass (%.2f us/draw), %.3f ms main pass (%.2f us/draw)",
+			renderList.GetCount(), extractMilliseconds,
+			shadowPassMilliseconds, shadowPassMilliseconds * 1000.0f / draws,
+			mainPassMilliseconds, mainPassMilliseconds * 1000.0f / draws);
+	}
+	ImGui::Checkbox("Sort draws", &sortDraws);
+	ImGui::Text("Constant buffer uploads last frame: %u (%u skipped as unchanged), %.1f KB",
+		constantBufferUploads, constantBufferSkips, constantBufferBytes / 1024.0f);
+	{
+		unsigned int submittedCount = 0;
+		unsigned int filteredCount = 0;
+		for (int i = 0; i < PIPELINE_CALL_COUNT; i++)
+		{
+			submittedCount += stateSubmitted[i];
+			filteredCount += stateFiltered[i];
+		}
+		ImGui::Checkbox("Filter redundant state", &filterState);
+		ImGui::Text("Pipeline state calls last frame: %u submitted, %u filtered", submittedCount, filteredCount);
+		ImGui::Text("  shaders %u/%u, input assembler %u/%u, constant buffers %u/%u, SRVs %u/%u, samplers %u/%u, fixed function %u/%u",
+			stateSubmitted[PIPELINE_CALL_SHADER], stateFiltered[PIPELINE_CALL_SHADER],
+			stateSubmitted[PIPELINE_CALL_INPUT_ASSEMBLER], stateFiltered[PIPELINE_CALL_INPUT_ASSEMBLER],
+			stateSubmitted[PIPELINE_CALL_CONSTANT_BUFFER], stateFiltered[PIPELINE_CALL_CONSTANT_BUFFER],
+			stateSubmitted[PIPELINE_CALL_SHADER_RESOURCE], stateFiltered[PIPELINE_CALL_SHADER_RESOURCE],
+			stateSubmitted[PIPELINE_CALL_SAMPLER], stateFiltered[PIPELINE_CALL_SAMPLER],
+			stateSubmitted[PIPELINE_CALL_FIXED_FUNCTION], stateFiltered[PIPELINE_CALL_FIXED_FUNCTION]);
+	}
+	ImGui::Text("Shaders loaded in %.2f ms, %.2f ms of it on reflection: %u from sidecar files, %u reflected",
+		shaderLoadMilliseconds, ISimpleShader::ReflectionMilliseconds,
+		ISimpleShader::ReflectionCacheHits, ISimpleShader::ReflectionCacheMisses);
+	ImGui::Text("Typed constant buffers: %u layout mismatches with the shaders%s",
+		ISimpleShader::LayoutMismatchCount, ISimpleShader::LayoutMismatchCount ? " (details in the console)" : "");
+	if (objectConstants.IsSupported())
+	{
+		ImGui::Checkbox("Constant buffer ring", &ringConstants);
+		ImGui::Text("Object constants: %.1f KB of a %.1f KB ring last frame%s",
+			objectConstants.GetBytesWritten() / 1024.0f, objectConstants.GetCapacity() / 1024.0f,
+			objectConstants.GetWrapped() ? ", wrapped" : "");
+	}
+	else
+	{
+		ImGui::Text("Constant buffer ring: needs D3D 11.1 constant buffer offsets");
+	}
+	ImGui::Checkbox("Instanced draws", &instanceDraws);
+	ImGui::Text("Draw calls last frame: %u (%u batches to the camera, %u to the light)",
+		drawCallCount, (unsigned int)cameraBatches.size(), (unsigned int)shadowBatches.size());
+	if (ImGui::Button("Plant 1000 trees"))
+	{
+		// A grid of identical cylinders - the case instancing is for
+		for (unsigned int i = 0; i < 1000; i++)
+		{
+			unsigned int index = (unsigned int)forestEntities.size();
+			Entity tree = CreateEntity(cylinder, materials[0]);
+			registry->Get<TransformHandle>(tree)->MoveAbsolute(XMFLOAT3(
+				-10.0f - (float)(index % 40) * 3.0f, -1.0f, (float)(index / 40) * 3.0f));
+			registry->Add(tree, Static{});
+			forestEntities.push_back(tree);
+		}
+
+		if (staticBatching)
+		{
+			transforms->UpdateMatrices();
+			staticBatcher.Build(*registry, *transforms, meshPool, materialPool, device, context);
+		}
+	}
+	ImGui::SameLine();
+	ImGui::Text("%u planted", (unsigned int)forestEntities.size());
+	if (ImGui::Checkbox("Static batching", &staticBatching))
+	{
+		if (staticBatching)
+		{
+			transforms->UpdateMatrices();
+			staticBatcher.Build(*registry, *transforms, meshPool, materialPool, device, context);
+		}
+		else
+		{
+			staticBatcher.Clear(*registry, meshPool);
+		}
+	}
+	ImGui::Text("Static batches: %u meshes from %u entities (%u vertices, built in %.3f ms)",
+		staticBatcher.GetBatchCount(), staticBatcher.GetSourceCount(),
+		staticBatcher.GetVertexCount(), staticBatcher.GetBuildMilliseconds());
+	ImGui::Text("State changes last frame: %u shader, %u material, %u mesh (sort took %.3f ms)",
+		shaderChangeCount, materialChangeCount, meshChangeCount, renderList.GetSortMilliseconds());
+	ImGui::Checkbox("Frustum culling", &cullDraws);
+	ImGui::Text("Visible: %u to the camera, %u to the light, of %u (culling took %.3f ms)",
+		renderList.GetCameraVisibleCount(), renderList.GetShadowVisibleCount(), renderList.GetCount(), renderList.GetCullMilliseconds());
+	ImGui::Checkbox("Occlusion culling", &occlusionCulling);
+	ImGui::Text("Occluded: %u (%u occluder triangles, %.3f ms rasterizing, %.3f ms testing)",
+		renderList.GetOccludedCount(), occlusionCuller.GetTriangleCount(),
+		occlusionCuller.GetRasterizeMilliseconds(), renderList.GetOcclusionMilliseconds());
+	{
+		// Pick with a ray from the camera through the mouse
+		XMFLOAT4X4 view = cameras[currentCameraIndex]->GetViewMatrix();
+		XMFLOAT4X4 projection = cameras[currentCameraIndex]->GetProjectionMatrix();
+		XMMATRIX inverseViewProjection = XMMatrixInverse(nullptr, XMLoadFloat4x4(&view) * XMLoadFloat4x4(&projection));
+		Input& input = Input::GetInstance();
+		float x = input.GetMouseX() * 2.0f / windowWidth - 1.0f;
+		float y = 1.0f - input.GetMouseY() * 2.0f / windowHeight;
+		XMVECTOR nearPoint = XMVector3TransformCoord(XMVectorSet(x, y, 0.0f, 1.0f), inverseViewProjection);
+		XMVECTOR farPoint = XMVector3TransformCoord(XMVectorSet(x, y, 1.0f, 1.0f), inverseViewProjection);
+		XMFLOAT3 origin, direction;
+		XMStoreFloat3(&origin, nearPoint);
+		XMStoreFloat3(&direction, XMVector3Normalize(XMVectorSubtract(farPoint, nearPoint)));
+
+		Entity picked;
+		float pickDistance;
+		int pickedIndex = -1;
+		if (spatialIndex.RayCast(origin, direction, 1000.0f, picked, pickDistance))
+		{
+			for (size_t i = 0; i < gameEntities.size(); i++)
+			{
+				if (gameEntities[i].Index == picked.Index && gameEntities[i].Generation == picked.Generation)
+					pickedIndex = (int)i;
+			}
+		}
+
+		unsigned int inView = 0;
+		spatialIndex.QueryFrustum(cameras[currentCameraIndex]->GetFrustum(), [&](Entity) { inView++; });
+
+		ImGui::Text("Spatial index: %u entities, height %d, %u in view, %u moved (%u reinserted) in %.3f ms",
+			spatialIndex.GetCount(), spatialIndex.GetHeight(), inView,
+			spatialIndex.GetMovedCount(), spatialIndex.GetReinsertedCount(), spatialIndex.GetUpdateMilliseconds());
+		if (pickedIndex >= 0)
+			ImGui::Text("Under the mouse: entity %d, %.2f units away", pickedIndex, pickDistance);
+		else
+			ImGui::Text("Under the mouse: nothing");
+	}
+	ImGui::Text("Resource loads: %u (%u deduplicated)", resources->GetLoadCount(), resources->GetDedupeCount());
+	ImGui::Text("IBL maps: %s in %.1f ms", iblMaps.LoadedFromDisk ? "loaded from disk" : "baked", iblMaps.BakeMilliseconds);
+	ImGui::Text("Ambient SH projection: %.2f ms", iblMaps.AmbientMilliseconds);
+	if (ImGui::Combo("Sky", &currentSky, skyNames, SKY_COUNT))
+		LoadSky(skyFolders[currentSky]);
+	for (int type = 0; type < RESOURCE_TYPE_COUNT; type++)
+	{
+		ImGui::Text("  %s: %u live, %.2f MB",
+			ResourceCache::GetTypeName((ResourceType)type),
+			resources->GetLiveCount((ResourceType)type),
+			resources->GetMemoryUsage((ResourceType)type) / (1024.0f * 1024.0f));
+	}
 
 
 	// controls to edit screen here:
@@ -549,12 +1113,17 @@ void Game::Update(float deltaTime, float totalTime)
 	//ImGui::DragFloat3("Edit a vector", &offset.x);
 	ImGui::ColorEdit4("4 - component(RGBA) color editor", &color.x);
 
+	ImGui::Text("Entities: %u in %u archetypes, %u chunks",
+		registry->GetEntityCount(), registry->GetArchetypeCount(), registry->GetChunkCount());
+
+	debugPanel.Draw();
+
 
-	gameEntities[0].GetTransform()->Rotate(0, 0, 0.0001f);
-	 gameEntities[1].GetTransform()->Rotate(0, 0, 0.0001f);
-	 gameEntities[2].GetTransform()->Rotate(0, 0, 0.0001f);
-	 // gameEntities[3].GetTransform()->Rotate(0, 0, -0.0001f);
-	 gameEntities[4].GetTransform()->MoveAbsolute(-0.000001f, 0, 0);
+	registry->Get<TransformHandle>(gameEntities[0])->Rotate(0, 0, 0.0001f);
+	 registry->Get<TransformHandle>(gameEntities[1])->Rotate(0, 0, 0.0001f);
+	 registry->Get<TransformHandle>(gameEntities[2])->Rotate(0, 0, 0.0001f);
+	 // registry->Get<TransformHandle>(gameEntities[3])->Rotate(0, 0, -0.0001f);
+	 registry->Get<TransformHandle>(gameEntities[4])->MoveAbsolute(-0.000001f, 0, 0);
 
 	// entity UI data here
 	for (int i = 0; i < gameEntities.size(); i++)
@@ -563,9 +1132,10 @@ void Game::Update(float deltaTime, float totalTime)
 		// ImGui::ListBox("Scene Entities", )
 
 		ImGui::Text("Entity %d", i);
-		XMFLOAT3 position = gameEntities[i].GetTransform()->GetPosition();
-		XMFLOAT3 scale = gameEntities[i].GetTransform()->GetScale();
-		XMFLOAT3 rotation = gameEntities[i].GetTransform()->GetPitchYawRoll();
+		TransformHandle* transform = registry->Get<TransformHandle>(gameEntities[i]);
+		XMFLOAT3 position = transform->GetPosition();
+		XMFLOAT3 scale = transform->GetScale();
+		XMFLOAT3 rotation = transform->GetPitchYawRoll();
 
 		ImGui::DragFloat3("Position##%f", &position.x, i * 1.0f);
 		ImGui::DragFloat3("Scale##f", &scale.x, i * 1.0f);
@@ -633,6 +1203,14 @@ void Game::Update(float deltaTime, float totalTime)
 
 	}
 
+	// Fewer lights & no shadows pick smaller shader variants
+	ImGui::SliderInt("Directional lights lit", &activeDirectionalLights, 1, MAX_DIRECTIONAL_LIGHTS);
+	ImGui::SliderInt("Point lights lit", &activePointLights, 0, MAX_POINT_LIGHTS);
+	ImGui::Checkbox("Shadows", &shadows);
+	ImGui::Text("Shader variants: %u loaded from the -bakeshaders build step%s",
+		pixelShaderPermutations->GetDiskLoadCount() + normalMapPermutations->GetDiskLoadCount(),
+		permutedShaders.empty() ? " (none baked - using the full shaders)" : "");
+
 	// Example input checking: Quit if the escape key is pressed
 	if (Input::GetInstance().KeyDown(VK_ESCAPE))
 		Quit();
@@ -645,8 +1223,11 @@ void Game::Update(float deltaTime, float totalTime)
 // creates a blank cube map and copies each of the six textures to
 // another face. Afterwards, creates a shader resource view for
 // the cube map and cleans up all of the temporary resources.
+//
+// The finished cube map is registered with the resource cache,
+// keyed by its faces, so asking for the same sky again is free.
 // --------------------------------------------------------
-Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Game::CreateCubemap(
+ResourceHandle Game::CreateCubemap(
 	const wchar_t* right,
 	const wchar_t* left,
 	const wchar_t* up,
@@ -658,13 +1239,29 @@ Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Game::CreateCubemap(
 	// - We need references to the TEXTURES, not SHADER RESOURCE VIEWS!
 	// - Explicitly NOT generating mipmaps, as we don't need them for the sky!
 	// - Order matters here! +X, -X, +Y, -Y, +Z, -Z
+	ResourceHandle faces[6] = {
+		resources->LoadTexture(right, false),
+		resources->LoadTexture(left, false),
+		resources->LoadTexture(up, false),
+		resources->LoadTexture(down, false),
+		resources->LoadTexture(front, false),
+		resources->LoadTexture(back, false) };
+
+	unsigned long long hash = ResourceCache::HashBytes(0, 0);
+	for (int i = 0; i < 6; i++)
+	{
+		if (!faces[i])
+			return ResourceHandle();
+		hash = ResourceCache::HashBytes(faces[i]->Key.data(), faces[i]->Key.size(), hash);
+	}
+	std::string cubeKey = ResourceCache::HashToKey("cubemap:", hash);
+	ResourceHandle existing = resources->Find(cubeKey);
+	if (existing)
+		return existing;
+
 	Microsoft::WRL::ComPtr<ID3D11Texture2D> textures[6] = {};
-	CreateWICTextureFromFile(device.Get(), right, (ID3D11Resource**)textures[0].GetAddressOf(), 0);
-	CreateWICTextureFromFile(device.Get(), left, (ID3D11Resource**)textures[1].GetAddressOf(), 0);
-	CreateWICTextureFromFile(device.Get(), up, (ID3D11Resource**)textures[2].GetAddressOf(), 0);
-	CreateWICTextureFromFile(device.Get(), down, (ID3D11Resource**)textures[3].GetAddressOf(), 0);
-	CreateWICTextureFromFile(device.Get(), front, (ID3D11Resource**)textures[4].GetAddressOf(), 0);
-	CreateWICTextureFromFile(device.Get(), back, (ID3D11Resource**)textures[5].GetAddressOf(), 0);
+	for (int i = 0; i < 6; i++)
+		textures[i] = faces[i]->Texture;
 	// We'll assume all of the textures are the same color format and resolution,
 	// so get the description of the first texture
 	D3D11_TEXTURE2D_DESC faceDesc = {};
@@ -716,8 +1313,9 @@ Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Game::CreateCubemap(
 	// Make the SRV
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cubeSRV;
 	device->CreateShaderResourceView(cubeMapTexture.Get(), &srvDesc, cubeSRV.GetAddressOf());
-	// Send back the SRV, which is what we need for our shaders
-	return cubeSRV;
+	// Send back the cube map, whose SRV is what we need for our shaders
+	// - The faces unload once their handles go out of scope here
+	return resources->AddTexture(cubeKey, RESOURCE_TYPE_CUBEMAP, cubeMapTexture, cubeSRV);
 }
 
 // --------------------------------------------------------
@@ -725,15 +1323,93 @@ Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Game::CreateCubemap(
 // --------------------------------------------------------
 void Game::Draw(float deltaTime, float totalTime)
 {
+	// Keep last frame's upload totals for the UI, then count this one's
+	constantBufferBytes = ISimpleShader::UploadedBytes;
+	constantBufferUploads = ISimpleShader::UploadCount;
+	constantBufferSkips = ISimpleShader::SkippedUploadCount;
+	ISimpleShader::ResetUploadStats();
+
+	// Same for the state cache.  Everything it remembers is forgotten,
+	// since plenty touches the context directly between frames: ImGui,
+	// the IBL bake, the SRV unbinds after Present.
+	for (int i = 0; i < PIPELINE_CALL_COUNT; i++)
+	{
+		stateSubmitted[i] = stateCache.GetSubmittedCount((PIPELINE_CALL)i);
+		stateFiltered[i] = stateCache.GetFilteredCount((PIPELINE_CALL)i);
+	}
+	stateCache.ResetCounts();
+	stateCache.Invalidate();
+	stateCache.SetFiltering(filterState);
+
+	// Rebuild everything that moved this frame in one go, then
+	// flatten the scene into the draw packets both passes use
+	auto extractStart = std::chrono::high_resolution_clock::now();
+	transforms->UpdateMatrices();
+	spatialIndex.Update(*transforms);
+	renderList.Extract(*registry, meshPool, materialPool, cameras[currentCameraIndex]->GetViewMatrix(), sortDraws);
+	auto extractEnd = std::chrono::high_resolution_clock::now();
+	extractMilliseconds = std::chrono::duration<float, std::milli>(extractEnd - extractStart).count();
+
+	// Both passes skip whatever's outside their own frustum
+	if (cullDraws)
+	{
+		XMFLOAT4X4 lightViewProjection;
+		XMStoreFloat4x4(&lightViewProjection, XMLoadFloat4x4(&shadowViewMatrix) * XMLoadFloat4x4(&shadowProjectionMatrix));
+		renderList.Cull(cameras[currentCameraIndex]->GetFrustum(), FrustumCuller::ExtractFrustum(lightViewProjection));
+	}
+
+	// Then the camera pass skips whatever's behind the occluders
+	if (occlusionCulling)
+	{
+		XMFLOAT4X4 view = cameras[currentCameraIndex]->GetViewMatrix();
+		XMFLOAT4X4 projection = cameras[currentCameraIndex]->GetProjectionMatrix();
+		XMFLOAT4X4 cameraViewProjection;
+		XMStoreFloat4x4(&cameraViewProjection, XMLoadFloat4x4(&view) * XMLoadFloat4x4(&projection));
+
+		occlusionCuller.BeginFrame(cameraViewProjection);
+		registry->ForEach<TransformHandle, Occluder>([&](Entity, TransformHandle& transform, Occluder& occluder)
+			{
+				Mesh* mesh = meshPool.Get(occluder.OcclusionMesh);
+				if (!mesh)
+					return;
+
+				const std::vector<XMFLOAT3>& positions = mesh->GetPositions();
+				const std::vector<unsigned int>& indices = mesh->GetIndices();
+				occlusionCuller.AddOccluder(positions.data(), (unsigned int)positions.size(),
+					indices.data(), (unsigned int)indices.size(), transform.GetWorldMatrix());
+			});
+		occlusionCuller.Rasterize();
+		renderList.CullOccluded(occlusionCuller);
+	}
+	const std::vector<DrawPacket>& packets = renderList.GetPackets();
+	const std::vector<unsigned char>& cameraVisible = renderList.GetCameraVisibility();
+	const std::vector<unsigned char>& shadowVisible = renderList.GetShadowVisibility();
+
+	// Shadows only matter when the light casting them is lit at all
+	bool shadowsActive = shadows && activeDirectionalLights > SHADOW_LIGHT_INDEX;
+
+	// Sorting already put matching packets side by side; each run of
+	// them becomes one batch, with its matrices in the instance buffer
+	instances.clear();
+	renderList.BuildBatches(cameraVisible, true, instanceDraws, cameraBatches, instances);
+	if (shadowsActive)
+		renderList.BuildBatches(shadowVisible, false, instanceDraws, shadowBatches, instances);
+	else
+		shadowBatches.clear();
+	if (instanceDraws)
+		UploadInstances();
+	bool ringObjects = UploadObjectConstants();
+	drawCallCount = 0;
+
 	// shadow map stuff
 	context->ClearDepthStencilView(shadowDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
 
-	context->RSSetState(shadowRasterizer.Get());
+	stateCache.SetRasterizerState(shadowRasterizer.Get());
 
 	ID3D11RenderTargetView* nullRTV{};
 	context->OMSetRenderTargets(1, &nullRTV, shadowDSV.Get());
 
-	context->PSSetShader(0, 0, 0);
+	stateCache.SetPixelShader(0);
 
 	D3D11_VIEWPORT viewport = {};
 	viewport.Width = (float)shadowMapResolution;
@@ -741,24 +1417,52 @@ void Game::Draw(float deltaTime, float totalTime)
 	viewport.MaxDepth = 1.0f;
 	context->RSSetViewports(1, &viewport);
 
-	shadowVS->SetShader();
-	shadowVS->SetMatrix4x4("view", shadowViewMatrix);
-	shadowVS->SetMatrix4x4("projection", shadowProjectionMatrix);
+	bool instancedShadows = instanceDraws && shadowVSInstanced->GetPerInstanceCompatible();
+	SimpleVertexShader* shadowShader = instancedShadows ? shadowVSInstanced.get() : shadowVS.get();
+	const VertexShaderHandles& shadowHandles = GetHandles(shadowShader);
+	shadowShader->SetShader();
+	ShadowFrameData shadowFrame = {};
+	shadowFrame.View = shadowViewMatrix;
+	shadowFrame.Projection = shadowProjectionMatrix;
+	shadowShader->SetTypedBuffer(shadowHandles.ShadowFrame, shadowFrame);
+	shadowShader->CopyAllBufferData();
+	bool ringShadows = ringObjects && shadowHandles.ObjectDataSlot >= 0;
 
 	// Loop and draw all entities
-	for (GameEntity entity : gameEntities)
+	auto shadowStart = std::chrono::high_resolution_clock::now();
+	for (const DrawBatch& batch : shadowBatches)
 	{
-		shadowVS->SetMatrix4x4("world", entity.GetTransform()->GetWorldMatrix());
-		shadowVS->SetMatrix4x4("lightView", entity.GetTransform()->GetWorldMatrix());
-		shadowVS->SetMatrix4x4("lightProjection", entity.GetTransform()->GetWorldMatrix());
-
-		// handles map here
-		//shadowVS->SetShaderResourceView("ShadowMap", shadowSRV);
-
-		shadowVS->CopyAllBufferData();
 		// Draw the mesh directly to avoid the entity's material
-		entity.GetMesh().get()->Draw();
+		Mesh* mesh = meshPool.Get(packets[batch.FirstPacket].Mesh);
+		if (instancedShadows)
+		{
+			mesh->DrawInstanced(stateCache, batch.InstanceCount, batch.FirstInstance);
+			drawCallCount++;
+			continue;
+		}
+
+		for (unsigned int i = 0; i < batch.InstanceCount; i++)
+		{
+			unsigned int index = batch.FirstInstance + i;
+			if (ringShadows)
+			{
+				objectConstants.BindVS(stateCache, shadowHandles.ObjectDataSlot, instanceConstantOffsets[index], sizeof(InstanceData));
+			}
+			else
+			{
+				shadowVS->SetTypedBuffer(shadowHandles.Object, instances[index]);
+
+				// handles map here
+				//shadowVS->SetShaderResourceView("ShadowMap", shadowSRV);
+
+				shadowVS->CopyAllBufferData();
+			}
+			mesh->Draw(stateCache);
+			drawCallCount++;
+		}
 	}
+	auto shadowEnd = std::chrono::high_resolution_clock::now();
+	shadowPassMilliseconds = std::chrono::duration<float, std::milli>(shadowEnd - shadowStart).count();
 
 	viewport.Width = (float)this->windowWidth;
 	viewport.Height = (float)this->windowHeight;
@@ -767,7 +1471,7 @@ void Game::Draw(float deltaTime, float totalTime)
 		1,
 		backBufferRTV.GetAddressOf(),
 		depthBufferDSV.Get());
-	context->RSSetState(0);
+	stateCache.SetRasterizerState(0);
 
 	// Frame START
 	// - These things should happen ONCE PER FRAME
@@ -781,50 +1485,206 @@ void Game::Draw(float deltaTime, float totalTime)
 		context->ClearDepthStencilView(depthBufferDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
 	}
 
-	for (GameEntity entity : gameEntities)
+	// Frame scope: the camera, lights and shadow & IBL maps are the
+	// same for every draw, so each shader the materials use gets them
+	// once here.  Only FrameData changes, so only it uploads.
+	bool hasSpecularIBL = iblMaps.Specular && iblMaps.BrdfLookUp;
+	VertexFrameData vertexFrame = {};
+	vertexFrame.View = cameras[currentCameraIndex]->GetViewMatrix();
+	vertexFrame.Projection = cameras[currentCameraIndex]->GetProjectionMatrix();
+	vertexFrame.LightView = shadowViewMatrix;
+	vertexFrame.LightProjection = shadowProjectionMatrix;
+
+	PixelFrameData pixelFrame = {};
+	pixelFrame.CameraPosition = cameras[currentCameraIndex].get()->GetTransform().GetPosition();
+	pixelFrame.SpecularIBLMipLevels = hasSpecularIBL ? (int)iblMaps.SpecularMipLevels : 0;
+	for (size_t i = 0; i < directionalLights.size() && i < MAX_DIRECTIONAL_LIGHTS; i++)
+		pixelFrame.DirectionalLights[i] = directionalLights[i];
+	for (size_t i = 0; i < pointLights.size() && i < MAX_POINT_LIGHTS; i++)
+		pixelFrame.PointLights[i] = pointLights[i];
+
+	auto setFrameData = [&](SimpleVertexShader* vs, SimplePixelShader* ps)
 	{
-		std::shared_ptr<SimpleVertexShader> vs = entity.GetMaterial().get()->GetVertexShader();
-		vs->SetMatrix4x4("world", entity.GetTransform()->GetWorldMatrix());
-		vs->SetMatrix4x4("view", cameras[currentCameraIndex]->GetViewMatrix());
-		vs->SetMatrix4x4("proj", cameras[currentCameraIndex]->GetProjectionMatrix());
-		vs->SetMatrix4x4("worldInvTranspose", entity.GetTransform()->GetWorldInverseTransposeMatrix());
-		vs->SetMatrix4x4("lightView", entity.GetTransform()->GetWorldMatrix());
-		vs->SetMatrix4x4("lightProjection", entity.GetTransform()->GetWorldMatrix());
+		vs->SetTypedBuffer(GetHandles(vs).Frame, vertexFrame);
 
+		const PixelShaderHandles& psHandles = GetHandles(ps);
+		ps->SetTypedBuffer(psHandles.Frame, pixelFrame);
 
-		vs->CopyAllBufferData(); // Adjust vs variable name if necessary
+		// SHADOW MAP
+		ps->SetShaderResourceView("ShadowMap", shadowSRV);
 
-		std::shared_ptr<SimplePixelShader> ps = entity.GetMaterial().get()->GetPixelShader();
-		ps->SetFloat4("colorTint", entity.GetMaterial().get()->GetColorTint());
-		ps->SetFloat("roughness", entity.GetMaterial().get()->GetRoughness());
-		ps->SetFloat3("cameraPosition", cameras[currentCameraIndex].get()->GetTransform().GetPosition());
-		ps->SetData(
-			"directionalLights", // The name of the (eventual) variable in the shader
-			&directionalLights[0], // The address of the data to set
-			sizeof(Light) * (int)directionalLights.size()); // The size of the data (the whole array!) to set
-		ps->SetData(
-			"pointLights", // The name of the (eventual) variable in the shader
-			&pointLights[0], // The address of the data to set
-			sizeof(Light) * (int)pointLights.size()); // The size of the data (the whole array!) to set
-		ps->SetMatrix4x4("lightView", entity.GetTransform()->GetWorldMatrix());
-		ps->SetMatrix4x4("lightProjection", entity.GetTransform()->GetWorldMatrix());
+		// IBL
+		ps->SetData(psHandles.AmbientSH, &iblMaps.AmbientSH, sizeof(SH9Color));
+		if (hasSpecularIBL)
+		{
+			ps->SetShaderResourceView("SpecularIBLMap", iblMaps.Specular->SRV);
+			ps->SetShaderResourceView("BrdfLookUpMap", iblMaps.BrdfLookUp->SRV);
+		}
+	};
 
-		// handles textures here
-		for (auto& t : entity.GetMaterial().get()->GetTextureSRVs()) { ps->SetShaderResourceView(t.first.c_str(), t.second); }
-		for (auto& s : entity.GetMaterial().get()->GetSamplers()) { ps->SetSamplerState(s.first.c_str(), s.second); }
+	// Each permuted pixel shader is swapped for the variant with just
+	// the lights & features that are on; one that fails to compile
+	// leaves the full shader in place
+	pixelVariants.clear();
+	for (auto& permuted : permutedShaders)
+	{
+		ShaderPermutations* permutations = permuted.second.Permutations;
+		unsigned int keywords = permuted.second.Keywords;
+		if (shadowsActive)
+			keywords |= permutations->GetKeyword("SHADOWS");
+		std::shared_ptr<SimplePixelShader> variant = permutations->GetPixelShader(
+			ShaderPermutations::MakeKey(keywords, activeDirectionalLights, activePointLights));
+		pixelVariants[permuted.first] = variant ? variant.get() : permuted.first;
+	}
+	auto getPixelVariant = [&](SimplePixelShader* ps)
+	{
+		auto variant = pixelVariants.find(ps);
+		return variant != pixelVariants.end() ? variant->second : ps;
+	};
 
-		// SHADOW MAP
-		ps->SetShaderResourceView("ShadowMap", shadowSRV);
+	for (MaterialHandle handle : materials)
+	{
+		Material* material = materialPool.Get(handle);
+		SimpleVertexShader* vs = material->GetVertexShader().get();
+		SimplePixelShader* ps = getPixelVariant(material->GetPixelShader().get());
+		setFrameData(vs, ps);
+
+		auto variant = instancedVariants.find(vs);
+		if (variant != instancedVariants.end())
+			setFrameData(variant->second, ps);
+	}
+
+	// Reset the per-frame SRV bind counters
+	srvBindCount = 0;
+	srvChangeCount = 0;
+	ID3D11ShaderResourceView* boundPixelSRVs[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = {};
+
+	// Count how often consecutive draws actually differ
+	shaderChangeCount = 0;
+	materialChangeCount = 0;
+	meshChangeCount = 0;
+	const void* lastShaders[2] = {};
+	MaterialHandle lastMaterial;
+	MeshHandle lastMesh;
+
+	auto drawBatch = [&](const DrawBatch& batch)
+	{
+		const DrawPacket& packet = packets[batch.FirstPacket];
+		Material* material = materialPool.Get(packet.Material);
+		SimpleVertexShader* vs = material->GetVertexShader().get();
+		SimplePixelShader* ps = getPixelVariant(material->GetPixelShader().get());
+
+		// Swap in the instanced twin when there is one; otherwise the
+		// batch still goes out one draw per packet below
+		bool instanced = false;
+		if (instanceDraws)
+		{
+			auto variant = instancedVariants.find(vs);
+			if (variant != instancedVariants.end())
+			{
+				vs = variant->second;
+				instanced = true;
+			}
+		}
+		const VertexShaderHandles& vsHandles = GetHandles(vs);
+
+		// Material scope: only when the material changes.  Its values sit
+		// in the pixel shader's MaterialData until another material's do.
+		if (lastMaterial != packet.Material)
+		{
+			const PixelShaderHandles& psHandles = GetHandles(ps);
+			ps->SetFloat4(psHandles.ColorTint, material->GetColorTint());
+			ps->SetFloat(psHandles.Roughness, material->GetRoughness());
+
+			// handles textures here
+			for (auto& t : material->GetTextures())
+			{
+				// Track how many binds actually change what's in a slot
+				ID3D11ShaderResourceView* srv = t.second->SRV.Get();
+				const SimpleSRV* srvInfo = ps->GetShaderResourceViewInfo(t.first);
+				if (srvInfo && srvInfo->BindIndex < D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT &&
+					boundPixelSRVs[srvInfo->BindIndex] != srv)
+				{
+					boundPixelSRVs[srvInfo->BindIndex] = srv;
+					srvChangeCount++;
+				}
+				srvBindCount++;
+
+				ps->SetShaderResourceView(t.first.c_str(), t.second->SRV);
+			}
+			for (auto& s : material->GetTextureSlices()) { ps->SetInt(s.first, s.second); }
+			for (auto& s : material->GetSamplers()) { ps->SetSamplerState(s.first.c_str(), s.second->Sampler); }
+		}
 		ps->CopyAllBufferData(); // Adjust ps variable name if necessary
 
 
-		entity.GetMaterial().get()->GetVertexShader().get()->SetShader();
-		entity.GetMaterial().get()->GetPixelShader().get()->SetShader();
+		vs->SetShader();
+		ps->SetShader();
+
+		if (lastShaders[0] != vs || lastShaders[1] != ps) shaderChangeCount++;
+		if (lastMaterial != packet.Material) materialChangeCount++;
+		if (lastMesh != packet.Mesh) meshChangeCount++;
+		lastShaders[0] = vs;
+		lastShaders[1] = ps;
+		lastMaterial = packet.Material;
+		lastMesh = packet.Mesh;
 
-		entity.GetMesh().get()->Draw();
+		Mesh* mesh = meshPool.Get(packet.Mesh);
+		vs->CopyAllBufferData();
+		if (instanced)
+		{
+			mesh->DrawInstanced(stateCache, batch.InstanceCount, batch.FirstInstance);
+			drawCallCount++;
+			return;
+		}
+
+		// Object scope: just the world matrices, every draw.  From the
+		// ring they're already on the GPU, and only the offset changes.
+		bool ringDraws = ringObjects && vsHandles.ObjectDataSlot >= 0;
+		for (unsigned int i = 0; i < batch.InstanceCount; i++)
+		{
+			unsigned int index = batch.FirstInstance + i;
+			if (ringDraws)
+			{
+				objectConstants.BindVS(stateCache, vsHandles.ObjectDataSlot, instanceConstantOffsets[index], sizeof(InstanceData));
+			}
+			else
+			{
+				vs->SetTypedBuffer(vsHandles.Object, instances[index]);
+				vs->CopyAllBufferData();
+			}
+			mesh->Draw(stateCache);
+			drawCallCount++;
+		}
+	};
+
+	// Opaque first, then the sky, then transparent things blended over both
+	auto mainStart = std::chrono::high_resolution_clock::now();
+	for (const DrawBatch& batch : cameraBatches)
+	{
+		if (RenderList::GetPass(packets[batch.FirstPacket]) == DRAW_PASS_OPAQUE)
+			drawBatch(batch);
+	}
+
+	skybox.Draw(stateCache, cameras[currentCameraIndex]);
+
+	// The sky binds its own texture & sampler over slot 0, so the
+	// next material has to bind its own again
+	lastMaterial = MaterialHandle();
+	memset(boundPixelSRVs, 0, sizeof(boundPixelSRVs));
+
+	stateCache.SetBlendState(transparentBlendState.Get());
+	stateCache.SetDepthStencilState(transparentDepthState.Get(), 0);
+	for (const DrawBatch& batch : cameraBatches)
+	{
+		if (RenderList::GetPass(packets[batch.FirstPacket]) == DRAW_PASS_TRANSPARENT)
+			drawBatch(batch);
 	}
+	stateCache.SetBlendState(0);
+	stateCache.SetDepthStencilState(0, 0);
+	auto mainEnd = std::chrono::high_resolution_clock::now();
+	mainPassMilliseconds = std::chrono::duration<float, std::milli>(mainEnd - mainStart).count();
 
-	skybox.Draw(context, cameras[currentCameraIndex]);
 	ImGui::Render();
 	ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
 
@@ -9,12 +9,50 @@
 #include "ImGui/imgui_impl_dx11.h"
 #include "ImGui/imgui_impl_win32.h"
 #include <vector>
-#include "GameEntity.h"
+#include <unordered_map>
+#include "EntityRegistry.h"
+#include "TransformSystem.h"
+#include "Components.h"
+#include "RenderList.h"
+#include "SpatialIndex.h"
+#include "StaticBatcher.h"
+#include "ConstantBufferRing.h"
+#include "PipelineStateCache.h"
 #include "Camera.h"
 #include "SimpleShader.h"
 #include "Material.h"
 #include "Lights.h"
 #include "Sky.h"
+#include "TextureArrayPacker.h"
+#include "ResourceCache.h"
+#include "IBLPrefilter.h"
+#include "ShaderPermutations.h"
+#include "DebugPanel.h"
+
+// Variables Draw() sets on every batch, looked up once per shader.
+// Frame & object data go in whole, from the structs in BufferStructs.h.
+struct VertexShaderHandles
+{
+	TypedBufferHandle<VertexFrameData> Frame;
+	TypedBufferHandle<ShadowFrameData> ShadowFrame;	// Only in the shadow shaders
+	TypedBufferHandle<ObjectData> Object;
+	int ObjectDataSlot = -1;				// Register of the ObjectData cbuffer, if there is one
+};
+
+struct PixelShaderHandles
+{
+	TypedBufferHandle<PixelFrameData> Frame;
+	SimpleVariableHandle ColorTint;
+	SimpleVariableHandle Roughness;
+	SimpleVariableHandle AmbientSH;
+};
+
+// A pixel shader that's really one variant of a permuted source
+struct PixelShaderPermutation
+{
+	ShaderPermutations* Permutations;
+	unsigned int Keywords;					// Always on for this shader, like PACKED_PBR
+};
 
 class Game 
 	: public DXCore
@@ -31,20 +69,37 @@ public:
 	void Update(float deltaTime, float totalTime);
 	void Draw(float deltaTime, float totalTime);
 
+	// Bake the sky's IBL maps to disk (ignoring any cached ones) and quit
+	void SetBakeIBLOnly(bool bakeOnly);
+	// Compile every declared shader variant to disk and quit
+	void SetBakeShadersOnly(bool bakeOnly);
+
 private:
 
 	// Initialization helper methods - feel free to customize, combine, remove, etc.
 	void LoadShaders(); 
 	void CreateGeometry();
+	// Makes an entity with a fresh transform that draws this mesh
+	Entity CreateEntity(MeshHandle mesh, MaterialHandle material);
 	void FeedInputsToImGui(float deltaTime);
+	// Hands every self test & benchmark to the debug panel
+	void RegisterDebugChecks();
 	// Helper for creating a cubemap from 6 individual textures
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateCubemap(
+	ResourceHandle CreateCubemap(
 		const wchar_t* right,
 		const wchar_t* left,
 		const wchar_t* up,
 		const wchar_t* down,
 		const wchar_t* front,
 		const wchar_t* back);
+	// Swaps the skybox and everything lit by it over to the sky in this folder
+	void LoadSky(const std::wstring& folder);
+	// Copies this frame's instance data into the instance buffer, growing it if needed
+	void UploadInstances();
+	bool UploadObjectConstants();
+	// A shader's variable handles, looked up the first time it's drawn with
+	const VertexShaderHandles& GetHandles(SimpleVertexShader* shader);
+	const PixelShaderHandles& GetHandles(SimplePixelShader* shader);
 
 	// Note the usage of ComPtr below
 	//  - This is a smart pointer for objects that abide by the
@@ -58,30 +113,113 @@ private:
 	// Shaders and shader-related constructs
 	std::shared_ptr<SimplePixelShader> pixelShader;
 	std::shared_ptr<SimplePixelShader> pixelShaderNormalMapping;
+	std::shared_ptr<SimplePixelShader> pixelShaderPackedPBR;
 	std::shared_ptr<SimplePixelShader> pixelShaderSky;
 	std::shared_ptr<SimplePixelShader> customPixelShader;
 	std::shared_ptr<SimpleVertexShader> vertexShader;
 	std::shared_ptr<SimpleVertexShader> vertexShaderNormalMapping;
 	std::shared_ptr<SimpleVertexShader> vertexShaderSky;
 	std::shared_ptr<SimpleVertexShader> shadowVS;
+	std::shared_ptr<SimpleVertexShader> vertexShaderInstanced;
+	std::shared_ptr<SimpleVertexShader> vertexShaderNormalMappingInstanced;
+	std::shared_ptr<SimpleVertexShader> shadowVSInstanced;
+	// Each vertex shader's per-instance twin, if it has one
+	std::unordered_map<SimpleVertexShader*, SimpleVertexShader*> instancedVariants;
+	std::unordered_map<SimpleVertexShader*, VertexShaderHandles> vertexShaderHandles;
+	std::unordered_map<SimplePixelShader*, PixelShaderHandles> pixelShaderHandles;
+	unsigned long long constantBufferBytes;
+	unsigned int constantBufferUploads;
+	unsigned int constantBufferSkips;
+
+	// Shaders, meshes & the passes bind through this, so repeats of
+	// what's already bound never reach the context
+	PipelineStateCache stateCache;
+	bool filterState;
+	unsigned int stateSubmitted[PIPELINE_CALL_COUNT];
+	unsigned int stateFiltered[PIPELINE_CALL_COUNT];
+
+	// How long LoadShaders() took, reflection tables included
+	float shaderLoadMilliseconds;
+
+	// The lit pixel shaders, rebuilt from source with only the lights
+	// & features in use.  Each frame maps the shaders the materials
+	// ask for to the variant for what's on.
+	std::shared_ptr<ShaderPermutations> pixelShaderPermutations;
+	std::shared_ptr<ShaderPermutations> normalMapPermutations;
+	std::unordered_map<SimplePixelShader*, PixelShaderPermutation> permutedShaders;
+	std::unordered_map<SimplePixelShader*, SimplePixelShader*> pixelVariants;
+	int activeDirectionalLights;
+	int activePointLights;
+	bool shadows;
+	bool bakeShadersOnly;
 
 	Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout;
 	/*std::shared_ptr<Mesh> triangle;
 	std::shared_ptr<Mesh> square;
 	std::shared_ptr<Mesh> diamond;*/
-	std::shared_ptr<Mesh> cube;
-	std::shared_ptr<Mesh> cylinder;
-	std::shared_ptr<Mesh> helix;
-	std::shared_ptr<Mesh> quad;
-	std::shared_ptr<Mesh> quad_double_sided;
-	std::shared_ptr<Mesh> sphere;
-	std::shared_ptr<Mesh> torus;
 
+	// Meshes & materials are owned by these and referred to by handle
+	HandlePool<Mesh> meshPool;
+	HandlePool<Material> materialPool;
+
+	MeshHandle cube;
+	MeshHandle cylinder;
+	MeshHandle helix;
+	MeshHandle quad;
+	MeshHandle quad_double_sided;
+	MeshHandle sphere;
+	MeshHandle torus;
+
+
+	// Every entity's components live in the registry; this is just
+	// the scene's entities in creation order, for the UI
+	std::shared_ptr<EntityRegistry> registry;
+	std::vector<Entity> gameEntities;
+
+	// This frame's draws, pulled out of the registry once
+	RenderList renderList;
+	float extractMilliseconds;
+	float shadowPassMilliseconds;
+	float mainPassMilliseconds;
+	bool sortDraws;
+	unsigned int shaderChangeCount;
+	unsigned int materialChangeCount;
+	unsigned int meshChangeCount;
+	bool cullDraws;
+
+	// Draws tagged occluders on the CPU and hides what's behind them
+	OcclusionCuller occlusionCuller;
+	bool occlusionCulling;
 
-	std::vector<GameEntity> gameEntities;
+	// Runs of packets sharing a mesh (& material) go out as one draw
+	bool instanceDraws;
+	unsigned int drawCallCount;
+	std::vector<InstanceData> instances;
+	std::vector<DrawBatch> cameraBatches;
+	std::vector<DrawBatch> shadowBatches;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> instanceBuffer;
+	unsigned int instanceCapacity;
+	std::vector<Entity> forestEntities;
+
+	// Every instance's ObjectData, written under one Map per frame
+	// and bound by offset instead of updated draw by draw
+	ConstantBufferRing objectConstants;
+	bool ringConstants;
+	std::vector<unsigned int> instanceConstantOffsets;
+
+	// Scenery tagged Static, merged by material & cell
+	StaticBatcher staticBatcher;
+	bool staticBatching;
+
+	// Every entity's world box, for picking & other spatial queries
+	SpatialIndex spatialIndex;
+	Microsoft::WRL::ComPtr<ID3D11BlendState> transparentBlendState;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> transparentDepthState;
+
+	std::shared_ptr<TransformSystem> transforms;
 
 	// Materials
-	std::vector<std::shared_ptr<Material>> materials;
+	std::vector<MaterialHandle> materials;
 
 	// controls to edit screen here:
 	DirectX::XMFLOAT4 color;
@@ -100,13 +238,17 @@ private:
 	std::vector<Light> pointLights;
 
 	// texture stuff
-	std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textureSubresources;
-	std::vector<Microsoft::WRL::ComPtr<ID3D11SamplerState>> samplerStates;
+	std::shared_ptr<ResourceCache> resources;
+	std::vector<PackedTexture> packedTextures;
+	ResourceHandle basicSampler;
+	unsigned int textureArrayCount;
+	unsigned int srvBindCount;
+	unsigned int srvChangeCount;
 
 	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> shadowDSV;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> shadowSRV;
 	Microsoft::WRL::ComPtr<ID3D11RasterizerState> shadowRasterizer;
-	Microsoft::WRL::ComPtr<ID3D11SamplerState> shadowSampler;
+	ResourceHandle shadowSampler;
 	DirectX::XMMATRIX  lightViewMatrix;
 	DirectX::XMMATRIX  lightProjectionMatrix;
 	DirectX::XMFLOAT4X4 shadowViewMatrix;
@@ -115,6 +257,16 @@ private:
 
 
 	// skybox stuff
+	ResourceHandle skyCubemap;
 	Sky skybox;
+	int currentSky;
+
+	// image based lighting, prefiltered from the sky
+	IBLMaps iblMaps;
+	ResourceHandle clampSampler;
+	bool bakeIBLOnly;
+
+	// Self tests & benchmarks, each behind its own button
+	DebugPanel debugPanel;
 };
 
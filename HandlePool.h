@@ -0,0 +1,117 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <utility>
+#include <stdexcept>
+
+// A handle's 32 bits are split between the slot and that slot's generation
+#define HANDLE_INDEX_BITS 20
+#define HANDLE_INDEX_MASK ((1u << HANDLE_INDEX_BITS) - 1)
+#define HANDLE_GENERATION_BITS (32 - HANDLE_INDEX_BITS)
+#define HANDLE_GENERATION_MASK ((1u << HANDLE_GENERATION_BITS) - 1)
+
+// Generation 0 is never handed out, so a zeroed handle is always invalid
+#define HANDLE_INVALID 0
+
+// --------------------------------------------------------
+// 32-bit reference to something in a HandlePool<T>.  Typed so
+// a mesh handle can't be passed where a material one is wanted,
+// and trivially copyable so it costs nothing to pass around.
+// --------------------------------------------------------
+template<typename T>
+struct Handle
+{
+	unsigned int Value;
+
+	Handle() : Value(HANDLE_INVALID) {}
+	explicit Handle(unsigned int value) : Value(value) {}
+
+	unsigned int GetIndex() const { return Value & HANDLE_INDEX_MASK; }
+	unsigned int GetGeneration() const { return Value >> HANDLE_INDEX_BITS; }
+	bool IsNull() const { return Value == HANDLE_INVALID; }
+
+	bool operator==(const Handle& other) const { return Value == other.Value; }
+	bool operator!=(const Handle& other) const { return Value != other.Value; }
+};
+
+// --------------------------------------------------------
+// Owns objects of one type and hands out generational handles
+// to them.  Looking one up is an index plus a generation check,
+// so stale handles are caught instead of pointing at whatever
+// reused the slot, and there's no reference counting at all.
+//
+// Objects are allocated individually, so pointers from Get()
+// stay valid until that object is destroyed.
+// --------------------------------------------------------
+template<typename T>
+class HandlePool
+{
+public:
+	HandlePool() : count(0) {}
+
+	template<typename... Args>
+	Handle<T> Create(Args&&... args)
+	{
+		unsigned int index;
+		if (!freeSlots.empty())
+		{
+			index = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else
+		{
+			if (slots.size() > HANDLE_INDEX_MASK)
+				throw std::length_error("Handle pool is full");
+			index = (unsigned int)slots.size();
+			slots.push_back(Slot{ nullptr, 1 });
+		}
+
+		slots[index].Object.reset(new T(std::forward<Args>(args)...));
+		count++;
+		return Handle<T>((slots[index].Generation << HANDLE_INDEX_BITS) | index);
+	}
+
+	void Destroy(Handle<T> handle)
+	{
+		if (!IsValid(handle))
+			return;
+
+		Slot& slot = slots[handle.GetIndex()];
+		slot.Object.reset();
+
+		// Skip 0 on wrap-around so null handles stay null
+		slot.Generation = (slot.Generation + 1) & HANDLE_GENERATION_MASK;
+		if (slot.Generation == 0)
+			slot.Generation = 1;
+
+		freeSlots.push_back(handle.GetIndex());
+		count--;
+	}
+
+	bool IsValid(Handle<T> handle) const
+	{
+		unsigned int index = handle.GetIndex();
+		return index < slots.size() &&
+			slots[index].Generation == handle.GetGeneration() &&
+			slots[index].Object;
+	}
+
+	// Null for stale or null handles
+	T* Get(Handle<T> handle) const
+	{
+		return IsValid(handle) ? slots[handle.GetIndex()].Object.get() : nullptr;
+	}
+
+	unsigned int GetCount() const { return count; }
+
+private:
+	struct Slot
+	{
+		std::unique_ptr<T> Object;
+		unsigned int Generation;
+	};
+
+	std::vector<Slot> slots;
+	std::vector<unsigned int> freeSlots;
+	unsigned int count;
+};
@@ -0,0 +1,695 @@
+#include "IBLPrefilter.h"
+#include "ParallelFor.h"
+#include "PathHelpers.h"
+#include <fstream>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <string.h>
+
+using namespace DirectX;
+
+namespace
+{
+	const unsigned int CacheMagic = 0x314C4249; // "IBL1"
+
+	struct CacheHeader
+	{
+		unsigned int Magic;
+		unsigned int Version;
+		unsigned long long Key;
+		unsigned int BlobCount;
+	};
+
+	// Van der Corput sequence paired with i/count - a well spread 2D point set
+	XMFLOAT2 Hammersley(unsigned int i, unsigned int count)
+	{
+		unsigned int bits = i;
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return XMFLOAT2((float)i / count, bits * 2.3283064365386963e-10f);
+	}
+
+	std::vector<float> LevelToBlob(const std::vector<XMFLOAT4>& texels)
+	{
+		const float* data = (const float*)texels.data();
+		return std::vector<float>(data, data + texels.size() * 4);
+	}
+
+	bool BlobToLevel(const std::vector<float>& blob, unsigned int& size, std::vector<XMFLOAT4>& texels)
+	{
+		size = (unsigned int)(sqrt(blob.size() / 24.0) + 0.5);
+		if (size == 0 || (size_t)size * size * 24 != blob.size())
+			return false;
+
+		texels.resize(blob.size() / 4);
+		memcpy(texels.data(), blob.data(), blob.size() * sizeof(float));
+		return true;
+	}
+}
+
+IBLPrefilter::IBLPrefilter(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	std::shared_ptr<ResourceCache> resources) :
+	device(device),
+	context(context),
+	resources(resources)
+{
+}
+
+IBLPrefilter::~IBLPrefilter()
+{
+}
+
+// --------------------------------------------------------
+// Gets the ambient SH, specular and BRDF maps for a sky.
+//
+// The maps come from, in order: the resource cache (already on
+// the GPU), the cache files on disk, or a full CPU bake whose
+// results are then written to disk for next time.
+//
+// skyCubemap - the cube built by Game::CreateCubemap()
+// forceBake - ignore the disk cache and bake from scratch
+// --------------------------------------------------------
+IBLMaps IBLPrefilter::LoadOrBake(ResourceHandle skyCubemap, bool forceBake)
+{
+	IBLMaps maps = {};
+	maps.SpecularMipLevels = IBL_SPECULAR_MIP_LEVELS;
+	if (!skyCubemap)
+		return maps;
+
+	// Everything that affects the output goes into the keys
+	const unsigned int settings[] = {
+		IBL_CACHE_VERSION,
+		IBL_SPECULAR_SIZE,
+		IBL_SPECULAR_MIP_LEVELS,
+		IBL_SPECULAR_SAMPLE_COUNT,
+		IBL_BRDF_LOOK_UP_SIZE,
+		IBL_BRDF_SAMPLE_COUNT };
+	unsigned long long settingsHash = ResourceCache::HashBytes(settings, sizeof(settings));
+	unsigned long long skyHash = ResourceCache::HashBytes(skyCubemap->Key.data(), skyCubemap->Key.size(), settingsHash);
+
+	std::string specularKey = ResourceCache::HashToKey("ibl-specular:", skyHash);
+	std::string brdfKey = ResourceCache::HashToKey("ibl-brdf:", settingsHash);
+
+	// Cache files live next to the executable
+	std::wstring skyPath = FixPath(NarrowToWide(ResourceCache::HashToKey("ibl_sky_", skyHash) + ".bin"));
+	std::wstring brdfPath = FixPath(NarrowToWide(ResourceCache::HashToKey("ibl_brdf_", settingsHash) + ".bin"));
+
+	auto start = std::chrono::high_resolution_clock::now();
+	maps.AmbientSH = ProjectAmbient(skyCubemap);
+	auto ambientEnd = std::chrono::high_resolution_clock::now();
+	maps.AmbientMilliseconds = std::chrono::duration<float, std::milli>(ambientEnd - start).count();
+	maps.LoadedFromDisk = true;
+
+	// Specular environment map
+	maps.Specular = resources->Find(specularKey);
+	if (!maps.Specular)
+	{
+		std::vector<CubeLevel> specular(IBL_SPECULAR_MIP_LEVELS);
+
+		// One blob per specular mip
+		std::vector<std::vector<float>> blobs;
+		bool loaded = !forceBake &&
+			LoadCacheFile(skyPath, skyHash, blobs) &&
+			blobs.size() == IBL_SPECULAR_MIP_LEVELS;
+		for (unsigned int mip = 0; loaded && mip < IBL_SPECULAR_MIP_LEVELS; mip++)
+			loaded = BlobToLevel(blobs[mip], specular[mip].Size, specular[mip].Texels);
+
+		if (!loaded)
+		{
+			// Read back at the specular base size, then keep every mip
+			// below it so the convolution can sample pre-filtered data
+			std::vector<CubeLevel> sourceMips(1);
+			if (!ReadBack(skyCubemap, IBL_SPECULAR_SIZE, sourceMips[0]))
+				return maps;
+			while (sourceMips.back().Size > 1)
+			{
+				CubeLevel smaller;
+				Downsample(sourceMips.back(), smaller);
+				sourceMips.push_back(std::move(smaller));
+			}
+
+			// Mip 0 is a mirror, so it's just the source
+			specular[0] = sourceMips[0];
+			for (unsigned int mip = 1; mip < IBL_SPECULAR_MIP_LEVELS; mip++)
+			{
+				specular[mip].Size = (std::max)(sourceMips[0].Size >> mip, 1u);
+				BakeSpecular(sourceMips, (float)mip / (IBL_SPECULAR_MIP_LEVELS - 1), specular[mip]);
+			}
+
+			blobs.clear();
+			for (const CubeLevel& level : specular)
+				blobs.push_back(LevelToBlob(level.Texels));
+			SaveCacheFile(skyPath, skyHash, blobs);
+			maps.LoadedFromDisk = false;
+		}
+
+		maps.Specular = CreateCube(specularKey, specular);
+	}
+
+	// The BRDF table doesn't depend on the sky at all
+	maps.BrdfLookUp = resources->Find(brdfKey);
+	if (!maps.BrdfLookUp)
+	{
+		std::vector<XMFLOAT2> brdf;
+		std::vector<std::vector<float>> blobs;
+		if (!forceBake &&
+			LoadCacheFile(brdfPath, settingsHash, blobs) &&
+			blobs.size() == 1 &&
+			blobs[0].size() == IBL_BRDF_LOOK_UP_SIZE * IBL_BRDF_LOOK_UP_SIZE * 2)
+		{
+			brdf.resize(IBL_BRDF_LOOK_UP_SIZE * IBL_BRDF_LOOK_UP_SIZE);
+			memcpy(brdf.data(), blobs[0].data(), blobs[0].size() * sizeof(float));
+		}
+		else
+		{
+			BakeBrdfLookUp(brdf);
+
+			const float* data = (const float*)brdf.data();
+			blobs.assign(1, std::vector<float>(data, data + brdf.size() * 2));
+			SaveCacheFile(brdfPath, settingsHash, blobs);
+			maps.LoadedFromDisk = false;
+		}
+
+		maps.BrdfLookUp = CreateBrdfLookUp(brdfKey, brdf);
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	maps.BakeMilliseconds = std::chrono::duration<float, std::milli>(end - ambientEnd).count();
+	return maps;
+}
+
+// --------------------------------------------------------
+// Reads back a small copy of the sky and projects it onto
+// spherical harmonics, convolved for diffuse lighting.
+// Quick enough to call again whenever the sky changes.
+// --------------------------------------------------------
+SH9Color IBLPrefilter::ProjectAmbient(ResourceHandle skyCubemap)
+{
+	CubeLevel source;
+	if (!ReadBack(skyCubemap, IBL_AMBIENT_SOURCE_SIZE, source))
+		return SH9Color();
+
+	return SphericalHarmonics::ConvolveCosine(
+		SphericalHarmonics::ProjectCubemap(source.Texels.data(), source.Size));
+}
+
+// --------------------------------------------------------
+// Copies the top mip of a cube back to the CPU as linear
+// floats, box filtering it down to at most maxSize on the way
+// so the full-size sky never has to exist as floats.
+//
+// Only 8-bit RGBA/BGRA is handled, which is all the WIC
+// loader hands us for the sky images.
+// --------------------------------------------------------
+bool IBLPrefilter::ReadBack(ResourceHandle cube, unsigned int maxSize, CubeLevel& level)
+{
+	if (!cube || !cube->Texture)
+		return false;
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	cube->Texture->GetDesc(&desc);
+
+	bool bgra = false;
+	switch (desc.Format)
+	{
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		break;
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8X8_UNORM:
+		bgra = true;
+		break;
+	default:
+		return false;
+	}
+
+	D3D11_TEXTURE2D_DESC stagingDesc = desc;
+	stagingDesc.Usage = D3D11_USAGE_STAGING;
+	stagingDesc.BindFlags = 0;
+	stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	stagingDesc.MiscFlags = 0;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> staging;
+	if (FAILED(device->CreateTexture2D(&stagingDesc, 0, staging.GetAddressOf())))
+		return false;
+	context->CopyResource(staging.Get(), cube->Texture.Get());
+
+	// Map all 6 faces up front so the conversion can run on every core
+	D3D11_MAPPED_SUBRESOURCE mapped[6] = {};
+	for (unsigned int face = 0; face < 6; face++)
+	{
+		if (FAILED(context->Map(staging.Get(), D3D11CalcSubresource(0, face, desc.MipLevels), D3D11_MAP_READ, 0, &mapped[face])))
+		{
+			for (unsigned int mappedFace = 0; mappedFace < face; mappedFace++)
+				context->Unmap(staging.Get(), D3D11CalcSubresource(0, mappedFace, desc.MipLevels));
+			return false;
+		}
+	}
+
+	// The sky is authored in gamma space, same "un-correction" as the shaders
+	float toLinear[256];
+	for (int i = 0; i < 256; i++)
+		toLinear[i] = powf(i / 255.0f, 2.2f);
+
+	unsigned int step = 1;
+	while (desc.Width / step > maxSize && desc.Width / step > 1)
+		step *= 2;
+	unsigned int size = desc.Width / step;
+	float averageScale = 1.0f / (step * step);
+
+	level.Size = size;
+	level.Texels.resize((size_t)size * size * 6);
+
+	ParallelFor((size_t)size * 6, 4, [&](size_t begin, size_t end)
+	{
+		for (size_t faceRow = begin; faceRow < end; faceRow++)
+		{
+			size_t face = faceRow / size;
+			unsigned int y = (unsigned int)(faceRow % size);
+			const unsigned char* faceData = (const unsigned char*)mapped[face].pData;
+
+			for (unsigned int x = 0; x < size; x++)
+			{
+				float red = 0, green = 0, blue = 0;
+				for (unsigned int sy = 0; sy < step; sy++)
+				{
+					const unsigned char* pixel = faceData + (size_t)(y * step + sy) * mapped[face].RowPitch + (size_t)x * step * 4;
+					for (unsigned int sx = 0; sx < step; sx++, pixel += 4)
+					{
+						red += toLinear[pixel[bgra ? 2 : 0]];
+						green += toLinear[pixel[1]];
+						blue += toLinear[pixel[bgra ? 0 : 2]];
+					}
+				}
+
+				level.Texels[faceRow * size + x] = XMFLOAT4(red * averageScale, green * averageScale, blue * averageScale, 1.0f);
+			}
+		}
+	});
+
+	for (unsigned int face = 0; face < 6; face++)
+		context->Unmap(staging.Get(), D3D11CalcSubresource(0, face, desc.MipLevels));
+
+	return true;
+}
+
+// --------------------------------------------------------
+// Halves a cube level with a 2x2 box filter
+// --------------------------------------------------------
+void IBLPrefilter::Downsample(const CubeLevel& source, CubeLevel& result)
+{
+	unsigned int size = (std::max)(source.Size / 2, 1u);
+	unsigned int step = source.Size > 1 ? 2 : 1;
+	result.Size = size;
+	result.Texels.resize((size_t)size * size * 6);
+
+	const XMVECTOR quarter = XMVectorReplicate(1.0f / (step * step));
+	ParallelFor((size_t)size * 6, 16, [&](size_t begin, size_t end)
+	{
+		for (size_t faceRow = begin; faceRow < end; faceRow++)
+		{
+			size_t face = faceRow / size;
+			unsigned int y = (unsigned int)(faceRow % size);
+			const XMFLOAT4* sourceFace = &source.Texels[face * source.Size * source.Size];
+
+			for (unsigned int x = 0; x < size; x++)
+			{
+				XMVECTOR sum = XMVectorZero();
+				for (unsigned int sy = 0; sy < step; sy++)
+					for (unsigned int sx = 0; sx < step; sx++)
+						sum = XMVectorAdd(sum, XMLoadFloat4(&sourceFace[(y * step + sy) * source.Size + x * step + sx]));
+
+				XMStoreFloat4(&result.Texels[faceRow * size + x], XMVectorMultiply(sum, quarter));
+			}
+		}
+	});
+}
+
+// --------------------------------------------------------
+// Prefilters one specular mip with GGX importance sampling,
+// assuming N = V = R as in the split-sum approximation.
+//
+// Samples read from a blurrier source mip the less likely
+// they are, which hides the noise from the low sample count.
+// --------------------------------------------------------
+void IBLPrefilter::BakeSpecular(const std::vector<CubeLevel>& sourceMips, float roughness, CubeLevel& result)
+{
+	// With N = V every texel uses the same sample set, just rotated,
+	// so work out the tangent-space directions & mips once up front
+	float a = roughness * roughness;
+	float a2 = a * a;
+	float texelSolidAngle = 4.0f * XM_PI / (6.0f * sourceMips[0].Size * sourceMips[0].Size);
+
+	std::vector<XMFLOAT4> samples; // xyz = light direction, w = NdotL
+	std::vector<float> sampleMips;
+	for (unsigned int i = 0; i < IBL_SPECULAR_SAMPLE_COUNT; i++)
+	{
+		XMFLOAT2 xi = Hammersley(i, IBL_SPECULAR_SAMPLE_COUNT);
+		float phi = 2.0f * XM_PI * xi.x;
+		float cosTheta = sqrtf((1.0f - xi.y) / (1.0f + (a2 - 1.0f) * xi.y));
+		float sinTheta = sqrtf(1.0f - cosTheta * cosTheta);
+		XMFLOAT3 h(sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta);
+
+		// Reflect V = (0, 0, 1) about H
+		XMFLOAT3 l(2.0f * h.z * h.x, 2.0f * h.z * h.y, 2.0f * h.z * h.z - 1.0f);
+		if (l.z <= 0.0f)
+			continue;
+
+		// pdf = D * NdotH / (4 * VdotH), which is just D / 4 here
+		float denominator = h.z * h.z * (a2 - 1.0f) + 1.0f;
+		float d = a2 / (XM_PI * denominator * denominator);
+		float sampleSolidAngle = 1.0f / (IBL_SPECULAR_SAMPLE_COUNT * d * 0.25f + 0.0001f);
+		float mip = roughness == 0.0f ? 0.0f : 0.5f * log2f(sampleSolidAngle / texelSolidAngle) + 1.0f;
+
+		samples.push_back(XMFLOAT4(l.x, l.y, l.z, l.z));
+		sampleMips.push_back((std::max)(mip, 0.0f));
+	}
+
+	unsigned int size = result.Size;
+	result.Texels.resize((size_t)size * size * 6);
+
+	ParallelFor(result.Texels.size(), 32, [&](size_t begin, size_t end)
+	{
+		for (size_t t = begin; t < end; t++)
+		{
+			unsigned int face = (unsigned int)(t / (size * size));
+			unsigned int y = (unsigned int)((t / size) % size);
+			unsigned int x = (unsigned int)(t % size);
+
+			XMVECTOR normal = TexelDirection(face, x, y, size);
+			XMVECTOR up = fabsf(XMVectorGetZ(normal)) < 0.999f ? XMVectorSet(0, 0, 1, 0) : XMVectorSet(1, 0, 0, 0);
+			XMVECTOR tangentX = XMVector3Normalize(XMVector3Cross(up, normal));
+			XMVECTOR tangentY = XMVector3Cross(normal, tangentX);
+
+			XMVECTOR sum = XMVectorZero();
+			float totalWeight = 0.0f;
+			for (size_t s = 0; s < samples.size(); s++)
+			{
+				const XMFLOAT4& sample = samples[s];
+				XMVECTOR dir = XMVectorScale(tangentX, sample.x);
+				dir = XMVectorMultiplyAdd(tangentY, XMVectorReplicate(sample.y), dir);
+				dir = XMVectorMultiplyAdd(normal, XMVectorReplicate(sample.z), dir);
+
+				sum = XMVectorMultiplyAdd(SampleCube(sourceMips, dir, sampleMips[s]), XMVectorReplicate(sample.w), sum);
+				totalWeight += sample.w;
+			}
+
+			XMStoreFloat4(&result.Texels[t], XMVectorSetW(XMVectorScale(sum, 1.0f / (std::max)(totalWeight, 0.0001f)), 1.0f));
+		}
+	});
+}
+
+// --------------------------------------------------------
+// Integrates the split-sum BRDF scale (x) and bias (y) for
+// NdotV across and roughness down.  Runs 4 samples at a time.
+//
+// Uses the IBL remap of k = a / 2 for the geometry term,
+// rather than the (r + 1)^2 / 8 used for analytic lights.
+// --------------------------------------------------------
+void IBLPrefilter::BakeBrdfLookUp(std::vector<XMFLOAT2>& result)
+{
+	// phi only depends on the sample index, so its sin & cos can be shared
+	const unsigned int count = (IBL_BRDF_SAMPLE_COUNT + 3) & ~3u;
+	std::vector<float> cosPhi(count), sinPhi(count), xiY(count), valid(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		XMFLOAT2 xi = Hammersley(i, IBL_BRDF_SAMPLE_COUNT);
+		cosPhi[i] = cosf(2.0f * XM_PI * xi.x);
+		sinPhi[i] = sinf(2.0f * XM_PI * xi.x);
+		xiY[i] = xi.y;
+		valid[i] = i < IBL_BRDF_SAMPLE_COUNT ? 1.0f : 0.0f;
+	}
+
+	const unsigned int size = IBL_BRDF_LOOK_UP_SIZE;
+	result.resize(size * size);
+
+	ParallelFor(size, 4, [&](size_t begin, size_t end)
+	{
+		const XMVECTOR zero = XMVectorZero();
+		const XMVECTOR one = XMVectorSplatOne();
+		const XMVECTOR two = XMVectorReplicate(2.0f);
+
+		for (size_t y = begin; y < end; y++)
+		{
+			float roughness = (y + 0.5f) / size;
+			float a = roughness * roughness;
+			XMVECTOR a2MinusOne = XMVectorReplicate(a * a - 1.0f);
+			XMVECTOR k = XMVectorReplicate(a * 0.5f);
+			XMVECTOR oneMinusK = XMVectorSubtract(one, k);
+
+			for (unsigned int x = 0; x < size; x++)
+			{
+				float nDotV = (x + 0.5f) / size;
+				XMVECTOR vx = XMVectorReplicate(sqrtf(1.0f - nDotV * nDotV));
+				XMVECTOR vz = XMVectorReplicate(nDotV);
+				XMVECTOR gV = XMVectorDivide(vz, XMVectorMultiplyAdd(vz, oneMinusK, k));
+
+				XMVECTOR sumA = zero;
+				XMVECTOR sumB = zero;
+				for (unsigned int i = 0; i < count; i += 4)
+				{
+					// GGX half vector - only x & z matter since V has no y
+					XMVECTOR u = XMLoadFloat4((const XMFLOAT4*)&xiY[i]);
+					XMVECTOR cosTheta = XMVectorSqrt(XMVectorDivide(XMVectorSubtract(one, u), XMVectorMultiplyAdd(a2MinusOne, u, one)));
+					XMVECTOR sinTheta = XMVectorSqrt(XMVectorMax(XMVectorNegativeMultiplySubtract(cosTheta, cosTheta, one), zero));
+					XMVECTOR hx = XMVectorMultiply(sinTheta, XMLoadFloat4((const XMFLOAT4*)&cosPhi[i]));
+					XMVECTOR hz = cosTheta;
+
+					XMVECTOR vDotH = XMVectorMultiplyAdd(vx, hx, XMVectorMultiply(vz, hz));
+					XMVECTOR nDotL = XMVectorSubtract(XMVectorMultiply(XMVectorMultiply(two, vDotH), hz), vz);
+					XMVECTOR mask = XMVectorAndInt(XMVectorGreater(nDotL, zero), XMVectorGreater(XMLoadFloat4((const XMFLOAT4*)&valid[i]), zero));
+					nDotL = XMVectorMax(nDotL, zero);
+					vDotH = XMVectorMax(vDotH, zero);
+
+					XMVECTOR gL = XMVectorDivide(nDotL, XMVectorMultiplyAdd(nDotL, oneMinusK, k));
+					XMVECTOR gVis = XMVectorDivide(XMVectorMultiply(XMVectorMultiply(gV, gL), vDotH), XMVectorMultiply(hz, vz));
+
+					XMVECTOR oneMinusVDotH = XMVectorSubtract(one, vDotH);
+					XMVECTOR squared = XMVectorMultiply(oneMinusVDotH, oneMinusVDotH);
+					XMVECTOR fresnel = XMVectorMultiply(XMVectorMultiply(squared, squared), oneMinusVDotH);
+
+					sumA = XMVectorAdd(sumA, XMVectorSelect(zero, XMVectorMultiply(XMVectorSubtract(one, fresnel), gVis), mask));
+					sumB = XMVectorAdd(sumB, XMVectorSelect(zero, XMVectorMultiply(fresnel, gVis), mask));
+				}
+
+				result[y * size + x] = XMFLOAT2(
+					XMVectorGetX(XMVector4Dot(sumA, one)) / IBL_BRDF_SAMPLE_COUNT,
+					XMVectorGetX(XMVector4Dot(sumB, one)) / IBL_BRDF_SAMPLE_COUNT);
+			}
+		}
+	});
+}
+
+// --------------------------------------------------------
+// Direction through the center of a cube texel, following
+// D3D's face order (+X, -X, +Y, -Y, +Z, -Z)
+// --------------------------------------------------------
+XMVECTOR IBLPrefilter::TexelDirection(unsigned int face, unsigned int x, unsigned int y, unsigned int size)
+{
+	float u = 2.0f * (x + 0.5f) / size - 1.0f;
+	float v = 2.0f * (y + 0.5f) / size - 1.0f;
+
+	XMVECTOR dir;
+	switch (face)
+	{
+	case 0: dir = XMVectorSet(1, -v, -u, 0); break;
+	case 1: dir = XMVectorSet(-1, -v, u, 0); break;
+	case 2: dir = XMVectorSet(u, 1, v, 0); break;
+	case 3: dir = XMVectorSet(u, -1, -v, 0); break;
+	case 4: dir = XMVectorSet(u, -v, 1, 0); break;
+	default: dir = XMVectorSet(-u, -v, -1, 0); break;
+	}
+	return XMVector3Normalize(dir);
+}
+
+// --------------------------------------------------------
+// Trilinear lookup into a CPU cube mip chain.  Filtering
+// stops at face edges, which is invisible at these sizes.
+// --------------------------------------------------------
+XMVECTOR IBLPrefilter::SampleCube(const std::vector<CubeLevel>& mips, FXMVECTOR direction, float lod)
+{
+	XMFLOAT3 d;
+	XMStoreFloat3(&d, direction);
+	float ax = fabsf(d.x);
+	float ay = fabsf(d.y);
+	float az = fabsf(d.z);
+
+	unsigned int face;
+	float u, v;
+	if (ax >= ay && ax >= az)
+	{
+		face = d.x > 0 ? 0 : 1;
+		u = (d.x > 0 ? -d.z : d.z) / ax;
+		v = -d.y / ax;
+	}
+	else if (ay >= az)
+	{
+		face = d.y > 0 ? 2 : 3;
+		u = d.x / ay;
+		v = (d.y > 0 ? d.z : -d.z) / ay;
+	}
+	else
+	{
+		face = d.z > 0 ? 4 : 5;
+		u = (d.z > 0 ? d.x : -d.x) / az;
+		v = -d.y / az;
+	}
+
+	lod = (std::min)((std::max)(lod, 0.0f), (float)(mips.size() - 1));
+	unsigned int mip0 = (unsigned int)lod;
+	unsigned int mip1 = (std::min)(mip0 + 1, (unsigned int)mips.size() - 1);
+
+	XMVECTOR colors[2];
+	unsigned int levels[2] = { mip0, mip1 };
+	for (int l = 0; l < 2; l++)
+	{
+		const CubeLevel& level = mips[levels[l]];
+		float maxCoord = (float)(level.Size - 1);
+		float fx = (std::min)((std::max)((u * 0.5f + 0.5f) * level.Size - 0.5f, 0.0f), maxCoord);
+		float fy = (std::min)((std::max)((v * 0.5f + 0.5f) * level.Size - 0.5f, 0.0f), maxCoord);
+		unsigned int x0 = (unsigned int)fx;
+		unsigned int y0 = (unsigned int)fy;
+		unsigned int x1 = (std::min)(x0 + 1, level.Size - 1);
+		unsigned int y1 = (std::min)(y0 + 1, level.Size - 1);
+
+		const XMFLOAT4* texels = &level.Texels[(size_t)face * level.Size * level.Size];
+		XMVECTOR top = XMVectorLerp(XMLoadFloat4(&texels[y0 * level.Size + x0]), XMLoadFloat4(&texels[y0 * level.Size + x1]), fx - x0);
+		XMVECTOR bottom = XMVectorLerp(XMLoadFloat4(&texels[y1 * level.Size + x0]), XMLoadFloat4(&texels[y1 * level.Size + x1]), fx - x0);
+		colors[l] = XMVectorLerp(top, bottom, fy - y0);
+	}
+
+	return XMVectorLerp(colors[0], colors[1], lod - mip0);
+}
+
+bool IBLPrefilter::LoadCacheFile(const std::wstring& path, unsigned long long key, std::vector<std::vector<float>>& blobs)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	CacheHeader header = {};
+	file.read((char*)&header, sizeof(CacheHeader));
+	if (!file || header.Magic != CacheMagic || header.Version != IBL_CACHE_VERSION || header.Key != key)
+		return false;
+
+	blobs.resize(header.BlobCount);
+	for (std::vector<float>& blob : blobs)
+	{
+		unsigned long long floatCount = 0;
+		file.read((char*)&floatCount, sizeof(floatCount));
+		if (!file || floatCount > (1ull << 28))
+			return false;
+
+		blob.resize((size_t)floatCount);
+		file.read((char*)blob.data(), blob.size() * sizeof(float));
+		if (!file)
+			return false;
+	}
+	return true;
+}
+
+bool IBLPrefilter::SaveCacheFile(const std::wstring& path, unsigned long long key, const std::vector<std::vector<float>>& blobs)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	CacheHeader header = {};
+	header.Magic = CacheMagic;
+	header.Version = IBL_CACHE_VERSION;
+	header.Key = key;
+	header.BlobCount = (unsigned int)blobs.size();
+	file.write((const char*)&header, sizeof(CacheHeader));
+
+	for (const std::vector<float>& blob : blobs)
+	{
+		unsigned long long floatCount = blob.size();
+		file.write((const char*)&floatCount, sizeof(floatCount));
+		file.write((const char*)blob.data(), blob.size() * sizeof(float));
+	}
+	return (bool)file;
+}
+
+// --------------------------------------------------------
+// Uploads a float cube (with however many mips it has) and
+// registers it with the resource cache
+// --------------------------------------------------------
+ResourceHandle IBLPrefilter::CreateCube(std::string key, const std::vector<CubeLevel>& levels)
+{
+	D3D11_TEXTURE2D_DESC cubeDesc = {};
+	cubeDesc.Width = levels[0].Size;
+	cubeDesc.Height = levels[0].Size;
+	cubeDesc.MipLevels = (UINT)levels.size();
+	cubeDesc.ArraySize = 6;
+	cubeDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	cubeDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	cubeDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+	cubeDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	cubeDesc.SampleDesc.Count = 1;
+
+	std::vector<D3D11_SUBRESOURCE_DATA> initialData(6 * levels.size());
+	for (UINT face = 0; face < 6; face++)
+	{
+		for (UINT mip = 0; mip < cubeDesc.MipLevels; mip++)
+		{
+			D3D11_SUBRESOURCE_DATA& data = initialData[D3D11CalcSubresource(mip, face, cubeDesc.MipLevels)];
+			data.pSysMem = &levels[mip].Texels[(size_t)face * levels[mip].Size * levels[mip].Size];
+			data.SysMemPitch = levels[mip].Size * sizeof(XMFLOAT4);
+			data.SysMemSlicePitch = 0;
+		}
+	}
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> cubeTexture;
+	if (FAILED(device->CreateTexture2D(&cubeDesc, initialData.data(), cubeTexture.GetAddressOf())))
+		return ResourceHandle();
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = cubeDesc.Format;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+	srvDesc.TextureCube.MostDetailedMip = 0;
+	srvDesc.TextureCube.MipLevels = cubeDesc.MipLevels;
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cubeSRV;
+	device->CreateShaderResourceView(cubeTexture.Get(), &srvDesc, cubeSRV.GetAddressOf());
+
+	return resources->AddTexture(key, RESOURCE_TYPE_CUBEMAP, cubeTexture, cubeSRV);
+}
+
+ResourceHandle IBLPrefilter::CreateBrdfLookUp(std::string key, const std::vector<XMFLOAT2>& texels)
+{
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = IBL_BRDF_LOOK_UP_SIZE;
+	desc.Height = IBL_BRDF_LOOK_UP_SIZE;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R32G32_FLOAT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.SampleDesc.Count = 1;
+
+	D3D11_SUBRESOURCE_DATA initialData = {};
+	initialData.pSysMem = texels.data();
+	initialData.SysMemPitch = IBL_BRDF_LOOK_UP_SIZE * sizeof(XMFLOAT2);
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	if (FAILED(device->CreateTexture2D(&desc, &initialData, texture.GetAddressOf())))
+		return ResourceHandle();
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = desc.Format;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvDesc.Texture2D.MipLevels = 1;
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	device->CreateShaderResourceView(texture.Get(), &srvDesc, srv.GetAddressOf());
+
+	return resources->AddTexture(key, RESOURCE_TYPE_TEXTURE, texture, srv);
+}
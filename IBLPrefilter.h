@@ -0,0 +1,96 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include "ResourceCache.h"
+#include "SphericalHarmonics.h"
+
+// Output sizes & quality - changing any of these changes the cache key
+#define IBL_SPECULAR_SIZE 128
+#define IBL_SPECULAR_MIP_LEVELS 6
+#define IBL_SPECULAR_SAMPLE_COUNT 256
+#define IBL_BRDF_LOOK_UP_SIZE 256
+#define IBL_BRDF_SAMPLE_COUNT 512
+
+// Ambient SH only needs a tiny copy of the sky
+#define IBL_AMBIENT_SOURCE_SIZE 64
+
+// Bump whenever the bake itself changes so old cache files are ignored
+#define IBL_CACHE_VERSION 2
+
+// --------------------------------------------------------
+// The prefiltered environment maps for one sky
+// --------------------------------------------------------
+struct IBLMaps
+{
+	SH9Color AmbientSH;			// Diffuse ambient, already divided by pi
+	ResourceHandle Specular;	// GGX-prefiltered cube, roughness goes up one mip at a time
+	ResourceHandle BrdfLookUp;	// Split-sum scale & bias, indexed by (NdotV, roughness)
+	unsigned int SpecularMipLevels;
+	bool LoadedFromDisk;
+	float BakeMilliseconds;
+	float AmbientMilliseconds;
+};
+
+// --------------------------------------------------------
+// Bakes image-based lighting out of a sky cubemap on the CPU.
+//
+// The sky is read back once, then convolved into a GGX specular
+// mip chain, plus the BRDF look-up table used by the split-sum
+// approximation.  Everything is spread across all cores and
+// vectorized with DirectXMath.
+//
+// Results are written to disk next to the executable, keyed by
+// the sky's contents, so later runs just load the floats back.
+//
+// Diffuse ambient is projected into spherical harmonics instead,
+// which is cheap enough to just redo every time.
+// --------------------------------------------------------
+class IBLPrefilter
+{
+public:
+	IBLPrefilter(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::shared_ptr<ResourceCache> resources);
+	~IBLPrefilter();
+
+	// Loads the maps for this sky from disk, baking & saving them first if needed
+	IBLMaps LoadOrBake(ResourceHandle skyCubemap, bool forceBake = false);
+
+	// Projects the sky into 9 SH coefficients of diffuse ambient light
+	SH9Color ProjectAmbient(ResourceHandle skyCubemap);
+
+private:
+	// One mip of a cube: 6 faces of Size x Size texels, one face after another
+	struct CubeLevel
+	{
+		unsigned int Size;
+		std::vector<DirectX::XMFLOAT4> Texels;
+	};
+
+	bool ReadBack(ResourceHandle cube, unsigned int maxSize, CubeLevel& level);
+
+	// CPU side of the bake - none of these touch D3D
+	static void Downsample(const CubeLevel& source, CubeLevel& result);
+	static void BakeSpecular(const std::vector<CubeLevel>& sourceMips, float roughness, CubeLevel& result);
+	static void BakeBrdfLookUp(std::vector<DirectX::XMFLOAT2>& result);
+
+	// Cube addressing helpers
+	static DirectX::XMVECTOR TexelDirection(unsigned int face, unsigned int x, unsigned int y, unsigned int size);
+	static DirectX::XMVECTOR SampleCube(const std::vector<CubeLevel>& mips, DirectX::FXMVECTOR direction, float lod);
+
+	// Disk cache - a flat list of float blobs behind a small header
+	static bool LoadCacheFile(const std::wstring& path, unsigned long long key, std::vector<std::vector<float>>& blobs);
+	static bool SaveCacheFile(const std::wstring& path, unsigned long long key, const std::vector<std::vector<float>>& blobs);
+
+	ResourceHandle CreateCube(std::string key, const std::vector<CubeLevel>& levels);
+	ResourceHandle CreateBrdfLookUp(std::string key, const std::vector<DirectX::XMFLOAT2>& texels);
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::shared_ptr<ResourceCache> resources;
+};
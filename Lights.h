@@ -5,6 +5,11 @@
 #define LIGHT_TYPE_POINT 1
 #define LIGHT_TYPE_SPOT 2
 
+// Same as NewInclude.hlsli - the shaders' light arrays are this big
+#define MAX_DIRECTIONAL_LIGHTS 3
+#define MAX_POINT_LIGHTS 2
+#define SHADOW_LIGHT_INDEX 2
+
 
 struct Light
 {
@@ -1,5 +1,6 @@
 
 #include <Windows.h>
+#include <string.h>
 #include "Game.h"
 
 // --------------------------------------------------------
@@ -22,6 +23,14 @@ int WINAPI WinMain(
 	// the app handle we got from WinMain
 	Game dxGame(hInstance);
 
+	// "-bakeibl" bakes the IBL cache files ahead of time and exits
+	if (lpCmdLine && strstr(lpCmdLine, "-bakeibl"))
+		dxGame.SetBakeIBLOnly(true);
+
+	// "-bakeshaders" does the same for every declared shader variant
+	if (lpCmdLine && strstr(lpCmdLine, "-bakeshaders"))
+		dxGame.SetBakeShadersOnly(true);
+
 	// Result variable for function calls below
 	HRESULT hr = S_OK;
 
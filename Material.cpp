@@ -9,6 +9,7 @@ Material::Material(
     :
     colorTint(colorTint),
     roughness(roughness),
+    transparent(false),
     pixelShader(pixelShader),
     vertexShader(vertexShader)
 {
@@ -23,31 +24,41 @@ DirectX::XMFLOAT4 Material::GetColorTint()
     return colorTint;
 }
 
-std::shared_ptr<SimplePixelShader> Material::GetPixelShader()
+const std::shared_ptr<SimplePixelShader>& Material::GetPixelShader()
 {
     return pixelShader;
 }
 
-std::shared_ptr<SimpleVertexShader> Material::GetVertexShader()
+const std::shared_ptr<SimpleVertexShader>& Material::GetVertexShader()
 {
     return vertexShader;
 }
 
+bool Material::IsTransparent()
+{
+    return transparent;
+}
+
 float Material::GetRoughness()
 {
     return roughness;
 }
 
-std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> Material::GetTextureSRVs()
+const std::unordered_map<std::string, ResourceHandle>& Material::GetTextures()
 {
-    return textureSRVs;
+    return textures;
 }
 
-std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11SamplerState>> Material::GetSamplers()
+const std::unordered_map<std::string, ResourceHandle>& Material::GetSamplers()
 {
     return samplers;
 }
 
+const std::unordered_map<std::string, unsigned int>& Material::GetTextureSlices()
+{
+    return textureSlices;
+}
+
 DirectX::XMFLOAT4 Material::SetColorTint()
 {
     return colorTint;
@@ -63,18 +74,27 @@ void Material::SetVertexShader(std::shared_ptr<SimpleVertexShader> vertexShader)
     this->vertexShader = vertexShader;
 }
 
+void Material::SetTransparent(bool transparent)
+{
+    this->transparent = transparent;
+}
+
 void Material::SetRoughness(float roughness)
 {
     this->roughness = roughness;
 }
 
-void Material::AddTextureSRV(std::string subresourceShaderName, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> textureSRV)
+void Material::AddTexture(std::string textureShaderName, ResourceHandle texture)
 {
-    textureSRVs.insert({ subresourceShaderName, textureSRV });
+    textures.insert({ textureShaderName, texture });
 }
 
-void Material::AddTextureSR(std::string samplerShaderName, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler)
+void Material::AddSampler(std::string samplerShaderName, ResourceHandle sampler)
 {
     samplers.insert({ samplerShaderName, sampler });
 }
 
+void Material::AddTextureSlice(std::string sliceShaderName, unsigned int slice)
+{
+    textureSlices.insert({ sliceShaderName, slice });
+}
@@ -2,6 +2,8 @@
 #include <DirectXMath.h>
 #include <memory>
 #include "SimpleShader.h"
+#include "HandlePool.h"
+#include "ResourceCache.h"
 
 
 class Material
@@ -16,28 +18,42 @@ public:
 	~Material();
 
 
+	// References, so reading these in the draw loop doesn't copy
+	// maps or touch any reference counts
 	DirectX::XMFLOAT4 GetColorTint();
-	std::shared_ptr<SimplePixelShader> GetPixelShader();
-	std::shared_ptr<SimpleVertexShader> GetVertexShader();
+	const std::shared_ptr<SimplePixelShader>& GetPixelShader();
+	const std::shared_ptr<SimpleVertexShader>& GetVertexShader();
 	float GetRoughness();
-	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> GetTextureSRVs();
-	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11SamplerState>> GetSamplers();
+	const std::unordered_map<std::string, ResourceHandle>& GetTextures();
+	const std::unordered_map<std::string, ResourceHandle>& GetSamplers();
+	const std::unordered_map<std::string, unsigned int>& GetTextureSlices();
+	bool IsTransparent();
 
 	DirectX::XMFLOAT4 SetColorTint();
 	void SetPixelShader(std::shared_ptr<SimplePixelShader> pixelShader);
 	void SetVertexShader(std::shared_ptr<SimpleVertexShader> vertexShader);
 	void SetRoughness(float roughness);
-	void AddTextureSRV(std::string subresourceShaderName, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> textureSRV);
-	void AddTextureSR(std::string samplerShaderName, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler);
+	// Holding the cache's handles keeps the textures & samplers loaded
+	// for as long as the material is around
+	void AddTexture(std::string textureShaderName, ResourceHandle texture);
+	void AddSampler(std::string samplerShaderName, ResourceHandle sampler);
+	void AddTextureSlice(std::string sliceShaderName, unsigned int slice);
+	// Transparent materials are alpha blended and drawn back to front after everything else
+	void SetTransparent(bool transparent);
 
 private:
 	DirectX::XMFLOAT4 colorTint;
 	float roughness;
+	bool transparent;
 	std::shared_ptr<SimplePixelShader> pixelShader;
 	std::shared_ptr<SimpleVertexShader> vertexShader;
 	// mappings from shader-side strings to C++ values
-	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textureSRVs;
-	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11SamplerState>> samplers;
+	std::unordered_map<std::string, ResourceHandle> textures;
+	std::unordered_map<std::string, ResourceHandle> samplers;
+	// which slice of a packed texture array each texture lives in
+	std::unordered_map<std::string, unsigned int> textureSlices;
 
 };
 
+typedef Handle<Material> MaterialHandle;
+
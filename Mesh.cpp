@@ -2,6 +2,8 @@
 #include <fstream>
 #include <vector>
 #include <DirectXMath.h>
+#include <algorithm>
+#include <cmath>
 
 using namespace DirectX;
 
@@ -349,20 +351,16 @@ int Mesh::GetIndexCount() {
 	return indicesCount;
 }
 
-void Mesh::Draw() {
+void Mesh::Draw(PipelineStateCache& stateCache) {
 	// DRAW geometry
 	// - These steps are generally repeated for EACH object you draw
 	// - Other Direct3D calls will also be necessary to do more complex things
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
 	{
 		// Set buffers in the input assembler (IA) stage
 		//  - Do this ONCE PER OBJECT, since each object may have different geometry
-		//  - For this demo, this step *could* simply be done once during Init()
-		//  - However, this needs to be done between EACH DrawIndexed() call
-		//     when drawing different geometry, so it's here as an example
-		deviceContext->IASetVertexBuffers(0, 1, vertexBuffer.GetAddressOf(), &stride, &offset);
-		deviceContext->IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+		//  - The cache drops these when the previous draw used the same mesh
+		stateCache.SetVertexBuffer(0, vertexBuffer.Get(), sizeof(Vertex), 0);
+		stateCache.SetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
 
 		// Tell Direct3D to draw
 		//  - Begins the rendering pipeline on the GPU
@@ -377,6 +375,82 @@ void Mesh::Draw() {
 	}
 }
 
+// --------------------------------------------------------
+// Same geometry, many copies: the instance buffer in slot 1
+// is read from firstInstance onwards, one element per copy
+// --------------------------------------------------------
+void Mesh::DrawInstanced(PipelineStateCache& stateCache, unsigned int instanceCount, unsigned int firstInstance)
+{
+	stateCache.SetVertexBuffer(0, vertexBuffer.Get(), sizeof(Vertex), 0);
+	stateCache.SetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+	deviceContext->DrawIndexedInstanced(indicesCount, instanceCount, 0, 0, firstInstance);
+}
+
+XMFLOAT4 Mesh::GetBoundingSphere()
+{
+	return boundingSphere;
+}
+
+XMFLOAT3 Mesh::GetAABBCenter()
+{
+	return aabbCenter;
+}
+
+XMFLOAT3 Mesh::GetAABBExtents()
+{
+	return aabbExtents;
+}
+
+const std::vector<XMFLOAT3>& Mesh::GetPositions()
+{
+	return positions;
+}
+
+const std::vector<Vertex>& Mesh::GetVertices()
+{
+	return cpuVertices;
+}
+
+const std::vector<unsigned int>& Mesh::GetIndices()
+{
+	return cpuIndices;
+}
+
+// --------------------------------------------------------
+// Box from the min & max corners, then a sphere around the
+// box's center that reaches the farthest vertex - tighter than
+// one around the box's corners
+// --------------------------------------------------------
+void Mesh::CalculateBounds(Vertex* verts, unsigned int numVerts)
+{
+	aabbCenter = XMFLOAT3(0, 0, 0);
+	aabbExtents = XMFLOAT3(0, 0, 0);
+	boundingSphere = XMFLOAT4(0, 0, 0, 0);
+	if (numVerts == 0)
+		return;
+
+	XMFLOAT3 low = verts[0].Position;
+	XMFLOAT3 high = verts[0].Position;
+	for (unsigned int i = 1; i < numVerts; i++)
+	{
+		const XMFLOAT3& p = verts[i].Position;
+		low = XMFLOAT3((std::min)(low.x, p.x), (std::min)(low.y, p.y), (std::min)(low.z, p.z));
+		high = XMFLOAT3((std::max)(high.x, p.x), (std::max)(high.y, p.y), (std::max)(high.z, p.z));
+	}
+	aabbCenter = XMFLOAT3((low.x + high.x) * 0.5f, (low.y + high.y) * 0.5f, (low.z + high.z) * 0.5f);
+	aabbExtents = XMFLOAT3((high.x - low.x) * 0.5f, (high.y - low.y) * 0.5f, (high.z - low.z) * 0.5f);
+
+	float radiusSquared = 0.0f;
+	for (unsigned int i = 0; i < numVerts; i++)
+	{
+		float x = verts[i].Position.x - aabbCenter.x;
+		float y = verts[i].Position.y - aabbCenter.y;
+		float z = verts[i].Position.z - aabbCenter.z;
+		radiusSquared = (std::max)(radiusSquared, x * x + y * y + z * z);
+	}
+	boundingSphere = XMFLOAT4(aabbCenter.x, aabbCenter.y, aabbCenter.z, sqrtf(radiusSquared));
+}
+
 void Mesh::Init(Vertex* verticies, unsigned int verticiesCount, unsigned int* indices, unsigned int indicesCount, Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext)
 {
 	this->verticies = verticies;
@@ -394,6 +468,15 @@ void Mesh::Init(Vertex* verticies, unsigned int verticiesCount, unsigned int* in
 		this->indicesCount
 	);
 
+	// The vertex data doesn't outlive loading, so get the bounds now
+	// and keep copies of the vertices & indices
+	CalculateBounds(this->verticies, this->verticiesCount);
+	positions.resize(verticiesCount);
+	for (unsigned int i = 0; i < verticiesCount; i++)
+		positions[i] = verticies[i].Position;
+	cpuVertices.assign(verticies, verticies + verticiesCount);
+	cpuIndices.assign(indices, indices + indicesCount);
+
 
 	// Create a VERTEX BUFFER
 	// - This holds the vertex data of triangles for a single object
@@ -4,6 +4,9 @@
 #include "Vertex.h"
 #include <d3d11.h>
 #include <string>
+#include <vector>
+#include "HandlePool.h"
+#include "PipelineStateCache.h"
 
 class Mesh {
 public:
@@ -26,8 +29,21 @@ public:
 	Microsoft::WRL::ComPtr<ID3D11Buffer>  GetVertexBuffer();
 	Microsoft::WRL::ComPtr<ID3D11Buffer>  GetIndexBuffer();
 	int GetIndexCount();
-	void Draw();
+	// Local space bounds: xyz = center, w = radius
+	DirectX::XMFLOAT4 GetBoundingSphere();
+	DirectX::XMFLOAT3 GetAABBCenter();
+	DirectX::XMFLOAT3 GetAABBExtents();
+	// CPU copies of the geometry, for software occlusion & static batching
+	const std::vector<DirectX::XMFLOAT3>& GetPositions();
+	const std::vector<Vertex>& GetVertices();
+	const std::vector<unsigned int>& GetIndices();
+	// Buffers are bound through the cache, so drawing the same
+	// mesh twice in a row only binds them once
+	void Draw(PipelineStateCache& stateCache);
+	// Per-instance data has to already be bound to input slot 1
+	void DrawInstanced(PipelineStateCache& stateCache, unsigned int instanceCount, unsigned int firstInstance);
 	void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
+	void CalculateBounds(Vertex* verts, unsigned int numVerts);
 
 private:
 	void Init(
@@ -47,4 +63,12 @@ private:
 	unsigned int* indices;
 	unsigned int indicesCount;
 	int indexBufferCount;
-};
\ No newline at end of file
+	DirectX::XMFLOAT4 boundingSphere;
+	DirectX::XMFLOAT3 aabbCenter;
+	DirectX::XMFLOAT3 aabbExtents;
+	std::vector<DirectX::XMFLOAT3> positions;
+	std::vector<Vertex> cpuVertices;
+	std::vector<unsigned int> cpuIndices;
+};
+
+typedef Handle<Mesh> MeshHandle;
@@ -6,6 +6,23 @@
 #define LIGHT_TYPE_SPOT 2
 #define MAX_SPECULAR_EXPONENT 256.0f
 
+// The light arrays are always this big, so the C++ side (Lights.h)
+// uploads the same layout whatever a shader variant uses
+#define MAX_DIRECTIONAL_LIGHTS 3
+#define MAX_POINT_LIGHTS 2
+
+// How many of them a pixel shader actually loops over.  Variants from
+// ShaderPermutations set these; the project's own build gets them all.
+#ifndef DIRECTIONAL_LIGHT_COUNT
+#define DIRECTIONAL_LIGHT_COUNT MAX_DIRECTIONAL_LIGHTS
+#endif
+#ifndef POINT_LIGHT_COUNT
+#define POINT_LIGHT_COUNT MAX_POINT_LIGHTS
+#endif
+
+// The directional light the shadow map is rendered from
+#define SHADOW_LIGHT_INDEX 2
+
 
 struct Light
 {
@@ -19,6 +36,22 @@ struct Light
     float3 Padding; // Purposefully padding to hit the 16-byte boundary
 };
 
+// Constant buffers are split by how often they change, and every
+// shader puts them in the same registers:
+// - b0 FrameData: camera, lights & shadow matrices, set once a frame
+// - b1 AmbientLight: below, changes with the sky
+// - b2 MaterialData: tint, roughness & texture slices, set per material
+// - b3 ObjectData: world matrices, set for every draw
+// A draw then only re-uploads the buffers whose scope changed.
+
+// Diffuse ambient light projected from the sky (see SphericalHarmonics.cpp)
+// - 9 coefficients, already convolved & divided by pi on the CPU
+// - Shared by every pixel shader, so it lives in its own buffer
+cbuffer AmbientLight : register(b1)
+{
+    float4 ambientSH[9];
+}
+
 // Struct representing the data we're sending down the pipeline
 // - Should match our pixel shader's input (hence the name: Vertex to Pixel)
 // - At a minimum, we need a piece of data defined tagged as SV_POSITION
@@ -284,4 +317,75 @@ float3 MicrofacetBRDF(float3 n, float3 l, float3 v, float roughness, float3 f0,
 }
 
 
+// IBL FUNCTIONS ================
+
+// Fresnel for ambient light - there's no single half vector to
+// use, so roughness keeps rough surfaces from getting a bright rim
+//
+// NdotV - Normal dot view vector
+// f0 - Value when l = n
+float3 F_SchlickRoughness(float NdotV, float3 f0, float roughness)
+{
+    return f0 + (max(1.0f - roughness, f0) - f0) * pow(1 - NdotV, 5);
+}
+
+
+
+// Diffuse ambient light arriving at a surface facing n
+// - Same basis order & constants as SphericalHarmonics.cpp
+//
+// n - NORMALIZED surface normal
+float3 IrradianceSH9(float3 n)
+{
+    float3 result =
+        ambientSH[0].rgb * 0.282095f +
+        ambientSH[1].rgb * 0.488603f * n.y +
+        ambientSH[2].rgb * 0.488603f * n.z +
+        ambientSH[3].rgb * 0.488603f * n.x +
+        ambientSH[4].rgb * 1.092548f * n.x * n.y +
+        ambientSH[5].rgb * 1.092548f * n.y * n.z +
+        ambientSH[6].rgb * 0.315392f * (3.0f * n.z * n.z - 1.0f) +
+        ambientSH[7].rgb * 1.092548f * n.x * n.z +
+        ambientSH[8].rgb * 0.546274f * (n.x * n.x - n.y * n.y);
+
+    // Ringing from only 3 bands can dip below zero opposite a bright sun
+    return max(result, 0);
+}
+
+
+
+// Ambient lighting from the prefiltered sky (see IBLPrefilter.cpp)
+// - Diffuse comes from the SH ambient above, using the normal
+// - Specular uses the split-sum approximation: the prefiltered
+//   cube sampled along the reflection, at a mip picked by roughness,
+//   scaled & biased by the BRDF look-up table
+//
+// n, v - NORMALIZED normal and surface-to-camera vectors
+float3 AmbientIBL(
+    TextureCube specularMap,
+    Texture2D brdfLookUpMap,
+    SamplerState basicSampler,
+    SamplerState clampSampler,
+    int specularMipLevels,
+    float3 n,
+    float3 v,
+    float3 surfaceColor,
+    float3 specularColor,
+    float roughness,
+    float metalness)
+{
+    float NdotV = saturate(dot(n, v));
+    float3 F = F_SchlickRoughness(NdotV, specularColor, roughness);
+
+    float3 irradiance = IrradianceSH9(n);
+    float3 diffuse = DiffuseEnergyConserve(irradiance, F, metalness) * surfaceColor;
+
+    float3 prefiltered = specularMap.SampleLevel(basicSampler, reflect(-v, n), roughness * (specularMipLevels - 1)).rgb;
+    float2 brdf = brdfLookUpMap.Sample(clampSampler, float2(NdotV, roughness)).rg;
+    float3 specular = prefiltered * (specularColor * brdf.x + brdf.y);
+
+    return diffuse + specular;
+}
+
+
 #endif
\ No newline at end of file
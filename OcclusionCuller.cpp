@@ -0,0 +1,549 @@
+#include "OcclusionCuller.h"
+#include "ParallelFor.h"
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+#include <chrono>
+#include <algorithm>
+
+using namespace DirectX;
+
+#define OCCLUSION_TILE_PIXELS (OCCLUSION_TILE_WIDTH * OCCLUSION_TILE_HEIGHT)
+#define OCCLUSION_TILES (OCCLUSION_TILES_X * OCCLUSION_TILES_Y)
+
+OcclusionCuller::OcclusionCuller() :
+	depth((size_t)OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 1.0f),
+	rasterizeMilliseconds(0.0f)
+{
+	XMStoreFloat4x4(&viewProjection, XMMatrixIdentity());
+
+	// spanLevel[n] is the largest power of two no bigger than n
+	spanLevel.resize((std::max)(OCCLUSION_TILES_X, OCCLUSION_TILES_Y) + 1, 0);
+	for (size_t n = 2; n < spanLevel.size(); n++)
+		spanLevel[n] = spanLevel[n / 2] + 1;
+	levelsX = spanLevel[OCCLUSION_TILES_X] + 1;
+	levelsY = spanLevel[OCCLUSION_TILES_Y] + 1;
+	tileMaxDepth.resize((size_t)levelsX * levelsY * OCCLUSION_TILES, 1.0f);
+}
+
+void OcclusionCuller::BeginFrame(const XMFLOAT4X4& newViewProjection)
+{
+	viewProjection = newViewProjection;
+	triangles.clear();
+	std::fill(depth.begin(), depth.end(), 1.0f);
+	std::fill(tileMaxDepth.begin(), tileMaxDepth.end(), 1.0f);
+}
+
+void OcclusionCuller::AddOccluder(
+	const XMFLOAT3* positions, unsigned int vertexCount,
+	const unsigned int* indices, unsigned int indexCount,
+	const XMFLOAT4X4& world)
+{
+	XMMATRIX worldViewProjection = XMLoadFloat4x4(&world) * XMLoadFloat4x4(&viewProjection);
+	clipPositions.resize(vertexCount);
+	for (unsigned int i = 0; i < vertexCount; i++)
+		XMStoreFloat4(&clipPositions[i], XMVector3Transform(XMLoadFloat3(&positions[i]), worldViewProjection));
+
+	for (unsigned int i = 0; i + 2 < indexCount; i += 3)
+		SetupTriangle(clipPositions[indices[i]], clipPositions[indices[i + 1]], clipPositions[indices[i + 2]]);
+}
+
+// --------------------------------------------------------
+// Projects a triangle to pixels and works out its edge functions,
+// which are positive inside, and its depth plane.  Triangles
+// that reach past the near plane are dropped rather than
+// clipped - losing an occluder only ever keeps more things.
+// --------------------------------------------------------
+void OcclusionCuller::SetupTriangle(XMFLOAT4 a, XMFLOAT4 b, XMFLOAT4 c)
+{
+	if (a.w < OCCLUSION_MIN_W || b.w < OCCLUSION_MIN_W || c.w < OCCLUSION_MIN_W ||
+		a.z < 0.0f || b.z < 0.0f || c.z < 0.0f)
+		return;
+
+	// Pixel coordinates, y down
+	float x[3], y[3], z[3];
+	XMFLOAT4 clip[3] = { a, b, c };
+	for (int i = 0; i < 3; i++)
+	{
+		float inverseW = 1.0f / clip[i].w;
+		x[i] = (clip[i].x * inverseW * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+		y[i] = (0.5f - clip[i].y * inverseW * 0.5f) * OCCLUSION_HEIGHT;
+		z[i] = clip[i].z * inverseW;
+	}
+
+	// Clockwise on screen is positive with y down
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (!(area > 0.0f))
+		return;
+
+	float minX = (std::max)((std::min)((std::min)(x[0], x[1]), x[2]), 0.0f);
+	float maxX = (std::min)((std::max)((std::max)(x[0], x[1]), x[2]), (float)OCCLUSION_WIDTH - 1.0f);
+	float minY = (std::max)((std::min)((std::min)(y[0], y[1]), y[2]), 0.0f);
+	float maxY = (std::min)((std::max)((std::max)(y[0], y[1]), y[2]), (float)OCCLUSION_HEIGHT - 1.0f);
+	if (minX > maxX || minY > maxY)
+		return;
+
+	Triangle triangle;
+	triangle.MinTileX = (int)minX / OCCLUSION_TILE_WIDTH;
+	triangle.MaxTileX = (int)maxX / OCCLUSION_TILE_WIDTH;
+	triangle.MinTileY = (int)minY / OCCLUSION_TILE_HEIGHT;
+	triangle.MaxTileY = (int)maxY / OCCLUSION_TILE_HEIGHT;
+
+	// Edge i runs from vertex i to the next one
+	for (int i = 0; i < 3; i++)
+	{
+		int next = (i + 1) % 3;
+		triangle.EdgeA[i] = y[i] - y[next];
+		triangle.EdgeB[i] = x[next] - x[i];
+		triangle.EdgeC[i] = -triangle.EdgeA[i] * x[i] - triangle.EdgeB[i] * y[i];
+	}
+
+	triangle.DepthX = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+	triangle.DepthY = ((x[1] - x[0]) * (z[2] - z[0]) - (x[2] - x[0]) * (z[1] - z[0])) / area;
+	triangle.Depth0 = z[0] - triangle.DepthX * x[0] - triangle.DepthY * y[0];
+	triangles.push_back(triangle);
+}
+
+// --------------------------------------------------------
+// Each thread takes a band of tile rows and draws every
+// triangle that reaches into it, so no two threads ever write
+// the same pixels.  The band's tile depths follow straight after.
+// --------------------------------------------------------
+void OcclusionCuller::Rasterize()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	ParallelFor(OCCLUSION_TILES_Y, 2, [&](size_t begin, size_t end)
+	{
+		int firstRow = (int)begin;
+		int lastRow = (int)end - 1;
+		for (const Triangle& triangle : triangles)
+		{
+			int minTileY = (std::max)(triangle.MinTileY, firstRow);
+			int maxTileY = (std::min)(triangle.MaxTileY, lastRow);
+			for (int tileY = minTileY; tileY <= maxTileY; tileY++)
+			{
+				for (int tileX = triangle.MinTileX; tileX <= triangle.MaxTileX; tileX++)
+					RasterizeTile(triangle, tileX, tileY);
+			}
+		}
+
+		for (int tileY = firstRow; tileY <= lastRow; tileY++)
+		{
+			for (int tileX = 0; tileX < OCCLUSION_TILES_X; tileX++)
+			{
+				size_t tile = (size_t)tileY * OCCLUSION_TILES_X + tileX;
+				const float* pixels = &depth[tile * OCCLUSION_TILE_PIXELS];
+				XMVECTOR farthest = XMLoadFloat4((const XMFLOAT4*)pixels);
+				for (int i = 4; i < OCCLUSION_TILE_PIXELS; i += 4)
+					farthest = XMVectorMax(farthest, XMLoadFloat4((const XMFLOAT4*)(pixels + i)));
+
+				XMFLOAT4 lanes;
+				XMStoreFloat4(&lanes, farthest);
+				tileMaxDepth[tile] = (std::max)((std::max)(lanes.x, lanes.y), (std::max)(lanes.z, lanes.w));
+			}
+		}
+	});
+
+	BuildTileLevels();
+
+	auto end = std::chrono::high_resolution_clock::now();
+	rasterizeMilliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+// --------------------------------------------------------
+// Level (levelX, levelY) holds, for every tile, the farthest
+// depth of the 2^levelX by 2^levelY tiles starting there
+// (cut short at the edges).  Any rectangle of tiles is then
+// covered by 4 overlapping blocks from one level, so finding
+// its farthest depth is 4 reads however big it is, and has no
+// loops to mispredict.
+// --------------------------------------------------------
+void OcclusionCuller::BuildTileLevels()
+{
+	for (int levelY = 0; levelY < levelsY; levelY++)
+	{
+		for (int levelX = 0; levelX < levelsX; levelX++)
+		{
+			if (levelX == 0 && levelY == 0)
+				continue;
+
+			// Two halves from the level below, side by side or one above the other
+			float* level = &tileMaxDepth[((size_t)levelY * levelsX + levelX) * OCCLUSION_TILES];
+			const float* half = levelX > 0 ?
+				&tileMaxDepth[((size_t)levelY * levelsX + levelX - 1) * OCCLUSION_TILES] :
+				&tileMaxDepth[((size_t)(levelY - 1) * levelsX) * OCCLUSION_TILES];
+			int stepX = levelX > 0 ? 1 << (levelX - 1) : 0;
+			int stepY = levelX > 0 ? 0 : 1 << (levelY - 1);
+
+			for (int tileY = 0; tileY < OCCLUSION_TILES_Y; tileY++)
+			{
+				int otherY = (std::min)(tileY + stepY, OCCLUSION_TILES_Y - 1);
+				for (int tileX = 0; tileX < OCCLUSION_TILES_X; tileX++)
+				{
+					int otherX = (std::min)(tileX + stepX, OCCLUSION_TILES_X - 1);
+					level[tileY * OCCLUSION_TILES_X + tileX] = (std::max)(
+						half[tileY * OCCLUSION_TILES_X + tileX],
+						half[otherY * OCCLUSION_TILES_X + otherX]);
+				}
+			}
+		}
+	}
+}
+
+// --------------------------------------------------------
+// One tile, 4 pixels at a time: the three edge tests make a
+// coverage mask, and covered pixels keep the nearer depth
+// --------------------------------------------------------
+void OcclusionCuller::RasterizeTile(const Triangle& triangle, int tileX, int tileY)
+{
+	float* pixels = &depth[((size_t)tileY * OCCLUSION_TILES_X + tileX) * OCCLUSION_TILE_PIXELS];
+	const XMVECTOR zero = XMVectorZero();
+	const XMVECTOR pixelOffsets = XMVectorSet(0.5f, 1.5f, 2.5f, 3.5f);
+
+	for (int row = 0; row < OCCLUSION_TILE_HEIGHT; row++)
+	{
+		float pixelY = (float)(tileY * OCCLUSION_TILE_HEIGHT + row) + 0.5f;
+		for (int quad = 0; quad < OCCLUSION_TILE_WIDTH; quad += 4)
+		{
+			XMVECTOR pixelX = XMVectorAdd(XMVectorReplicate((float)(tileX * OCCLUSION_TILE_WIDTH + quad)), pixelOffsets);
+
+			XMVECTOR covered = XMVectorTrueInt();
+			for (int edge = 0; edge < 3; edge++)
+			{
+				XMVECTOR value = XMVectorMultiplyAdd(XMVectorReplicate(triangle.EdgeA[edge]), pixelX,
+					XMVectorReplicate(triangle.EdgeB[edge] * pixelY + triangle.EdgeC[edge]));
+				covered = XMVectorAndInt(covered, XMVectorGreaterOrEqual(value, zero));
+			}
+
+			XMVECTOR triangleDepth = XMVectorMultiplyAdd(XMVectorReplicate(triangle.DepthX), pixelX,
+				XMVectorReplicate(triangle.DepthY * pixelY + triangle.Depth0));
+
+			XMFLOAT4* destination = (XMFLOAT4*)(pixels + row * OCCLUSION_TILE_WIDTH + quad);
+			XMVECTOR current = XMLoadFloat4(destination);
+			XMStoreFloat4(destination, XMVectorSelect(current, XMVectorMin(current, triangleDepth), covered));
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Box tests
+// --------------------------------------------------------
+void OcclusionCuller::CullAABBs(
+	const float* centerX, const float* centerY, const float* centerZ,
+	const float* extentX, const float* extentY, const float* extentZ,
+	unsigned int count,
+	unsigned char* visible)
+{
+	unsigned int groups = count / 4;
+	ParallelFor(groups, 1024, [&](size_t begin, size_t end)
+	{
+		for (size_t group = begin; group < end; group++)
+		{
+			size_t i = group * 4;
+			if ((visible[i] | visible[i + 1] | visible[i + 2] | visible[i + 3]) == 0)
+				continue;
+
+			int result = TestGroup(
+				XMLoadFloat4((const XMFLOAT4*)&centerX[i]), XMLoadFloat4((const XMFLOAT4*)&centerY[i]), XMLoadFloat4((const XMFLOAT4*)&centerZ[i]),
+				XMLoadFloat4((const XMFLOAT4*)&extentX[i]), XMLoadFloat4((const XMFLOAT4*)&extentY[i]), XMLoadFloat4((const XMFLOAT4*)&extentZ[i]));
+			// Masked rather than branched on - which way each box goes is a coin toss
+			for (int lane = 0; lane < 4; lane++)
+				visible[i + lane] &= (unsigned char)(0 - ((result >> lane) & 1));
+		}
+	});
+
+	for (unsigned int i = groups * 4; i < count; i++)
+	{
+		if (visible[i] && !IsAABBVisible(centerX[i], centerY[i], centerZ[i], extentX[i], extentY[i], extentZ[i]))
+			visible[i] = 0;
+	}
+}
+
+// Same math as the groups, with the box in every lane
+bool OcclusionCuller::IsAABBVisible(float x, float y, float z, float extentX, float extentY, float extentZ)
+{
+	return (TestGroup(
+		XMVectorReplicate(x), XMVectorReplicate(y), XMVectorReplicate(z),
+		XMVectorReplicate(extentX), XMVectorReplicate(extentY), XMVectorReplicate(extentZ)) & 1) != 0;
+}
+
+// --------------------------------------------------------
+// Tests 4 boxes at once, without projecting their corners.
+//
+// Each clip-space coordinate of a box is its projected center
+// plus or minus the sum of its projected half-axes' sizes,
+// which gives a range for x, y & w.  With w positive, x / w is
+// smallest or largest at a corner of those ranges, so two
+// reciprocals bound the box on screen.  That's a little looser
+// than the 8 projected corners, never tighter.
+//
+// Depth can't be bounded that way - z / w is squeezed so close
+// to 1 that the loose range would hide nothing.  Instead, with
+// D the farthest depth of the tiles under the box, the box is
+// hidden when z - D * w is positive at every corner, and that's
+// linear, so its smallest value is exact: the center's minus
+// the sum of the half-axes' sizes.
+// --------------------------------------------------------
+int OcclusionCuller::TestGroup(
+	FXMVECTOR centerX, FXMVECTOR centerY, FXMVECTOR centerZ,
+	GXMVECTOR extentX, HXMVECTOR extentY, HXMVECTOR extentZ)
+{
+	const XMFLOAT4X4& m = viewProjection;
+	XMVECTOR center[4], radius[4];
+	for (int c = 0; c < 4; c++)
+	{
+		center[c] = XMVectorMultiplyAdd(centerX, XMVectorReplicate(m.m[0][c]),
+			XMVectorMultiplyAdd(centerY, XMVectorReplicate(m.m[1][c]),
+				XMVectorMultiplyAdd(centerZ, XMVectorReplicate(m.m[2][c]), XMVectorReplicate(m.m[3][c]))));
+		radius[c] = XMVectorMultiplyAdd(extentX, XMVectorReplicate(fabsf(m.m[0][c])),
+			XMVectorMultiplyAdd(extentY, XMVectorReplicate(fabsf(m.m[1][c])),
+				XMVectorMultiply(extentZ, XMVectorReplicate(fabsf(m.m[2][c])))));
+	}
+
+	// Anything reaching behind the near plane is kept.  Those lanes get
+	// a w of 1 below, just so the math stays finite.
+	const XMVECTOR one = XMVectorSplatOne();
+	XMVECTOR nearW = XMVectorSubtract(center[3], radius[3]);
+	XMVECTOR crossesNearPlane = XMVectorOrInt(
+		XMVectorLess(nearW, XMVectorReplicate(OCCLUSION_MIN_W)),
+		XMVectorLess(XMVectorSubtract(center[2], radius[2]), XMVectorZero()));
+
+	XMVECTOR inverseNearW = XMVectorReciprocal(XMVectorSelect(nearW, one, crossesNearPlane));
+	XMVECTOR inverseFarW = XMVectorReciprocal(XMVectorSelect(XMVectorAdd(center[3], radius[3]), one, crossesNearPlane));
+	XMVECTOR lowX = XMVectorSubtract(center[0], radius[0]);
+	XMVECTOR highX = XMVectorAdd(center[0], radius[0]);
+	XMVECTOR lowY = XMVectorSubtract(center[1], radius[1]);
+	XMVECTOR highY = XMVectorAdd(center[1], radius[1]);
+	XMVECTOR minX = XMVectorMin(XMVectorMultiply(lowX, inverseNearW), XMVectorMultiply(lowX, inverseFarW));
+	XMVECTOR maxX = XMVectorMax(XMVectorMultiply(highX, inverseNearW), XMVectorMultiply(highX, inverseFarW));
+	XMVECTOR minY = XMVectorMin(XMVectorMultiply(lowY, inverseNearW), XMVectorMultiply(lowY, inverseFarW));
+	XMVECTOR maxY = XMVectorMax(XMVectorMultiply(highY, inverseNearW), XMVectorMultiply(highY, inverseFarW));
+
+	// Pixel rectangles.  Anything partly off screen is kept too, since
+	// the depth buffer can't vouch for the rest of it.
+	const XMVECTOR half = XMVectorReplicate(0.5f);
+	const XMVECTOR width = XMVectorReplicate((float)OCCLUSION_WIDTH);
+	const XMVECTOR height = XMVectorReplicate((float)OCCLUSION_HEIGHT);
+	XMVECTOR left = XMVectorMultiply(XMVectorMultiplyAdd(minX, half, half), width);
+	XMVECTOR right = XMVectorMultiply(XMVectorMultiplyAdd(maxX, half, half), width);
+	XMVECTOR top = XMVectorMultiply(XMVectorNegativeMultiplySubtract(maxY, half, half), height);
+	XMVECTOR bottom = XMVectorMultiply(XMVectorNegativeMultiplySubtract(minY, half, half), height);
+	XMVECTOR onScreen = XMVectorAndInt(
+		XMVectorAndInt(XMVectorGreaterOrEqual(left, XMVectorZero()), XMVectorLess(right, width)),
+		XMVectorAndInt(XMVectorGreaterOrEqual(top, XMVectorZero()), XMVectorLess(bottom, height)));
+	XMVECTOR kept = XMVectorOrInt(crossesNearPlane, XMVectorAndCInt(XMVectorTrueInt(), onScreen));
+
+	// Tiles under each rectangle, pulled back on screen for the kept
+	// lanes so they still read inside the buffer
+	const XMVECTOR lastX = XMVectorReplicate((float)OCCLUSION_WIDTH - 1.0f);
+	const XMVECTOR lastY = XMVectorReplicate((float)OCCLUSION_HEIGHT - 1.0f);
+	XMFLOAT4 tileLeft, tileRight, tileTop, tileBottom;
+	XMStoreFloat4(&tileLeft, XMVectorMin(XMVectorMax(left, XMVectorZero()), lastX));
+	XMStoreFloat4(&tileRight, XMVectorMin(XMVectorMax(right, XMVectorZero()), lastX));
+	XMStoreFloat4(&tileTop, XMVectorMin(XMVectorMax(top, XMVectorZero()), lastY));
+	XMStoreFloat4(&tileBottom, XMVectorMin(XMVectorMax(bottom, XMVectorZero()), lastY));
+
+	XMFLOAT4 farthest;
+	for (int lane = 0; lane < 4; lane++)
+	{
+		(&farthest.x)[lane] = GetFarthestDepth(
+			(int)(&tileLeft.x)[lane] / OCCLUSION_TILE_WIDTH, (int)(&tileRight.x)[lane] / OCCLUSION_TILE_WIDTH,
+			(int)(&tileTop.x)[lane] / OCCLUSION_TILE_HEIGHT, (int)(&tileBottom.x)[lane] / OCCLUSION_TILE_HEIGHT);
+	}
+
+	// The nearest corner's z - D * w, per the depth plane above
+	XMVECTOR farthestDepth = XMLoadFloat4(&farthest);
+	XMVECTOR nearest = XMVectorNegativeMultiplySubtract(farthestDepth, center[3], center[2]);
+	const XMVECTOR extents[3] = { extentX, extentY, extentZ };
+	for (int axis = 0; axis < 3; axis++)
+	{
+		XMVECTOR axisZ = XMVectorMultiply(extents[axis], XMVectorReplicate(m.m[axis][2]));
+		XMVECTOR axisW = XMVectorMultiply(extents[axis], XMVectorReplicate(m.m[axis][3]));
+		nearest = XMVectorSubtract(nearest, XMVectorAbs(XMVectorNegativeMultiplySubtract(farthestDepth, axisW, axisZ)));
+	}
+
+	uint32_t visible[4];
+	XMStoreInt4(visible, XMVectorOrInt(kept, XMVectorLessOrEqual(nearest, XMVectorZero())));
+	return (visible[0] & 1) | (visible[1] & 2) | (visible[2] & 4) | (visible[3] & 8);
+}
+
+// --------------------------------------------------------
+// The farthest depth of any tile in a rectangle of them
+// --------------------------------------------------------
+float OcclusionCuller::GetFarthestDepth(int minTileX, int maxTileX, int minTileY, int maxTileY)
+{
+	// The biggest blocks that fit, from each corner inwards
+	int levelX = spanLevel[maxTileX - minTileX + 1];
+	int levelY = spanLevel[maxTileY - minTileY + 1];
+	const float* level = &tileMaxDepth[((size_t)levelY * levelsX + levelX) * OCCLUSION_TILES];
+	int farX = maxTileX + 1 - (1 << levelX);
+	int farY = (maxTileY + 1 - (1 << levelY)) * OCCLUSION_TILES_X;
+	int nearY = minTileY * OCCLUSION_TILES_X;
+	return (std::max)(
+		(std::max)(level[nearY + minTileX], level[nearY + farX]),
+		(std::max)(level[farY + minTileX], level[farY + farX]));
+}
+
+unsigned int OcclusionCuller::GetTriangleCount() { return (unsigned int)triangles.size(); }
+float OcclusionCuller::GetRasterizeMilliseconds() { return rasterizeMilliseconds; }
+
+// --------------------------------------------------------
+// Self test & benchmark
+// --------------------------------------------------------
+namespace
+{
+	// Deterministic, so every run tests the same boxes
+	struct OcclusionRandom
+	{
+		unsigned int state;
+		float Next(float low, float high)
+		{
+			state = state * 1664525u + 1013904223u;
+			return low + (high - low) * ((state >> 8) * (1.0f / 16777216.0f));
+		}
+	};
+
+	// Camera at the origin looking down +Z, like the game's cameras
+	XMFLOAT4X4 MakeTestViewProjection()
+	{
+		XMMATRIX view = XMMatrixLookToLH(XMVectorZero(), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0));
+		XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 200.0f);
+		XMFLOAT4X4 viewProjection;
+		XMStoreFloat4x4(&viewProjection, view * projection);
+		return viewProjection;
+	}
+
+	// A square facing the camera, clockwise from the top left
+	const XMFLOAT3 wallPositions[] = {
+		XMFLOAT3(-1, 1, 0), XMFLOAT3(1, 1, 0), XMFLOAT3(1, -1, 0), XMFLOAT3(-1, -1, 0) };
+	const unsigned int wallIndices[] = { 0, 1, 2, 0, 2, 3 };
+	const unsigned int backwardsWallIndices[] = { 0, 2, 1, 0, 3, 2 };
+
+	XMFLOAT4X4 MakeWallWorld(float x, float y, float z, float halfSize)
+	{
+		XMFLOAT4X4 world;
+		XMStoreFloat4x4(&world, XMMatrixScaling(halfSize, halfSize, 1.0f) * XMMatrixTranslation(x, y, z));
+		return world;
+	}
+}
+
+bool OcclusionCuller::SelfTest()
+{
+	bool passed = true;
+	OcclusionCuller culler;
+	culler.BeginFrame(MakeTestViewProjection());
+	culler.AddOccluder(wallPositions, 4, wallIndices, 6, MakeWallWorld(0, 0, 10, 20));
+	culler.Rasterize();
+
+	passed = passed && !culler.IsAABBVisible(0, 0, 30, 1, 1, 1);		// Behind the wall
+	passed = passed && culler.IsAABBVisible(0, 0, 5, 1, 1, 1);			// In front of it
+	passed = passed && culler.IsAABBVisible(0, 0, 10, 2, 2, 2);		// Poking through it
+	passed = passed && culler.IsAABBVisible(0, 0, 0, 1, 1, 1);			// Around the camera
+	passed = passed && culler.IsAABBVisible(200, 0, 30, 1, 1, 1);		// Off to the side
+
+	// A wall facing away doesn't occlude anything
+	culler.BeginFrame(MakeTestViewProjection());
+	culler.AddOccluder(wallPositions, 4, backwardsWallIndices, 6, MakeWallWorld(0, 0, 10, 20));
+	culler.Rasterize();
+	passed = passed && culler.GetTriangleCount() == 0 && culler.IsAABBVisible(0, 0, 30, 1, 1, 1);
+
+	// The threaded groups against one box at a time, with a small wall so
+	// the boxes land on both sides of its edges
+	culler.BeginFrame(MakeTestViewProjection());
+	culler.AddOccluder(wallPositions, 4, wallIndices, 6, MakeWallWorld(0, 0, 10, 3));
+	culler.Rasterize();
+
+	OcclusionRandom random = { 777 };
+	const unsigned int count = 10007;
+	std::vector<float> x(count), y(count), z(count), extentX(count), extentY(count), extentZ(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		x[i] = random.Next(-10.0f, 10.0f);
+		y[i] = random.Next(-6.0f, 6.0f);
+		z[i] = random.Next(0.0f, 40.0f);
+		extentX[i] = random.Next(0.0f, 2.0f);
+		extentY[i] = random.Next(0.0f, 2.0f);
+		extentZ[i] = random.Next(0.0f, 2.0f);
+	}
+	std::vector<unsigned char> visible(count, 1);
+	culler.CullAABBs(x.data(), y.data(), z.data(), extentX.data(), extentY.data(), extentZ.data(), count, visible.data());
+
+	unsigned int occluded = 0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		bool single = culler.IsAABBVisible(x[i], y[i], z[i], extentX[i], extentY[i], extentZ[i]);
+		if ((visible[i] != 0) != single)
+			passed = false;
+		if (!single)
+			occluded++;
+	}
+
+	// Some have to be hidden, or the comparison proves nothing
+	return passed && occluded > 0;
+}
+
+OcclusionBenchmarkResult OcclusionCuller::Benchmark(unsigned int count)
+{
+	OcclusionBenchmarkResult result = {};
+	result.Count = count;
+	result.SelfTestPassed = SelfTest();
+
+	// A row of walls in front of a field of boxes, with a few hundred
+	// small occluders scattered around to give the rasterizer some work
+	OcclusionCuller culler;
+	culler.BeginFrame(MakeTestViewProjection());
+	for (int i = -2; i <= 2; i++)
+		culler.AddOccluder(wallPositions, 4, wallIndices, 6, MakeWallWorld(i * 8.0f, 0, 15, 4));
+
+	OcclusionRandom random = { 4242 };
+	for (int i = 0; i < 500; i++)
+	{
+		culler.AddOccluder(wallPositions, 4, wallIndices, 6,
+			MakeWallWorld(random.Next(-40.0f, 40.0f), random.Next(-20.0f, 20.0f), random.Next(20.0f, 80.0f), random.Next(0.5f, 2.0f)));
+	}
+
+	culler.Rasterize();
+	result.OccluderTriangles = culler.GetTriangleCount();
+	result.RasterizeMilliseconds = culler.GetRasterizeMilliseconds();
+	if (count == 0)
+		return result;
+
+	std::vector<float> x(count), y(count), z(count), extentX(count), extentY(count), extentZ(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		z[i] = random.Next(20.0f, 100.0f);
+		x[i] = random.Next(-0.4f, 0.4f) * z[i];
+		y[i] = random.Next(-0.3f, 0.3f) * z[i];
+		extentX[i] = random.Next(0.1f, 1.0f);
+		extentY[i] = random.Next(0.1f, 1.0f);
+		extentZ[i] = random.Next(0.1f, 1.0f);
+	}
+
+	std::vector<unsigned char> visible(count, 1);
+	auto start = std::chrono::high_resolution_clock::now();
+	culler.CullAABBs(x.data(), y.data(), z.data(), extentX.data(), extentY.data(), extentZ.data(), count, visible.data());
+	auto end = std::chrono::high_resolution_clock::now();
+	result.TestMilliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+	result.ThreadCount = WorkerPool::Get().GetThreadCount();
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (!visible[i])
+			result.OccludedCount++;
+	}
+
+	// The same groups on this thread alone
+	volatile int sink = 0;
+	start = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i + 3 < count; i += 4)
+	{
+		sink = sink + culler.TestGroup(
+			XMLoadFloat4((const XMFLOAT4*)&x[i]), XMLoadFloat4((const XMFLOAT4*)&y[i]), XMLoadFloat4((const XMFLOAT4*)&z[i]),
+			XMLoadFloat4((const XMFLOAT4*)&extentX[i]), XMLoadFloat4((const XMFLOAT4*)&extentY[i]), XMLoadFloat4((const XMFLOAT4*)&extentZ[i]));
+	}
+	end = std::chrono::high_resolution_clock::now();
+	result.SingleThreadTestMilliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+
+	return result;
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+// Resolution of the software depth buffer.  Has to be a
+// multiple of the tile size both ways.
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+
+// Pixels are stored & tested a tile at a time - two 4-wide
+// vectors per row
+#define OCCLUSION_TILE_WIDTH 8
+#define OCCLUSION_TILE_HEIGHT 4
+#define OCCLUSION_TILES_X (OCCLUSION_WIDTH / OCCLUSION_TILE_WIDTH)
+#define OCCLUSION_TILES_Y (OCCLUSION_HEIGHT / OCCLUSION_TILE_HEIGHT)
+
+// Anything with a clip-space w smaller than this is treated as
+// touching the near plane
+#define OCCLUSION_MIN_W 0.0001f
+
+// Results from OcclusionCuller::Benchmark()
+struct OcclusionBenchmarkResult
+{
+	unsigned int Count;
+	unsigned int OccluderTriangles;
+	float RasterizeMilliseconds;
+	float TestMilliseconds;				// Every box, spread across threads
+	unsigned int ThreadCount;			// ...this many of them
+	float SingleThreadTestMilliseconds;
+	unsigned int OccludedCount;
+	bool SelfTestPassed;
+};
+
+// --------------------------------------------------------
+// Hides things behind big occluders before the GPU ever sees
+// them, using a small depth buffer drawn on the CPU.
+//
+// Occluder triangles are set up once, then rasterized in bands
+// of tiles, one band per thread.  Every triangle gets an 8x4
+// coverage mask per tile from its edge functions, 4 pixels at
+// a time, and only the covered pixels take its depth.  Each
+// tile then keeps its farthest depth, and so does every
+// power-of-two block of tiles, so a box only ever reads 4.
+//
+// A box is tested by its projected bounds: it's hidden only
+// if its nearest point is behind the farthest depth of every
+// tile its screen rectangle touches.  Anything crossing the
+// near plane or leaving the screen is always kept, so the
+// result is conservative.
+//
+// Needs no GPU.
+// --------------------------------------------------------
+class OcclusionCuller
+{
+public:
+	OcclusionCuller();
+
+	// Clears the depth buffer and forgets last frame's occluders
+	void BeginFrame(const DirectX::XMFLOAT4X4& viewProjection);
+
+	// Queues an occluder's triangles.  Front faces are clockwise, the
+	// same as the GPU draws them; back faces are skipped.
+	void AddOccluder(
+		const DirectX::XMFLOAT3* positions, unsigned int vertexCount,
+		const unsigned int* indices, unsigned int indexCount,
+		const DirectX::XMFLOAT4X4& world);
+
+	// Draws every queued triangle, then builds the per-tile depths
+	void Rasterize();
+
+	// visible[i] is in & out: boxes already at 0 are skipped, and the
+	// visible ones hidden behind the occluders are set to 0
+	void CullAABBs(
+		const float* centerX, const float* centerY, const float* centerZ,
+		const float* extentX, const float* extentY, const float* extentZ,
+		unsigned int count,
+		unsigned char* visible);
+
+	bool IsAABBVisible(float x, float y, float z, float extentX, float extentY, float extentZ);
+
+	// From the last Rasterize()
+	unsigned int GetTriangleCount();
+	float GetRasterizeMilliseconds();
+
+	// Known cases, plus the threaded path against single boxes
+	static bool SelfTest();
+
+	static OcclusionBenchmarkResult Benchmark(unsigned int count);
+
+private:
+	// Edge functions & depth plane in pixel coordinates
+	struct Triangle
+	{
+		int MinTileX, MinTileY, MaxTileX, MaxTileY;
+		float EdgeA[3], EdgeB[3], EdgeC[3];
+		float DepthX, DepthY, Depth0;
+	};
+
+	void SetupTriangle(DirectX::XMFLOAT4 a, DirectX::XMFLOAT4 b, DirectX::XMFLOAT4 c);
+	void RasterizeTile(const Triangle& triangle, int tileX, int tileY);
+	void BuildTileLevels();
+
+	// Tests 4 boxes; the results go in the low 4 bits
+	int TestGroup(
+		DirectX::FXMVECTOR centerX, DirectX::FXMVECTOR centerY, DirectX::FXMVECTOR centerZ,
+		DirectX::GXMVECTOR extentX, DirectX::HXMVECTOR extentY, DirectX::HXMVECTOR extentZ);
+	float GetFarthestDepth(int minTileX, int maxTileX, int minTileY, int maxTileY);
+
+	DirectX::XMFLOAT4X4 viewProjection;
+	std::vector<Triangle> triangles;
+	std::vector<DirectX::XMFLOAT4> clipPositions;
+
+	// Tile after tile, each one row after row
+	std::vector<float> depth;
+
+	// Farthest depth per tile, then the same over bigger blocks of
+	// tiles - see BuildTileLevels()
+	std::vector<float> tileMaxDepth;
+	std::vector<int> spanLevel;
+	int levelsX;
+	int levelsY;
+
+	float rasterizeMilliseconds;
+};
@@ -0,0 +1,109 @@
+#include "ParallelFor.h"
+
+namespace
+{
+	// Set on pool threads, and on a caller while its job runs
+	thread_local bool insideJob = false;
+}
+
+WorkerPool& WorkerPool::Get()
+{
+	static WorkerPool pool;
+	return pool;
+}
+
+// One worker per hardware thread, less the one that calls Run()
+WorkerPool::WorkerPool() :
+	generation(0),
+	busyWorkers(0),
+	stopping(false),
+	runChunk(0),
+	context(0),
+	chunkCount(0),
+	nextChunk(0)
+{
+	unsigned int threadCount = (std::max)(std::thread::hardware_concurrency(), 1u);
+	for (unsigned int t = 1; t < threadCount; t++)
+		workers.push_back(std::thread(&WorkerPool::WorkerLoop, this));
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		stopping = true;
+	}
+	jobReady.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+unsigned int WorkerPool::GetThreadCount()
+{
+	return (unsigned int)workers.size() + 1;
+}
+
+void WorkerPool::Run(size_t newChunkCount, void (*newRunChunk)(void*, size_t), void* newContext)
+{
+	// Nested, busy or single-core: just do it here
+	if (workers.empty() || insideJob || !runMutex.try_lock())
+	{
+		for (size_t chunk = 0; chunk < newChunkCount; chunk++)
+			newRunChunk(newContext, chunk);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		runChunk = newRunChunk;
+		context = newContext;
+		chunkCount = newChunkCount;
+		nextChunk = 0;
+		busyWorkers = (unsigned int)workers.size();
+		generation++;
+	}
+	jobReady.notify_all();
+
+	insideJob = true;
+	RunChunks();
+	insideJob = false;
+
+	// Workers that woke late still have to check in before the job goes away
+	{
+		std::unique_lock<std::mutex> lock(jobMutex);
+		jobDone.wait(lock, [&] { return busyWorkers == 0; });
+	}
+	runMutex.unlock();
+}
+
+void WorkerPool::RunChunks()
+{
+	for (size_t chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++)
+		runChunk(context, chunk);
+}
+
+void WorkerPool::WorkerLoop()
+{
+	insideJob = true;
+	unsigned long long seen = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(jobMutex);
+			jobReady.wait(lock, [&] { return stopping || generation != seen; });
+			if (stopping)
+				return;
+			seen = generation;
+		}
+
+		RunChunks();
+
+		bool last;
+		{
+			std::lock_guard<std::mutex> lock(jobMutex);
+			last = --busyWorkers == 0;
+		}
+		if (last)
+			jobDone.notify_one();
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+// --------------------------------------------------------
+// The threads ParallelFor() runs on.  They're started the
+// first time they're needed and then sleep between jobs, so
+// a job costs a wake-up instead of creating & joining a
+// thread per core - which is most of a millisecond, and
+// too much for work done every frame.
+//
+// One job runs at a time.  A ParallelFor() from inside a
+// job, or from another thread while one is running, just
+// runs on the thread that called it.
+// --------------------------------------------------------
+class WorkerPool
+{
+public:
+	static WorkerPool& Get();
+
+	// Worker threads plus the calling thread
+	unsigned int GetThreadCount();
+
+	// Calls runChunk(context, chunk) for every chunk in [0, chunkCount),
+	// on the workers & the calling thread, and returns once all are done
+	void Run(size_t chunkCount, void (*runChunk)(void* context, size_t chunk), void* context);
+
+private:
+	WorkerPool();
+	~WorkerPool();
+	void WorkerLoop();
+	void RunChunks();
+
+	std::vector<std::thread> workers;
+	std::mutex runMutex;	// Held by whoever's job is running
+
+	// The current job
+	std::mutex jobMutex;
+	std::condition_variable jobReady;
+	std::condition_variable jobDone;
+	unsigned long long generation;
+	unsigned int busyWorkers;
+	bool stopping;
+	void (*runChunk)(void*, size_t);
+	void* context;
+	size_t chunkCount;
+	std::atomic<size_t> nextChunk;
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+};
+
+// --------------------------------------------------------
+// Runs func(begin, end) over [0, count) split into chunks
+// of chunkSize, spread across the worker pool.  The
+// calling thread helps out, and this returns once every
+// chunk is finished.
+// --------------------------------------------------------
+template<typename Func>
+void ParallelFor(size_t count, size_t chunkSize, Func func)
+{
+	if (count == 0)
+		return;
+
+	chunkSize = (std::max<size_t>)(chunkSize, 1);
+	size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+
+	// Not worth waking anyone for a single chunk
+	if (chunkCount == 1)
+	{
+		func((size_t)0, count);
+		return;
+	}
+
+	struct Job
+	{
+		Func* Body;
+		size_t Count;
+		size_t ChunkSize;
+	} job = { &func, count, chunkSize };
+
+	WorkerPool::Get().Run(chunkCount, [](void* context, size_t chunk)
+	{
+		Job& job = *(Job*)context;
+		size_t begin = chunk * job.ChunkSize;
+		(*job.Body)(begin, (std::min)(begin + job.ChunkSize, job.Count));
+	}, &job);
+}
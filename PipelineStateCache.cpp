@@ -0,0 +1,412 @@
+#include "PipelineStateCache.h"
+#include <cstdint>
+#include <vector>
+
+// --------------------------------------------------------
+// Context target
+// --------------------------------------------------------
+ContextStateTarget::ContextStateTarget(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context) :
+	context(context)
+{
+	context.As(&context1);
+}
+
+void ContextStateTarget::SetInputLayout(ID3D11InputLayout* layout)
+{
+	context->IASetInputLayout(layout);
+}
+
+void ContextStateTarget::SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int stride, unsigned int offset)
+{
+	UINT strides[] = { stride };
+	UINT offsets[] = { offset };
+	context->IASetVertexBuffers(slot, 1, &buffer, strides, offsets);
+}
+
+void ContextStateTarget::SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset)
+{
+	context->IASetIndexBuffer(buffer, format, offset);
+}
+
+void ContextStateTarget::SetVertexShader(ID3D11VertexShader* shader)
+{
+	context->VSSetShader(shader, 0, 0);
+}
+
+void ContextStateTarget::SetPixelShader(ID3D11PixelShader* shader)
+{
+	context->PSSetShader(shader, 0, 0);
+}
+
+void ContextStateTarget::SetConstantBuffer(PIPELINE_STAGE stage, unsigned int slot, ID3D11Buffer* buffer,
+	unsigned int firstConstant, unsigned int constantCount)
+{
+	// Whole buffers go through the plain 11.0 calls
+	if (constantCount == 0 || !context1)
+	{
+		if (stage == PIPELINE_STAGE_VERTEX) context->VSSetConstantBuffers(slot, 1, &buffer);
+		else context->PSSetConstantBuffers(slot, 1, &buffer);
+		return;
+	}
+
+	UINT first[] = { firstConstant };
+	UINT count[] = { constantCount };
+	if (stage == PIPELINE_STAGE_VERTEX) context1->VSSetConstantBuffers1(slot, 1, &buffer, first, count);
+	else context1->PSSetConstantBuffers1(slot, 1, &buffer, first, count);
+}
+
+void ContextStateTarget::SetShaderResource(PIPELINE_STAGE stage, unsigned int slot, ID3D11ShaderResourceView* srv)
+{
+	if (stage == PIPELINE_STAGE_VERTEX) context->VSSetShaderResources(slot, 1, &srv);
+	else context->PSSetShaderResources(slot, 1, &srv);
+}
+
+void ContextStateTarget::SetSampler(PIPELINE_STAGE stage, unsigned int slot, ID3D11SamplerState* sampler)
+{
+	if (stage == PIPELINE_STAGE_VERTEX) context->VSSetSamplers(slot, 1, &sampler);
+	else context->PSSetSamplers(slot, 1, &sampler);
+}
+
+void ContextStateTarget::SetRasterizerState(ID3D11RasterizerState* state)
+{
+	context->RSSetState(state);
+}
+
+void ContextStateTarget::SetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef)
+{
+	context->OMSetDepthStencilState(state, stencilRef);
+}
+
+void ContextStateTarget::SetBlendState(ID3D11BlendState* state)
+{
+	context->OMSetBlendState(state, 0, 0xFFFFFFFF);
+}
+
+// --------------------------------------------------------
+// Cache
+// --------------------------------------------------------
+namespace
+{
+	// No real object lives here, so a binding set to it never
+	// matches and the next call for that slot goes through
+	template<typename T> T* UnknownBinding()
+	{
+		return reinterpret_cast<T*>(~(uintptr_t)0);
+	}
+}
+
+PipelineStateCache::PipelineStateCache() :
+	filtering(true)
+{
+	Invalidate();
+	ResetCounts();
+}
+
+void PipelineStateCache::Init(std::shared_ptr<IPipelineStateTarget> target)
+{
+	this->target = target;
+	Invalidate();
+}
+
+void PipelineStateCache::Invalidate()
+{
+	inputLayout = UnknownBinding<ID3D11InputLayout>();
+	for (VertexBufferBinding& binding : vertexBuffers)
+		binding = { UnknownBinding<ID3D11Buffer>(), 0, 0 };
+	indexBuffer = { UnknownBinding<ID3D11Buffer>(), 0, 0 };
+	vertexShader = UnknownBinding<ID3D11VertexShader>();
+	pixelShader = UnknownBinding<ID3D11PixelShader>();
+
+	for (StageBindings& stage : stages)
+	{
+		for (ConstantBufferBinding& binding : stage.ConstantBuffers)
+			binding = { UnknownBinding<ID3D11Buffer>(), 0, 0 };
+		for (ID3D11ShaderResourceView*& srv : stage.ShaderResources)
+			srv = UnknownBinding<ID3D11ShaderResourceView>();
+		for (ID3D11SamplerState*& sampler : stage.Samplers)
+			sampler = UnknownBinding<ID3D11SamplerState>();
+	}
+
+	rasterizerState = UnknownBinding<ID3D11RasterizerState>();
+	depthStencilState = UnknownBinding<ID3D11DepthStencilState>();
+	stencilRef = 0;
+	blendState = UnknownBinding<ID3D11BlendState>();
+}
+
+void PipelineStateCache::SetFiltering(bool filtering)
+{
+	this->filtering = filtering;
+}
+
+bool PipelineStateCache::Submit(bool changed, PIPELINE_CALL call)
+{
+	if (!changed && filtering)
+	{
+		filtered[call]++;
+		return false;
+	}
+
+	submitted[call]++;
+	return true;
+}
+
+void PipelineStateCache::SetInputLayout(ID3D11InputLayout* layout)
+{
+	if (!Submit(inputLayout != layout, PIPELINE_CALL_INPUT_ASSEMBLER))
+		return;
+
+	inputLayout = layout;
+	target->SetInputLayout(layout);
+}
+
+void PipelineStateCache::SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int stride, unsigned int offset)
+{
+	// Out-of-range slots aren't tracked; D3D gets to complain about them
+	if (slot >= D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT)
+	{
+		target->SetVertexBuffer(slot, buffer, stride, offset);
+		return;
+	}
+
+	VertexBufferBinding& bound = vertexBuffers[slot];
+	if (!Submit(bound.Buffer != buffer || bound.Stride != stride || bound.Offset != offset, PIPELINE_CALL_INPUT_ASSEMBLER))
+		return;
+
+	bound = { buffer, stride, offset };
+	target->SetVertexBuffer(slot, buffer, stride, offset);
+}
+
+void PipelineStateCache::SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset)
+{
+	if (!Submit(indexBuffer.Buffer != buffer || indexBuffer.Stride != (unsigned int)format || indexBuffer.Offset != offset,
+		PIPELINE_CALL_INPUT_ASSEMBLER))
+		return;
+
+	indexBuffer = { buffer, (unsigned int)format, offset };
+	target->SetIndexBuffer(buffer, format, offset);
+}
+
+void PipelineStateCache::SetVertexShader(ID3D11VertexShader* shader)
+{
+	if (!Submit(vertexShader != shader, PIPELINE_CALL_SHADER))
+		return;
+
+	vertexShader = shader;
+	target->SetVertexShader(shader);
+}
+
+void PipelineStateCache::SetPixelShader(ID3D11PixelShader* shader)
+{
+	if (!Submit(pixelShader != shader, PIPELINE_CALL_SHADER))
+		return;
+
+	pixelShader = shader;
+	target->SetPixelShader(shader);
+}
+
+void PipelineStateCache::SetConstantBuffer(PIPELINE_STAGE stage, unsigned int slot, ID3D11Buffer* buffer,
+	unsigned int firstConstant, unsigned int constantCount)
+{
+	if (slot >= D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT)
+	{
+		target->SetConstantBuffer(stage, slot, buffer, firstConstant, constantCount);
+		return;
+	}
+
+	ConstantBufferBinding& bound = stages[stage].ConstantBuffers[slot];
+	if (!Submit(bound.Buffer != buffer || bound.FirstConstant != firstConstant || bound.ConstantCount != constantCount,
+		PIPELINE_CALL_CONSTANT_BUFFER))
+		return;
+
+	bound = { buffer, firstConstant, constantCount };
+	target->SetConstantBuffer(stage, slot, buffer, firstConstant, constantCount);
+}
+
+void PipelineStateCache::SetShaderResource(PIPELINE_STAGE stage, unsigned int slot, ID3D11ShaderResourceView* srv)
+{
+	if (slot >= D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT)
+	{
+		target->SetShaderResource(stage, slot, srv);
+		return;
+	}
+
+	ID3D11ShaderResourceView*& bound = stages[stage].ShaderResources[slot];
+	if (!Submit(bound != srv, PIPELINE_CALL_SHADER_RESOURCE))
+		return;
+
+	bound = srv;
+	target->SetShaderResource(stage, slot, srv);
+}
+
+void PipelineStateCache::SetSampler(PIPELINE_STAGE stage, unsigned int slot, ID3D11SamplerState* sampler)
+{
+	if (slot >= D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT)
+	{
+		target->SetSampler(stage, slot, sampler);
+		return;
+	}
+
+	ID3D11SamplerState*& bound = stages[stage].Samplers[slot];
+	if (!Submit(bound != sampler, PIPELINE_CALL_SAMPLER))
+		return;
+
+	bound = sampler;
+	target->SetSampler(stage, slot, sampler);
+}
+
+void PipelineStateCache::SetRasterizerState(ID3D11RasterizerState* state)
+{
+	if (!Submit(rasterizerState != state, PIPELINE_CALL_FIXED_FUNCTION))
+		return;
+
+	rasterizerState = state;
+	target->SetRasterizerState(state);
+}
+
+void PipelineStateCache::SetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef)
+{
+	if (!Submit(depthStencilState != state || this->stencilRef != stencilRef, PIPELINE_CALL_FIXED_FUNCTION))
+		return;
+
+	depthStencilState = state;
+	this->stencilRef = stencilRef;
+	target->SetDepthStencilState(state, stencilRef);
+}
+
+void PipelineStateCache::SetBlendState(ID3D11BlendState* state)
+{
+	if (!Submit(blendState != state, PIPELINE_CALL_FIXED_FUNCTION))
+		return;
+
+	blendState = state;
+	target->SetBlendState(state);
+}
+
+unsigned int PipelineStateCache::GetSubmittedCount(PIPELINE_CALL call) { return submitted[call]; }
+unsigned int PipelineStateCache::GetFilteredCount(PIPELINE_CALL call) { return filtered[call]; }
+
+unsigned int PipelineStateCache::GetSubmittedCount()
+{
+	unsigned int total = 0;
+	for (unsigned int count : submitted)
+		total += count;
+	return total;
+}
+
+unsigned int PipelineStateCache::GetFilteredCount()
+{
+	unsigned int total = 0;
+	for (unsigned int count : filtered)
+		total += count;
+	return total;
+}
+
+void PipelineStateCache::ResetCounts()
+{
+	for (int i = 0; i < PIPELINE_CALL_COUNT; i++)
+	{
+		submitted[i] = 0;
+		filtered[i] = 0;
+	}
+}
+
+// --------------------------------------------------------
+// Self test
+// --------------------------------------------------------
+namespace
+{
+	// Stands in for the context: writes down each call it gets,
+	// as a kind and the slot & object it was for
+	class RecordingStateTarget : public IPipelineStateTarget
+	{
+	public:
+		struct Call
+		{
+			PIPELINE_CALL Kind;
+			unsigned int Slot;
+			const void* Object;
+		};
+		std::vector<Call> Calls;
+
+		void SetInputLayout(ID3D11InputLayout* layout) { Record(PIPELINE_CALL_INPUT_ASSEMBLER, 0, layout); }
+		void SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int, unsigned int) { Record(PIPELINE_CALL_INPUT_ASSEMBLER, slot, buffer); }
+		void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT, unsigned int) { Record(PIPELINE_CALL_INPUT_ASSEMBLER, 0, buffer); }
+		void SetVertexShader(ID3D11VertexShader* shader) { Record(PIPELINE_CALL_SHADER, 0, shader); }
+		void SetPixelShader(ID3D11PixelShader* shader) { Record(PIPELINE_CALL_SHADER, 1, shader); }
+		void SetConstantBuffer(PIPELINE_STAGE, unsigned int slot, ID3D11Buffer* buffer, unsigned int, unsigned int) { Record(PIPELINE_CALL_CONSTANT_BUFFER, slot, buffer); }
+		void SetShaderResource(PIPELINE_STAGE, unsigned int slot, ID3D11ShaderResourceView* srv) { Record(PIPELINE_CALL_SHADER_RESOURCE, slot, srv); }
+		void SetSampler(PIPELINE_STAGE, unsigned int slot, ID3D11SamplerState* sampler) { Record(PIPELINE_CALL_SAMPLER, slot, sampler); }
+		void SetRasterizerState(ID3D11RasterizerState* state) { Record(PIPELINE_CALL_FIXED_FUNCTION, 0, state); }
+		void SetDepthStencilState(ID3D11DepthStencilState* state, unsigned int) { Record(PIPELINE_CALL_FIXED_FUNCTION, 1, state); }
+		void SetBlendState(ID3D11BlendState* state) { Record(PIPELINE_CALL_FIXED_FUNCTION, 2, state); }
+
+	private:
+		void Record(PIPELINE_CALL kind, unsigned int slot, const void* object)
+		{
+			Calls.push_back({ kind, slot, object });
+		}
+	};
+
+	// Distinct addresses that are never dereferenced
+	template<typename T> T* FakeObject(uintptr_t id)
+	{
+		return reinterpret_cast<T*>(id * 16);
+	}
+}
+
+bool PipelineStateCache::SelfTest()
+{
+	std::shared_ptr<RecordingStateTarget> recorder = std::make_shared<RecordingStateTarget>();
+	PipelineStateCache cache;
+	cache.Init(recorder);
+	bool passed = true;
+
+	// Everything is unknown to start with - even null goes through once
+	ID3D11VertexShader* vs = FakeObject<ID3D11VertexShader>(1);
+	ID3D11ShaderResourceView* srvA = FakeObject<ID3D11ShaderResourceView>(2);
+	ID3D11ShaderResourceView* srvB = FakeObject<ID3D11ShaderResourceView>(3);
+	ID3D11Buffer* buffer = FakeObject<ID3D11Buffer>(4);
+	cache.SetVertexShader(vs);
+	cache.SetVertexShader(vs);
+	cache.SetRasterizerState(0);
+	cache.SetRasterizerState(0);
+	passed = passed && recorder->Calls.size() == 2;
+	passed = passed && cache.GetSubmittedCount(PIPELINE_CALL_SHADER) == 1 && cache.GetFilteredCount(PIPELINE_CALL_SHADER) == 1;
+
+	// Slots & stages are tracked separately
+	cache.SetShaderResource(PIPELINE_STAGE_PIXEL, 0, srvA);
+	cache.SetShaderResource(PIPELINE_STAGE_PIXEL, 1, srvA);
+	cache.SetShaderResource(PIPELINE_STAGE_VERTEX, 0, srvA);
+	cache.SetShaderResource(PIPELINE_STAGE_PIXEL, 0, srvA);
+	cache.SetShaderResource(PIPELINE_STAGE_PIXEL, 0, srvB);
+	passed = passed && recorder->Calls.size() == 6;
+	passed = passed && recorder->Calls.back().Object == srvB && recorder->Calls.back().Slot == 0;
+
+	// The same buffer at another offset is a different binding
+	cache.SetConstantBuffer(PIPELINE_STAGE_VERTEX, 3, buffer, 0, 16);
+	cache.SetConstantBuffer(PIPELINE_STAGE_VERTEX, 3, buffer, 16, 16);
+	cache.SetConstantBuffer(PIPELINE_STAGE_VERTEX, 3, buffer, 16, 16);
+	cache.SetConstantBuffer(PIPELINE_STAGE_VERTEX, 3, buffer);
+	passed = passed && recorder->Calls.size() == 9;
+
+	// Only the stencil reference changed, which still counts
+	cache.SetDepthStencilState(0, 0);
+	cache.SetDepthStencilState(0, 1);
+	cache.SetDepthStencilState(0, 1);
+	passed = passed && recorder->Calls.size() == 11;
+
+	// Forgetting makes everything go through again
+	cache.Invalidate();
+	cache.SetVertexShader(vs);
+	cache.SetShaderResource(PIPELINE_STAGE_PIXEL, 0, srvB);
+	passed = passed && recorder->Calls.size() == 13;
+
+	// Unfiltered, repeats go through but are still counted
+	cache.SetFiltering(false);
+	cache.SetVertexShader(vs);
+	passed = passed && recorder->Calls.size() == 14;
+
+	passed = passed && cache.GetSubmittedCount() == (unsigned int)recorder->Calls.size();
+	passed = passed && cache.GetFilteredCount() == 5;
+	return passed;
+}
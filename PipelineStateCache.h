@@ -0,0 +1,166 @@
+#pragma once
+#include <d3d11_1.h>
+#include <wrl/client.h>
+#include <memory>
+
+// The shader stages whose bindings are tracked - the only
+// two anything draws with
+enum PIPELINE_STAGE
+{
+	PIPELINE_STAGE_VERTEX,
+	PIPELINE_STAGE_PIXEL,
+	PIPELINE_STAGE_COUNT
+};
+
+// What kind of call was submitted or filtered, for the counters
+enum PIPELINE_CALL
+{
+	PIPELINE_CALL_SHADER,
+	PIPELINE_CALL_INPUT_ASSEMBLER,
+	PIPELINE_CALL_CONSTANT_BUFFER,
+	PIPELINE_CALL_SHADER_RESOURCE,
+	PIPELINE_CALL_SAMPLER,
+	PIPELINE_CALL_FIXED_FUNCTION,
+	PIPELINE_CALL_COUNT
+};
+
+// --------------------------------------------------------
+// Where the cache sends the calls that survive filtering.
+// Normally the device context; the self test records them
+// instead.
+// --------------------------------------------------------
+class IPipelineStateTarget
+{
+public:
+	virtual ~IPipelineStateTarget() {}
+
+	virtual void SetInputLayout(ID3D11InputLayout* layout) = 0;
+	virtual void SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int stride, unsigned int offset) = 0;
+	virtual void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset) = 0;
+	virtual void SetVertexShader(ID3D11VertexShader* shader) = 0;
+	virtual void SetPixelShader(ID3D11PixelShader* shader) = 0;
+
+	// A constantCount of 0 binds the whole buffer
+	virtual void SetConstantBuffer(PIPELINE_STAGE stage, unsigned int slot, ID3D11Buffer* buffer,
+		unsigned int firstConstant, unsigned int constantCount) = 0;
+	virtual void SetShaderResource(PIPELINE_STAGE stage, unsigned int slot, ID3D11ShaderResourceView* srv) = 0;
+	virtual void SetSampler(PIPELINE_STAGE stage, unsigned int slot, ID3D11SamplerState* sampler) = 0;
+
+	virtual void SetRasterizerState(ID3D11RasterizerState* state) = 0;
+	virtual void SetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef) = 0;
+	virtual void SetBlendState(ID3D11BlendState* state) = 0;
+};
+
+// Passes everything straight to a D3D context
+class ContextStateTarget : public IPipelineStateTarget
+{
+public:
+	ContextStateTarget(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	void SetInputLayout(ID3D11InputLayout* layout);
+	void SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int stride, unsigned int offset);
+	void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset);
+	void SetVertexShader(ID3D11VertexShader* shader);
+	void SetPixelShader(ID3D11PixelShader* shader);
+	void SetConstantBuffer(PIPELINE_STAGE stage, unsigned int slot, ID3D11Buffer* buffer,
+		unsigned int firstConstant, unsigned int constantCount);
+	void SetShaderResource(PIPELINE_STAGE stage, unsigned int slot, ID3D11ShaderResourceView* srv);
+	void SetSampler(PIPELINE_STAGE stage, unsigned int slot, ID3D11SamplerState* sampler);
+	void SetRasterizerState(ID3D11RasterizerState* state);
+	void SetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef);
+	void SetBlendState(ID3D11BlendState* state);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context1;	// For offset constant buffers
+};
+
+// --------------------------------------------------------
+// Remembers what's bound and drops calls that would bind it
+// again, counting both kinds.
+//
+// Raw pointers are enough to compare by: the context holds a
+// reference to everything bound, so nothing the cache thinks
+// is bound can be freed and have its address reused.  That
+// only holds while every bind goes through here - anything
+// that talks to the context directly has to be followed by
+// Invalidate().  So does anything D3D unbinds by itself, like
+// a texture that gets bound as a render target.
+// --------------------------------------------------------
+class PipelineStateCache
+{
+public:
+	PipelineStateCache();
+
+	void Init(std::shared_ptr<IPipelineStateTarget> target);
+
+	// Forgets all bindings, so the next call for each goes through
+	void Invalidate();
+	// With filtering off every call goes through, but still counts
+	void SetFiltering(bool filtering);
+
+	void SetInputLayout(ID3D11InputLayout* layout);
+	void SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int stride, unsigned int offset);
+	void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset);
+	void SetVertexShader(ID3D11VertexShader* shader);
+	void SetPixelShader(ID3D11PixelShader* shader);
+	void SetConstantBuffer(PIPELINE_STAGE stage, unsigned int slot, ID3D11Buffer* buffer,
+		unsigned int firstConstant = 0, unsigned int constantCount = 0);
+	void SetShaderResource(PIPELINE_STAGE stage, unsigned int slot, ID3D11ShaderResourceView* srv);
+	void SetSampler(PIPELINE_STAGE stage, unsigned int slot, ID3D11SamplerState* sampler);
+	void SetRasterizerState(ID3D11RasterizerState* state);
+	void SetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef);
+	// No blend factor and a full sample mask, as everything here uses
+	void SetBlendState(ID3D11BlendState* state);
+
+	unsigned int GetSubmittedCount(PIPELINE_CALL call);
+	unsigned int GetFilteredCount(PIPELINE_CALL call);
+	unsigned int GetSubmittedCount();
+	unsigned int GetFilteredCount();
+	void ResetCounts();
+
+	// Runs a scripted sequence against a recording target
+	static bool SelfTest();
+
+private:
+	// Whether a call has to go through, counting it either way
+	bool Submit(bool changed, PIPELINE_CALL call);
+
+	struct VertexBufferBinding
+	{
+		ID3D11Buffer* Buffer;
+		unsigned int Stride;
+		unsigned int Offset;
+	};
+
+	struct ConstantBufferBinding
+	{
+		ID3D11Buffer* Buffer;
+		unsigned int FirstConstant;
+		unsigned int ConstantCount;
+	};
+
+	struct StageBindings
+	{
+		ConstantBufferBinding ConstantBuffers[D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
+		ID3D11ShaderResourceView* ShaderResources[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT];
+		ID3D11SamplerState* Samplers[D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT];
+	};
+
+	std::shared_ptr<IPipelineStateTarget> target;
+	bool filtering;
+
+	ID3D11InputLayout* inputLayout;
+	VertexBufferBinding vertexBuffers[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+	VertexBufferBinding indexBuffer;			// Stride holds the format
+	ID3D11VertexShader* vertexShader;
+	ID3D11PixelShader* pixelShader;
+	StageBindings stages[PIPELINE_STAGE_COUNT];
+	ID3D11RasterizerState* rasterizerState;
+	ID3D11DepthStencilState* depthStencilState;
+	unsigned int stencilRef;
+	ID3D11BlendState* blendState;
+
+	unsigned int submitted[PIPELINE_CALL_COUNT];
+	unsigned int filtered[PIPELINE_CALL_COUNT];
+};
@@ -1,18 +1,32 @@
+// What ShaderPermutations can build variants of (see ShaderPermutations.h)
+// @keywords SHADOWS
+// @directional_lights 1-3
+// @point_lights 0-2
+
+// Shadows are on unless a variant turns them off
+#ifndef SHADOWS
+#define SHADOWS 1
+#endif
+
 #include "NewInclude.hlsli"
-// Constant buffer defined here
-cbuffer ExternalData : register(b0)
+// Constant buffers defined here, split by scope (see NewInclude.hlsli)
+cbuffer FrameData : register(b0)
+{
+    float3 cameraPosition;
+    Light directionalLights[MAX_DIRECTIONAL_LIGHTS];
+    Light pointLights[MAX_POINT_LIGHTS];
+}
+
+cbuffer MaterialData : register(b2)
 {
-    matrix lightView;
-    matrix lightProjection;
     float4 colorTint;
     float roughness;
-    float3 cameraPosition;
-    Light directionalLights[3];
-    Light pointLights[2];
+    int albedoSlice; // Slices into the packed texture arrays below
+    int specularSlice;
 }
 
-Texture2D Albedo : register(t0); // "t" registers for textures
-Texture2D SpecularTexture : register(t1);
+Texture2DArray Albedo : register(t0); // "t" registers for textures
+Texture2DArray SpecularTexture : register(t1);
 Texture2D RoughnessMap : register(t2);
 Texture2D MetalnessMap : register(t3);
 Texture2D ShadowMap : register(t4); // Adjust index as necessary
@@ -30,6 +44,7 @@ SamplerComparisonState ShadowSampler : register(s1);
 // --------------------------------------------------------
 float4 main(VertexToPixel input) : SV_TARGET
 {
+#if SHADOWS
         // Perform the perspective divide (divide by W) ourselves
     input.shadowMapPos /= input.shadowMapPos.w;
 // Convert the normalized device coordinates to UVs for sampling
@@ -49,9 +64,10 @@ float4 main(VertexToPixel input) : SV_TARGET
     // For now (since my shadows aren't working), just return black where there are shadows so the professor sees i did SOMETHING.
     if (distShadowMap < distToLight)
         return float4(0, 0, 0, 1);
+#endif
     
-    float3 surfaceColor = Albedo.Sample(BasicSampler, input.uv).rgb;
-    float specularMapValue = SpecularTexture.Sample(BasicSampler, input.uv).x;
+    float3 surfaceColor = Albedo.Sample(BasicSampler, float3(input.uv, albedoSlice)).rgb;
+    float specularMapValue = SpecularTexture.Sample(BasicSampler, float3(input.uv, specularSlice)).x;
     
     // float roughness = RoughnessMap.Sample(SamplerOptions, input.uv).r;
     // float metalness = MetalnessMap.Sample(SamplerOptions, input.uv).r;
@@ -65,7 +81,7 @@ float4 main(VertexToPixel input) : SV_TARGET
     
     float4 totalDirectionalLight = float4(0, 0, 0, 0);
     
-    for (int i = 0; i < 3; i++)
+    for (int i = 0; i < DIRECTIONAL_LIGHT_COUNT; i++)
     {
         float4 lightResult = DiffuseAndSpecularForADirectionalLight(
     colorTint,
@@ -78,11 +94,13 @@ float4 main(VertexToPixel input) : SV_TARGET
     directionalLights[i].Intensity,
         specularMapValue);
         
+#if SHADOWS
         // If this is the 3RD light, apply the shadowing result
-        if (i == 2)
+        if (i == SHADOW_LIGHT_INDEX)
         {
             lightResult *= shadowAmount;
         }
+#endif
         // Add this light's result to the total light for this pixel        
         totalDirectionalLight += lightResult;
 
@@ -91,7 +109,7 @@ float4 main(VertexToPixel input) : SV_TARGET
     
     float4 totalPointLight = float4(0, 0, 0, 0);
 
-    for (int j = 0; j < 2; j++)
+    for (int j = 0; j < POINT_LIGHT_COUNT; j++)
     {
         totalPointLight += DiffuseAndSpecularForAPointLight(
     colorTint,
@@ -107,7 +125,8 @@ float4 main(VertexToPixel input) : SV_TARGET
         specularMapValue);
 
     }
-    float4 finalLight = totalDirectionalLight + totalPointLight  + float4(surfaceColor, 1);
+    float3 ambientLight = surfaceColor * IrradianceSH9(normalize(input.normal));
+    float4 finalLight = totalDirectionalLight + totalPointLight + float4(ambientLight, 1);
     // gamma correction
     finalLight = float4(pow(finalLight.xyz, 1.0f / 2.2f), 1);
     
@@ -0,0 +1,4 @@
+// Same shader as PixelShaderWithNormalMaps.hlsl, but reading metalness,
+// roughness and AO out of one channel-packed texture (see ChannelPacker.h)
+#define PACKED_PBR 1
+#include "PixelShaderWithNormalMaps.hlsl"
@@ -1,26 +1,57 @@
+// What ShaderPermutations can build variants of (see ShaderPermutations.h)
+// @keywords SHADOWS PACKED_PBR
+// @directional_lights 1-3
+// @point_lights 0-2
+
+// Shadows are on and the PBR maps separate unless a variant says otherwise
+#ifndef SHADOWS
+#define SHADOWS 1
+#endif
+#ifndef PACKED_PBR
+#define PACKED_PBR 0
+#endif
+
 #include "NewInclude.hlsli"
-// Constant buffer defined here
-cbuffer ExternalData : register(b0)
+// Constant buffers defined here, split by scope (see NewInclude.hlsli)
+cbuffer FrameData : register(b0)
+{
+    float3 cameraPosition;
+    int specularIBLMipLevels; // How many roughness steps SpecularIBLMap has
+    Light directionalLights[MAX_DIRECTIONAL_LIGHTS];
+    Light pointLights[MAX_POINT_LIGHTS];
+}
+
+cbuffer MaterialData : register(b2)
 {
-    // matrix lightView;
-    // matrix lightProjection;
     float4 colorTint;
     float roughness;
-    float3 cameraPosition;
-    Light directionalLights[3];
-    Light pointLights[2];
+    int albedoSlice; // Slices into the packed texture arrays below
+#if PACKED_PBR
+    int metalRoughnessAOSlice;
+#else
+    int roughnessSlice;
+    int metalnessSlice;
+#endif
+    int normalSlice;
 }
 
-Texture2D Albedo : register(t0); // "t" registers for textures
+Texture2DArray Albedo : register(t0); // "t" registers for textures
 //Texture2D SpecularTexture : register(t1);
-Texture2D RoughnessMap : register(t1);
-Texture2D MetalnessMap : register(t2);
-Texture2D NormalMap : register(t3);
+#if PACKED_PBR
+Texture2DArray MetalRoughnessAOMap : register(t1); // See ChannelPacker.h for the layout
+#else
+Texture2DArray RoughnessMap : register(t1);
+Texture2DArray MetalnessMap : register(t2);
+#endif
+Texture2DArray NormalMap : register(t3);
 Texture2D ShadowMap : register(t4); // Adjust index as necessary
+TextureCube SpecularIBLMap : register(t6); // Prefiltered from the sky
+Texture2D BrdfLookUpMap : register(t7);
 
 
 SamplerState BasicSampler : register(s0); // "s" registers for samplers
 SamplerComparisonState ShadowSampler : register(s1);
+SamplerState ClampSampler : register(s2);
 
 // --------------------------------------------------------
 // The entry point (main method) for our pixel shader
@@ -33,6 +64,7 @@ SamplerComparisonState ShadowSampler : register(s1);
 // --------------------------------------------------------
 float4 main(VertexToPixel_NormalMap input) : SV_TARGET
 {
+#if SHADOWS
           // Perform the perspective divide (divide by W) ourselves
     input.shadowMapPos /= input.shadowMapPos.w;
 // Convert the normalized device coordinates to UVs for sampling
@@ -46,13 +78,23 @@ float4 main(VertexToPixel_NormalMap input) : SV_TARGET
                ShadowSampler,
                shadowUV,
                distToLight).r;
+#endif
     
-    float3 surfaceColor = Albedo.Sample(BasicSampler, input.uv).rgb;
+    float3 surfaceColor = Albedo.Sample(BasicSampler, float3(input.uv, albedoSlice)).rgb;
     // "un-correction"
     surfaceColor = pow(surfaceColor, 2.2f);
     
-    float roughness = RoughnessMap.Sample(BasicSampler, input.uv).r;
-    float metalness = MetalnessMap.Sample(BasicSampler, input.uv).r;
+#if PACKED_PBR
+    // One sample for all three
+    float3 metalRoughnessAO = MetalRoughnessAOMap.Sample(BasicSampler, float3(input.uv, metalRoughnessAOSlice)).rgb;
+    float metalness = metalRoughnessAO.r;
+    float roughness = metalRoughnessAO.g;
+    float ambientOcclusion = metalRoughnessAO.b;
+#else
+    float roughness = RoughnessMap.Sample(BasicSampler, float3(input.uv, roughnessSlice)).r;
+    float metalness = MetalnessMap.Sample(BasicSampler, float3(input.uv, metalnessSlice)).r;
+    float ambientOcclusion = 1.0f;
+#endif
     
     //float roughness = 0.1f;
     //float metalness = 1.0f;
@@ -64,7 +106,7 @@ float4 main(VertexToPixel_NormalMap input) : SV_TARGET
     // because of linear texture sampling, so we lerp the specular color to match
     float3 specularColor = lerp(F0_NON_METAL, surfaceColor.rgb, metalness);
     
-    float3 unpackedNormal = NormalMap.Sample(BasicSampler, input.uv).rgb * 2 - 1;
+    float3 unpackedNormal = NormalMap.Sample(BasicSampler, float3(input.uv, normalSlice)).rgb * 2 - 1;
     unpackedNormal = normalize(unpackedNormal); // Dont forget to normalize!
 
     // Feel free to adjust/simplify this code to fit with your existing shader(s)
@@ -79,7 +121,7 @@ float4 main(VertexToPixel_NormalMap input) : SV_TARGET
     
     float4 totalDirectionalLight = float4(0, 0, 0, 0);
     
-    for (int i = 0; i < 3; i++)
+    for (int i = 0; i < DIRECTIONAL_LIGHT_COUNT; i++)
     {
     //    totalDirectionalLight += DiffuseAndSpecularForADirectionalLight(
     //colorTint,
@@ -111,18 +153,20 @@ float4 main(VertexToPixel_NormalMap input) : SV_TARGET
         float4 lightResult = float4((balancedDiff * surfaceColor + spec) * directionalLights[i].Intensity * directionalLights[i].Color, 1);
         
         
+#if SHADOWS
         // If this is the 3RD light, apply the shadowing result
-        if (i == 2)
+        if (i == SHADOW_LIGHT_INDEX)
         {
             lightResult *= shadowAmount;
         }
+#endif
         totalDirectionalLight += lightResult;
 
     }
     
     float4 totalPointLight = float4(0, 0, 0, 0);
 
-    for (int j = 0; j < 2; j++)
+    for (int j = 0; j < POINT_LIGHT_COUNT; j++)
     {
     //    totalPointLight += DiffuseAndSpecularForAPointLight(
     //colorTint,
@@ -160,7 +204,21 @@ float4 main(VertexToPixel_NormalMap input) : SV_TARGET
 
     }
     
-    float4 finalLight = totalDirectionalLight + totalPointLight;
+    // Ambient light from the sky
+    float3 ambientLight = AmbientIBL(
+        SpecularIBLMap,
+        BrdfLookUpMap,
+        BasicSampler,
+        ClampSampler,
+        specularIBLMipLevels,
+        normalize(input.normal),
+        normalize(cameraPosition - input.worldPosition),
+        surfaceColor,
+        specularColor,
+        roughness,
+        metalness) * ambientOcclusion;
+
+    float4 finalLight = totalDirectionalLight + totalPointLight + float4(ambientLight, 0);
     // gamma correction
     finalLight = float4(pow(finalLight.xyz, 1.0f / 2.2f), 1);
     return finalLight;
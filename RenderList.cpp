@@ -0,0 +1,363 @@
+#include "RenderList.h"
+#include "TransformSystem.h"
+#include "Components.h"
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+
+RenderList::RenderList() :
+	sortMilliseconds(0.0f),
+	cameraVisibleCount(0),
+	shadowVisibleCount(0),
+	cullMilliseconds(0.0f),
+	occludedCount(0),
+	occlusionMilliseconds(0.0f)
+{
+}
+
+void RenderList::Extract(EntityRegistry& registry, HandlePool<Mesh>& meshes, HandlePool<Material>& materials, DirectX::XMFLOAT4X4 view, bool sort)
+{
+	// Materials can be edited between frames, so their key bits are rebuilt each time
+	materialKeys.clear();
+
+	packets.clear();
+	registry.ForEachChunk<TransformHandle, MeshRenderer>(
+		[&](unsigned int count, const Entity*, TransformHandle* transforms, MeshRenderer* renderers)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				// A renderer can outlive the mesh or material it points at -
+				// there's nothing to draw then, so it gets no packet
+				Mesh* mesh = meshes.Get(renderers[i].RenderMesh);
+				if (!mesh || !materials.Get(renderers[i].RenderMaterial))
+					continue;
+
+				DrawPacket packet;
+				packet.Mesh = renderers[i].RenderMesh;
+				packet.Material = renderers[i].RenderMaterial;
+				packet.World = transforms[i].GetWorldMatrix();
+				packet.WorldInverseTranspose = transforms[i].GetWorldInverseTransposeMatrix();
+				packet.BoundingSphere = TransformSphere(mesh->GetBoundingSphere(), packet.World);
+
+				// Depth of the object's origin along the camera's forward axis
+				float viewDepth =
+					packet.World._41 * view._13 +
+					packet.World._42 * view._23 +
+					packet.World._43 * view._33 +
+					view._43;
+				packet.SortKey = MakeSortKey(GetMaterialKey(materials, packet.Material), packet.Mesh, viewDepth);
+				packets.push_back(packet);
+			}
+		});
+
+	auto start = std::chrono::high_resolution_clock::now();
+	if (sort)
+	{
+		// Sort the small key/index pairs, then move each packet once
+		sortItems.resize(packets.size());
+		for (size_t i = 0; i < packets.size(); i++)
+			sortItems[i] = SortItem{ packets[i].SortKey, (unsigned int)i };
+		RadixSort(sortItems, sortScratch);
+
+		sortedPackets.resize(packets.size());
+		for (size_t i = 0; i < sortItems.size(); i++)
+			sortedPackets[i] = packets[sortItems[i].Index];
+		packets.swap(sortedPackets);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	sortMilliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+
+	cameraVisible.assign(packets.size(), 1);
+	shadowVisible.assign(packets.size(), 1);
+	cameraVisibleCount = (unsigned int)packets.size();
+	shadowVisibleCount = (unsigned int)packets.size();
+	cullMilliseconds = 0.0f;
+	occludedCount = 0;
+	occlusionMilliseconds = 0.0f;
+}
+
+void RenderList::Cull(const Frustum& camera, const Frustum& light)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	size_t count = packets.size();
+	GatherBounds();
+
+	FrustumCuller::CullSpheres(camera, boundsX.data(), boundsY.data(), boundsZ.data(), boundsRadius.data(), (unsigned int)count, cameraVisible.data());
+	FrustumCuller::CullSpheres(light, boundsX.data(), boundsY.data(), boundsZ.data(), boundsRadius.data(), (unsigned int)count, shadowVisible.data());
+
+	cameraVisibleCount = 0;
+	shadowVisibleCount = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		cameraVisibleCount += cameraVisible[i];
+		shadowVisibleCount += shadowVisible[i];
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	cullMilliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+void RenderList::BuildBatches(
+	const std::vector<unsigned char>& visible,
+	bool matchMaterial,
+	bool instancing,
+	std::vector<DrawBatch>& batches,
+	std::vector<InstanceData>& instances)
+{
+	batches.clear();
+	for (size_t i = 0; i < packets.size(); i++)
+	{
+		if (!visible[i])
+			continue;
+
+		const DrawPacket& packet = packets[i];
+		bool joins = instancing && !batches.empty();
+		if (joins)
+		{
+			const DrawPacket& first = packets[batches.back().FirstPacket];
+			joins = first.Mesh == packet.Mesh &&
+				(!matchMaterial || first.Material == packet.Material);
+		}
+
+		if (joins)
+			batches.back().InstanceCount++;
+		else
+			batches.push_back(DrawBatch{ (unsigned int)i, (unsigned int)instances.size(), 1 });
+
+		instances.push_back(InstanceData{ packet.World, packet.WorldInverseTranspose });
+	}
+}
+
+// --------------------------------------------------------
+// Tests each sphere's bounding box, so a packet can only be
+// hidden if a whole box around its sphere is
+// --------------------------------------------------------
+void RenderList::CullOccluded(OcclusionCuller& occlusion)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	size_t count = packets.size();
+	GatherBounds();
+
+	unsigned int before = 0;
+	for (size_t i = 0; i < count; i++)
+		before += cameraVisible[i];
+
+	occlusion.CullAABBs(boundsX.data(), boundsY.data(), boundsZ.data(),
+		boundsRadius.data(), boundsRadius.data(), boundsRadius.data(), (unsigned int)count, cameraVisible.data());
+
+	cameraVisibleCount = 0;
+	for (size_t i = 0; i < count; i++)
+		cameraVisibleCount += cameraVisible[i];
+	occludedCount = before - cameraVisibleCount;
+
+	auto end = std::chrono::high_resolution_clock::now();
+	occlusionMilliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+// Bounding spheres split into components for the cullers
+void RenderList::GatherBounds()
+{
+	size_t count = packets.size();
+	boundsX.resize(count);
+	boundsY.resize(count);
+	boundsZ.resize(count);
+	boundsRadius.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		boundsX[i] = packets[i].BoundingSphere.x;
+		boundsY[i] = packets[i].BoundingSphere.y;
+		boundsZ[i] = packets[i].BoundingSphere.z;
+		boundsRadius[i] = packets[i].BoundingSphere.w;
+	}
+}
+
+const std::vector<DrawPacket>& RenderList::GetPackets() { return packets; }
+unsigned int RenderList::GetCount() { return (unsigned int)packets.size(); }
+float RenderList::GetSortMilliseconds() { return sortMilliseconds; }
+const std::vector<unsigned char>& RenderList::GetCameraVisibility() { return cameraVisible; }
+const std::vector<unsigned char>& RenderList::GetShadowVisibility() { return shadowVisible; }
+unsigned int RenderList::GetCameraVisibleCount() { return cameraVisibleCount; }
+unsigned int RenderList::GetShadowVisibleCount() { return shadowVisibleCount; }
+float RenderList::GetCullMilliseconds() { return cullMilliseconds; }
+unsigned int RenderList::GetOccludedCount() { return occludedCount; }
+float RenderList::GetOcclusionMilliseconds() { return occlusionMilliseconds; }
+
+// --------------------------------------------------------
+// Moves a local sphere into world space.  The radius grows by
+// the largest axis scale, so non-uniform scaling stays
+// conservative.
+// --------------------------------------------------------
+DirectX::XMFLOAT4 RenderList::TransformSphere(DirectX::XMFLOAT4 sphere, const DirectX::XMFLOAT4X4& world)
+{
+	float scaleX = world._11 * world._11 + world._12 * world._12 + world._13 * world._13;
+	float scaleY = world._21 * world._21 + world._22 * world._22 + world._23 * world._23;
+	float scaleZ = world._31 * world._31 + world._32 * world._32 + world._33 * world._33;
+	float scale = sqrtf((std::max)((std::max)(scaleX, scaleY), scaleZ));
+
+	return DirectX::XMFLOAT4(
+		sphere.x * world._11 + sphere.y * world._21 + sphere.z * world._31 + world._41,
+		sphere.x * world._12 + sphere.y * world._22 + sphere.z * world._32 + world._42,
+		sphere.x * world._13 + sphere.y * world._23 + sphere.z * world._33 + world._43,
+		sphere.w * scale);
+}
+
+DrawPass RenderList::GetPass(const DrawPacket& packet)
+{
+	return (DrawPass)(packet.SortKey >> SORT_KEY_PASS_SHIFT);
+}
+
+RenderList::MaterialKey RenderList::GetMaterialKey(HandlePool<Material>& materials, MaterialHandle handle)
+{
+	auto found = materialKeys.find(handle.Value);
+	if (found != materialKeys.end())
+		return found->second;
+
+	MaterialKey key = {};
+	Material* material = materials.Get(handle);
+	if (material)
+	{
+		std::pair<const void*, const void*> shaders(material->GetVertexShader().get(), material->GetPixelShader().get());
+		auto shader = shaderIDs.find(shaders);
+		if (shader == shaderIDs.end())
+			shader = shaderIDs.insert(std::make_pair(shaders, (unsigned int)shaderIDs.size())).first;
+
+		key.Pass = material->IsTransparent() ? DRAW_PASS_TRANSPARENT : DRAW_PASS_OPAQUE;
+		key.Shader = shader->second;
+		key.Material = handle.GetIndex();
+	}
+
+	materialKeys[handle.Value] = key;
+	return key;
+}
+
+unsigned long long RenderList::MakeSortKey(const MaterialKey& material, MeshHandle mesh, float viewDepth)
+{
+	// Anything past the field widths just shares a bucket - the order is
+	// a little less tidy, nothing breaks
+	unsigned long long shader = material.Shader & ((1u << SORT_KEY_SHADER_BITS) - 1);
+	unsigned long long materialIndex = material.Material & ((1u << SORT_KEY_MATERIAL_BITS) - 1);
+	unsigned long long meshIndex = mesh.GetIndex() & ((1u << SORT_KEY_MESH_BITS) - 1);
+	unsigned long long depth = QuantizeDepth(viewDepth);
+	unsigned long long state =
+		(shader << (SORT_KEY_MATERIAL_BITS + SORT_KEY_MESH_BITS)) |
+		(materialIndex << SORT_KEY_MESH_BITS) |
+		meshIndex;
+
+	unsigned long long key = (unsigned long long)material.Pass << SORT_KEY_PASS_SHIFT;
+	if (material.Pass == DRAW_PASS_TRANSPARENT)
+	{
+		unsigned long long farToNear = ((1u << SORT_KEY_DEPTH_BITS) - 1) - depth;
+		return key | (farToNear << (SORT_KEY_SHADER_BITS + SORT_KEY_MATERIAL_BITS + SORT_KEY_MESH_BITS)) | state;
+	}
+	return key | (state << SORT_KEY_DEPTH_BITS) | depth;
+}
+
+// --------------------------------------------------------
+// A positive float's bits sort the same way as its value, so
+// the top 24 of them are a depth key with no far plane needed.
+// Anything behind the camera lands on 0.
+// --------------------------------------------------------
+unsigned int RenderList::QuantizeDepth(float viewDepth)
+{
+	if (!(viewDepth > 0.0f))
+		return 0;
+
+	unsigned int bits;
+	memcpy(&bits, &viewDepth, sizeof(bits));
+	return bits >> (31 - SORT_KEY_DEPTH_BITS);
+}
+
+// --------------------------------------------------------
+// LSD radix sort, 8 bits at a time.  All 8 histograms come
+// from one read of the keys, and any byte where every key
+// agrees (common in the high bits) is skipped outright.
+// --------------------------------------------------------
+void RenderList::RadixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch)
+{
+	size_t count = items.size();
+	if (count < 2)
+		return;
+
+	unsigned int histograms[8][256] = {};
+	for (const SortItem& item : items)
+	{
+		for (int b = 0; b < 8; b++)
+			histograms[b][(item.Key >> (b * 8)) & 0xFF]++;
+	}
+
+	scratch.resize(count);
+	SortItem* source = items.data();
+	SortItem* destination = scratch.data();
+	for (int b = 0; b < 8; b++)
+	{
+		unsigned int* histogram = histograms[b];
+		if (histogram[(source[0].Key >> (b * 8)) & 0xFF] == count)
+			continue;
+
+		// Counts -> starting offsets
+		unsigned int offset = 0;
+		for (int d = 0; d < 256; d++)
+		{
+			unsigned int bucket = histogram[d];
+			histogram[d] = offset;
+			offset += bucket;
+		}
+
+		for (size_t i = 0; i < count; i++)
+			destination[histogram[(source[i].Key >> (b * 8)) & 0xFF]++] = source[i];
+		std::swap(source, destination);
+	}
+
+	if (source != items.data())
+		items.swap(scratch);
+}
+
+// --------------------------------------------------------
+// Benchmark
+// --------------------------------------------------------
+SortBenchmarkResult RenderList::BenchmarkSort(unsigned int count)
+{
+	SortBenchmarkResult result = {};
+	result.Count = count;
+
+	// Roughly what a scene produces: a few passes & shaders, lots of depths
+	std::vector<SortItem> items(count);
+	unsigned long long state = 0x9E3779B97F4A7C15ull;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		MaterialKey material = { (DrawPass)(state % 8 == 0), (unsigned int)(state >> 8) % 16, (unsigned int)(state >> 16) % 64 };
+		MeshHandle mesh((unsigned int)(state >> 24) % 256);
+		float depth = (float)((state >> 32) % 100000) * 0.01f;
+		items[i] = SortItem{ MakeSortKey(material, mesh, depth), i };
+	}
+	std::vector<SortItem> radixItems = items;
+	std::vector<SortItem> scratch;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	RadixSort(radixItems, scratch);
+	auto end = std::chrono::high_resolution_clock::now();
+	result.RadixMilliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+
+	start = std::chrono::high_resolution_clock::now();
+	std::stable_sort(items.begin(), items.end(), [](const SortItem& a, const SortItem& b) { return a.Key < b.Key; });
+	end = std::chrono::high_resolution_clock::now();
+	result.StdSortMilliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+
+	// LSD radix is stable, so even the indices should line up
+	result.Matches = true;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (radixItems[i].Key != items[i].Key || radixItems[i].Index != items[i].Index)
+		{
+			result.Matches = false;
+			break;
+		}
+	}
+	return result;
+}
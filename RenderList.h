@@ -0,0 +1,178 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <type_traits>
+#include "EntityRegistry.h"
+#include "HandlePool.h"
+#include "Mesh.h"
+#include "Material.h"
+#include "FrustumCuller.h"
+#include "OcclusionCuller.h"
+#include "BufferStructs.h"
+
+// Which pass a draw belongs to - the top bits of its sort key
+enum DrawPass
+{
+	DRAW_PASS_OPAQUE,
+	DRAW_PASS_TRANSPARENT,
+	DRAW_PASS_COUNT
+};
+
+// --------------------------------------------------------
+// Sort key layout, most significant bits first:
+//
+//   opaque:      pass:2 | shader:14 | material:12 | mesh:12 | depth:24
+//   transparent: pass:2 | far-to-near depth:24 | shader:14 | material:12 | mesh:12
+//
+// Opaque draws group by state and go front to back within a
+// group for early-Z; transparent ones go strictly back to front.
+// --------------------------------------------------------
+#define SORT_KEY_PASS_SHIFT 62
+#define SORT_KEY_SHADER_BITS 14
+#define SORT_KEY_MATERIAL_BITS 12
+#define SORT_KEY_MESH_BITS 12
+#define SORT_KEY_DEPTH_BITS 24
+
+// --------------------------------------------------------
+// Everything a pass needs to draw one object, flattened out of
+// the scene so the passes never touch entities or components.
+// Plain data - copying one is a memcpy.
+// --------------------------------------------------------
+struct DrawPacket
+{
+	unsigned long long SortKey;
+	MeshHandle Mesh;
+	MaterialHandle Material;
+	DirectX::XMFLOAT4X4 World;
+	DirectX::XMFLOAT4X4 WorldInverseTranspose;
+	DirectX::XMFLOAT4 BoundingSphere;		// World space, w = radius
+};
+static_assert(std::is_trivially_copyable<DrawPacket>::value, "Draw packets have to stay plain data");
+
+// Per-instance vertex data - the WORLD_PER_INSTANCE and
+// WORLDINVTRANSPOSE_PER_INSTANCE inputs of the instanced shaders.
+// Laid out as the ObjectData cbuffer, so the same data can be
+// written to the constant buffer ring or set on a shader as is.
+typedef ObjectData InstanceData;
+
+// A run of visible packets drawn with one call.  They all share
+// the first packet's mesh (and material, in the main pass).
+struct DrawBatch
+{
+	unsigned int FirstPacket;
+	unsigned int FirstInstance;		// Into the instance data
+	unsigned int InstanceCount;
+};
+
+// Timings from RenderList::BenchmarkSort()
+struct SortBenchmarkResult
+{
+	unsigned int Count;
+	float RadixMilliseconds;
+	float StdSortMilliseconds;	// std::stable_sort, since the radix sort is stable too
+	bool Matches;			// Both sorts agreed
+};
+
+// --------------------------------------------------------
+// The frame's draw packets.  Extract() walks the registry once
+// after the transforms are up to date, gives every draw a sort
+// key and radix sorts them; the shadow and main passes then
+// both read the same flat array, skipping whatever Cull()
+// found outside their frustum.
+// --------------------------------------------------------
+class RenderList
+{
+public:
+	RenderList();
+
+	// Rebuilds the packets from every entity with a transform & mesh
+	// renderer.  Keeps the array's memory between frames.  Without
+	// sorting the packets stay in registry order.
+	void Extract(
+		EntityRegistry& registry,
+		HandlePool<Mesh>& meshes,
+		HandlePool<Material>& materials,
+		DirectX::XMFLOAT4X4 view,
+		bool sort);
+
+	// Tests every packet's bounding sphere against both frustums.
+	// Until this runs, everything counts as visible.
+	void Cull(const Frustum& camera, const Frustum& light);
+
+	// Groups neighbouring visible packets that can be drawn together and
+	// appends their instance data.  The sort already puts matching
+	// packets next to each other.  The shadow pass only needs the same
+	// mesh; without instancing every packet is a batch of its own.
+	void BuildBatches(
+		const std::vector<unsigned char>& visible,
+		bool matchMaterial,
+		bool instancing,
+		std::vector<DrawBatch>& batches,
+		std::vector<InstanceData>& instances);
+
+	// Drops camera-visible packets hidden behind the occluders drawn
+	// into this culler.  Leaves the shadow pass alone.
+	void CullOccluded(OcclusionCuller& occlusion);
+
+	const std::vector<DrawPacket>& GetPackets();
+	unsigned int GetCount();
+	float GetSortMilliseconds();
+
+	// One flag per packet, in the same order
+	const std::vector<unsigned char>& GetCameraVisibility();
+	const std::vector<unsigned char>& GetShadowVisibility();
+	unsigned int GetCameraVisibleCount();
+	unsigned int GetShadowVisibleCount();
+	float GetCullMilliseconds();
+	unsigned int GetOccludedCount();
+	float GetOcclusionMilliseconds();
+
+	static DrawPass GetPass(const DrawPacket& packet);
+
+	// Times the radix sort against std::sort on random keys
+	static SortBenchmarkResult BenchmarkSort(unsigned int count);
+
+private:
+	struct SortItem
+	{
+		unsigned long long Key;
+		unsigned int Index;
+	};
+
+	// The parts of a key that only depend on the material
+	struct MaterialKey
+	{
+		DrawPass Pass;
+		unsigned int Shader;
+		unsigned int Material;
+	};
+
+	MaterialKey GetMaterialKey(HandlePool<Material>& materials, MaterialHandle handle);
+	static unsigned long long MakeSortKey(const MaterialKey& material, MeshHandle mesh, float viewDepth);
+	static unsigned int QuantizeDepth(float viewDepth);
+	static DirectX::XMFLOAT4 TransformSphere(DirectX::XMFLOAT4 sphere, const DirectX::XMFLOAT4X4& world);
+	static void RadixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch);
+	void GatherBounds();
+
+	std::vector<DrawPacket> packets;
+	std::vector<DrawPacket> sortedPackets;
+	std::vector<SortItem> sortItems;
+	std::vector<SortItem> sortScratch;
+	float sortMilliseconds;
+
+	// Bounding spheres split into components for the culler
+	std::vector<float> boundsX, boundsY, boundsZ, boundsRadius;
+	std::vector<unsigned char> cameraVisible;
+	std::vector<unsigned char> shadowVisible;
+	unsigned int cameraVisibleCount;
+	unsigned int shadowVisibleCount;
+	float cullMilliseconds;
+	unsigned int occludedCount;
+	float occlusionMilliseconds;
+
+	// Shader pairs get small IDs in the order they're first seen
+	std::map<std::pair<const void*, const void*>, unsigned int> shaderIDs;
+	std::unordered_map<unsigned int, MaterialKey> materialKeys;
+};
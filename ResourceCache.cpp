@@ -0,0 +1,332 @@
+#include "ResourceCache.h"
+#include "WICTextureLoader.h"
+#include "PathHelpers.h"
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+
+ResourceCache::ResourceCache(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context) :
+	device(device),
+	context(context),
+	loadCount(0),
+	dedupeCount(0)
+{
+}
+
+ResourceCache::~ResourceCache()
+{
+}
+
+// --------------------------------------------------------
+// Loads a texture file, or hands back the already loaded
+// copy if either its path or its contents match one we have
+//
+// path - path to the image file
+// generateMips - whether the loader should build a mip chain
+// --------------------------------------------------------
+ResourceHandle ResourceCache::LoadTexture(std::wstring path, bool generateMips)
+{
+	const char* mipSuffix = generateMips ? "|mips" : "|nomips";
+
+	// Canonical path key - resolves "..", relative paths and casing
+	wchar_t fullPath[MAX_PATH] = {};
+	GetFullPathNameW(path.c_str(), MAX_PATH, fullPath, 0);
+	std::string pathKey = WideToNarrow(fullPath);
+	std::transform(pathKey.begin(), pathKey.end(), pathKey.begin(), ::tolower);
+	pathKey = "path:" + pathKey + mipSuffix;
+
+	ResourceHandle existing = Lookup(pathKey);
+	if (existing)
+	{
+		dedupeCount++;
+		return existing;
+	}
+
+	// Read the whole file so we can key it by what's actually in it
+	std::ifstream file(fullPath, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+		return ResourceHandle();
+
+	std::vector<unsigned char> bytes((size_t)file.tellg());
+	file.seekg(0);
+	file.read((char*)bytes.data(), bytes.size());
+
+	std::string contentKey = HashToKey("content:", HashBytes(bytes.data(), bytes.size())) + mipSuffix;
+	existing = Lookup(contentKey);
+	if (existing)
+	{
+		// Same image under a different name
+		Store(pathKey, existing);
+		dedupeCount++;
+		return existing;
+	}
+
+	// Actually load it
+	ResourceHandle resource = std::make_shared<CachedResource>();
+	resource->Key = contentKey;
+	resource->Type = RESOURCE_TYPE_TEXTURE;
+	CreateWICTextureFromMemory(
+		device.Get(),
+		generateMips ? context.Get() : nullptr,
+		bytes.data(),
+		bytes.size(),
+		(ID3D11Resource**)resource->Texture.GetAddressOf(),
+		resource->SRV.GetAddressOf());
+
+	if (!resource->Texture)
+		return ResourceHandle();
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	resource->Texture->GetDesc(&desc);
+	resource->Bytes = CalculateTextureBytes(desc);
+
+	Store(pathKey, resource);
+	Store(contentKey, resource);
+	loadCount++;
+	return resource;
+}
+
+// --------------------------------------------------------
+// Gets a sampler matching the description, creating it
+// the first time a description is seen
+// --------------------------------------------------------
+ResourceHandle ResourceCache::GetSampler(const D3D11_SAMPLER_DESC& desc)
+{
+	std::string key = HashToKey("sampler:", HashBytes(&desc, sizeof(D3D11_SAMPLER_DESC)));
+
+	ResourceHandle existing = Lookup(key);
+	if (existing)
+	{
+		dedupeCount++;
+		return existing;
+	}
+
+	ResourceHandle resource = std::make_shared<CachedResource>();
+	resource->Key = key;
+	resource->Type = RESOURCE_TYPE_SAMPLER;
+	resource->Bytes = 0;
+	device->CreateSamplerState(&desc, resource->Sampler.GetAddressOf());
+
+	Store(key, resource);
+	loadCount++;
+	return resource;
+}
+
+// --------------------------------------------------------
+// A single white texel, as a one slice Texture2DArray so it
+// can stand in for anything the TextureArrayPacker makes.
+// Sampling it with any slice index just clamps to slice 0.
+// --------------------------------------------------------
+ResourceHandle ResourceCache::GetFallbackTexture()
+{
+	const std::string key = "fallback:white";
+	ResourceHandle existing = Lookup(key);
+	if (existing)
+		return existing;
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = 1;
+	desc.Height = 1;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	unsigned int white = 0xFFFFFFFF;
+	D3D11_SUBRESOURCE_DATA data = {};
+	data.pSysMem = &white;
+	data.SysMemPitch = sizeof(white);
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	device->CreateTexture2D(&desc, &data, texture.GetAddressOf());
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = desc.Format;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MipLevels = 1;
+	srvDesc.Texture2DArray.ArraySize = 1;
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	device->CreateShaderResourceView(texture.Get(), &srvDesc, srv.GetAddressOf());
+
+	return AddTexture(key, RESOURCE_TYPE_TEXTURE_ARRAY, texture, srv);
+}
+
+ResourceHandle ResourceCache::Find(std::string key)
+{
+	// Not a dedupe - whoever built it under this key is just asking again
+	return Lookup(key);
+}
+
+// --------------------------------------------------------
+// Registers a texture that was built at runtime so it shows
+// up in the stats and can be shared by key
+// --------------------------------------------------------
+ResourceHandle ResourceCache::AddTexture(
+	std::string key,
+	ResourceType type,
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture,
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+{
+	ResourceHandle resource = std::make_shared<CachedResource>();
+	resource->Key = key;
+	resource->Type = type;
+	resource->Texture = texture;
+	resource->SRV = srv;
+	resource->Bytes = 0;
+	if (texture)
+	{
+		D3D11_TEXTURE2D_DESC desc = {};
+		texture->GetDesc(&desc);
+		resource->Bytes = CalculateTextureBytes(desc);
+	}
+
+	Store(key, resource);
+	return resource;
+}
+
+size_t ResourceCache::GetMemoryUsage(ResourceType type)
+{
+	RemoveExpired();
+
+	// Path & content keys can point at the same resource, so
+	// only count each one under its own key
+	size_t total = 0;
+	for (auto& entry : entries)
+	{
+		ResourceHandle resource = entry.second.lock();
+		if (resource && resource->Type == type && resource->Key == entry.first)
+			total += resource->Bytes;
+	}
+	return total;
+}
+
+unsigned int ResourceCache::GetLiveCount(ResourceType type)
+{
+	RemoveExpired();
+
+	unsigned int count = 0;
+	for (auto& entry : entries)
+	{
+		ResourceHandle resource = entry.second.lock();
+		if (resource && resource->Type == type && resource->Key == entry.first)
+			count++;
+	}
+	return count;
+}
+
+unsigned int ResourceCache::GetLoadCount()
+{
+	return loadCount;
+}
+
+unsigned int ResourceCache::GetDedupeCount()
+{
+	return dedupeCount;
+}
+
+const char* ResourceCache::GetTypeName(ResourceType type)
+{
+	switch (type)
+	{
+	case RESOURCE_TYPE_TEXTURE: return "Texture";
+	case RESOURCE_TYPE_TEXTURE_ARRAY: return "Texture Array";
+	case RESOURCE_TYPE_CUBEMAP: return "Cubemap";
+	case RESOURCE_TYPE_SAMPLER: return "Sampler";
+	default: return "Unknown";
+	}
+}
+
+// --------------------------------------------------------
+// 64-bit FNV-1a hash - pass a previous hash as the seed
+// to keep hashing more data into it
+// --------------------------------------------------------
+unsigned long long ResourceCache::HashBytes(const void* data, size_t size, unsigned long long seed)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	unsigned long long hash = seed;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+std::string ResourceCache::HashToKey(const char* prefix, unsigned long long hash)
+{
+	char buffer[17] = {};
+	snprintf(buffer, sizeof(buffer), "%016llx", hash);
+	return std::string(prefix) + buffer;
+}
+
+// --------------------------------------------------------
+// Approximate GPU size of a texture, including all mips
+// and array slices
+// --------------------------------------------------------
+size_t ResourceCache::CalculateTextureBytes(const D3D11_TEXTURE2D_DESC& desc)
+{
+	size_t bitsPerPixel = 32;
+	switch (desc.Format)
+	{
+	case DXGI_FORMAT_R8_UNORM:
+	case DXGI_FORMAT_A8_UNORM:
+		bitsPerPixel = 8; break;
+	case DXGI_FORMAT_R8G8_UNORM:
+	case DXGI_FORMAT_R16_UNORM:
+	case DXGI_FORMAT_R16_FLOAT:
+		bitsPerPixel = 16; break;
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+	case DXGI_FORMAT_R16G16B16A16_UNORM:
+	case DXGI_FORMAT_R32G32_FLOAT:
+		bitsPerPixel = 64; break;
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		bitsPerPixel = 128; break;
+	default:
+		bitsPerPixel = 32; break;
+	}
+
+	size_t total = 0;
+	size_t width = desc.Width;
+	size_t height = desc.Height;
+	for (unsigned int mip = 0; mip < desc.MipLevels; mip++)
+	{
+		total += width * height * bitsPerPixel / 8;
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	return total * desc.ArraySize;
+}
+
+ResourceHandle ResourceCache::Lookup(const std::string& key)
+{
+	auto result = entries.find(key);
+	if (result == entries.end())
+		return ResourceHandle();
+
+	return result->second.lock();
+}
+
+void ResourceCache::Store(const std::string& key, ResourceHandle resource)
+{
+	entries[key] = resource;
+}
+
+// --------------------------------------------------------
+// Drops entries whose resources have already been released
+// --------------------------------------------------------
+void ResourceCache::RemoveExpired()
+{
+	for (auto it = entries.begin(); it != entries.end();)
+	{
+		if (it->second.expired())
+			it = entries.erase(it);
+		else
+			++it;
+	}
+}
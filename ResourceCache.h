@@ -0,0 +1,91 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+enum ResourceType
+{
+	RESOURCE_TYPE_TEXTURE,
+	RESOURCE_TYPE_TEXTURE_ARRAY,
+	RESOURCE_TYPE_CUBEMAP,
+	RESOURCE_TYPE_SAMPLER,
+	RESOURCE_TYPE_COUNT
+};
+
+// --------------------------------------------------------
+// A single GPU resource owned by the cache.  Only the
+// members that make sense for its type are filled in.
+// --------------------------------------------------------
+struct CachedResource
+{
+	std::string Key;
+	ResourceType Type;
+	size_t Bytes;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> Texture;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> SRV;
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> Sampler;
+};
+
+// Handles are refcounted - the resource unloads when the last one goes away
+typedef std::shared_ptr<CachedResource> ResourceHandle;
+
+// --------------------------------------------------------
+// Content-addressed cache for textures and samplers.
+//
+// Textures are looked up by canonical path first and then by
+// a hash of the file's bytes, so the same image is only ever
+// on the GPU once no matter how many materials ask for it.
+// The cache only keeps weak references, so anything nobody
+// holds a handle to anymore is released right away.
+// --------------------------------------------------------
+class ResourceCache
+{
+public:
+	ResourceCache(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+	~ResourceCache();
+
+	ResourceHandle LoadTexture(std::wstring path, bool generateMips = true);
+	ResourceHandle GetSampler(const D3D11_SAMPLER_DESC& desc);
+
+	// 1x1 white texture array for anything that failed to load
+	ResourceHandle GetFallbackTexture();
+
+	// For resources built at runtime (arrays, cubemaps, etc.)
+	ResourceHandle Find(std::string key);
+	ResourceHandle AddTexture(
+		std::string key,
+		ResourceType type,
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> texture,
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
+
+	// Stats
+	size_t GetMemoryUsage(ResourceType type);
+	unsigned int GetLiveCount(ResourceType type);
+	unsigned int GetLoadCount();
+	// Loads & samplers that reused an entry with the same path or contents
+	unsigned int GetDedupeCount();
+	static const char* GetTypeName(ResourceType type);
+
+	// Helpers for building keys out of raw data
+	static unsigned long long HashBytes(const void* data, size_t size, unsigned long long seed = 14695981039346656037ull);
+	static std::string HashToKey(const char* prefix, unsigned long long hash);
+	static size_t CalculateTextureBytes(const D3D11_TEXTURE2D_DESC& desc);
+
+private:
+	ResourceHandle Lookup(const std::string& key);
+	void Store(const std::string& key, ResourceHandle resource);
+	void RemoveExpired();
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+
+	// Both path keys and content keys map to the same entry
+	std::unordered_map<std::string, std::weak_ptr<CachedResource>> entries;
+
+	unsigned int loadCount;
+	unsigned int dedupeCount;
+};
@@ -0,0 +1,129 @@
+#include "RingAllocator.h"
+#include <vector>
+
+RingAllocator::RingAllocator() :
+	capacity(0),
+	head(0),
+	frameStart(0),
+	frameEnd(0),
+	mustWrap(true)
+{
+}
+
+void RingAllocator::Reset(unsigned int capacity)
+{
+	this->capacity = capacity;
+	head = 0;
+	frameStart = 0;
+	frameEnd = 0;
+	mustWrap = true;
+}
+
+bool RingAllocator::BeginFrame(unsigned int bytesNeeded, unsigned int alignment)
+{
+	unsigned int start = AlignUp(head, alignment);
+	bool wrapped = mustWrap || start > capacity || bytesNeeded > capacity - start;
+	if (wrapped)
+		start = 0;
+
+	mustWrap = false;
+	head = start;
+	frameStart = start;
+	frameEnd = start + bytesNeeded;
+	return wrapped;
+}
+
+unsigned int RingAllocator::Allocate(unsigned int size, unsigned int alignment)
+{
+	unsigned int offset = AlignUp(head, alignment);
+	if (offset > frameEnd || size > frameEnd - offset)
+		return RING_ALLOCATION_FAILED;
+
+	head = offset + size;
+	return offset;
+}
+
+unsigned int RingAllocator::GetCapacity() { return capacity; }
+unsigned int RingAllocator::GetFrameStart() { return frameStart; }
+unsigned int RingAllocator::GetFrameUsed() { return head - frameStart; }
+
+unsigned int RingAllocator::AlignUp(unsigned int value, unsigned int alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// --------------------------------------------------------
+// Self test
+// --------------------------------------------------------
+namespace
+{
+	// Deterministic, so every run tests the same frames
+	struct RingRandom
+	{
+		unsigned int state;
+		unsigned int Next(unsigned int low, unsigned int high)
+		{
+			state = state * 1664525u + 1013904223u;
+			return low + (state >> 8) % (high - low + 1);
+		}
+	};
+}
+
+bool RingAllocator::SelfTest()
+{
+	bool passed = true;
+	passed = passed && AlignUp(0, 256) == 0 && AlignUp(1, 256) == 256 && AlignUp(256, 256) == 256;
+
+	// A fresh ring always wraps, then frames follow each other until one doesn't fit
+	RingAllocator ring;
+	ring.Reset(1024);
+	passed = passed && ring.BeginFrame(512, 256);
+	passed = passed && ring.Allocate(100, 256) == 0;
+	passed = passed && ring.Allocate(100, 256) == 256;
+	passed = passed && ring.Allocate(256, 256) == RING_ALLOCATION_FAILED;
+	passed = passed && !ring.BeginFrame(256, 256) && ring.GetFrameStart() == 512;
+	passed = passed && ring.Allocate(256, 256) == 512;
+	passed = passed && ring.BeginFrame(512, 256) && ring.GetFrameStart() == 0;
+
+	// Random frames: every allocation stays inside its frame's reservation,
+	// and a frame that didn't wrap never reuses the last frame's bytes
+	const unsigned int capacity = 64 * 1024;
+	RingRandom random = { 4242 };
+	ring.Reset(capacity);
+	unsigned int lastEnd = 0;
+	std::vector<unsigned int> sizes;
+	for (int frame = 0; frame < 10000 && passed; frame++)
+	{
+		sizes.clear();
+		unsigned int needed = 0;
+		unsigned int count = random.Next(0, 60);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			sizes.push_back(random.Next(1, 512));
+			needed += AlignUp(sizes.back(), 256);
+		}
+
+		bool wrapped = ring.BeginFrame(needed, 256);
+		unsigned int start = ring.GetFrameStart();
+		passed = passed && (wrapped ? start == 0 : start >= lastEnd);
+		passed = passed && start + needed <= capacity;
+
+		unsigned int previousEnd = start;
+		for (unsigned int size : sizes)
+		{
+			unsigned int offset = ring.Allocate(size, 256);
+			passed = passed &&
+				offset != RING_ALLOCATION_FAILED &&
+				offset % 256 == 0 &&
+				offset >= previousEnd &&
+				offset + size <= start + needed;
+			previousEnd = offset + size;
+		}
+
+		// Nothing more fits than was reserved
+		passed = passed && ring.Allocate(1, 256) == RING_ALLOCATION_FAILED;
+		lastEnd = start + ring.GetFrameUsed();
+	}
+
+	return passed;
+}
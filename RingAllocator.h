@@ -0,0 +1,51 @@
+#pragma once
+
+// Returned by Allocate() when the frame's reservation is used up
+#define RING_ALLOCATION_FAILED 0xFFFFFFFFu
+
+// --------------------------------------------------------
+// Hands out offsets into a fixed-size buffer, front to back,
+// one frame's worth at a time.  Knows nothing about D3D - it
+// only does the arithmetic, so it can be tested on its own.
+//
+// Each frame reserves the room it needs up front.  If that
+// doesn't fit after last frame's allocations the frame starts
+// over at offset 0, and BeginFrame() says so: the caller has
+// to discard the old contents, since the GPU may still be
+// reading them.  Otherwise the new frame never touches what
+// earlier frames wrote, so writing without overwrite is safe.
+// --------------------------------------------------------
+class RingAllocator
+{
+public:
+	RingAllocator();
+
+	// Forgets everything.  The next frame always wraps.
+	void Reset(unsigned int capacity);
+
+	// Reserves bytesNeeded, starting at the given alignment.  True if
+	// the frame had to wrap to the start of the buffer.  The caller
+	// has to make sure bytesNeeded fits in the capacity.
+	bool BeginFrame(unsigned int bytesNeeded, unsigned int alignment);
+
+	// Offset of size bytes inside this frame's reservation, or
+	// RING_ALLOCATION_FAILED if there isn't room left in it
+	unsigned int Allocate(unsigned int size, unsigned int alignment);
+
+	unsigned int GetCapacity();
+	unsigned int GetFrameStart();
+	unsigned int GetFrameUsed();
+
+	// Rounds up to a power-of-two alignment
+	static unsigned int AlignUp(unsigned int value, unsigned int alignment);
+
+	// Known cases, plus a long run of random frames
+	static bool SelfTest();
+
+private:
+	unsigned int capacity;
+	unsigned int head;			// Where the next allocation can start
+	unsigned int frameStart;
+	unsigned int frameEnd;		// End of this frame's reservation
+	bool mustWrap;
+};
@@ -0,0 +1,446 @@
+#include "ShaderPermutations.h"
+#include "ResourceCache.h"
+#include "PathHelpers.h"
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+	// Debug builds keep their symbols, like the project's own shaders
+#if defined(DEBUG) || defined(_DEBUG)
+	const unsigned int CompileFlags = D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#else
+	const unsigned int CompileFlags = D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_OPTIMIZATION_LEVEL3;
+#endif
+	const char* Target = "ps_5_0";
+}
+
+ShaderPermutations::ShaderPermutations(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	const std::wstring& sourcePath) :
+	device(device),
+	context(context),
+	sourcePath(sourcePath),
+	loaded(false),
+	canCompile(false),
+	directionalLights({ 0, 0, false }),
+	pointLights({ 0, 0, false }),
+	sourceHash(0),
+	compileCount(0),
+	diskLoadCount(0),
+	compileMilliseconds(0.0f)
+{
+}
+
+// --------------------------------------------------------
+// Picks the declarations out of the source's comments and
+// hashes it along with its includes.  Anything that changes
+// the hash gets new variant files.
+// --------------------------------------------------------
+bool ShaderPermutations::Load()
+{
+	loaded = false;
+	canCompile = false;
+	variants.clear();
+	variantFiles.clear();
+	keywords.clear();
+	directionalLights = { 0, 0, false };
+	pointLights = { 0, 0, false };
+
+	std::string contents;
+	if (!ReadFile(sourcePath, contents))
+		return false;
+
+	std::istringstream lines(contents);
+	std::string line;
+	while (std::getline(lines, line))
+	{
+		size_t comment = line.find("//");
+		if (comment == std::string::npos)
+			continue;
+
+		std::istringstream words(line.substr(comment + 2));
+		std::string tag;
+		words >> tag;
+		if (tag == "@keywords")
+		{
+			std::string keyword;
+			while (words >> keyword && keywords.size() < SHADER_MAX_KEYWORDS)
+			{
+				if (std::find(keywords.begin(), keywords.end(), keyword) == keywords.end())
+					keywords.push_back(keyword);
+			}
+		}
+		else if (tag == "@directional_lights" || tag == "@point_lights")
+		{
+			std::string text;
+			words >> text;
+			LightRange& range = tag == "@directional_lights" ? directionalLights : pointLights;
+			if (!ParseRange(text, range))
+				return false;
+		}
+	}
+
+	std::vector<std::wstring> visited;
+	sourceHash = HashIncludes(sourcePath, contents, ResourceCache::HashBytes(contents.data(), contents.size()), visited);
+	sourceHash = ResourceCache::HashBytes(Target, strlen(Target), sourceHash);
+	sourceHash = ResourceCache::HashBytes(&CompileFlags, sizeof(CompileFlags), sourceHash);
+	loaded = true;
+	canCompile = true;
+	return true;
+}
+
+// --------------------------------------------------------
+// The runtime half: the declarations and variant files come
+// from the list Bake() wrote, and every variant is loaded
+// now so a frame never waits on the disk either.  A list from
+// an older version of this code is ignored, since its keys
+// may not mean the same thing.
+// --------------------------------------------------------
+bool ShaderPermutations::LoadBaked()
+{
+	loaded = false;
+	canCompile = false;
+	variants.clear();
+	variantFiles.clear();
+	keywords.clear();
+	directionalLights = { 0, 0, false };
+	pointLights = { 0, 0, false };
+
+	std::string contents;
+	if (!ReadFile(GetVariantListPath(), contents))
+		return false;
+
+	std::istringstream lines(contents);
+	std::string line;
+	bool versionMatches = false;
+	while (std::getline(lines, line))
+	{
+		std::istringstream words(line);
+		std::string tag;
+		words >> tag;
+		if (tag == "version")
+		{
+			unsigned int version = 0;
+			words >> version;
+			versionMatches = version == SHADER_VARIANT_VERSION;
+		}
+		else if (tag == "keyword")
+		{
+			std::string keyword;
+			if (words >> keyword && keywords.size() < SHADER_MAX_KEYWORDS)
+				keywords.push_back(keyword);
+		}
+		else if (tag == "directional_lights" || tag == "point_lights")
+		{
+			LightRange& range = tag == "directional_lights" ? directionalLights : pointLights;
+			if (words >> range.Min >> range.Max)
+				range.Declared = true;
+		}
+		else if (tag == "variant")
+		{
+			unsigned int key = 0;
+			std::string file;
+			if (words >> key >> file)
+				variantFiles[key] = NarrowToWide(file);
+		}
+	}
+	if (!versionMatches)
+		return false;
+
+	for (auto& variantFile : variantFiles)
+	{
+		std::shared_ptr<SimplePixelShader> shader = std::make_shared<SimplePixelShader>(
+			device, context, FixPath(variantFile.second).c_str());
+		if (shader->IsShaderValid())
+		{
+			variants[variantFile.first] = shader;
+			diskLoadCount++;
+		}
+		else
+			variants[variantFile.first] = 0;
+	}
+	loaded = true;
+	return true;
+}
+bool ShaderPermutations::IsLoaded() { return loaded; }
+
+unsigned int ShaderPermutations::GetKeyword(const char* name)
+{
+	for (size_t i = 0; i < keywords.size(); i++)
+	{
+		if (keywords[i] == name)
+			return 1u << i;
+	}
+	return 0;
+}
+
+unsigned int ShaderPermutations::MakeKey(unsigned int keywords, unsigned int directionalLights, unsigned int pointLights)
+{
+	return (keywords & ((1u << SHADER_MAX_KEYWORDS) - 1)) |
+		((directionalLights & 0xFF) << SHADER_KEY_DIRECTIONAL_SHIFT) |
+		((pointLights & 0xFF) << SHADER_KEY_POINT_SHIFT);
+}
+
+unsigned int ShaderPermutations::Resolve(unsigned int key)
+{
+	unsigned int keywordBits = key & ((1u << keywords.size()) - 1);
+	unsigned int directional = (key >> SHADER_KEY_DIRECTIONAL_SHIFT) & 0xFF;
+	unsigned int point = (key >> SHADER_KEY_POINT_SHIFT) & 0xFF;
+	directional = directionalLights.Declared ? (std::min)((std::max)(directional, directionalLights.Min), directionalLights.Max) : 0;
+	point = pointLights.Declared ? (std::min)((std::max)(point, pointLights.Min), pointLights.Max) : 0;
+	return MakeKey(keywordBits, directional, point);
+}
+
+// --------------------------------------------------------
+// Memory first.  When baking, then the variant file on disk,
+// and only then the compiler.  A variant that's missing or
+// fails to compile is remembered as null, so it isn't tried
+// again every frame.
+// --------------------------------------------------------
+std::shared_ptr<SimplePixelShader> ShaderPermutations::GetPixelShader(unsigned int key)
+{
+	if (!loaded)
+		return 0;
+
+	key = Resolve(key);
+	auto existing = variants.find(key);
+	if (existing != variants.end())
+		return existing->second;
+
+	// A run that loaded a bake has everything it's going to get
+	if (!canCompile)
+	{
+		variants[key] = 0;
+		return 0;
+	}
+
+	std::vector<std::string> names;
+	std::vector<std::string> values;
+	BuildDefines(key, names, values);
+	std::string defines;
+	for (size_t i = 0; i < names.size(); i++)
+		defines += names[i] + "=" + values[i] + ";";
+	unsigned long long variantHash = ResourceCache::HashBytes(defines.data(), defines.size(), sourceHash);
+	unsigned int version = SHADER_VARIANT_VERSION;
+	variantHash = ResourceCache::HashBytes(&version, sizeof(version), variantHash);
+	std::wstring file = NarrowToWide(ResourceCache::HashToKey("shader_", variantHash) + ".cso");
+	std::wstring path = FixPath(file);
+
+	std::shared_ptr<SimplePixelShader> shader;
+	bool onDisk = GetFileAttributesW(path.c_str()) != INVALID_FILE_ATTRIBUTES;
+	if (onDisk || CompileVariant(key, path))
+	{
+		shader = std::make_shared<SimplePixelShader>(device, context, path.c_str());
+		if (!shader->IsShaderValid())
+			shader.reset();
+		else
+		{
+			variantFiles[key] = file;
+			if (onDisk)
+				diskLoadCount++;
+		}
+	}
+	variants[key] = shader;
+	return shader;
+}
+
+bool ShaderPermutations::CompileVariant(unsigned int key, const std::wstring& path)
+{
+	auto compileStart = std::chrono::high_resolution_clock::now();
+
+	std::vector<std::string> names;
+	std::vector<std::string> values;
+	BuildDefines(key, names, values);
+	std::vector<D3D_SHADER_MACRO> macros;
+	for (size_t i = 0; i < names.size(); i++)
+		macros.push_back({ names[i].c_str(), values[i].c_str() });
+	macros.push_back({ 0, 0 });
+
+	// Includes resolve next to the including file, same as in the project
+	Microsoft::WRL::ComPtr<ID3DBlob> bytecode;
+	Microsoft::WRL::ComPtr<ID3DBlob> errors;
+	HRESULT hr = D3DCompileFromFile(sourcePath.c_str(), macros.data(), D3D_COMPILE_STANDARD_FILE_INCLUDE,
+		"main", Target, CompileFlags, 0, bytecode.GetAddressOf(), errors.GetAddressOf());
+
+	// Reported like SimpleShader's own load errors, and only when asked for
+	if (FAILED(hr) && ISimpleShader::ReportErrors)
+	{
+		ISimpleShader::LogErrorW(L"ShaderPermutations::CompileVariant() - Error compiling '" + sourcePath + L"' with ");
+		ISimpleShader::LogError(DescribeDefines(names, values) + ":\n");
+		if (errors)
+			ISimpleShader::LogError((const char*)errors->GetBufferPointer());
+	}
+	else if (SUCCEEDED(hr) && errors && ISimpleShader::ReportWarnings)
+	{
+		ISimpleShader::LogWarningW(L"ShaderPermutations::CompileVariant() - Warnings compiling '" + sourcePath + L"' with ");
+		ISimpleShader::LogWarning(DescribeDefines(names, values) + ":\n");
+		ISimpleShader::LogWarning((const char*)errors->GetBufferPointer());
+	}
+
+	bool compiled = SUCCEEDED(hr) && SUCCEEDED(D3DWriteBlobToFile(bytecode.Get(), path.c_str(), TRUE));
+	if (compiled)
+		compileCount++;
+	else if (SUCCEEDED(hr) && ISimpleShader::ReportErrors)
+		ISimpleShader::LogErrorW(L"ShaderPermutations::CompileVariant() - Error writing '" + path + L"'.\n");
+
+	auto compileEnd = std::chrono::high_resolution_clock::now();
+	compileMilliseconds += std::chrono::duration<float, std::milli>(compileEnd - compileStart).count();
+	return compiled;
+}
+
+// "SHADOWS=1 PACKED_PBR=0 ...", for messages
+std::string ShaderPermutations::DescribeDefines(const std::vector<std::string>& names, const std::vector<std::string>& values)
+{
+	std::string description;
+	for (size_t i = 0; i < names.size(); i++)
+		description += (i > 0 ? " " : "") + names[i] + "=" + values[i];
+	return description.empty() ? "no defines" : description;
+}
+
+// Every declared keyword is defined either way, so the source can use #if
+void ShaderPermutations::BuildDefines(unsigned int key, std::vector<std::string>& names, std::vector<std::string>& values)
+{
+	for (size_t i = 0; i < keywords.size(); i++)
+	{
+		names.push_back(keywords[i]);
+		values.push_back((key & (1u << i)) ? "1" : "0");
+	}
+	if (directionalLights.Declared)
+	{
+		names.push_back("DIRECTIONAL_LIGHT_COUNT");
+		values.push_back(std::to_string((key >> SHADER_KEY_DIRECTIONAL_SHIFT) & 0xFF));
+	}
+	if (pointLights.Declared)
+	{
+		names.push_back("POINT_LIGHT_COUNT");
+		values.push_back(std::to_string((key >> SHADER_KEY_POINT_SHIFT) & 0xFF));
+	}
+}
+
+unsigned int ShaderPermutations::Bake()
+{
+	if (!loaded || !canCompile)
+		return 0;
+
+	unsigned int keywordCombinations = 1u << keywords.size();
+	unsigned int directionalCount = directionalLights.Max - directionalLights.Min + 1;
+	unsigned int pointCount = pointLights.Max - pointLights.Min + 1;
+	if ((unsigned long long)keywordCombinations * directionalCount * pointCount > SHADER_MAX_VARIANTS)
+		return 0;
+
+	unsigned int valid = 0;
+	for (unsigned int keywordBits = 0; keywordBits < keywordCombinations; keywordBits++)
+		for (unsigned int d = directionalLights.Min; d <= directionalLights.Max; d++)
+			for (unsigned int p = pointLights.Min; p <= pointLights.Max; p++)
+			{
+				if (GetPixelShader(MakeKey(keywordBits, d, p)))
+					valid++;
+			}
+
+	// What LoadBaked() reads: the declarations, then a key & file per variant
+	std::ofstream list(GetVariantListPath(), std::ios::trunc);
+	if (!list.is_open())
+	{
+		if (ISimpleShader::ReportErrors)
+			ISimpleShader::LogErrorW(L"ShaderPermutations::Bake() - Error writing '" + GetVariantListPath() + L"'.\n");
+		return 0;
+	}
+	list << "version " << SHADER_VARIANT_VERSION << "\n";
+	for (const std::string& keyword : keywords)
+		list << "keyword " << keyword << "\n";
+	if (directionalLights.Declared)
+		list << "directional_lights " << directionalLights.Min << " " << directionalLights.Max << "\n";
+	if (pointLights.Declared)
+		list << "point_lights " << pointLights.Min << " " << pointLights.Max << "\n";
+	for (auto& variantFile : variantFiles)
+		list << "variant " << variantFile.first << " " << WideToNarrow(variantFile.second) << "\n";
+	return valid;
+}
+
+// "PixelShader.variants" for "../../PixelShader.hlsl", next to the executable
+std::wstring ShaderPermutations::GetVariantListPath()
+{
+	std::wstring name = sourcePath.substr(sourcePath.find_last_of(L"/\\") + 1);
+	return FixPath(name.substr(0, name.find_last_of(L'.')) + L".variants");
+}
+
+unsigned int ShaderPermutations::GetVariantCount()
+{
+	unsigned int count = 0;
+	for (auto& variant : variants)
+	{
+		if (variant.second)
+			count++;
+	}
+	return count;
+}
+
+unsigned int ShaderPermutations::GetCompileCount() { return compileCount; }
+unsigned int ShaderPermutations::GetDiskLoadCount() { return diskLoadCount; }
+float ShaderPermutations::GetCompileMilliseconds() { return compileMilliseconds; }
+const std::wstring& ShaderPermutations::GetSourcePath() { return sourcePath; }
+
+bool ShaderPermutations::ReadFile(const std::wstring& path, std::string& contents)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	std::ostringstream buffer;
+	buffer << file.rdbuf();
+	contents = buffer.str();
+	return true;
+}
+
+// "1-3", or just "2" for a fixed count
+bool ShaderPermutations::ParseRange(const std::string& text, LightRange& range)
+{
+	unsigned int low = 0;
+	unsigned int high = 0;
+	int fields = sscanf_s(text.c_str(), "%u-%u", &low, &high);
+	if (fields == 1)
+		high = low;
+	if (fields < 1 || low > high || high > 0xFF)
+		return false;
+
+	range.Min = low;
+	range.Max = high;
+	range.Declared = true;
+	return true;
+}
+
+unsigned long long ShaderPermutations::HashIncludes(const std::wstring& path, const std::string& contents,
+	unsigned long long hash, std::vector<std::wstring>& visited)
+{
+	std::wstring folder = path.substr(0, path.find_last_of(L"/\\") + 1);
+
+	std::istringstream lines(contents);
+	std::string line;
+	while (std::getline(lines, line))
+	{
+		size_t include = line.find("#include");
+		size_t open = include == std::string::npos ? std::string::npos : line.find('"', include);
+		size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+		if (close == std::string::npos)
+			continue;
+
+		std::wstring includePath = folder + NarrowToWide(line.substr(open + 1, close - open - 1));
+		if (std::find(visited.begin(), visited.end(), includePath) != visited.end())
+			continue;
+		visited.push_back(includePath);
+
+		// A missing include still changes the hash, by its name
+		std::string included;
+		if (!ReadFile(includePath, included))
+			included = WideToNarrow(includePath);
+		hash = ResourceCache::HashBytes(included.data(), included.size(), hash);
+		hash = HashIncludes(includePath, included, hash, visited);
+	}
+	return hash;
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "SimpleShader.h"
+
+// A variant key packs the keywords that are on into the low bits
+// and the two light counts above them
+#define SHADER_MAX_KEYWORDS 16
+#define SHADER_KEY_DIRECTIONAL_SHIFT 16
+#define SHADER_KEY_POINT_SHIFT 24
+
+// Bump when the way variants get compiled changes, so old files are ignored
+#define SHADER_VARIANT_VERSION 1
+
+// How many variants of one source there can be at most,
+// so a bad declaration can't ask for millions
+#define SHADER_MAX_VARIANTS 1024
+
+// --------------------------------------------------------
+// Compiles one pixel shader source into the variants it
+// declares, instead of a hand-copied file per combination.
+//
+// The source says what it can vary on with comments:
+//   // @keywords SHADOWS PACKED_PBR
+//   // @directional_lights 1-3
+//   // @point_lights 0-2
+// Each keyword becomes a 0/1 macro, and the light counts become
+// DIRECTIONAL_LIGHT_COUNT & POINT_LIGHT_COUNT, so a variant only
+// has the loops & features it's asked for.
+//
+// Compiling only happens in the -bakeshaders build step: Load()
+// reads the source and Bake() compiles every variant to disk
+// next to the executable, named by a hash of the source,
+// everything it includes and the defines, so a variant is only
+// compiled again after an edit.  It also writes a
+// "<source name>.variants" list of them.  A normal run calls
+// LoadBaked() instead, which reads that list and the .cso
+// files it names, and never needs the source or the compiler.
+// --------------------------------------------------------
+class ShaderPermutations
+{
+public:
+	ShaderPermutations(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		const std::wstring& sourcePath);
+
+	// Reads the declarations & hashes the source; false if it can't be read.
+	// Only for baking - variants missing from disk get compiled after this.
+	bool Load();
+
+	// Reads what Bake() wrote and loads every variant in it; false if
+	// there's no bake.  Variants are never compiled after this.
+	bool LoadBaked();
+	bool IsLoaded();
+
+	// The key bit of a declared keyword, or 0 if there's no such keyword
+	unsigned int GetKeyword(const char* name);
+	static unsigned int MakeKey(unsigned int keywords, unsigned int directionalLights, unsigned int pointLights);
+
+	// Null if the variant wasn't baked or doesn't compile.  Keywords
+	// the source doesn't declare are dropped and light counts are
+	// clamped to the declared range, so any key gets a usable variant.
+	std::shared_ptr<SimplePixelShader> GetPixelShader(unsigned int key);
+
+	// Compiles (or loads) every declared variant and writes the list
+	// LoadBaked() reads - the whole job of -bakeshaders.  Returns how
+	// many variants are usable.
+	unsigned int Bake();
+
+	// Stats
+	unsigned int GetVariantCount();
+	unsigned int GetCompileCount();
+	unsigned int GetDiskLoadCount();
+	float GetCompileMilliseconds();
+	const std::wstring& GetSourcePath();
+
+private:
+	struct LightRange
+	{
+		unsigned int Min;
+		unsigned int Max;
+		bool Declared;
+	};
+
+	// Drops what the source doesn't declare, so equal variants share a key
+	unsigned int Resolve(unsigned int key);
+	bool CompileVariant(unsigned int key, const std::wstring& path);
+	void BuildDefines(unsigned int key, std::vector<std::string>& names, std::vector<std::string>& values);
+	static std::string DescribeDefines(const std::vector<std::string>& names, const std::vector<std::string>& values);
+
+	std::wstring GetVariantListPath();
+	static bool ReadFile(const std::wstring& path, std::string& contents);
+	static bool ParseRange(const std::string& text, LightRange& range);
+	// Hashes every file pulled in with #include "...", once each
+	static unsigned long long HashIncludes(const std::wstring& path, const std::string& contents,
+		unsigned long long hash, std::vector<std::wstring>& visited);
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::wstring sourcePath;
+	bool loaded;
+	bool canCompile;	// Only after Load(), never after LoadBaked()
+
+	std::vector<std::string> keywords;
+	LightRange directionalLights;
+	LightRange pointLights;
+	unsigned long long sourceHash;
+
+	std::unordered_map<unsigned int, std::shared_ptr<SimplePixelShader>> variants;
+	std::unordered_map<unsigned int, std::wstring> variantFiles;	// Just the file name, per key
+	unsigned int compileCount;
+	unsigned int diskLoadCount;
+	float compileMilliseconds;
+};
@@ -0,0 +1,389 @@
+#include "ShaderReflectionData.h"
+#include <fstream>
+#include <string.h>
+
+namespace
+{
+	const unsigned int ReflectionMagic = 0x4C464552; // "REFL"
+
+	// The arrays follow in order - buffers, variables, resources,
+	// parameters, then the names - with nothing in between
+	struct ReflectionHeader
+	{
+		unsigned int Magic;
+		unsigned int Version;
+		unsigned long long Key;
+		unsigned int BufferCount;
+		unsigned int VariableCount;
+		unsigned int ResourceCount;
+		unsigned int ParameterCount;
+		unsigned int NameBytes;
+		unsigned int ThreadGroupSize[3];
+	};
+}
+
+ShaderReflectionData::ShaderReflectionData() :
+	file(INVALID_HANDLE_VALUE),
+	mapping(0),
+	view(0)
+{
+	builtThreadGroupSize[0] = 0;
+	builtThreadGroupSize[1] = 0;
+	builtThreadGroupSize[2] = 0;
+	UseBuiltRecords();
+}
+
+ShaderReflectionData::~ShaderReflectionData()
+{
+	Unmap();
+}
+
+void ShaderReflectionData::AddBuffer(const char* name, unsigned int bindIndex, unsigned int type, unsigned int size)
+{
+	ReflectedBuffer buffer = {};
+	buffer.Name = AddName(name);
+	buffer.BindIndex = bindIndex;
+	buffer.Type = type;
+	buffer.Size = size;
+	buffer.FirstVariable = (unsigned int)builtVariables.size();
+	builtBuffers.push_back(buffer);
+	UseBuiltRecords();
+}
+
+void ShaderReflectionData::AddVariable(const char* name, unsigned int byteOffset, unsigned int size)
+{
+	if (builtBuffers.empty())
+		return;
+
+	ReflectedVariable variable = {};
+	variable.Name = AddName(name);
+	variable.ByteOffset = byteOffset;
+	variable.Size = size;
+	builtVariables.push_back(variable);
+	builtBuffers.back().VariableCount++;
+	UseBuiltRecords();
+}
+
+void ShaderReflectionData::AddResource(const char* name, unsigned int bindIndex, REFLECTED_RESOURCE_TYPE type)
+{
+	ReflectedResource resource = {};
+	resource.Name = AddName(name);
+	resource.BindIndex = bindIndex;
+	resource.Type = type;
+	builtResources.push_back(resource);
+	UseBuiltRecords();
+}
+
+void ShaderReflectionData::AddParameter(const char* semanticName, unsigned int semanticIndex, unsigned int componentType, unsigned int mask, unsigned int stream, bool output)
+{
+	ReflectedParameter parameter = {};
+	parameter.SemanticName = AddName(semanticName);
+	parameter.SemanticIndex = semanticIndex;
+	parameter.ComponentType = componentType;
+	parameter.Mask = mask;
+	parameter.Stream = stream;
+	parameter.Output = output ? 1 : 0;
+	builtParameters.push_back(parameter);
+	UseBuiltRecords();
+}
+
+void ShaderReflectionData::SetThreadGroupSize(unsigned int x, unsigned int y, unsigned int z)
+{
+	builtThreadGroupSize[0] = x;
+	builtThreadGroupSize[1] = y;
+	builtThreadGroupSize[2] = z;
+	UseBuiltRecords();
+}
+
+unsigned int ShaderReflectionData::AddName(const char* name)
+{
+	unsigned int offset = (unsigned int)builtNames.size();
+	builtNames.insert(builtNames.end(), name, name + strlen(name) + 1);
+	return offset;
+}
+
+void ShaderReflectionData::UseBuiltRecords()
+{
+	Unmap();
+	buffers = builtBuffers.data();
+	variables = builtVariables.data();
+	resources = builtResources.data();
+	parameters = builtParameters.data();
+	names = builtNames.data();
+	threadGroupSize = builtThreadGroupSize;
+	bufferCount = (unsigned int)builtBuffers.size();
+	variableCount = (unsigned int)builtVariables.size();
+	resourceCount = (unsigned int)builtResources.size();
+	parameterCount = (unsigned int)builtParameters.size();
+	nameBytes = (unsigned int)builtNames.size();
+}
+
+void ShaderReflectionData::Unmap()
+{
+	if (view) UnmapViewOfFile(view);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	view = 0;
+	mapping = 0;
+	file = INVALID_HANDLE_VALUE;
+}
+
+// --------------------------------------------------------
+// Maps the file and points the getters straight into it.
+// Everything the header claims is checked against the file
+// size, and every name & variable range against the arrays,
+// so a truncated or stale file is rejected, not read past.
+// Bind slots have to fit D3D11's limits, and every variable
+// has to fit inside its buffer, since SimpleShader indexes
+// and copies with those without checking again.
+// --------------------------------------------------------
+bool ShaderReflectionData::Load(const std::wstring& path, unsigned long long key)
+{
+	builtBuffers.clear();
+	builtVariables.clear();
+	builtResources.clear();
+	builtParameters.clear();
+	builtNames.clear();
+	builtThreadGroupSize[0] = builtThreadGroupSize[1] = builtThreadGroupSize[2] = 0;
+	UseBuiltRecords();
+
+	file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize = {};
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < (long long)sizeof(ReflectionHeader))
+	{
+		Unmap();
+		return false;
+	}
+
+	mapping = CreateFileMappingW(file, 0, PAGE_READONLY, 0, 0, 0);
+	if (mapping)
+		view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view)
+	{
+		Unmap();
+		return false;
+	}
+
+	const ReflectionHeader* header = (const ReflectionHeader*)view;
+	unsigned long long expectedSize = sizeof(ReflectionHeader) +
+		(unsigned long long)header->BufferCount * sizeof(ReflectedBuffer) +
+		(unsigned long long)header->VariableCount * sizeof(ReflectedVariable) +
+		(unsigned long long)header->ResourceCount * sizeof(ReflectedResource) +
+		(unsigned long long)header->ParameterCount * sizeof(ReflectedParameter) +
+		header->NameBytes;
+	if (header->Magic != ReflectionMagic ||
+		header->Version != SHADER_REFLECTION_VERSION ||
+		header->Key != key ||
+		expectedSize != (unsigned long long)fileSize.QuadPart)
+	{
+		Unmap();
+		return false;
+	}
+
+	const unsigned char* bytes = (const unsigned char*)view + sizeof(ReflectionHeader);
+	const ReflectedBuffer* mappedBuffers = (const ReflectedBuffer*)bytes;
+	bytes += header->BufferCount * sizeof(ReflectedBuffer);
+	const ReflectedVariable* mappedVariables = (const ReflectedVariable*)bytes;
+	bytes += header->VariableCount * sizeof(ReflectedVariable);
+	const ReflectedResource* mappedResources = (const ReflectedResource*)bytes;
+	bytes += header->ResourceCount * sizeof(ReflectedResource);
+	const ReflectedParameter* mappedParameters = (const ReflectedParameter*)bytes;
+	bytes += header->ParameterCount * sizeof(ReflectedParameter);
+	const char* mappedNames = (const char*)bytes;
+
+	// Every name has to end inside the block
+	bool valid = header->NameBytes == 0 || mappedNames[header->NameBytes - 1] == 0;
+	for (unsigned int i = 0; i < header->BufferCount && valid; i++)
+	{
+		const ReflectedBuffer& buffer = mappedBuffers[i];
+		valid = buffer.Name < header->NameBytes &&
+			buffer.BindIndex < REFLECTED_MAX_BUFFER_SLOTS &&
+			buffer.FirstVariable <= header->VariableCount &&
+			buffer.VariableCount <= header->VariableCount - buffer.FirstVariable;
+
+		for (unsigned int v = 0; v < buffer.VariableCount && valid; v++)
+		{
+			const ReflectedVariable& variable = mappedVariables[buffer.FirstVariable + v];
+			valid = variable.ByteOffset <= buffer.Size &&
+				variable.Size <= buffer.Size - variable.ByteOffset;
+		}
+	}
+	for (unsigned int i = 0; i < header->VariableCount && valid; i++)
+		valid = mappedVariables[i].Name < header->NameBytes;
+	for (unsigned int i = 0; i < header->ResourceCount && valid; i++)
+	{
+		const ReflectedResource& resource = mappedResources[i];
+		valid = resource.Name < header->NameBytes &&
+			(resource.Type == REFLECTED_RESOURCE_TEXTURE ? resource.BindIndex < REFLECTED_MAX_TEXTURE_SLOTS :
+			 resource.Type == REFLECTED_RESOURCE_SAMPLER ? resource.BindIndex < REFLECTED_MAX_SAMPLER_SLOTS :
+			 resource.Type == REFLECTED_RESOURCE_UAV ? resource.BindIndex < REFLECTED_MAX_UAV_SLOTS :
+			 false);
+	}
+	for (unsigned int i = 0; i < header->ParameterCount && valid; i++)
+	{
+		// A mask covers at most four components
+		const ReflectedParameter& parameter = mappedParameters[i];
+		valid = parameter.SemanticName < header->NameBytes &&
+			parameter.Mask <= 15 &&
+			parameter.Output <= 1;
+	}
+	if (!valid)
+	{
+		Unmap();
+		return false;
+	}
+
+	buffers = mappedBuffers;
+	variables = mappedVariables;
+	resources = mappedResources;
+	parameters = mappedParameters;
+	names = mappedNames;
+	threadGroupSize = header->ThreadGroupSize;
+	bufferCount = header->BufferCount;
+	variableCount = header->VariableCount;
+	resourceCount = header->ResourceCount;
+	parameterCount = header->ParameterCount;
+	nameBytes = header->NameBytes;
+	return true;
+}
+
+bool ShaderReflectionData::Save(const std::wstring& path, unsigned long long key)
+{
+	std::ofstream output(path, std::ios::binary | std::ios::trunc);
+	if (!output.is_open())
+		return false;
+
+	ReflectionHeader header = {};
+	header.Magic = ReflectionMagic;
+	header.Version = SHADER_REFLECTION_VERSION;
+	header.Key = key;
+	header.BufferCount = bufferCount;
+	header.VariableCount = variableCount;
+	header.ResourceCount = resourceCount;
+	header.ParameterCount = parameterCount;
+	header.NameBytes = nameBytes;
+	header.ThreadGroupSize[0] = threadGroupSize[0];
+	header.ThreadGroupSize[1] = threadGroupSize[1];
+	header.ThreadGroupSize[2] = threadGroupSize[2];
+	output.write((const char*)&header, sizeof(ReflectionHeader));
+	output.write((const char*)buffers, bufferCount * sizeof(ReflectedBuffer));
+	output.write((const char*)variables, variableCount * sizeof(ReflectedVariable));
+	output.write((const char*)resources, resourceCount * sizeof(ReflectedResource));
+	output.write((const char*)parameters, parameterCount * sizeof(ReflectedParameter));
+	output.write(names, nameBytes);
+	return (bool)output;
+}
+
+unsigned int ShaderReflectionData::GetBufferCount() { return bufferCount; }
+unsigned int ShaderReflectionData::GetVariableCount() { return variableCount; }
+unsigned int ShaderReflectionData::GetResourceCount() { return resourceCount; }
+unsigned int ShaderReflectionData::GetParameterCount() { return parameterCount; }
+const ReflectedBuffer& ShaderReflectionData::GetBuffer(unsigned int index) { return buffers[index]; }
+const ReflectedVariable& ShaderReflectionData::GetVariable(unsigned int index) { return variables[index]; }
+const ReflectedResource& ShaderReflectionData::GetResource(unsigned int index) { return resources[index]; }
+const ReflectedParameter& ShaderReflectionData::GetParameter(unsigned int index) { return parameters[index]; }
+const char* ShaderReflectionData::GetName(unsigned int name) { return names + name; }
+
+void ShaderReflectionData::GetThreadGroupSize(unsigned int& x, unsigned int& y, unsigned int& z)
+{
+	x = threadGroupSize[0];
+	y = threadGroupSize[1];
+	z = threadGroupSize[2];
+}
+
+// --------------------------------------------------------
+// Self test
+// --------------------------------------------------------
+bool ShaderReflectionData::SelfTest(const std::wstring& scratchPath)
+{
+	const unsigned long long key = 0x0123456789ABCDEFull;
+	bool passed = true;
+	{
+		ShaderReflectionData built;
+		built.AddResource("Albedo", 0, REFLECTED_RESOURCE_TEXTURE);
+		built.AddResource("BasicSampler", 0, REFLECTED_RESOURCE_SAMPLER);
+		built.AddResource("Output", 1, REFLECTED_RESOURCE_UAV);
+		built.AddParameter("POSITION", 0, 3, 7, 0, false);
+		built.AddParameter("TEXCOORD", 1, 3, 3, 0, false);
+		built.AddParameter("SV_POSITION", 0, 3, 15, 0, true);
+		built.SetThreadGroupSize(8, 4, 2);
+		built.AddBuffer("FrameData", 0, 0, 144);
+		built.AddVariable("view", 0, 64);
+		built.AddVariable("proj", 64, 64);
+		built.AddBuffer("Empty", 1, 0, 16);
+		built.AddBuffer("ObjectData", 3, 0, 128);
+		built.AddVariable("world", 0, 64);
+		passed = passed && built.Save(scratchPath, key);
+
+		// Mapped back, everything reads the same
+		ShaderReflectionData loaded;
+		passed = passed && loaded.Load(scratchPath, key);
+		passed = passed &&
+			loaded.GetBufferCount() == 3 &&
+			loaded.GetVariableCount() == 3 &&
+			loaded.GetResourceCount() == 3 &&
+			loaded.GetParameterCount() == 3;
+		for (unsigned int i = 0; i < loaded.GetBufferCount() && passed; i++)
+		{
+			const ReflectedBuffer& a = built.GetBuffer(i);
+			const ReflectedBuffer& b = loaded.GetBuffer(i);
+			passed = strcmp(built.GetName(a.Name), loaded.GetName(b.Name)) == 0 &&
+				a.BindIndex == b.BindIndex && a.Size == b.Size &&
+				a.FirstVariable == b.FirstVariable && a.VariableCount == b.VariableCount;
+		}
+		for (unsigned int i = 0; i < loaded.GetVariableCount() && passed; i++)
+		{
+			const ReflectedVariable& a = built.GetVariable(i);
+			const ReflectedVariable& b = loaded.GetVariable(i);
+			passed = strcmp(built.GetName(a.Name), loaded.GetName(b.Name)) == 0 &&
+				a.ByteOffset == b.ByteOffset && a.Size == b.Size;
+		}
+		for (unsigned int i = 0; i < loaded.GetResourceCount() && passed; i++)
+		{
+			const ReflectedResource& a = built.GetResource(i);
+			const ReflectedResource& b = loaded.GetResource(i);
+			passed = strcmp(built.GetName(a.Name), loaded.GetName(b.Name)) == 0 &&
+				a.BindIndex == b.BindIndex && a.Type == b.Type;
+		}
+		for (unsigned int i = 0; i < loaded.GetParameterCount() && passed; i++)
+		{
+			const ReflectedParameter& a = built.GetParameter(i);
+			const ReflectedParameter& b = loaded.GetParameter(i);
+			passed = strcmp(built.GetName(a.SemanticName), loaded.GetName(b.SemanticName)) == 0 &&
+				a.SemanticIndex == b.SemanticIndex && a.ComponentType == b.ComponentType &&
+				a.Mask == b.Mask && a.Stream == b.Stream && a.Output == b.Output;
+		}
+		unsigned int x, y, z;
+		loaded.GetThreadGroupSize(x, y, z);
+		passed = passed && x == 8 && y == 4 && z == 2;
+		passed = passed && strcmp(loaded.GetName(loaded.GetVariable(2).Name), "world") == 0;
+
+		// Another shader's bytecode doesn't get these
+		ShaderReflectionData stale;
+		passed = passed && !stale.Load(scratchPath, key + 1) && stale.GetBufferCount() == 0;
+	}
+
+	// Records a real shader can't have: each one alone fails the load
+	for (int damage = 0; damage < 7 && passed; damage++)
+	{
+		ShaderReflectionData damaged;
+		damaged.AddResource("Albedo", damage == 0 ? REFLECTED_MAX_TEXTURE_SLOTS : 0, REFLECTED_RESOURCE_TEXTURE);
+		damaged.AddResource("BasicSampler", damage == 1 ? REFLECTED_MAX_SAMPLER_SLOTS : 0, REFLECTED_RESOURCE_SAMPLER);
+		damaged.AddResource("Output", damage == 5 ? REFLECTED_MAX_UAV_SLOTS : 0, REFLECTED_RESOURCE_UAV);
+		damaged.AddParameter("POSITION", 0, 3, damage == 6 ? 16 : 15, 0, false);
+		damaged.AddBuffer("FrameData", damage == 2 ? REFLECTED_MAX_BUFFER_SLOTS : 0, 0, 128);
+		damaged.AddVariable("view", 0, 64);
+		damaged.AddVariable("proj", damage == 3 ? 80 : 64, 64);
+		damaged.AddVariable("farPlane", damage == 4 ? 0xFFFFFFF0 : 112, 16); // Wraps if added up
+		passed = damaged.Save(scratchPath, key);
+
+		ShaderReflectionData loaded;
+		passed = passed && !loaded.Load(scratchPath, key) && loaded.GetBufferCount() == 0;
+	}
+
+	DeleteFileW(scratchPath.c_str());
+	return passed;
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <Windows.h>
+#include <string>
+#include <vector>
+
+// Bump when the records below change, so old sidecar files get rebuilt
+#define SHADER_REFLECTION_VERSION 2
+
+// D3D11's slot limits, repeated here so this doesn't need d3d11.h.
+// A loaded file with bind points past these is rejected.
+#define REFLECTED_MAX_BUFFER_SLOTS 14		// D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT
+#define REFLECTED_MAX_TEXTURE_SLOTS 128		// D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT
+#define REFLECTED_MAX_SAMPLER_SLOTS 16		// D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT
+#define REFLECTED_MAX_UAV_SLOTS 64			// D3D11_1_UAV_SLOT_COUNT
+
+enum REFLECTED_RESOURCE_TYPE
+{
+	REFLECTED_RESOURCE_TEXTURE,
+	REFLECTED_RESOURCE_SAMPLER,
+	REFLECTED_RESOURCE_UAV
+};
+
+// Flat records, written to disk as they are.  Names are byte
+// offsets into one block of null-terminated strings.
+struct ReflectedBuffer
+{
+	unsigned int Name;
+	unsigned int BindIndex;
+	unsigned int Type;				// A D3D_CBUFFER_TYPE
+	unsigned int Size;
+	unsigned int FirstVariable;
+	unsigned int VariableCount;
+};
+
+struct ReflectedVariable
+{
+	unsigned int Name;
+	unsigned int ByteOffset;
+	unsigned int Size;
+};
+
+struct ReflectedResource
+{
+	unsigned int Name;
+	unsigned int BindIndex;
+	unsigned int Type;				// A REFLECTED_RESOURCE_TYPE
+};
+
+// One entry of the input or output signature
+struct ReflectedParameter
+{
+	unsigned int SemanticName;
+	unsigned int SemanticIndex;
+	unsigned int ComponentType;		// A D3D_REGISTER_COMPONENT_TYPE
+	unsigned int Mask;
+	unsigned int Stream;
+	unsigned int Output;			// 0 for inputs, 1 for outputs
+};
+
+// --------------------------------------------------------
+// What SimpleShader needs to know about a shader's constant
+// buffers, variables, textures, samplers & UAVs, its input
+// and output signatures and its thread group size, as flat
+// arrays - so a shader with a sidecar file is never reflected.
+// Doesn't touch D3D, so tools can read the sidecar files too.
+//
+// Either built up with the Add methods, or loaded from a file
+// saved earlier - which is memory-mapped and read in place,
+// so it has to stay alive while its records are in use.
+// --------------------------------------------------------
+class ShaderReflectionData
+{
+public:
+	ShaderReflectionData();
+	~ShaderReflectionData();
+
+	// Variables go in the buffer added last
+	void AddBuffer(const char* name, unsigned int bindIndex, unsigned int type, unsigned int size);
+	void AddVariable(const char* name, unsigned int byteOffset, unsigned int size);
+	void AddResource(const char* name, unsigned int bindIndex, REFLECTED_RESOURCE_TYPE type);
+	void AddParameter(const char* semanticName, unsigned int semanticIndex, unsigned int componentType, unsigned int mask, unsigned int stream, bool output);
+	// Compute shaders only
+	void SetThreadGroupSize(unsigned int x, unsigned int y, unsigned int z);
+
+	// Fails if the file is missing, damaged, from another version
+	// or was saved for different bytecode, as told by the key.
+	// Records that couldn't have come from a real shader - bind
+	// slots out of range, variables past the end of their buffer -
+	// count as damage, so the caller reflects the bytecode instead.
+	bool Load(const std::wstring& path, unsigned long long key);
+	bool Save(const std::wstring& path, unsigned long long key);
+
+	unsigned int GetBufferCount();
+	unsigned int GetVariableCount();
+	unsigned int GetResourceCount();
+	unsigned int GetParameterCount();
+	const ReflectedBuffer& GetBuffer(unsigned int index);
+	const ReflectedVariable& GetVariable(unsigned int index);
+	const ReflectedResource& GetResource(unsigned int index);
+	const ReflectedParameter& GetParameter(unsigned int index);
+	void GetThreadGroupSize(unsigned int& x, unsigned int& y, unsigned int& z);
+	const char* GetName(unsigned int name);
+
+	// Builds a small set of records, saves them to the given
+	// path, maps them back & compares, checks that damaged
+	// records are rejected, then deletes the file
+	static bool SelfTest(const std::wstring& scratchPath);
+
+private:
+	// Maps view pointers & counts onto whichever storage is in use
+	void UseBuiltRecords();
+	void Unmap();
+	unsigned int AddName(const char* name);
+
+	// While building
+	std::vector<ReflectedBuffer> builtBuffers;
+	std::vector<ReflectedVariable> builtVariables;
+	std::vector<ReflectedResource> builtResources;
+	std::vector<ReflectedParameter> builtParameters;
+	std::vector<char> builtNames;
+	unsigned int builtThreadGroupSize[3];
+
+	// What the getters read, built or mapped
+	const ReflectedBuffer* buffers;
+	const ReflectedVariable* variables;
+	const ReflectedResource* resources;
+	const ReflectedParameter* parameters;
+	const char* names;
+	const unsigned int* threadGroupSize;
+	unsigned int bufferCount;
+	unsigned int variableCount;
+	unsigned int resourceCount;
+	unsigned int parameterCount;
+	unsigned int nameBytes;
+
+	HANDLE file;
+	HANDLE mapping;
+	const void* view;
+
+	// The mapping can't be shared
+	ShaderReflectionData(const ShaderReflectionData&) = delete;
+	ShaderReflectionData& operator=(const ShaderReflectionData&) = delete;
+};
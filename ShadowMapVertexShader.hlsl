@@ -1,13 +1,17 @@
 #include "NewInclude.hlsli"
 
-// Constant Buffer for external (C++) data
-cbuffer externalData : register(b0)
+// Constant Buffers for external (C++) data - the light's view is per frame
+cbuffer FrameData : register(b0)
 {
-    matrix world;
     matrix view;
     matrix projection;
 };
 
+cbuffer ObjectData : register(b3)
+{
+    matrix world;
+};
+
 // Struct representing a single vertex worth of data
 // - This should match the vertex definition in our C++ code
 // - By "match", I mean the size, order and number of members
@@ -24,6 +28,11 @@ struct VertexShaderInput
     float3 normal : NORMAL; // Normal vectors
     float2 uv : TEXCOORD; // UV Maps
     float3 tangent : TANGENT; // Tangent of texture
+#ifdef INSTANCED
+    // Per-instance matrices from the second vertex buffer, a row per element
+    float4x4 instanceWorld : WORLD_PER_INSTANCE;
+    float4x4 instanceWorldInvTranspose : WORLDINVTRANSPOSE_PER_INSTANCE;
+#endif
 };
 
 // --------------------------------------------------------
@@ -31,6 +40,11 @@ struct VertexShaderInput
 // --------------------------------------------------------
 float4 main(VertexShaderInput input) : SV_POSITION
 {
-    matrix wvp = mul(projection, mul(view, world));
+#ifdef INSTANCED
+    matrix worldMatrix = transpose(input.instanceWorld);
+#else
+    matrix worldMatrix = world;
+#endif
+    matrix wvp = mul(projection, mul(view, worldMatrix));
     return mul(wvp, float4(input.localPosition, 1.0f));
 }
\ No newline at end of file
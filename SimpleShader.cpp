@@ -1,9 +1,34 @@
 #include "SimpleShader.h"
+#include <algorithm>
+#include <chrono>
 
 // Default error reporting state
 bool ISimpleShader::ReportErrors = false;
 bool ISimpleShader::ReportWarnings = false;
 
+// Upload counters start empty
+unsigned long long ISimpleShader::UploadedBytes = 0;
+unsigned int ISimpleShader::UploadCount = 0;
+unsigned int ISimpleShader::SkippedUploadCount = 0;
+
+// Binds go straight to the context until a cache is given
+PipelineStateCache* ISimpleShader::StateCache = 0;
+
+// Reflection is saved next to each .cso unless this is turned off
+bool ISimpleShader::UseReflectionCache = true;
+unsigned int ISimpleShader::ReflectionCacheHits = 0;
+unsigned int ISimpleShader::ReflectionCacheMisses = 0;
+float ISimpleShader::ReflectionMilliseconds = 0.0f;
+
+// Counts struct & shader disagreements, which are always reported
+unsigned int ISimpleShader::LayoutMismatchCount = 0;
+
+namespace
+{
+	// Set by SelfTest() while it makes mismatches on purpose
+	bool quietLayoutChecks = false;
+}
+
 // To enable error reporting, use either or both 
 // of the following lines somewhere in your program, 
 // preferably before loading/using any shaders.
@@ -65,6 +90,8 @@ void ISimpleShader::CleanUp()
 
 	// Clean up tables
 	varTable.clear();
+	variables.clear();
+	variableNames.clear();
 	cbTable.clear();
 	samplerTable.clear();
 	textureTable.clear();
@@ -94,9 +121,31 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		return false;
 	}
 
+	// The records come from the sidecar file saved the last time this
+	// exact bytecode was loaded, or from reflection if there isn't one
+	auto reflectStart = std::chrono::high_resolution_clock::now();
+	unsigned long long bytecodeHash = HashBytes(
+		(const unsigned char*)shaderBlob->GetBufferPointer(), (unsigned int)shaderBlob->GetBufferSize());
+	std::wstring cachePath = std::wstring(shaderFile) + L".refl";
+
+	ShaderReflectionData reflection;
+	if (UseReflectionCache && reflection.Load(cachePath, bytecodeHash))
+	{
+		ReflectionCacheHits++;
+	}
+	else
+	{
+		ReflectShader(reflection);
+		if (UseReflectionCache)
+			reflection.Save(cachePath, bytecodeHash);
+		ReflectionCacheMisses++;
+	}
+	auto reflectEnd = std::chrono::high_resolution_clock::now();
+	ReflectionMilliseconds += std::chrono::duration<float, std::milli>(reflectEnd - reflectStart).count();
+
 	// Create the shader - Calls an overloaded version of this abstract
 	// method in the appropriate child class
-	shaderValid = CreateShader(shaderBlob);
+	shaderValid = CreateShader(shaderBlob, reflection);
 	if (!shaderValid)
 	{
 		if (ReportErrors)
@@ -109,6 +158,23 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		return false;
 	}
 
+	// After the shader, since creating it cleans up any old tables
+	auto tablesStart = std::chrono::high_resolution_clock::now();
+	BuildTables(reflection);
+	auto tablesEnd = std::chrono::high_resolution_clock::now();
+	ReflectionMilliseconds += std::chrono::duration<float, std::milli>(tablesEnd - tablesStart).count();
+
+	// All set
+	return true;
+}
+
+// --------------------------------------------------------
+// Flattens what D3D reflection says about the shader's
+// textures, samplers, UAVs, constant buffers and their
+// variables, its signatures and its thread group size
+// --------------------------------------------------------
+void ISimpleShader::ReflectShader(ShaderReflectionData& reflection)
+{
 	// Set up shader reflection to get information about
 	// this shader and its variables,  buffers, etc.
 	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
@@ -122,10 +188,6 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 	D3D11_SHADER_DESC shaderDesc;
 	refl->GetDesc(&shaderDesc);
 
-	// Create resource arrays
-	constantBufferCount = shaderDesc.ConstantBuffers;
-	constantBuffers = new SimpleConstantBuffer[constantBufferCount];
-	
 	// Handle bound resources (like shaders and samplers)
 	unsigned int resourceCount = shaderDesc.BoundResources;
 	for (unsigned int r = 0; r < resourceCount; r++)
@@ -139,33 +201,45 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		{
 		case D3D_SIT_STRUCTURED: // Treat structured buffers as texture resources
 		case D3D_SIT_TEXTURE: // A texture resource
-		{
-			// Create the SRV wrapper
-			SimpleSRV* srv = new SimpleSRV();
-			srv->BindIndex = resourceDesc.BindPoint;				// Shader bind point
-			srv->Index = (unsigned int)shaderResourceViews.size();	// Raw index
-
-			textureTable.insert(std::pair<std::string, SimpleSRV*>(resourceDesc.Name, srv));
-			shaderResourceViews.push_back(srv);
-		}
+			reflection.AddResource(resourceDesc.Name, resourceDesc.BindPoint, REFLECTED_RESOURCE_TEXTURE);
 			break;
 
 		case D3D_SIT_SAMPLER: // A sampler resource
-		{
-			// Create the sampler wrapper
-			SimpleSampler* samp = new SimpleSampler();
-			samp->BindIndex = resourceDesc.BindPoint;			// Shader bind point
-			samp->Index = (unsigned int)samplerStates.size();	// Raw index
+			reflection.AddResource(resourceDesc.Name, resourceDesc.BindPoint, REFLECTED_RESOURCE_SAMPLER);
+			break;
 
-			samplerTable.insert(std::pair<std::string, SimpleSampler*>(resourceDesc.Name, samp));
-			samplerStates.push_back(samp);
-		}
+		case D3D_SIT_UAV_APPEND_STRUCTURED: // Any kind of UAV, for compute shaders
+		case D3D_SIT_UAV_CONSUME_STRUCTURED:
+		case D3D_SIT_UAV_RWBYTEADDRESS:
+		case D3D_SIT_UAV_RWSTRUCTURED:
+		case D3D_SIT_UAV_RWSTRUCTURED_WITH_COUNTER:
+		case D3D_SIT_UAV_RWTYPED:
+			reflection.AddResource(resourceDesc.Name, resourceDesc.BindPoint, REFLECTED_RESOURCE_UAV);
 			break;
 		}
 	}
 
+	// Signatures, for input layouts & stream out
+	for (unsigned int i = 0; i < shaderDesc.InputParameters; i++)
+	{
+		D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
+		refl->GetInputParameterDesc(i, &paramDesc);
+		reflection.AddParameter(paramDesc.SemanticName, paramDesc.SemanticIndex, paramDesc.ComponentType, paramDesc.Mask, paramDesc.Stream, false);
+	}
+	for (unsigned int i = 0; i < shaderDesc.OutputParameters; i++)
+	{
+		D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
+		refl->GetOutputParameterDesc(i, &paramDesc);
+		reflection.AddParameter(paramDesc.SemanticName, paramDesc.SemanticIndex, paramDesc.ComponentType, paramDesc.Mask, paramDesc.Stream, true);
+	}
+
+	// Zero for anything but a compute shader
+	unsigned int threadsX, threadsY, threadsZ;
+	refl->GetThreadGroupSize(&threadsX, &threadsY, &threadsZ);
+	reflection.SetThreadGroupSize(threadsX, threadsY, threadsZ);
+
 	// Loop through all constant buffers
-	for (unsigned int b = 0; b < constantBufferCount; b++)
+	for (unsigned int b = 0; b < shaderDesc.ConstantBuffers; b++)
 	{
 		// Get this buffer
 		ID3D11ShaderReflectionConstantBuffer* cb =
@@ -175,62 +249,114 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		D3D11_SHADER_BUFFER_DESC bufferDesc;
 		cb->GetDesc(&bufferDesc);
 
-		// Save the type, which we reference when setting these buffers
-		constantBuffers[b].Type = bufferDesc.Type;
-		
 		// Get the description of the resource binding, so
 		// we know exactly how it's bound in the shader
 		D3D11_SHADER_INPUT_BIND_DESC bindDesc;
 		refl->GetResourceBindingDescByName(bufferDesc.Name, &bindDesc);
+		reflection.AddBuffer(bufferDesc.Name, bindDesc.BindPoint, bufferDesc.Type, bufferDesc.Size);
+
+		// Loop through all variables in this buffer
+		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
+		{
+			// Get the description of the variable
+			D3D11_SHADER_VARIABLE_DESC varDesc;
+			cb->GetVariableByIndex(v)->GetDesc(&varDesc);
+			reflection.AddVariable(varDesc.Name, varDesc.StartOffset, varDesc.Size);
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Builds the lookup tables & constant buffers from the flat
+// reflection records, wherever they came from
+// --------------------------------------------------------
+void ISimpleShader::BuildTables(ShaderReflectionData& reflection)
+{
+	// Create resource arrays
+	constantBufferCount = reflection.GetBufferCount();
+	constantBuffers = new SimpleConstantBuffer[constantBufferCount];
+
+	// Handle bound resources (like shaders and samplers) - UAVs
+	// are left to SimpleComputeShader::CreateShader()
+	for (unsigned int r = 0; r < reflection.GetResourceCount(); r++)
+	{
+		const ReflectedResource& resource = reflection.GetResource(r);
+		if (resource.Type == REFLECTED_RESOURCE_TEXTURE)
+		{
+			// Create the SRV wrapper
+			SimpleSRV* srv = new SimpleSRV();
+			srv->BindIndex = resource.BindIndex;					// Shader bind point
+			srv->Index = (unsigned int)shaderResourceViews.size();	// Raw index
+
+			textureTable.insert(std::pair<std::string, SimpleSRV*>(reflection.GetName(resource.Name), srv));
+			shaderResourceViews.push_back(srv);
+		}
+		else if (resource.Type == REFLECTED_RESOURCE_SAMPLER)
+		{
+			// Create the sampler wrapper
+			SimpleSampler* samp = new SimpleSampler();
+			samp->BindIndex = resource.BindIndex;				// Shader bind point
+			samp->Index = (unsigned int)samplerStates.size();	// Raw index
+
+			samplerTable.insert(std::pair<std::string, SimpleSampler*>(reflection.GetName(resource.Name), samp));
+			samplerStates.push_back(samp);
+		}
+	}
+
+	// Loop through all constant buffers
+	for (unsigned int b = 0; b < constantBufferCount; b++)
+	{
+		const ReflectedBuffer& buffer = reflection.GetBuffer(b);
+
+		// Save the type, which we reference when setting these buffers
+		constantBuffers[b].Type = (D3D_CBUFFER_TYPE)buffer.Type;
 		
 		// Set up the buffer and put its pointer in the table
-		constantBuffers[b].BindIndex = bindDesc.BindPoint;
-		constantBuffers[b].Name = bufferDesc.Name;
-		cbTable.insert(std::pair<std::string, SimpleConstantBuffer*>(bufferDesc.Name, &constantBuffers[b]));
+		constantBuffers[b].BindIndex = buffer.BindIndex;
+		constantBuffers[b].Name = reflection.GetName(buffer.Name);
+		cbTable.insert(std::pair<std::string, SimpleConstantBuffer*>(constantBuffers[b].Name, &constantBuffers[b]));
 
 		// Create this constant buffer
 		D3D11_BUFFER_DESC newBuffDesc = {};
 		newBuffDesc.Usage = D3D11_USAGE_DEFAULT;
-		newBuffDesc.ByteWidth = ((bufferDesc.Size + 15) / 16) * 16; // Quick and dirty 16-byte alignment using integer division
+		newBuffDesc.ByteWidth = ((buffer.Size + 15) / 16) * 16; // Quick and dirty 16-byte alignment using integer division
 		newBuffDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
 		newBuffDesc.CPUAccessFlags = 0;
 		newBuffDesc.MiscFlags = 0;
 		newBuffDesc.StructureByteStride = 0;
-		device->CreateBuffer(&newBuffDesc, 0, constantBuffers[b].ConstantBuffer.GetAddressOf());
+		if (device) // The self test's shader has none
+			device->CreateBuffer(&newBuffDesc, 0, constantBuffers[b].ConstantBuffer.GetAddressOf());
 
 		// Set up the data buffer for this constant buffer
-		constantBuffers[b].Size = bufferDesc.Size;
-		constantBuffers[b].LocalDataBuffer = new unsigned char[bufferDesc.Size];
-		ZeroMemory(constantBuffers[b].LocalDataBuffer, bufferDesc.Size);
+		constantBuffers[b].Size = buffer.Size;
+		constantBuffers[b].LocalDataBuffer = new unsigned char[buffer.Size];
+		ZeroMemory(constantBuffers[b].LocalDataBuffer, buffer.Size);
+
+		// Nothing's been uploaded yet, so the whole buffer starts dirty
+		constantBuffers[b].DirtyStart = 0;
+		constantBuffers[b].DirtyEnd = buffer.Size;
 
 		// Loop through all variables in this buffer
-		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
+		for (unsigned int v = 0; v < buffer.VariableCount; v++)
 		{
-			// Get this variable
-			ID3D11ShaderReflectionVariable* var =
-				cb->GetVariableByIndex(v);
-			
-			// Get the description of the variable and its type
-			D3D11_SHADER_VARIABLE_DESC varDesc;
-			var->GetDesc(&varDesc);
+			const ReflectedVariable& variable = reflection.GetVariable(buffer.FirstVariable + v);
 
 			// Create the variable struct
 			SimpleShaderVariable varStruct = {};
 			varStruct.ConstantBufferIndex = b;
-			varStruct.ByteOffset = varDesc.StartOffset;
-			varStruct.Size = varDesc.Size;
+			varStruct.ByteOffset = variable.ByteOffset;
+			varStruct.Size = variable.Size;
 			
 			// Get a string version
-			std::string varName(varDesc.Name);
+			std::string varName(reflection.GetName(variable.Name));
 
 			// Add this variable to the table and the constant buffer
 			varTable.insert(std::pair<std::string, SimpleShaderVariable>(varName, varStruct));
 			constantBuffers[b].Variables.push_back(varStruct);
+			variables.push_back(varStruct);
+			variableNames.push_back(varName);
 		}
 	}
-
-	// All set
-	return true;
 }
 
 // --------------------------------------------------------
@@ -345,14 +471,9 @@ void ISimpleShader::CopyAllBufferData()
 	// Ensure the shader is valid
 	if (!shaderValid) return;
 
-	// Loop through the constant buffers and copy all data
+	// Loop through the constant buffers and copy any that changed
 	for (unsigned int i = 0; i < constantBufferCount; i++)
-	{
-		// Copy the entire local data buffer
-		deviceContext->UpdateSubresource(
-			constantBuffers[i].ConstantBuffer.Get(), 0, 0,
-			constantBuffers[i].LocalDataBuffer, 0, 0);
-	}
+		UploadBuffer(constantBuffers[i]);
 }
 
 // --------------------------------------------------------
@@ -379,10 +500,8 @@ void ISimpleShader::CopyBufferData(unsigned int index)
 	SimpleConstantBuffer* cb = &this->constantBuffers[index];
 	if (!cb) return;
 
-	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer.Get(), 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+	// Copy the data (if it changed) and get out
+	UploadBuffer(*cb);
 }
 
 // --------------------------------------------------------
@@ -401,10 +520,93 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 	SimpleConstantBuffer* cb = this->FindConstantBuffer(bufferName);
 	if (!cb) return;
 
-	// Copy the data and get out
+	// Copy the data (if it changed) and get out
+	UploadBuffer(*cb);
+}
+
+// --------------------------------------------------------
+// Sends a constant buffer to the GPU, unless nothing was
+// changed since last time or the changes put it back the
+// way it was.  D3D 11.0 can only update a constant buffer
+// as a whole, so the dirty range just says whether to go.
+// --------------------------------------------------------
+void ISimpleShader::UploadBuffer(SimpleConstantBuffer& cb)
+{
+	if (cb.DirtyStart >= cb.DirtyEnd)
+	{
+		SkippedUploadCount++;
+		return;
+	}
+	cb.DirtyStart = 0;
+	cb.DirtyEnd = 0;
+
+	unsigned long long hash = HashBytes(cb.LocalDataBuffer, cb.Size);
+	if (hash == cb.UploadedHash)
+	{
+		SkippedUploadCount++;
+		return;
+	}
+	cb.UploadedHash = hash;
+
+	UpdateGPUBuffer(cb);
+	UploadedBytes += cb.Size;
+	UploadCount++;
+}
+
+void ISimpleShader::UpdateGPUBuffer(SimpleConstantBuffer& cb)
+{
 	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer.Get(), 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+		cb.ConstantBuffer.Get(), 0, 0,
+		cb.LocalDataBuffer, 0, 0);
+}
+
+// --------------------------------------------------------
+// 64-bit FNV-1a of a buffer's contents
+// --------------------------------------------------------
+unsigned long long ISimpleShader::HashBytes(const unsigned char* data, unsigned int size)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	for (unsigned int i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// --------------------------------------------------------
+// Clears the upload counters, usually once a frame
+// --------------------------------------------------------
+void ISimpleShader::ResetUploadStats()
+{
+	UploadedBytes = 0;
+	UploadCount = 0;
+	SkippedUploadCount = 0;
+}
+
+// --------------------------------------------------------
+// Copies data into a variable's spot in the local buffer,
+// growing the buffer's dirty range only if it changes
+// anything.  Setting the same value again costs a compare.
+// --------------------------------------------------------
+void ISimpleShader::WriteVariable(const SimpleShaderVariable& var, const void* data, unsigned int size)
+{
+	SimpleConstantBuffer& cb = constantBuffers[var.ConstantBufferIndex];
+	unsigned char* destination = cb.LocalDataBuffer + var.ByteOffset;
+	if (memcmp(destination, data, size) == 0)
+		return;
+
+	memcpy(destination, data, size);
+	if (cb.DirtyStart >= cb.DirtyEnd)
+	{
+		cb.DirtyStart = var.ByteOffset;
+		cb.DirtyEnd = var.ByteOffset + size;
+	}
+	else
+	{
+		cb.DirtyStart = (std::min)(cb.DirtyStart, var.ByteOffset);
+		cb.DirtyEnd = (std::max)(cb.DirtyEnd, var.ByteOffset + size);
+	}
 }
 
 
@@ -446,10 +648,7 @@ bool ISimpleShader::SetData(std::string name, const void* data, unsigned int siz
 	}
 
 	// Set the data in the local data buffer
-	memcpy(
-		constantBuffers[var->ConstantBufferIndex].LocalDataBuffer + var->ByteOffset,
-		data,
-		size);
+	WriteVariable(*var, data, size);
 
 	// Success
 	return true;
@@ -535,6 +734,479 @@ bool ISimpleShader::SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 dat
 	return this->SetData(name, &data, sizeof(float) * 16);
 }
 
+// --------------------------------------------------------
+// Finds a variable once so it can be set by handle from
+// then on.  The handle is invalid if the variable doesn't
+// exist, and setting with it then just returns false.
+// --------------------------------------------------------
+SimpleVariableHandle ISimpleShader::GetVariableHandle(std::string name)
+{
+	SimpleVariableHandle handle;
+	for (size_t i = 0; i < variableNames.size(); i++)
+	{
+		if (variableNames[i] == name)
+		{
+			handle.Index = (int)i;
+			break;
+		}
+	}
+
+	if (!handle.IsValid() && ReportWarnings)
+	{
+		LogWarning("SimpleShader::GetVariableHandle() - Shader variable '");
+		Log(name);
+		LogWarning("' not found. Setting it by handle will do nothing.\n");
+	}
+	return handle;
+}
+
+// --------------------------------------------------------
+// Sets a variable by handle with arbitrary data of the
+// specified size - no lookup, just a bounds check & copy
+//
+// Returns true if data is copied, false if the handle is
+// invalid or the data is too big for the variable
+// --------------------------------------------------------
+bool ISimpleShader::SetData(SimpleVariableHandle handle, const void* data, unsigned int size)
+{
+	if (handle.Index < 0 || handle.Index >= (int)variables.size())
+		return false;
+
+	const SimpleShaderVariable& var = variables[handle.Index];
+	if (size > var.Size)
+		return false;
+
+	WriteVariable(var, data, size);
+	return true;
+}
+
+bool ISimpleShader::SetInt(SimpleVariableHandle handle, int data)
+{
+	return SetData(handle, &data, sizeof(int));
+}
+
+bool ISimpleShader::SetFloat(SimpleVariableHandle handle, float data)
+{
+	return SetData(handle, &data, sizeof(float));
+}
+
+bool ISimpleShader::SetFloat2(SimpleVariableHandle handle, const DirectX::XMFLOAT2& data)
+{
+	return SetData(handle, &data, sizeof(float) * 2);
+}
+
+bool ISimpleShader::SetFloat3(SimpleVariableHandle handle, const DirectX::XMFLOAT3& data)
+{
+	return SetData(handle, &data, sizeof(float) * 3);
+}
+
+bool ISimpleShader::SetFloat4(SimpleVariableHandle handle, const DirectX::XMFLOAT4& data)
+{
+	return SetData(handle, &data, sizeof(float) * 4);
+}
+
+bool ISimpleShader::SetMatrix4x4(SimpleVariableHandle handle, const DirectX::XMFLOAT4X4& data)
+{
+	return SetData(handle, &data, sizeof(float) * 16);
+}
+
+// --------------------------------------------------------
+// Checks a C++ struct against the named buffer: each of the
+// buffer's variables needs a field with the same name, offset
+// and size.  Fields the shader doesn't use are fine, as long
+// as the struct still covers the whole buffer.
+//
+// Mismatches are logged whether or not ReportErrors is on -
+// they mean the C++ and HLSL sides have drifted apart.  Only
+// SelfTest() quiets them, for the ones it makes itself.
+//
+// Returns the buffer's index, or -1 if it's missing or
+// doesn't match
+// --------------------------------------------------------
+int ISimpleShader::FindMatchingBuffer(std::string name, unsigned int bufferRegister, const ConstantBufferField* fields, unsigned int fieldCount, unsigned int size)
+{
+	// Not an error in itself - a shader may not need the buffer - but a
+	// typo in the name would otherwise fail the same silent way
+	SimpleConstantBuffer* cb = FindConstantBuffer(name);
+	if (!cb)
+	{
+		if (ReportWarnings)
+			LogWarning("SimpleShader::FindMatchingBuffer() - The shader has no cbuffer '" + name + "', so its typed handle is invalid.\n");
+		return -1;
+	}
+	int index = (int)(cb - constantBuffers);
+
+	bool matches = true;
+	if (cb->BindIndex != bufferRegister)
+	{
+		if (!quietLayoutChecks)
+			LogError("SimpleShader::FindMatchingBuffer() - cbuffer '" + name + "' is in register b" +
+				std::to_string(cb->BindIndex) + ", but its struct expects b" + std::to_string(bufferRegister) + ".\n");
+		matches = false;
+	}
+
+	if (size < cb->Size)
+	{
+		if (!quietLayoutChecks)
+			LogError("SimpleShader::FindMatchingBuffer() - The struct for cbuffer '" + name + "' is " +
+				std::to_string(size) + " bytes, but the shader's is " + std::to_string(cb->Size) + ".\n");
+		matches = false;
+	}
+
+	for (size_t v = 0; v < variables.size(); v++)
+	{
+		if (variables[v].ConstantBufferIndex != (unsigned int)index)
+			continue;
+
+		const ConstantBufferField* field = 0;
+		for (unsigned int f = 0; f < fieldCount && !field; f++)
+		{
+			if (variableNames[v] == fields[f].Name)
+				field = &fields[f];
+		}
+
+		if (!field)
+		{
+			if (!quietLayoutChecks)
+				LogError("SimpleShader::FindMatchingBuffer() - The struct for cbuffer '" + name +
+					"' has no field for '" + variableNames[v] + "'.\n");
+			matches = false;
+		}
+		else if (field->ByteOffset != variables[v].ByteOffset || field->Size != variables[v].Size)
+		{
+			if (!quietLayoutChecks)
+				LogError("SimpleShader::FindMatchingBuffer() - '" + variableNames[v] + "' in cbuffer '" + name +
+					"' is " + std::to_string(variables[v].Size) + " bytes at offset " + std::to_string(variables[v].ByteOffset) +
+					", but the struct has " + std::to_string(field->Size) + " bytes at offset " + std::to_string(field->ByteOffset) + ".\n");
+			matches = false;
+		}
+	}
+
+	if (!matches)
+	{
+		LayoutMismatchCount++;
+		return -1;
+	}
+	return index;
+}
+
+// --------------------------------------------------------
+// Replaces a buffer's local data in one go.  Only as much as
+// the buffer holds is copied, so a struct can carry fields
+// past the end for shaders that leave them out.
+// --------------------------------------------------------
+bool ISimpleShader::SetBufferData(int index, const void* data, unsigned int size)
+{
+	if (index < 0 || index >= (int)constantBufferCount)
+		return false;
+
+	SimpleConstantBuffer& cb = constantBuffers[index];
+	if (size < cb.Size)
+		return false;
+
+	if (memcmp(cb.LocalDataBuffer, data, cb.Size) == 0)
+		return true;
+
+	memcpy(cb.LocalDataBuffer, data, cb.Size);
+	cb.DirtyStart = 0;
+	cb.DirtyEnd = cb.Size;
+	return true;
+}
+
+// --------------------------------------------------------
+// Times the two ways of setting variables against each
+// other on a real shader.  Each variable gets a 16 byte
+// write (or its whole size, if smaller) both ways, so the
+// difference is just the lookup.
+//
+// Before timing, one pass each way from zeroed buffers has
+// to leave identical bytes.  The shader is usually one the
+// game draws with, so its local buffers & dirty ranges are
+// put back afterwards, as if nothing had been set.
+// --------------------------------------------------------
+SetterBenchmarkResult ISimpleShader::BenchmarkSetters(ISimpleShader& shader, unsigned int iterations)
+{
+	SetterBenchmarkResult result = {};
+	result.SetsMatch = true;
+	result.VariableCount = (unsigned int)shader.variables.size();
+	result.SetCount = result.VariableCount * iterations;
+	if (result.SetCount == 0)
+		return result;
+
+	std::vector<SimpleVariableHandle> handles;
+	std::vector<unsigned int> sizes;
+	for (size_t i = 0; i < shader.variables.size(); i++)
+	{
+		handles.push_back(shader.GetVariableHandle(shader.variableNames[i]));
+		sizes.push_back((std::min)(shader.variables[i].Size, 16u));
+	}
+	const float data[4] = { 1.0f, 2.0f, 3.0f, 4.0f };
+
+	// Names are passed the way callers usually do: as literals
+	std::vector<const char*> names;
+	for (const std::string& name : shader.variableNames)
+		names.push_back(name.c_str());
+
+	std::vector<std::vector<unsigned char>> saved(shader.constantBufferCount);
+	std::vector<unsigned int> savedDirtyStart(shader.constantBufferCount);
+	std::vector<unsigned int> savedDirtyEnd(shader.constantBufferCount);
+	for (unsigned int b = 0; b < shader.constantBufferCount; b++)
+	{
+		SimpleConstantBuffer& cb = shader.constantBuffers[b];
+		saved[b].assign(cb.LocalDataBuffer, cb.LocalDataBuffer + cb.Size);
+		savedDirtyStart[b] = cb.DirtyStart;
+		savedDirtyEnd[b] = cb.DirtyEnd;
+	}
+
+	// Different data per variable, so one landing on the wrong variable shows
+	std::vector<std::vector<unsigned char>> byName(shader.constantBufferCount);
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (unsigned int b = 0; b < shader.constantBufferCount; b++)
+			memset(shader.constantBuffers[b].LocalDataBuffer, 0, shader.constantBuffers[b].Size);
+
+		for (size_t v = 0; v < names.size(); v++)
+		{
+			const float values[4] = { v * 4.0f + 1.0f, v * 4.0f + 2.0f, v * 4.0f + 3.0f, v * 4.0f + 4.0f };
+			if (pass == 0)
+				shader.SetData(names[v], values, sizes[v]);
+			else
+				shader.SetData(handles[v], values, sizes[v]);
+		}
+
+		for (unsigned int b = 0; b < shader.constantBufferCount; b++)
+		{
+			SimpleConstantBuffer& cb = shader.constantBuffers[b];
+			if (pass == 0)
+				byName[b].assign(cb.LocalDataBuffer, cb.LocalDataBuffer + cb.Size);
+			else if (cb.Size > 0 && memcmp(byName[b].data(), cb.LocalDataBuffer, cb.Size) != 0)
+				result.SetsMatch = false;
+		}
+	}
+	auto nameStart = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < iterations; i++)
+		for (size_t v = 0; v < names.size(); v++)
+			shader.SetData(names[v], data, sizes[v]);
+	auto nameEnd = std::chrono::high_resolution_clock::now();
+
+	auto handleStart = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < iterations; i++)
+		for (size_t v = 0; v < handles.size(); v++)
+			shader.SetData(handles[v], data, sizes[v]);
+	auto handleEnd = std::chrono::high_resolution_clock::now();
+
+	result.NameNanoseconds = std::chrono::duration<float, std::nano>(nameEnd - nameStart).count() / result.SetCount;
+	result.HandleNanoseconds = std::chrono::duration<float, std::nano>(handleEnd - handleStart).count() / result.SetCount;
+
+	for (unsigned int b = 0; b < shader.constantBufferCount; b++)
+	{
+		SimpleConstantBuffer& cb = shader.constantBuffers[b];
+		if (cb.Size > 0)
+			memcpy(cb.LocalDataBuffer, saved[b].data(), cb.Size);
+		cb.DirtyStart = savedDirtyStart[b];
+		cb.DirtyEnd = savedDirtyEnd[b];
+	}
+	return result;
+}
+
+// --------------------------------------------------------
+// Self test
+// --------------------------------------------------------
+namespace
+{
+	// A shader with no device: its tables come from hand-made
+	// reflection, and instead of reaching the GPU, each upload
+	// is written down as the buffer's index & bytes
+	class RecordingShader : public ISimpleShader
+	{
+	public:
+		struct Upload
+		{
+			unsigned int Buffer;
+			std::vector<unsigned char> Bytes;
+		};
+		std::vector<Upload> Uploads;
+
+		RecordingShader(ShaderReflectionData& reflection) :
+			ISimpleShader(0, 0)
+		{
+			BuildTables(reflection);
+			shaderValid = true;
+		}
+		~RecordingShader() { CleanUp(); }
+
+		bool SetShaderResourceView(std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>) { return false; }
+		bool SetSamplerState(std::string, Microsoft::WRL::ComPtr<ID3D11SamplerState>) { return false; }
+		const SimpleConstantBuffer& GetBuffer(unsigned int index) { return constantBuffers[index]; }
+
+	protected:
+		bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob>, ShaderReflectionData&) { return true; }
+		void SetShaderAndCBs() {}
+		void UpdateGPUBuffer(SimpleConstantBuffer& cb)
+		{
+			Upload upload;
+			upload.Buffer = (unsigned int)(&cb - constantBuffers);
+			upload.Bytes.assign(cb.LocalDataBuffer, cb.LocalDataBuffer + cb.Size);
+			Uploads.push_back(upload);
+		}
+	};
+
+	// Mirrors the test shader's "Data" buffer
+	struct alignas(16) TestData
+	{
+		DirectX::XMFLOAT4 First;
+		DirectX::XMFLOAT4 Gap;
+		DirectX::XMFLOAT4 Second;
+		DirectX::XMFLOAT4 End;
+
+		static const char* GetBufferName() { return "Data"; }
+		static unsigned int GetBufferRegister() { return 0; }
+		static const ConstantBufferField* GetFields(unsigned int& count)
+		{
+			static const ConstantBufferField fields[] =
+			{
+				CONSTANT_BUFFER_FIELD(TestData, First, "first"),
+				CONSTANT_BUFFER_FIELD(TestData, Second, "second"),
+			};
+			count = sizeof(fields) / sizeof(fields[0]);
+			return fields;
+		}
+	};
+
+	// The same, with "second" where the gap is
+	struct alignas(16) MisplacedTestData
+	{
+		DirectX::XMFLOAT4 First;
+		DirectX::XMFLOAT4 Second;
+		DirectX::XMFLOAT4 Rest[2];
+
+		static const char* GetBufferName() { return "Data"; }
+		static unsigned int GetBufferRegister() { return 0; }
+		static const ConstantBufferField* GetFields(unsigned int& count)
+		{
+			static const ConstantBufferField fields[] =
+			{
+				CONSTANT_BUFFER_FIELD(MisplacedTestData, First, "first"),
+				CONSTANT_BUFFER_FIELD(MisplacedTestData, Second, "second"),
+			};
+			count = sizeof(fields) / sizeof(fields[0]);
+			return fields;
+		}
+	};
+
+	// Right layout, wrong register
+	struct WrongRegisterTestData : TestData
+	{
+		static unsigned int GetBufferRegister() { return 2; }
+	};
+
+	// A buffer the shader doesn't have
+	struct MissingTestData : TestData
+	{
+		static const char* GetBufferName() { return "Missing"; }
+	};
+}
+
+bool ISimpleShader::SelfTest()
+{
+	// The upload counters are shared with every real shader
+	unsigned long long uploadedBytes = UploadedBytes;
+	unsigned int uploadCount = UploadCount;
+	unsigned int skippedUploadCount = SkippedUploadCount;
+	ResetUploadStats();
+
+	// "Data" has a gap between its two variables; "Other" has just the one
+	ShaderReflectionData reflection;
+	reflection.AddBuffer("Data", 0, D3D11_CT_CBUFFER, 64);
+	reflection.AddVariable("first", 0, 16);
+	reflection.AddVariable("second", 32, 16);
+	reflection.AddBuffer("Other", 1, D3D11_CT_CBUFFER, 16);
+	reflection.AddVariable("third", 0, 16);
+	RecordingShader shader(reflection);
+	bool passed = true;
+
+	// Nothing's on the GPU yet, so both go up once, then never again until changed
+	shader.CopyAllBufferData();
+	passed = passed && shader.Uploads.size() == 2;
+	shader.CopyAllBufferData();
+	passed = passed && shader.Uploads.size() == 2 && SkippedUploadCount == 2;
+
+	// The dirty range covers just the variables set, gap included
+	const DirectX::XMFLOAT4 one(1, 2, 3, 4);
+	const DirectX::XMFLOAT4 two(5, 6, 7, 8);
+	shader.SetFloat4(shader.GetVariableHandle("second"), two);
+	passed = passed && shader.GetBuffer(0).DirtyStart == 32 && shader.GetBuffer(0).DirtyEnd == 48;
+	shader.SetFloat4("first", one);
+	passed = passed && shader.GetBuffer(0).DirtyStart == 0 && shader.GetBuffer(0).DirtyEnd == 48;
+	passed = passed && shader.GetBuffer(1).DirtyStart >= shader.GetBuffer(1).DirtyEnd;
+
+	// Only "Data" goes, holding exactly what was set
+	shader.CopyAllBufferData();
+	passed = passed && shader.Uploads.size() == 3 && shader.Uploads.back().Buffer == 0;
+	if (passed)
+	{
+		const std::vector<unsigned char>& bytes = shader.Uploads.back().Bytes;
+		const unsigned char zeros[16] = {};
+		passed = memcmp(&bytes[0], &one, 16) == 0 && memcmp(&bytes[16], zeros, 16) == 0 &&
+			memcmp(&bytes[32], &two, 16) == 0 && memcmp(&bytes[48], zeros, 16) == 0;
+	}
+
+	// Setting what's already there dirties nothing
+	shader.SetFloat4("first", one);
+	passed = passed && shader.GetBuffer(0).DirtyStart >= shader.GetBuffer(0).DirtyEnd;
+
+	// A change that's undone before the upload is dirty, but hashes
+	// the same as what the GPU has, so it's skipped
+	shader.SetFloat4("first", two);
+	shader.SetFloat4("first", one);
+	passed = passed && shader.GetBuffer(0).DirtyStart < shader.GetBuffer(0).DirtyEnd;
+	unsigned int skipped = SkippedUploadCount;
+	shader.CopyBufferData("Data");
+	passed = passed && shader.Uploads.size() == 3 && SkippedUploadCount == skipped + 1;
+	passed = passed && shader.GetBuffer(0).DirtyStart >= shader.GetBuffer(0).DirtyEnd;
+
+	// One buffer at a time leaves the other's changes waiting
+	shader.SetFloat4("first", two);
+	shader.SetFloat4("third", two);
+	shader.CopyBufferData(1);
+	passed = passed && shader.Uploads.size() == 4 && shader.Uploads.back().Buffer == 1;
+	passed = passed && shader.GetBuffer(0).DirtyStart < shader.GetBuffer(0).DirtyEnd;
+	shader.CopyAllBufferData();
+	passed = passed && shader.Uploads.size() == 5 && shader.Uploads.back().Buffer == 0;
+	passed = passed && UploadCount == 5 && UploadedBytes == 64 + 16 + 64 + 16 + 64;
+
+	// Typed lookups, with the errors they make on purpose kept off the console
+	bool reportErrors = ReportErrors;
+	bool reportWarnings = ReportWarnings;
+	unsigned int layoutMismatches = LayoutMismatchCount;
+	ReportErrors = false;
+	ReportWarnings = false;
+	quietLayoutChecks = true;
+
+	TypedBufferHandle<TestData> typed = shader.GetTypedBuffer<TestData>();
+	passed = passed && typed.IsValid() && LayoutMismatchCount == layoutMismatches;
+	passed = passed && !shader.GetTypedBuffer<MissingTestData>().IsValid() && LayoutMismatchCount == layoutMismatches;
+	passed = passed && !shader.GetTypedBuffer<MisplacedTestData>().IsValid() && LayoutMismatchCount == layoutMismatches + 1;
+	passed = passed && !shader.GetTypedBuffer<WrongRegisterTestData>().IsValid() && LayoutMismatchCount == layoutMismatches + 2;
+
+	// A whole struct lands where the variables would
+	TestData data = {};
+	data.First = two;
+	data.Second = one;
+	shader.SetTypedBuffer(typed, data);
+	shader.CopyAllBufferData();
+	passed = passed && shader.Uploads.size() == 6 && memcmp(shader.Uploads.back().Bytes.data(), &data, sizeof(data)) == 0;
+
+	quietLayoutChecks = false;
+	ReportErrors = reportErrors;
+	ReportWarnings = reportWarnings;
+	LayoutMismatchCount = layoutMismatches;
+	UploadedBytes = uploadedBytes;
+	UploadCount = uploadCount;
+	SkippedUploadCount = skippedUploadCount;
+	return passed;
+}
+
 // --------------------------------------------------------
 // Determines if the shader contains the specified
 // variable within one of its constant buffers
@@ -744,7 +1416,7 @@ void SimpleVertexShader::CleanUp()
 //
 // Returns true if shader is created correctly, false otherwise
 // --------------------------------------------------------
-bool SimpleVertexShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob)
+bool SimpleVertexShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, ShaderReflectionData& reflection)
 {
 	// Clean up first, in the event this method is
 	// called more than once on the same object
@@ -766,33 +1438,22 @@ bool SimpleVertexShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlo
 	if (inputLayout)
 		return true;
 
-	// Vertex shader was created successfully, so we now use the
-	// shader code to re-reflect and create an input layout that 
-	// matches what the vertex shader expects.  Code adapted from:
+	// Vertex shader was created successfully, so we now use its
+	// input signature to create an input layout that matches what
+	// the vertex shader expects.  Code adapted from:
 	// https://takinginitiative.wordpress.com/2011/12/11/directx-1011-basic-shader-reflection-automatic-input-layout-creation/
 
-	// Reflect shader info
-	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		IID_ID3D11ShaderReflection,
-		(void**)refl.GetAddressOf());
-	
-	// Get shader info
-	D3D11_SHADER_DESC shaderDesc;
-	refl->GetDesc(&shaderDesc);
-
-	// Read input layout description from shader info
+	// Read input layout description from the signature records
 	std::vector<D3D11_INPUT_ELEMENT_DESC> inputLayoutDesc;
-	for (unsigned int i = 0; i< shaderDesc.InputParameters; i++)
+	for (unsigned int i = 0; i < reflection.GetParameterCount(); i++)
 	{
-		D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
-		refl->GetInputParameterDesc(i, &paramDesc);
+		const ReflectedParameter& paramDesc = reflection.GetParameter(i);
+		if (paramDesc.Output)
+			continue;
 
 		// Check the semantic name for "_PER_INSTANCE"
 		std::string perInstanceStr = "_PER_INSTANCE";
-		std::string sem = paramDesc.SemanticName;
+		std::string sem = reflection.GetName(paramDesc.SemanticName);
 		int lenDiff = (int)sem.size() - (int)perInstanceStr.size();
 		bool isPerInstance = 
 			lenDiff >= 0 &&
@@ -800,7 +1461,7 @@ bool SimpleVertexShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlo
 
 		// Fill out input element desc
 		D3D11_INPUT_ELEMENT_DESC elementDesc = {};
-		elementDesc.SemanticName = paramDesc.SemanticName;
+		elementDesc.SemanticName = reflection.GetName(paramDesc.SemanticName);
 		elementDesc.SemanticIndex = paramDesc.SemanticIndex;
 		elementDesc.InputSlot = 0;
 		elementDesc.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
@@ -869,8 +1530,16 @@ void SimpleVertexShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader and input layout
-	deviceContext->IASetInputLayout(inputLayout.Get());
-	deviceContext->VSSetShader(shader.Get(), 0, 0);
+	if (StateCache)
+	{
+		StateCache->SetInputLayout(inputLayout.Get());
+		StateCache->SetVertexShader(shader.Get());
+	}
+	else
+	{
+		deviceContext->IASetInputLayout(inputLayout.Get());
+		deviceContext->VSSetShader(shader.Get(), 0, 0);
+	}
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -880,6 +1549,11 @@ void SimpleVertexShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
+		if (StateCache)
+		{
+			StateCache->SetConstantBuffer(PIPELINE_STAGE_VERTEX, constantBuffers[i].BindIndex, constantBuffers[i].ConstantBuffer.Get());
+			continue;
+		}
 		deviceContext->VSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
@@ -911,7 +1585,10 @@ bool SimpleVertexShader::SetShaderResourceView(std::string name, Microsoft::WRL:
 	}
 
 	// Set the shader resource view
-	deviceContext->VSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	if (StateCache)
+		StateCache->SetShaderResource(PIPELINE_STAGE_VERTEX, srvInfo->BindIndex, srv.Get());
+	else
+		deviceContext->VSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -941,7 +1618,10 @@ bool SimpleVertexShader::SetSamplerState(std::string name, Microsoft::WRL::ComPt
 	}
 
 	// Set the shader resource view
-	deviceContext->VSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	if (StateCache)
+		StateCache->SetSampler(PIPELINE_STAGE_VERTEX, sampInfo->BindIndex, samplerState.Get());
+	else
+		deviceContext->VSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -985,7 +1665,7 @@ void SimplePixelShader::CleanUp()
 //
 // Returns true if shader is created correctly, false otherwise
 // --------------------------------------------------------
-bool SimplePixelShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob)
+bool SimplePixelShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, ShaderReflectionData& reflection)
 {
 	// Clean up first, in the event this method is
 	// called more than once on the same object
@@ -1012,7 +1692,10 @@ void SimplePixelShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 	
 	// Set the shader
-	deviceContext->PSSetShader(shader.Get(), 0, 0);
+	if (StateCache)
+		StateCache->SetPixelShader(shader.Get());
+	else
+		deviceContext->PSSetShader(shader.Get(), 0, 0);
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1022,6 +1705,11 @@ void SimplePixelShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
+		if (StateCache)
+		{
+			StateCache->SetConstantBuffer(PIPELINE_STAGE_PIXEL, constantBuffers[i].BindIndex, constantBuffers[i].ConstantBuffer.Get());
+			continue;
+		}
 		deviceContext->PSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
@@ -1053,7 +1741,10 @@ bool SimplePixelShader::SetShaderResourceView(std::string name, Microsoft::WRL::
 	}
 
 	// Set the shader resource view
-	deviceContext->PSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	if (StateCache)
+		StateCache->SetShaderResource(PIPELINE_STAGE_PIXEL, srvInfo->BindIndex, srv.Get());
+	else
+		deviceContext->PSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1083,7 +1774,10 @@ bool SimplePixelShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr
 	}
 
 	// Set the shader resource view
-	deviceContext->PSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	if (StateCache)
+		StateCache->SetSampler(PIPELINE_STAGE_PIXEL, sampInfo->BindIndex, samplerState.Get());
+	else
+		deviceContext->PSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1129,7 +1823,7 @@ void SimpleDomainShader::CleanUp()
 //
 // Returns true if shader is created correctly, false otherwise
 // --------------------------------------------------------
-bool SimpleDomainShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob)
+bool SimpleDomainShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, ShaderReflectionData& reflection)
 {
 	// Clean up first, in the event this method is
 	// called more than once on the same object
@@ -1272,7 +1966,7 @@ void SimpleHullShader::CleanUp()
 //
 // Returns true if shader is created correctly, false otherwise
 // --------------------------------------------------------
-bool SimpleHullShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob)
+bool SimpleHullShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, ShaderReflectionData& reflection)
 {
 	// Clean up first, in the event this method is
 	// called more than once on the same object
@@ -1420,7 +2114,7 @@ void SimpleGeometryShader::CleanUp()
 //
 // Returns true if shader is created correctly, false otherwise
 // --------------------------------------------------------
-bool SimpleGeometryShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob)
+bool SimpleGeometryShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, ShaderReflectionData& reflection)
 {
 	// Clean up first, in the event this method is
 	// called more than once on the same object
@@ -1428,7 +2122,7 @@ bool SimpleGeometryShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderB
 
 	// Using stream out?
 	if (useStreamOut)
-		return this->CreateShaderWithStreamOut(shaderBlob);
+		return this->CreateShaderWithStreamOut(shaderBlob, reflection);
 
 	// Create the shader from the blob
 	HRESULT result = device->CreateGeometryShader(
@@ -1449,37 +2143,26 @@ bool SimpleGeometryShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderB
 //
 // Returns true if shader is created correctly, false otherwise
 // --------------------------------------------------------
-bool SimpleGeometryShader::CreateShaderWithStreamOut(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob)
+bool SimpleGeometryShader::CreateShaderWithStreamOut(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, ShaderReflectionData& reflection)
 {
 	// Clean up first, in the event this method is
 	// called more than once on the same object
 	this->CleanUp();
 
-	// Reflect shader info
-	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		IID_ID3D11ShaderReflection,
-		(void**)refl.GetAddressOf());
-
-	// Get shader info
-	D3D11_SHADER_DESC shaderDesc;
-	refl->GetDesc(&shaderDesc);
-
 	// Set up the output signature
 	streamOutVertexSize = 0;
 	std::vector<D3D11_SO_DECLARATION_ENTRY> soDecl;
-	for (unsigned int i = 0; i < shaderDesc.OutputParameters; i++)
+	for (unsigned int i = 0; i < reflection.GetParameterCount(); i++)
 	{
 		// Get the info about this entry
-		D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
-		refl->GetOutputParameterDesc(i, &paramDesc);
+		const ReflectedParameter& paramDesc = reflection.GetParameter(i);
+		if (!paramDesc.Output)
+			continue;
 		
 		// Create the SO Declaration
 		D3D11_SO_DECLARATION_ENTRY entry = {};
 		entry.SemanticIndex  = paramDesc.SemanticIndex;
-		entry.SemanticName   = paramDesc.SemanticName;
+		entry.SemanticName   = reflection.GetName(paramDesc.SemanticName);
 		entry.Stream         = paramDesc.Stream;
 		entry.StartComponent = 0; // Assume starting at 0
 		entry.OutputSlot     = 0; // Assume the first output slot
@@ -1713,7 +2396,7 @@ void SimpleComputeShader::CleanUp()
 //
 // Returns true if shader is created correctly, false otherwise
 // --------------------------------------------------------
-bool SimpleComputeShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob)
+bool SimpleComputeShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, ShaderReflectionData& reflection)
 {
 	// Clean up first, in the event this method is
 	// called more than once on the same object
@@ -1730,43 +2413,16 @@ bool SimpleComputeShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBl
 	if (result != S_OK)
 		return false;
 
-	// Set up shader reflection to get information about UAV's
-	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		IID_ID3D11ShaderReflection,
-		(void**)refl.GetAddressOf());
-
-	// Get the description of the shader
-	D3D11_SHADER_DESC shaderDesc;
-	refl->GetDesc(&shaderDesc);
-	
 	// Grab the thread info
-	threadsTotal = refl->GetThreadGroupSize(
-		&threadsX,
-		&threadsY,
-		&threadsZ);
+	reflection.GetThreadGroupSize(threadsX, threadsY, threadsZ);
+	threadsTotal = threadsX * threadsY * threadsZ;
 
-	// Loop and get all UAV resources
-	unsigned int resourceCount = shaderDesc.BoundResources;
-	for (unsigned int r = 0; r < resourceCount; r++)
+	// Get all UAV resources
+	for (unsigned int r = 0; r < reflection.GetResourceCount(); r++)
 	{
-		// Get this resource's description
-		D3D11_SHADER_INPUT_BIND_DESC resourceDesc;
-		refl->GetResourceBindingDesc(r, &resourceDesc);
-
-		// Check the type, looking for any kind of UAV
-		switch (resourceDesc.Type)
-		{
-		case D3D_SIT_UAV_APPEND_STRUCTURED:
-		case D3D_SIT_UAV_CONSUME_STRUCTURED:
-		case D3D_SIT_UAV_RWBYTEADDRESS:
-		case D3D_SIT_UAV_RWSTRUCTURED:
-		case D3D_SIT_UAV_RWSTRUCTURED_WITH_COUNTER:
-		case D3D_SIT_UAV_RWTYPED:
-			uavTable.insert(std::pair<std::string, unsigned int>(resourceDesc.Name, resourceDesc.BindPoint));
-		}
+		const ReflectedResource& resource = reflection.GetResource(r);
+		if (resource.Type == REFLECTED_RESOURCE_UAV)
+			uavTable.insert(std::pair<std::string, unsigned int>(reflection.GetName(resource.Name), resource.BindIndex));
 	}
 
 	// All set
@@ -6,6 +6,9 @@
 #include <d3dcompiler.h>
 #include <DirectXMath.h>
 #include <wrl/client.h>
+#include "PipelineStateCache.h"
+#include "ShaderReflectionData.h"
+#include "ConstantBufferLayout.h"
 
 #include <unordered_map>
 #include <vector>
@@ -37,6 +40,36 @@ struct SimpleConstantBuffer
 	Microsoft::WRL::ComPtr<ID3D11Buffer> ConstantBuffer = 0;
 	unsigned char* LocalDataBuffer = 0;
 	std::vector<SimpleShaderVariable> Variables;
+
+	// Bytes the setters actually changed since the last upload -
+	// nothing is dirty when DirtyStart >= DirtyEnd
+	unsigned int DirtyStart = 0;
+	unsigned int DirtyEnd = 0;
+	unsigned long long UploadedHash = 0;	// Of what the GPU copy holds
+};
+
+// --------------------------------------------------------
+// Refers to a shader variable without its name.  Look it up
+// once with GetVariableHandle(), then set by handle to skip
+// hashing the name on every call.  Only valid for the shader
+// it came from.
+// --------------------------------------------------------
+struct SimpleVariableHandle
+{
+	int Index = -1;
+	bool IsValid() const { return Index >= 0; }
+};
+
+// --------------------------------------------------------
+// Timings from ISimpleShader::BenchmarkSetters()
+// --------------------------------------------------------
+struct SetterBenchmarkResult
+{
+	unsigned int VariableCount;
+	unsigned int SetCount;
+	float NameNanoseconds;		// Per set, by name
+	float HandleNanoseconds;	// Per set, by handle
+	bool SetsMatch;				// Both ways left the same bytes in every buffer
 };
 
 // --------------------------------------------------------
@@ -89,6 +122,43 @@ public:
 	bool SetMatrix4x4(std::string name, const float data[16]);
 	bool SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 data);
 
+	// Same as above, by handle - these write straight to the local data buffer
+	SimpleVariableHandle GetVariableHandle(std::string name);
+	bool SetData(SimpleVariableHandle handle, const void* data, unsigned int size);
+	bool SetInt(SimpleVariableHandle handle, int data);
+	bool SetFloat(SimpleVariableHandle handle, float data);
+	bool SetFloat2(SimpleVariableHandle handle, const DirectX::XMFLOAT2& data);
+	bool SetFloat3(SimpleVariableHandle handle, const DirectX::XMFLOAT3& data);
+	bool SetFloat4(SimpleVariableHandle handle, const DirectX::XMFLOAT4& data);
+	bool SetMatrix4x4(SimpleVariableHandle handle, const DirectX::XMFLOAT4X4& data);
+
+	// Whole cbuffers from a C++ struct (see ConstantBufferLayout.h).
+	// The lookup checks the buffer's register, and every variable
+	// reflection found in it, against the struct and reports anything
+	// that doesn't line up; the handle is invalid then, or if the
+	// shader has no such buffer (a warning, when those are on).
+	template<typename T>
+	TypedBufferHandle<T> GetTypedBuffer()
+	{
+		static_assert(ConstantBufferStructCheck<T>::Value, "");
+		unsigned int fieldCount = 0;
+		const ConstantBufferField* fields = T::GetFields(fieldCount);
+		TypedBufferHandle<T> handle;
+		handle.Index = FindMatchingBuffer(T::GetBufferName(), T::GetBufferRegister(), fields, fieldCount, sizeof(T));
+		return handle;
+	}
+
+	// One copy into the local buffer, uploaded by the next CopyAllBufferData()
+	template<typename T>
+	bool SetTypedBuffer(TypedBufferHandle<T> handle, const T& data)
+	{
+		return SetBufferData(handle.Index, &data, sizeof(T));
+	}
+
+	// The untyped halves of the two above
+	int FindMatchingBuffer(std::string name, unsigned int bufferRegister, const ConstantBufferField* fields, unsigned int fieldCount, unsigned int size);
+	bool SetBufferData(int index, const void* data, unsigned int size);
+
 	// Setting shader resources
 	virtual bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv) = 0;
 	virtual bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState) = 0;
@@ -122,6 +192,50 @@ public:
 	static bool ReportErrors;
 	static bool ReportWarnings;
 
+	// Error logging - to the console & the debugger, colored.
+	// Static so code that builds shaders for SimpleShader can
+	// report the same way it does.
+	static void Log(std::string message, WORD color);
+	static void LogW(std::wstring message, WORD color);
+	static void Log(std::string message);
+	static void LogW(std::wstring message);
+	static void LogError(std::string message);
+	static void LogErrorW(std::wstring message);
+	static void LogWarning(std::string message);
+	static void LogWarningW(std::wstring message);
+
+	// Constant buffer uploads across every shader, since the last reset
+	static unsigned long long UploadedBytes;
+	static unsigned int UploadCount;
+	static unsigned int SkippedUploadCount;
+	static void ResetUploadStats();
+
+	// When set, vertex & pixel shaders bind through this instead of
+	// the context, so binds that change nothing are dropped.  Shared
+	// by every shader, since they all bind to the one context.
+	static PipelineStateCache* StateCache;
+
+	// Loaded shaders keep their reflection in a "<file>.cso.refl"
+	// sidecar, keyed by a hash of the bytecode, and later loads of
+	// the same bytecode read that instead of calling D3DReflect
+	static bool UseReflectionCache;
+	static unsigned int ReflectionCacheHits;
+	static unsigned int ReflectionCacheMisses;
+	static float ReflectionMilliseconds;		// Reflecting or loading, plus building the tables
+
+	// Typed buffer lookups whose struct didn't match the shader
+	static unsigned int LayoutMismatchCount;
+
+	// Sets every variable in the shader by name, then by handle
+	static SetterBenchmarkResult BenchmarkSetters(ISimpleShader& shader, unsigned int iterations);
+
+	// Drives the setters & uploads of a shader built from hand-made
+	// reflection, recording what would reach the GPU: first uploads,
+	// dirty ranges, repeats & changes that cancel out being skipped.
+	// Then the typed buffer lookups: a struct that matches, a buffer
+	// the shader lacks, and a wrong register or offset.
+	static bool SelfTest();
+
 protected:
 	
 	bool shaderValid;
@@ -141,11 +255,20 @@ protected:
 	std::unordered_map<std::string, SimpleSRV*> textureTable;
 	std::unordered_map<std::string, SimpleSampler*> samplerTable;
 
+	// Every variable in load order - a handle is an index into these
+	std::vector<SimpleShaderVariable> variables;
+	std::vector<std::string> variableNames;
+
 	// Initialization method
 	bool LoadShaderFile(LPCWSTR shaderFile);
-
-	// Pure virtual functions for dealing with shader types
-	virtual bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob) = 0;
+	void ReflectShader(ShaderReflectionData& reflection);
+	void BuildTables(ShaderReflectionData& reflection);
+
+	// Pure virtual functions for dealing with shader types.  The
+	// reflection records are there for anything else a shader type
+	// needs - input layouts, stream out, UAVs - so none of them
+	// reflect the bytecode again.
+	virtual bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, ShaderReflectionData& reflection) = 0;
 	virtual void SetShaderAndCBs() = 0;
 
 	virtual void CleanUp();
@@ -154,15 +277,11 @@ protected:
 	SimpleShaderVariable* FindVariable(std::string name, int size);
 	SimpleConstantBuffer* FindConstantBuffer(std::string name);
 
-	// Error logging
-	void Log(std::string message, WORD color);
-	void LogW(std::wstring message, WORD color);
-	void Log(std::string message);
-	void LogW(std::wstring message);
-	void LogError(std::string message);
-	void LogErrorW(std::wstring message);
-	void LogWarning(std::string message);
-	void LogWarningW(std::wstring message);
+	// Helpers for change tracking
+	void WriteVariable(const SimpleShaderVariable& var, const void* data, unsigned int size);
+	void UploadBuffer(SimpleConstantBuffer& cb);
+	virtual void UpdateGPUBuffer(SimpleConstantBuffer& cb);	// Once UploadBuffer() decides to go
+	static unsigned long long HashBytes(const unsigned char* data, unsigned int size);
 };
 
 // --------------------------------------------------------
@@ -185,7 +304,7 @@ protected:
 	bool perInstanceCompatible;
 	 Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout;
 	 Microsoft::WRL::ComPtr<ID3D11VertexShader> shader;
-	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
+	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, ShaderReflectionData& reflection);
 	void SetShaderAndCBs();
 	void CleanUp();
 };
@@ -206,7 +325,7 @@ public:
 
 protected:
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> shader;
-	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
+	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, ShaderReflectionData& reflection);
 	void SetShaderAndCBs();
 	void CleanUp();
 };
@@ -226,7 +345,7 @@ public:
 
 protected:
 	Microsoft::WRL::ComPtr<ID3D11DomainShader> shader;
-	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
+	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, ShaderReflectionData& reflection);
 	void SetShaderAndCBs();
 	void CleanUp();
 };
@@ -246,7 +365,7 @@ public:
 
 protected:
 	Microsoft::WRL::ComPtr<ID3D11HullShader> shader;
-	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
+	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, ShaderReflectionData& reflection);
 	void SetShaderAndCBs();
 	void CleanUp();
 };
@@ -277,8 +396,8 @@ protected:
 	bool allowStreamOutRasterization;
 	unsigned int streamOutVertexSize;
 
-	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
-	bool CreateShaderWithStreamOut(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
+	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, ShaderReflectionData& reflection);
+	bool CreateShaderWithStreamOut(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, ShaderReflectionData& reflection);
 	void SetShaderAndCBs();
 	void CleanUp();
 
@@ -317,7 +436,7 @@ protected:
 	unsigned int threadsZ;
 	unsigned int threadsTotal;
 
-	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
+	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, ShaderReflectionData& reflection);
 	void SetShaderAndCBs();
 	void CleanUp();
 };
\ No newline at end of file
@@ -1,11 +1,12 @@
 #include "Sky.h"
 
-Sky::Sky()
+Sky::Sky() :
+	geometryMesh(nullptr)
 {
 }
 
 Sky::Sky(
-	std::shared_ptr<Mesh> mesh, 
+	Mesh* mesh, 
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler, 
 	Microsoft::WRL::ComPtr<ID3D11Device> device,
 	std::shared_ptr<SimpleVertexShader> vertexShaderSky,
@@ -35,10 +36,10 @@ Sky::~Sky()
 {
 }
 
-void Sky::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::shared_ptr<Camera> camera)
+void Sky::Draw(PipelineStateCache& stateCache, std::shared_ptr<Camera> camera)
 {
-	context->RSSetState(rasterizerState.Get());
-	context->OMSetDepthStencilState(depthState.Get(), 0);
+	stateCache.SetRasterizerState(rasterizerState.Get());
+	stateCache.SetDepthStencilState(depthState.Get(), 0);
 
 	vertexShader->SetMatrix4x4("view",camera->GetViewMatrix());
 	vertexShader->SetMatrix4x4("proj", camera->GetProjectionMatrix());
@@ -55,10 +56,10 @@ void Sky::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::shared_
 	pixelShader->SetShader();
 	
 
-	geometryMesh->Draw();
+	geometryMesh->Draw(stateCache);
 
 	// reset state to default
-	context->RSSetState(0);
-	context->OMSetDepthStencilState(0, 0);
+	stateCache.SetRasterizerState(0);
+	stateCache.SetDepthStencilState(0, 0);
 
 }
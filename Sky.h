@@ -14,7 +14,8 @@ class Sky
 public:
 	//giving this a default constructor since the game class wants that in its constructor
 	Sky();
-	Sky(std::shared_ptr<Mesh> mesh,
+	// The mesh is borrowed - it has to outlive the sky
+	Sky(Mesh* mesh,
 		Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler,
 		Microsoft::WRL::ComPtr<ID3D11Device> device,
 		std::shared_ptr<SimpleVertexShader> vertexShaderSky,
@@ -23,14 +24,14 @@ public:
 	);
 		~Sky();
 		void Draw(
-			Microsoft::WRL::ComPtr<ID3D11DeviceContext>	context,
+			PipelineStateCache& stateCache,
 			std::shared_ptr<Camera> camera);
 private:
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> sampleState;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cubeMapSubresourceView;
 	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> depthState;
 	Microsoft::WRL::ComPtr<ID3D11RasterizerState> rasterizerState;
-	std::shared_ptr<Mesh> geometryMesh;
+	Mesh* geometryMesh;
 	std::shared_ptr<SimplePixelShader> pixelShader;
 	std::shared_ptr<SimpleVertexShader> vertexShader;
 };
@@ -0,0 +1,126 @@
+#include "SpatialIndex.h"
+#include <chrono>
+
+using namespace DirectX;
+
+SpatialIndex::SpatialIndex() :
+	movedCount(0),
+	reinsertedCount(0),
+	updateMilliseconds(0.0f)
+{
+}
+
+void SpatialIndex::Add(Entity entity, unsigned int transformID, XMFLOAT3 localCenter, XMFLOAT3 localExtents)
+{
+	if (transformID >= records.size())
+		records.resize((size_t)transformID + 1, Record{ Entity{ 0, 0 }, AABB_TREE_NULL, false });
+
+	Record& record = records[transformID];
+	if (record.Active)
+		return;
+
+	record.Owner = entity;
+	record.Proxy = AABB_TREE_NULL;
+	record.Active = true;
+	record.LocalCenter = localCenter;
+	record.LocalExtents = localExtents;
+	pending.push_back(transformID);
+}
+
+void SpatialIndex::Remove(unsigned int transformID)
+{
+	if (transformID >= records.size() || !records[transformID].Active)
+		return;
+
+	Record& record = records[transformID];
+	if (record.Proxy != AABB_TREE_NULL)
+		tree.DestroyProxy(record.Proxy);
+	record.Proxy = AABB_TREE_NULL;
+	record.Active = false;
+}
+
+// --------------------------------------------------------
+// New entities go in first, then everything the transforms
+// rebuilt gets its box refit.  Changed transforms that aren't
+// in the index (cameras, say) are skipped.
+// --------------------------------------------------------
+void SpatialIndex::Update(TransformSystem& transforms)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	transforms.TakeChangedIDs(changedIDs);
+
+	for (unsigned int id : pending)
+	{
+		Record& record = records[id];
+		if (!record.Active || record.Proxy != AABB_TREE_NULL)
+			continue;
+
+		record.WorldBox = TransformBox(record.LocalCenter, record.LocalExtents, transforms.GetWorldMatrix(id));
+		record.Proxy = tree.CreateProxy(record.WorldBox, id);
+	}
+	pending.clear();
+
+	movedCount = 0;
+	reinsertedCount = 0;
+	for (unsigned int id : changedIDs)
+	{
+		if (id >= records.size() || records[id].Proxy == AABB_TREE_NULL)
+			continue;
+
+		Record& record = records[id];
+		record.WorldBox = TransformBox(record.LocalCenter, record.LocalExtents, transforms.GetWorldMatrix(id));
+		movedCount++;
+		if (tree.MoveProxy(record.Proxy, record.WorldBox))
+			reinsertedCount++;
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	updateMilliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+bool SpatialIndex::RayCast(XMFLOAT3 origin, XMFLOAT3 direction, float maxDistance, Entity& hit, float& distance)
+{
+	XMFLOAT3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	bool found = false;
+	distance = maxDistance;
+
+	tree.RayCast(origin, direction, maxDistance, [&](int proxy, float)
+		{
+			const Record& record = records[tree.GetUserData(proxy)];
+			float entry = DynamicAABBTree::IntersectRay(record.WorldBox, origin, inverseDirection);
+			if (entry >= 0.0f && entry < distance)
+			{
+				distance = entry;
+				hit = record.Owner;
+				found = true;
+			}
+			return distance;
+		});
+
+	return found;
+}
+
+unsigned int SpatialIndex::GetCount() { return tree.GetProxyCount(); }
+int SpatialIndex::GetHeight() { return tree.GetHeight(); }
+unsigned int SpatialIndex::GetMovedCount() { return movedCount; }
+unsigned int SpatialIndex::GetReinsertedCount() { return reinsertedCount; }
+float SpatialIndex::GetUpdateMilliseconds() { return updateMilliseconds; }
+
+// --------------------------------------------------------
+// World box around a transformed local box: the center goes
+// through the matrix, and each world extent is how far the
+// three scaled & rotated local axes reach along it
+// --------------------------------------------------------
+AABB SpatialIndex::TransformBox(XMFLOAT3 center, XMFLOAT3 extents, const XMFLOAT4X4& world)
+{
+	XMMATRIX matrix = XMLoadFloat4x4(&world);
+	XMVECTOR worldCenter = XMVector3Transform(XMLoadFloat3(&center), matrix);
+	XMVECTOR worldExtents = XMVectorMultiplyAdd(XMVectorAbs(matrix.r[0]), XMVectorReplicate(extents.x),
+		XMVectorMultiplyAdd(XMVectorAbs(matrix.r[1]), XMVectorReplicate(extents.y),
+			XMVectorMultiply(XMVectorAbs(matrix.r[2]), XMVectorReplicate(extents.z))));
+
+	AABB box;
+	XMStoreFloat3(&box.Min, XMVectorSubtract(worldCenter, worldExtents));
+	XMStoreFloat3(&box.Max, XMVectorAdd(worldCenter, worldExtents));
+	return box;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "DynamicAABBTree.h"
+#include "EntityRegistry.h"
+#include "TransformSystem.h"
+
+// --------------------------------------------------------
+// The scene's entities in a DynamicAABBTree, by world-space box.
+//
+// Each entity is added once with its mesh's local bounds.  After
+// that, Update() asks the TransformSystem which world matrices
+// it rebuilt and only refits those entities - anything that
+// didn't move costs nothing, and most small moves stay inside
+// the tree's fat boxes.
+//
+// Queries test the real world boxes, so they only report
+// entities that actually overlap.
+// --------------------------------------------------------
+class SpatialIndex
+{
+public:
+	SpatialIndex();
+
+	// The entity goes into the tree on the next Update()
+	void Add(Entity entity, unsigned int transformID, DirectX::XMFLOAT3 localCenter, DirectX::XMFLOAT3 localExtents);
+	void Remove(unsigned int transformID);
+
+	// Run after the transforms' matrices are rebuilt
+	void Update(TransformSystem& transforms);
+
+	// func(Entity entity) for every entity whose box passes
+	template<typename Func> void QueryAABB(const AABB& box, Func func);
+	template<typename Func> void QuerySphere(DirectX::XMFLOAT3 center, float radius, Func func);
+	template<typename Func> void QueryFrustum(const Frustum& frustum, Func func);
+
+	// Closest entity whose box the ray hits.  False if there isn't one.
+	bool RayCast(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, Entity& hit, float& distance);
+
+	unsigned int GetCount();
+	int GetHeight();
+
+	// From the last Update()
+	unsigned int GetMovedCount();
+	unsigned int GetReinsertedCount();
+	float GetUpdateMilliseconds();
+
+private:
+	struct Record
+	{
+		Entity Owner;
+		int Proxy;		// AABB_TREE_NULL until it's in the tree
+		bool Active;
+		DirectX::XMFLOAT3 LocalCenter;
+		DirectX::XMFLOAT3 LocalExtents;
+		AABB WorldBox;
+	};
+
+	static AABB TransformBox(DirectX::XMFLOAT3 center, DirectX::XMFLOAT3 extents, const DirectX::XMFLOAT4X4& world);
+
+	DynamicAABBTree tree;
+
+	// Indexed by transform ID, which the tree keeps as each proxy's user data
+	std::vector<Record> records;
+	std::vector<unsigned int> pending;
+	std::vector<unsigned int> changedIDs;
+
+	unsigned int movedCount;
+	unsigned int reinsertedCount;
+	float updateMilliseconds;
+};
+
+template<typename Func>
+void SpatialIndex::QueryAABB(const AABB& box, Func func)
+{
+	tree.QueryAABB(box, [&](int proxy)
+		{
+			const Record& record = records[tree.GetUserData(proxy)];
+			if (DynamicAABBTree::Overlaps(record.WorldBox, box))
+				func(record.Owner);
+		});
+}
+
+template<typename Func>
+void SpatialIndex::QuerySphere(DirectX::XMFLOAT3 center, float radius, Func func)
+{
+	tree.QuerySphere(center, radius, [&](int proxy)
+		{
+			const Record& record = records[tree.GetUserData(proxy)];
+			if (DynamicAABBTree::OverlapsSphere(record.WorldBox, center, radius))
+				func(record.Owner);
+		});
+}
+
+template<typename Func>
+void SpatialIndex::QueryFrustum(const Frustum& frustum, Func func)
+{
+	tree.QueryFrustum(frustum, [&](int proxy)
+		{
+			const Record& record = records[tree.GetUserData(proxy)];
+			const AABB& box = record.WorldBox;
+			if (FrustumCuller::IsAABBVisible(frustum,
+				(box.Min.x + box.Max.x) * 0.5f, (box.Min.y + box.Max.y) * 0.5f, (box.Min.z + box.Max.z) * 0.5f,
+				(box.Max.x - box.Min.x) * 0.5f, (box.Max.y - box.Min.y) * 0.5f, (box.Max.z - box.Min.z) * 0.5f))
+				func(record.Owner);
+		});
+}
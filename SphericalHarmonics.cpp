@@ -0,0 +1,249 @@
+#include "SphericalHarmonics.h"
+#include "ParallelFor.h"
+#include <mutex>
+#include <vector>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	// Normalization constants for each basis function
+	const float BasisScale[9] = {
+		0.282095f,
+		0.488603f, 0.488603f, 0.488603f,
+		1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f };
+
+	// Evaluates all 9 basis functions for 4 directions at once
+	void EvaluateBasis(FXMVECTOR x, FXMVECTOR y, FXMVECTOR z, XMVECTOR basis[9])
+	{
+		basis[0] = XMVectorReplicate(BasisScale[0]);
+		basis[1] = XMVectorScale(y, BasisScale[1]);
+		basis[2] = XMVectorScale(z, BasisScale[2]);
+		basis[3] = XMVectorScale(x, BasisScale[3]);
+		basis[4] = XMVectorScale(XMVectorMultiply(x, y), BasisScale[4]);
+		basis[5] = XMVectorScale(XMVectorMultiply(y, z), BasisScale[5]);
+		basis[6] = XMVectorScale(XMVectorSubtract(XMVectorScale(XMVectorMultiply(z, z), 3.0f), XMVectorSplatOne()), BasisScale[6]);
+		basis[7] = XMVectorScale(XMVectorMultiply(x, z), BasisScale[7]);
+		basis[8] = XMVectorScale(XMVectorSubtract(XMVectorMultiply(x, x), XMVectorMultiply(y, y)), BasisScale[8]);
+	}
+
+	float HorizontalSum(FXMVECTOR v)
+	{
+		return XMVectorGetX(XMVector4Dot(v, XMVectorSplatOne()));
+	}
+
+	// Same face layout as ProjectCubemap(), one texel at a time
+	XMFLOAT3 TexelDirection(unsigned int face, unsigned int x, unsigned int y, unsigned int size)
+	{
+		float u = 2.0f * (x + 0.5f) / size - 1.0f;
+		float v = 2.0f * (y + 0.5f) / size - 1.0f;
+		XMFLOAT3 direction;
+		switch (face)
+		{
+		case 0: direction = XMFLOAT3(1.0f, -v, -u); break;
+		case 1: direction = XMFLOAT3(-1.0f, -v, u); break;
+		case 2: direction = XMFLOAT3(u, 1.0f, v); break;
+		case 3: direction = XMFLOAT3(u, -1.0f, -v); break;
+		case 4: direction = XMFLOAT3(u, -v, 1.0f); break;
+		default: direction = XMFLOAT3(-u, -v, -1.0f); break;
+		}
+		XMStoreFloat3(&direction, XMVector3Normalize(XMLoadFloat3(&direction)));
+		return direction;
+	}
+}
+
+// --------------------------------------------------------
+// Integrates radiance * basis over the sphere, weighting each
+// texel by the solid angle it covers.
+//
+// Texels are handled 4 at a time along each row: their colors
+// are transposed into red, green and blue vectors so all 27
+// running sums are plain multiply-adds.  Rows are spread over
+// every core, each chunk adding into the total once at the end.
+// --------------------------------------------------------
+SH9Color SphericalHarmonics::ProjectCubemap(const XMFLOAT4* texels, unsigned int size)
+{
+	XMVECTOR total[27] = {};
+	XMVECTOR totalWeight = XMVectorZero();
+	std::mutex totalLock;
+
+	ParallelFor((size_t)size * 6, 16, [&](size_t begin, size_t end)
+	{
+		XMVECTOR sums[27] = {};
+		XMVECTOR weightSum = XMVectorZero();
+		const XMVECTOR one = XMVectorSplatOne();
+		const XMVECTOR laneOffsets = XMVectorSet(0.5f, 1.5f, 2.5f, 3.5f);
+		const XMVECTOR texelScale = XMVectorReplicate(2.0f / size);
+
+		for (size_t faceRow = begin; faceRow < end; faceRow++)
+		{
+			unsigned int face = (unsigned int)(faceRow / size);
+			unsigned int y = (unsigned int)(faceRow % size);
+			const XMFLOAT4* row = &texels[faceRow * size];
+			XMVECTOR v = XMVectorReplicate(2.0f * (y + 0.5f) / size - 1.0f);
+
+			for (unsigned int x = 0; x < size; x += 4)
+			{
+				XMVECTOR u = XMVectorSubtract(XMVectorMultiply(XMVectorAdd(XMVectorReplicate((float)x), laneOffsets), texelScale), one);
+
+				// Unnormalized direction through each texel center
+				XMVECTOR dx, dy, dz;
+				switch (face)
+				{
+				case 0: dx = one; dy = XMVectorNegate(v); dz = XMVectorNegate(u); break;
+				case 1: dx = XMVectorNegate(one); dy = XMVectorNegate(v); dz = u; break;
+				case 2: dx = u; dy = one; dz = v; break;
+				case 3: dx = u; dy = XMVectorNegate(one); dz = XMVectorNegate(v); break;
+				case 4: dx = u; dy = XMVectorNegate(v); dz = one; break;
+				default: dx = XMVectorNegate(u); dy = XMVectorNegate(v); dz = XMVectorNegate(one); break;
+				}
+
+				// Solid angle of a texel is proportional to (1 + u^2 + v^2)^(-3/2)
+				XMVECTOR invLength = XMVectorReciprocalSqrt(XMVectorMultiplyAdd(u, u, XMVectorMultiplyAdd(v, v, one)));
+				XMVECTOR weight = XMVectorMultiply(XMVectorMultiply(invLength, invLength), invLength);
+				dx = XMVectorMultiply(dx, invLength);
+				dy = XMVectorMultiply(dy, invLength);
+				dz = XMVectorMultiply(dz, invLength);
+
+				// Rows that aren't a multiple of 4 wide get zero texels at the end
+				XMVECTOR colors[4];
+				for (unsigned int lane = 0; lane < 4; lane++)
+					colors[lane] = x + lane < size ? XMLoadFloat4(&row[x + lane]) : XMVectorZero();
+				if (x + 4 > size)
+					weight = XMVectorSelect(weight, XMVectorZero(), XMVectorGreaterOrEqual(XMVectorAdd(XMVectorReplicate((float)x), laneOffsets), XMVectorReplicate((float)size)));
+
+				XMMATRIX channels = XMMatrixTranspose(XMMATRIX(colors[0], colors[1], colors[2], colors[3]));
+				XMVECTOR red = XMVectorMultiply(channels.r[0], weight);
+				XMVECTOR green = XMVectorMultiply(channels.r[1], weight);
+				XMVECTOR blue = XMVectorMultiply(channels.r[2], weight);
+
+				XMVECTOR basis[9];
+				EvaluateBasis(dx, dy, dz, basis);
+				for (int i = 0; i < 9; i++)
+				{
+					sums[i * 3 + 0] = XMVectorMultiplyAdd(basis[i], red, sums[i * 3 + 0]);
+					sums[i * 3 + 1] = XMVectorMultiplyAdd(basis[i], green, sums[i * 3 + 1]);
+					sums[i * 3 + 2] = XMVectorMultiplyAdd(basis[i], blue, sums[i * 3 + 2]);
+				}
+				weightSum = XMVectorAdd(weightSum, weight);
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(totalLock);
+		for (int i = 0; i < 27; i++)
+			total[i] = XMVectorAdd(total[i], sums[i]);
+		totalWeight = XMVectorAdd(totalWeight, weightSum);
+	});
+
+	// The weights above are only proportional to solid angle, so
+	// scale everything so they add up to the full sphere
+	float scale = 4.0f * XM_PI / HorizontalSum(totalWeight);
+
+	SH9Color result = {};
+	for (int i = 0; i < 9; i++)
+	{
+		result.Coefficients[i] = XMFLOAT4(
+			HorizontalSum(total[i * 3 + 0]) * scale,
+			HorizontalSum(total[i * 3 + 1]) * scale,
+			HorizontalSum(total[i * 3 + 2]) * scale,
+			0.0f);
+	}
+	return result;
+}
+
+// --------------------------------------------------------
+// Convolving with a clamped cosine just scales each band:
+// pi, 2pi/3 and pi/4 (Ramamoorthi & Hanrahan), and the
+// extra 1/pi is the Lambert BRDF
+// --------------------------------------------------------
+SH9Color SphericalHarmonics::ConvolveCosine(const SH9Color& radiance)
+{
+	const float bandScale[3] = { 1.0f, 2.0f / 3.0f, 0.25f };
+	const int bandOf[9] = { 0, 1, 1, 1, 2, 2, 2, 2, 2 };
+
+	SH9Color result = {};
+	for (int i = 0; i < 9; i++)
+	{
+		XMStoreFloat4(&result.Coefficients[i],
+			XMVectorScale(XMLoadFloat4(&radiance.Coefficients[i]), bandScale[bandOf[i]]));
+	}
+	return result;
+}
+
+XMVECTOR SphericalHarmonics::Evaluate(const SH9Color& sh, FXMVECTOR direction)
+{
+	XMVECTOR basis[9];
+	EvaluateBasis(XMVectorSplatX(direction), XMVectorSplatY(direction), XMVectorSplatZ(direction), basis);
+
+	XMVECTOR result = XMVectorZero();
+	for (int i = 0; i < 9; i++)
+		result = XMVectorMultiplyAdd(XMLoadFloat4(&sh.Coefficients[i]), basis[i], result);
+	return result;
+}
+
+// --------------------------------------------------------
+// Each environment is one basis function times a constant,
+// so exactly one coefficient should come out non-zero:
+//   1               -> Y00 = sqrt(4pi)
+//   cos(theta)      -> Y10 = sqrt(4pi/3)
+//   3cos^2(theta)-1 -> Y20 = 4 sqrt(pi/5)
+// Convolving then scales the bands by pi, 2pi/3 & pi/4 (over
+// pi), so the irradiance / pi is 1, 2/3 cos & (3cos^2 - 1)/4.
+// The size isn't a multiple of 4, to cover the row tails.
+// --------------------------------------------------------
+bool SphericalHarmonics::SelfTest()
+{
+	const unsigned int size = 30;
+	const float tolerance = 0.01f;
+	const int expectedIndex[3] = { 0, 2, 6 };
+	const float expectedCoefficient[3] = {
+		sqrtf(4.0f * XM_PI),
+		sqrtf(4.0f * XM_PI / 3.0f),
+		4.0f * sqrtf(XM_PI / 5.0f) };
+	const float bandFactor[3] = { XM_PI, 2.0f * XM_PI / 3.0f, XM_PI / 4.0f };
+
+	bool passed = true;
+	std::vector<XMFLOAT4> texels((size_t)size * size * 6);
+	for (int environment = 0; environment < 3 && passed; environment++)
+	{
+		for (unsigned int face = 0; face < 6; face++)
+			for (unsigned int y = 0; y < size; y++)
+				for (unsigned int x = 0; x < size; x++)
+				{
+					float z = TexelDirection(face, x, y, size).z;
+					float radiance = environment == 0 ? 1.0f : environment == 1 ? z : 3.0f * z * z - 1.0f;
+					// Green & blue get scaled copies, so the channels can't mix
+					texels[((size_t)face * size + y) * size + x] = XMFLOAT4(radiance, radiance * 2.0f, radiance * 0.5f, 1.0f);
+				}
+
+		SH9Color radiance = ProjectCubemap(texels.data(), size);
+		SH9Color irradiance = ConvolveCosine(radiance);
+		for (int i = 0; i < 9 && passed; i++)
+		{
+			float expected = i == expectedIndex[environment] ? expectedCoefficient[environment] : 0.0f;
+			const XMFLOAT4& c = radiance.Coefficients[i];
+			passed =
+				fabsf(c.x - expected) < tolerance &&
+				fabsf(c.y - expected * 2.0f) < tolerance &&
+				fabsf(c.z - expected * 0.5f) < tolerance;
+		}
+
+		// The band's factor, with the 1/pi put back
+		float factor = irradiance.Coefficients[expectedIndex[environment]].x * XM_PI / radiance.Coefficients[expectedIndex[environment]].x;
+		passed = passed && fabsf(factor - bandFactor[environment]) < 1e-4f;
+
+		// And evaluated, against the closed-form irradiance / pi
+		const XMVECTOR normals[3] = { XMVectorSet(0, 0, 1, 0), XMVectorSet(0.6f, 0, -0.8f, 0), XMVectorSet(0, 1, 0, 0) };
+		for (int n = 0; n < 3 && passed; n++)
+		{
+			float cosTheta = XMVectorGetZ(normals[n]);
+			float expected =
+				environment == 0 ? 1.0f :
+				environment == 1 ? 2.0f / 3.0f * cosTheta :
+				(3.0f * cosTheta * cosTheta - 1.0f) / 4.0f;
+			passed = fabsf(XMVectorGetX(Evaluate(irradiance, normals[n])) - expected) < tolerance;
+		}
+	}
+	return passed;
+}
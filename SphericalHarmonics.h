@@ -0,0 +1,35 @@
+#pragma once
+#include <DirectXMath.h>
+
+// --------------------------------------------------------
+// 9 coefficients (bands 0 - 2) for red, green and blue.
+// Stored as float4s so it matches a float4[9] cbuffer array.
+// --------------------------------------------------------
+struct SH9Color
+{
+	DirectX::XMFLOAT4 Coefficients[9];
+};
+
+// --------------------------------------------------------
+// Order-3 spherical harmonics for low frequency lighting.
+//
+// Basis order is the usual l, m one:
+//   Y00, Y1-1, Y10, Y11, Y2-2, Y2-1, Y20, Y21, Y22
+// --------------------------------------------------------
+class SphericalHarmonics
+{
+public:
+	// Projects the radiance of a cube given as 6 faces of size x size
+	// linear RGBA texels, in D3D face order (+X, -X, +Y, -Y, +Z, -Z)
+	static SH9Color ProjectCubemap(const DirectX::XMFLOAT4* texels, unsigned int size);
+
+	// Radiance -> irradiance / pi, so evaluating it with a normal
+	// gives the diffuse light to multiply into the albedo
+	static SH9Color ConvolveCosine(const SH9Color& radiance);
+
+	static DirectX::XMVECTOR Evaluate(const SH9Color& sh, DirectX::FXMVECTOR direction);
+
+	// Projects constant, cos(theta) & 3cos^2(theta) - 1 environments and
+	// compares the coefficients & convolved irradiance with closed forms
+	static bool SelfTest();
+};
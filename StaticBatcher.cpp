@@ -0,0 +1,163 @@
+#include "StaticBatcher.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace DirectX;
+
+StaticBatcher::StaticBatcher() :
+	sourceCount(0),
+	vertexCount(0),
+	buildMilliseconds(0.0f)
+{
+}
+
+void StaticBatcher::Build(
+	EntityRegistry& registry,
+	TransformSystem& transforms,
+	HandlePool<Mesh>& meshes,
+	HandlePool<Material>& materials,
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	Clear(registry, meshes);
+
+	// Find every opaque static entity & the cell its bounds are centered in
+	sources.clear();
+	registry.ForEach<TransformHandle, MeshRenderer, Static>(
+		[&](Entity entity, TransformHandle& transform, MeshRenderer& renderer, Static&)
+		{
+			Mesh* mesh = meshes.Get(renderer.RenderMesh);
+			Material* material = materials.Get(renderer.RenderMaterial);
+			if (!mesh || !material || material->IsTransparent())
+				return;
+
+			Source source;
+			source.Owner = entity;
+			source.Renderer = renderer;
+			source.World = transform.GetWorldMatrix();
+			source.WorldInverseTranspose = transform.GetWorldInverseTransposeMatrix();
+
+			XMFLOAT3 localCenter = mesh->GetAABBCenter();
+			XMFLOAT3 center;
+			XMStoreFloat3(&center, XMVector3Transform(XMLoadFloat3(&localCenter), XMLoadFloat4x4(&source.World)));
+			source.CellX = (int)std::floor(center.x / STATIC_BATCH_CELL_SIZE);
+			source.CellY = (int)std::floor(center.y / STATIC_BATCH_CELL_SIZE);
+			source.CellZ = (int)std::floor(center.z / STATIC_BATCH_CELL_SIZE);
+			sources.push_back(source);
+		});
+
+	// Everything that ends up in one mesh is now side by side
+	std::sort(sources.begin(), sources.end(), [](const Source& a, const Source& b)
+		{
+			if (a.Renderer.RenderMaterial.Value != b.Renderer.RenderMaterial.Value)
+				return a.Renderer.RenderMaterial.Value < b.Renderer.RenderMaterial.Value;
+			if (a.CellX != b.CellX) return a.CellX < b.CellX;
+			if (a.CellY != b.CellY) return a.CellY < b.CellY;
+			return a.CellZ < b.CellZ;
+		});
+
+	size_t first = 0;
+	while (first < sources.size())
+	{
+		const Source& head = sources[first];
+		size_t last = first + 1;
+		while (last < sources.size() &&
+			sources[last].Renderer.RenderMaterial == head.Renderer.RenderMaterial &&
+			sources[last].CellX == head.CellX &&
+			sources[last].CellY == head.CellY &&
+			sources[last].CellZ == head.CellZ)
+			last++;
+
+		mergedVertices.clear();
+		mergedIndices.clear();
+		for (size_t i = first; i < last; i++)
+			AppendSource(sources[i], *meshes.Get(sources[i].Renderer.RenderMesh));
+
+		MeshHandle merged = meshes.Create(
+			mergedVertices.data(), (unsigned int)mergedVertices.size(),
+			mergedIndices.data(), (unsigned int)mergedIndices.size(),
+			device, context);
+		vertexCount += (unsigned int)mergedVertices.size();
+
+		if (batchMeshes.size() == batchEntities.size())
+		{
+			Entity batchEntity = registry.Create();
+			registry.Add(batchEntity, transforms.Create());
+			batchEntities.push_back(batchEntity);
+		}
+		registry.Add(batchEntities[batchMeshes.size()], MeshRenderer{ merged, head.Renderer.RenderMaterial });
+		batchMeshes.push_back(merged);
+
+		first = last;
+	}
+
+	// The originals stop drawing themselves.  Done after the query,
+	// since changing components moves entities between chunks.
+	for (const Source& source : sources)
+	{
+		registry.Add(source.Owner, StaticBatched{ source.Renderer });
+		registry.Remove<MeshRenderer>(source.Owner);
+	}
+	sourceCount = (unsigned int)sources.size();
+
+	auto end = std::chrono::high_resolution_clock::now();
+	buildMilliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+void StaticBatcher::Clear(EntityRegistry& registry, HandlePool<Mesh>& meshes)
+{
+	std::vector<Entity> batched;
+	registry.ForEach<StaticBatched>([&](Entity entity, StaticBatched&) { batched.push_back(entity); });
+	for (Entity entity : batched)
+	{
+		MeshRenderer original = registry.Get<StaticBatched>(entity)->Original;
+		registry.Add(entity, original);
+		registry.Remove<StaticBatched>(entity);
+	}
+
+	for (Entity batchEntity : batchEntities)
+		registry.Remove<MeshRenderer>(batchEntity);
+	for (MeshHandle mesh : batchMeshes)
+		meshes.Destroy(mesh);
+	batchMeshes.clear();
+
+	sourceCount = 0;
+	vertexCount = 0;
+}
+
+unsigned int StaticBatcher::GetSourceCount() { return sourceCount; }
+unsigned int StaticBatcher::GetBatchCount() { return (unsigned int)batchMeshes.size(); }
+unsigned int StaticBatcher::GetVertexCount() { return vertexCount; }
+float StaticBatcher::GetBuildMilliseconds() { return buildMilliseconds; }
+
+// --------------------------------------------------------
+// Copies one entity's mesh into the merged arrays in world
+// space.  Mirroring transforms turn the triangles inside out,
+// so those get their winding flipped back.
+// --------------------------------------------------------
+void StaticBatcher::AppendSource(const Source& source, Mesh& mesh)
+{
+	XMMATRIX world = XMLoadFloat4x4(&source.World);
+	XMMATRIX normalMatrix = XMLoadFloat4x4(&source.WorldInverseTranspose);
+	unsigned int baseVertex = (unsigned int)mergedVertices.size();
+
+	// Tangents are rebuilt from the merged triangles by the new mesh
+	for (const Vertex& vertex : mesh.GetVertices())
+	{
+		Vertex merged = vertex;
+		XMStoreFloat3(&merged.Position, XMVector3Transform(XMLoadFloat3(&vertex.Position), world));
+		XMStoreFloat3(&merged.Normal, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&vertex.Normal), normalMatrix)));
+		mergedVertices.push_back(merged);
+	}
+
+	bool mirrored = XMVectorGetX(XMMatrixDeterminant(world)) < 0.0f;
+	const std::vector<unsigned int>& indices = mesh.GetIndices();
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		mergedIndices.push_back(baseVertex + indices[i]);
+		mergedIndices.push_back(baseVertex + indices[mirrored ? i + 2 : i + 1]);
+		mergedIndices.push_back(baseVertex + indices[mirrored ? i + 1 : i + 2]);
+	}
+}
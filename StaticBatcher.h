@@ -0,0 +1,84 @@
+#pragma once
+#include <DirectXMath.h>
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <vector>
+#include "EntityRegistry.h"
+#include "TransformSystem.h"
+#include "Components.h"
+#include "Mesh.h"
+#include "Material.h"
+
+// Static entities are grouped into cubes this wide, by the
+// center of their world bounds, so each merged mesh stays
+// small enough to be culled on its own
+#define STATIC_BATCH_CELL_SIZE 32.0f
+
+// --------------------------------------------------------
+// Bakes entities tagged Static into a few merged meshes.
+//
+// Every static entity's vertices are moved into world space
+// and appended to the mesh for its material & cell.  Each of
+// those meshes is drawn by a batch entity of its own with an
+// identity transform, so both passes (shadows included) and
+// the culling treat it like any other entity.  The originals
+// keep their transforms - and their place in the spatial
+// index - but lose their MeshRenderer until Clear().
+//
+// Transparent materials are left alone: their draws are sorted
+// back to front one entity at a time, which a merged mesh
+// would break.
+//
+// Moving a static entity afterwards does nothing visible until
+// the next Build().
+// --------------------------------------------------------
+class StaticBatcher
+{
+public:
+	StaticBatcher();
+
+	// Undoes any earlier batches, then merges everything tagged
+	// Static that's opaque.  World matrices have to be up to date.
+	void Build(
+		EntityRegistry& registry,
+		TransformSystem& transforms,
+		HandlePool<Mesh>& meshes,
+		HandlePool<Material>& materials,
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	// Gives the static entities their own MeshRenderers back
+	void Clear(EntityRegistry& registry, HandlePool<Mesh>& meshes);
+
+	// From the last Build()
+	unsigned int GetSourceCount();
+	unsigned int GetBatchCount();
+	unsigned int GetVertexCount();
+	float GetBuildMilliseconds();
+
+private:
+	// One static entity, ready to be sorted into its batch
+	struct Source
+	{
+		Entity Owner;
+		MeshRenderer Renderer;
+		int CellX, CellY, CellZ;
+		DirectX::XMFLOAT4X4 World;
+		DirectX::XMFLOAT4X4 WorldInverseTranspose;
+	};
+
+	void AppendSource(const Source& source, Mesh& mesh);
+
+	// Batch entities are kept & reused between builds, since
+	// their transforms can't be given back
+	std::vector<Entity> batchEntities;
+	std::vector<MeshHandle> batchMeshes;
+	std::vector<Source> sources;
+
+	std::vector<Vertex> mergedVertices;
+	std::vector<unsigned int> mergedIndices;
+
+	unsigned int sourceCount;
+	unsigned int vertexCount;
+	float buildMilliseconds;
+};
@@ -0,0 +1,194 @@
+#include "TextureArrayPacker.h"
+
+TextureArrayPacker::TextureArrayPacker(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	std::shared_ptr<ResourceCache> resources) :
+	device(device),
+	context(context),
+	resources(resources)
+{
+}
+
+TextureArrayPacker::~TextureArrayPacker()
+{
+}
+
+// --------------------------------------------------------
+// Queues a texture for packing.  Adding the same path twice
+// hands back the original ticket so it only takes one slice.
+// --------------------------------------------------------
+unsigned int TextureArrayPacker::AddTexture(std::wstring path)
+{
+	for (unsigned int i = 0; i < sources.size(); i++)
+	{
+		if (sources[i].Path == path)
+			return i;
+	}
+
+	SourceTexture source = {};
+	source.Path = path;
+	sources.push_back(source);
+	return (unsigned int)sources.size() - 1;
+}
+
+unsigned int TextureArrayPacker::AddTexture(ResourceHandle texture)
+{
+	for (unsigned int i = 0; i < sources.size(); i++)
+	{
+		if (texture && sources[i].Resource == texture)
+			return i;
+	}
+
+	SourceTexture source = {};
+	source.Resource = texture;
+	sources.push_back(source);
+	return (unsigned int)sources.size() - 1;
+}
+
+// --------------------------------------------------------
+// Loads all queued textures, buckets them by size, format
+// and mip count, then copies each bucket into one
+// Texture2DArray (one slice per unique source texture)
+// --------------------------------------------------------
+void TextureArrayPacker::Pack()
+{
+	// Load everything first so we know the real sizes & formats
+	// - The cache hands back the same resource for duplicate files
+	for (SourceTexture& source : sources)
+	{
+		if (!source.Resource)
+			source.Resource = resources->LoadTexture(source.Path);
+		if (source.Resource)
+			source.Resource->Texture->GetDesc(&source.Desc);
+	}
+
+	// Bucket the textures
+	arrays.clear();
+	for (unsigned int t = 0; t < sources.size(); t++)
+	{
+		SourceTexture& source = sources[t];
+		if (!source.Resource)
+			continue;
+
+		size_t a = 0;
+		for (; a < arrays.size(); a++)
+		{
+			const D3D11_TEXTURE2D_DESC& desc = arrays[a].Desc;
+			if (desc.Width == source.Desc.Width &&
+				desc.Height == source.Desc.Height &&
+				desc.Format == source.Desc.Format &&
+				desc.MipLevels == source.Desc.MipLevels)
+				break;
+		}
+
+		if (a == arrays.size())
+		{
+			TextureArray newArray = {};
+			newArray.Desc = source.Desc;
+			arrays.push_back(newArray);
+		}
+
+		// Different paths with identical contents share a slice
+		source.Packed.ArrayIndex = (unsigned int)a;
+		source.Packed.Slice = (unsigned int)arrays[a].Tickets.size();
+		for (unsigned int slice = 0; slice < arrays[a].Tickets.size(); slice++)
+		{
+			if (sources[arrays[a].Tickets[slice]].Resource == source.Resource)
+			{
+				source.Packed.Slice = slice;
+				break;
+			}
+		}
+
+		if (source.Packed.Slice == arrays[a].Tickets.size())
+			arrays[a].Tickets.push_back(t);
+	}
+
+	// Build each array and copy every mip of every slice into it
+	for (TextureArray& texArray : arrays)
+	{
+		// Key the array by what's in it, so an identical set of
+		// textures packed again just gets the existing array back
+		unsigned long long hash = ResourceCache::HashBytes(&texArray.Desc, sizeof(D3D11_TEXTURE2D_DESC));
+		for (unsigned int ticket : texArray.Tickets)
+		{
+			const std::string& key = sources[ticket].Resource->Key;
+			hash = ResourceCache::HashBytes(key.data(), key.size(), hash);
+		}
+		std::string arrayKey = ResourceCache::HashToKey("array:", hash);
+
+		texArray.Resource = resources->Find(arrayKey);
+		if (!texArray.Resource)
+		{
+			D3D11_TEXTURE2D_DESC arrayDesc = texArray.Desc;
+			arrayDesc.ArraySize = (UINT)texArray.Tickets.size();
+			arrayDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+			arrayDesc.CPUAccessFlags = 0;
+			arrayDesc.MiscFlags = 0;
+			arrayDesc.Usage = D3D11_USAGE_DEFAULT;
+			arrayDesc.SampleDesc.Count = 1;
+			arrayDesc.SampleDesc.Quality = 0;
+
+			Microsoft::WRL::ComPtr<ID3D11Texture2D> arrayTexture;
+			device->CreateTexture2D(&arrayDesc, 0, arrayTexture.GetAddressOf());
+
+			for (UINT slice = 0; slice < arrayDesc.ArraySize; slice++)
+			{
+				ID3D11Texture2D* sourceTexture = sources[texArray.Tickets[slice]].Resource->Texture.Get();
+				for (UINT mip = 0; mip < arrayDesc.MipLevels; mip++)
+				{
+					context->CopySubresourceRegion(
+						arrayTexture.Get(),
+						D3D11CalcSubresource(mip, slice, arrayDesc.MipLevels),
+						0, 0, 0,
+						sourceTexture,
+						D3D11CalcSubresource(mip, 0, arrayDesc.MipLevels),
+						0);
+				}
+			}
+
+			D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+			srvDesc.Format = arrayDesc.Format;
+			srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+			srvDesc.Texture2DArray.MostDetailedMip = 0;
+			srvDesc.Texture2DArray.MipLevels = arrayDesc.MipLevels;
+			srvDesc.Texture2DArray.FirstArraySlice = 0;
+			srvDesc.Texture2DArray.ArraySize = arrayDesc.ArraySize;
+
+			Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> arraySRV;
+			device->CreateShaderResourceView(arrayTexture.Get(), &srvDesc, arraySRV.GetAddressOf());
+
+			texArray.Resource = resources->AddTexture(arrayKey, RESOURCE_TYPE_TEXTURE_ARRAY, arrayTexture, arraySRV);
+		}
+	}
+
+	for (SourceTexture& source : sources)
+	{
+		if (source.Resource)
+			source.Packed.Array = arrays[source.Packed.ArrayIndex].Resource;
+	}
+
+	// The arrays hold their own copies now, so drop our handles to
+	// the originals - the cache unloads them once nobody else has one
+	for (SourceTexture& source : sources)
+		source.Resource.reset();
+}
+
+PackedTexture TextureArrayPacker::GetPackedTexture(unsigned int ticket)
+{
+	if (ticket >= sources.size())
+		return PackedTexture();
+
+	return sources[ticket].Packed;
+}
+
+size_t TextureArrayPacker::GetTextureCount()
+{
+	return sources.size();
+}
+
+size_t TextureArrayPacker::GetArrayCount()
+{
+	return arrays.size();
+}
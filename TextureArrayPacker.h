@@ -0,0 +1,68 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
+#include <string>
+#include <vector>
+#include <memory>
+#include "ResourceCache.h"
+
+// --------------------------------------------------------
+// Where a packed texture ended up: the array it was copied
+// into and the slice index to sample it with
+// --------------------------------------------------------
+struct PackedTexture
+{
+	ResourceHandle Array;
+	unsigned int ArrayIndex;
+	unsigned int Slice;
+};
+
+// --------------------------------------------------------
+// Import step that groups same-size, same-format textures
+// into Texture2DArrays so materials that only differ by
+// texture end up binding the exact same SRVs
+// --------------------------------------------------------
+class TextureArrayPacker
+{
+public:
+	TextureArrayPacker(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::shared_ptr<ResourceCache> resources);
+	~TextureArrayPacker();
+
+	// Queues a texture file and returns a ticket for GetPackedTexture()
+	unsigned int AddTexture(std::wstring path);
+
+	// Same, for textures built at runtime (e.g. by the ChannelPacker)
+	unsigned int AddTexture(ResourceHandle texture);
+
+	// Loads every queued texture and builds the arrays
+	void Pack();
+
+	PackedTexture GetPackedTexture(unsigned int ticket);
+	size_t GetTextureCount();
+	size_t GetArrayCount();
+
+private:
+	struct SourceTexture
+	{
+		std::wstring Path;
+		ResourceHandle Resource;
+		D3D11_TEXTURE2D_DESC Desc;
+		PackedTexture Packed;
+	};
+
+	struct TextureArray
+	{
+		D3D11_TEXTURE2D_DESC Desc;
+		std::vector<unsigned int> Tickets;
+		ResourceHandle Resource;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::shared_ptr<ResourceCache> resources;
+	std::vector<SourceTexture> sources;
+	std::vector<TextureArray> arrays;
+};
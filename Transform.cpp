@@ -1,9 +1,11 @@
 #include "Transform.h"
+#include <algorithm>
 
 using namespace DirectX;
 Transform::Transform() :
 	position(0, 0, 0),
 	scale(1, 1, 1),
+	rotation(0, 0, 0, 1),
 	pitchYawRoll(0, 0, 0),
 	up(0, 1, 0),
 	right(1, 0, 0),
@@ -34,6 +36,7 @@ void Transform::SetRotation(float pitch, float yaw, float roll)
 	pitchYawRoll.x = pitch;
 	pitchYawRoll.y = yaw;
 	pitchYawRoll.z = roll;
+	XMStoreFloat4(&rotation, XMQuaternionRotationRollPitchYaw(pitch, yaw, roll));
 	matrixDirty = true;
 	vectorsDirty = true;
 }
@@ -43,6 +46,27 @@ void Transform::SetRotation(DirectX::XMFLOAT3 rotation)
 	SetRotation(rotation.x, rotation.y, rotation.z);
 }
 
+// --------------------------------------------------------
+// Sets the rotation directly.  The angles are pulled back out
+// of the rotation matrix (same roll, pitch, yaw order as
+// XMQuaternionRotationRollPitchYaw) so GetPitchYawRoll() and
+// Rotate() stay consistent with it.
+// --------------------------------------------------------
+void Transform::SetRotation(DirectX::XMFLOAT4 quaternion)
+{
+	XMVECTOR normalized = XMQuaternionNormalize(XMLoadFloat4(&quaternion));
+	XMStoreFloat4(&rotation, normalized);
+
+	XMFLOAT3X3 rotationMatrix;
+	XMStoreFloat3x3(&rotationMatrix, XMMatrixRotationQuaternion(normalized));
+	pitchYawRoll.x = asinf((std::max)(-1.0f, (std::min)(1.0f, -rotationMatrix._32)));
+	pitchYawRoll.y = atan2f(rotationMatrix._31, rotationMatrix._33);
+	pitchYawRoll.z = atan2f(rotationMatrix._12, rotationMatrix._22);
+
+	matrixDirty = true;
+	vectorsDirty = true;
+}
+
 void Transform::SetScale(float x, float y, float z)
 {
 	scale.x = x;
@@ -72,9 +96,7 @@ void Transform::MoveRelative(float x, float y, float z)
 	XMVECTOR relativeMovementVector = XMVectorSet(x, y, z, 0);
 	XMVECTOR positionVector = XMLoadFloat3(&position);
 	XMStoreFloat3(&position,
-		XMVector3Rotate(
-			relativeMovementVector,
-			XMQuaternionRotationRollPitchYaw(pitchYawRoll.x, pitchYawRoll.y, pitchYawRoll.z)) + positionVector);
+		XMVector3Rotate(relativeMovementVector, XMLoadFloat4(&rotation)) + positionVector);
 	matrixDirty = true;
 }
 
@@ -108,6 +130,11 @@ DirectX::XMFLOAT3 Transform::GetPitchYawRoll()
 	return pitchYawRoll;
 }
 
+DirectX::XMFLOAT4 Transform::GetRotation()
+{
+	return rotation;
+}
+
 DirectX::XMFLOAT3 Transform::GetScale()
 {
 	return scale;
@@ -115,38 +142,13 @@ DirectX::XMFLOAT3 Transform::GetScale()
 
 DirectX::XMFLOAT4X4 Transform::GetWorldMatrix()
 {
-
-	if (matrixDirty)
-	{
-		// TODO: do stuff
-		XMMATRIX translationMatrix = XMMatrixTranslation(position.x, position.y, position.z);
-		XMMATRIX scalingMatrix = XMMatrixScaling(scale.x, scale.y, scale.z);
-		XMMATRIX rotationMatrix = XMMatrixRotationRollPitchYaw(pitchYawRoll.x, pitchYawRoll.y, pitchYawRoll.z);
-		XMMATRIX worldSIMDMatrix = scalingMatrix * rotationMatrix * translationMatrix;
-
-		XMStoreFloat4x4(&world, worldSIMDMatrix);
-		XMStoreFloat4x4(&worldInverseTranspose, XMMatrixInverse(0, XMMatrixTranspose(worldSIMDMatrix)));
-
-		matrixDirty = false;
-	}
+	UpdateMatrices();
 	return world;
 }
 
 DirectX::XMFLOAT4X4 Transform::GetWorldInverseTransposeMatrix()
 {
-	if (matrixDirty)
-	{
-		// TODO: do stuff
-		XMMATRIX translationMatrix = XMMatrixTranslation(position.x, position.y, position.z);
-		XMMATRIX scalingMatrix = XMMatrixScaling(scale.x, scale.y, scale.z);
-		XMMATRIX rotationMatrix = XMMatrixRotationRollPitchYaw(pitchYawRoll.x, pitchYawRoll.y, pitchYawRoll.z);
-		XMMATRIX worldSIMDMatrix = scalingMatrix * rotationMatrix * translationMatrix;
-
-		XMStoreFloat4x4(&world, worldSIMDMatrix);
-		XMStoreFloat4x4(&worldInverseTranspose, XMMatrixInverse(0, XMMatrixTranspose(worldSIMDMatrix)));
-
-		matrixDirty = false;
-	}
+	UpdateMatrices();
 	return worldInverseTranspose;
 }
 
@@ -168,6 +170,48 @@ DirectX::XMFLOAT3 Transform::GetForward()
 	return forward;
 }
 
+// --------------------------------------------------------
+// Builds scale * rotation * translation straight from the
+// quaternion, without multiplying three matrices together.
+//
+// The inverse transpose comes from the same pieces: rotation
+// rows r over scale s give its 3x3 part, and -dot(t, r) / s its
+// last column.  No general 4x4 inverse needed.
+// --------------------------------------------------------
+void Transform::UpdateMatrices()
+{
+	if (!matrixDirty)
+	{
+		return;
+	}
+
+	XMMATRIX rotationMatrix = XMMatrixRotationQuaternion(XMLoadFloat4(&rotation));
+	XMVECTOR scaleVector = XMLoadFloat3(&scale);
+	XMVECTOR translation = XMLoadFloat3(&position);
+	XMVECTOR invScale = XMVectorReciprocal(scaleVector);
+
+	XMMATRIX worldSIMDMatrix(
+		XMVectorMultiply(rotationMatrix.r[0], XMVectorSplatX(scaleVector)),
+		XMVectorMultiply(rotationMatrix.r[1], XMVectorSplatY(scaleVector)),
+		XMVectorMultiply(rotationMatrix.r[2], XMVectorSplatZ(scaleVector)),
+		XMVectorSetW(translation, 1.0f));
+
+	// Each component is dot(t, r) for one rotation row
+	XMVECTOR lastColumn = XMVectorNegate(XMVectorMultiply(
+		XMVector3TransformNormal(translation, XMMatrixTranspose(rotationMatrix)),
+		invScale));
+	XMMATRIX inverseTranspose(
+		XMVectorSelect(XMVectorSplatX(lastColumn), XMVectorMultiply(rotationMatrix.r[0], XMVectorSplatX(invScale)), g_XMSelect1110),
+		XMVectorSelect(XMVectorSplatY(lastColumn), XMVectorMultiply(rotationMatrix.r[1], XMVectorSplatY(invScale)), g_XMSelect1110),
+		XMVectorSelect(XMVectorSplatZ(lastColumn), XMVectorMultiply(rotationMatrix.r[2], XMVectorSplatZ(invScale)), g_XMSelect1110),
+		g_XMIdentityR3);
+
+	XMStoreFloat4x4(&world, worldSIMDMatrix);
+	XMStoreFloat4x4(&worldInverseTranspose, inverseTranspose);
+
+	matrixDirty = false;
+}
+
 void Transform::UpdateVectors()
 {
 	if (!vectorsDirty)
@@ -180,7 +224,7 @@ void Transform::UpdateVectors()
 	XMFLOAT3 worldForward(0, 0, 1);
 
 
-	XMVECTOR rotationQuaternion = XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&pitchYawRoll));
+	XMVECTOR rotationQuaternion = XMLoadFloat4(&rotation);
 	XMStoreFloat3(&up, XMVector3Rotate(XMLoadFloat3(&worldUp), rotationQuaternion));
 	XMStoreFloat3(&right, XMVector3Rotate(XMLoadFloat3(&worldRight), rotationQuaternion));
 	XMStoreFloat3(&forward, XMVector3Rotate(XMLoadFloat3(&worldForward), rotationQuaternion));
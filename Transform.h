@@ -11,6 +11,7 @@ public:
 	void SetPosition(DirectX::XMFLOAT3 position);
 	void SetRotation(float pitch, float yaw, float roll);
 	void SetRotation(DirectX::XMFLOAT3 rotation);
+	void SetRotation(DirectX::XMFLOAT4 quaternion);
 	void SetScale(float x, float y, float z);
 	void SetScale(DirectX::XMFLOAT3 scale);
 
@@ -26,6 +27,7 @@ public:
 	//getters
 	DirectX::XMFLOAT3 GetPosition();
 	DirectX::XMFLOAT3 GetPitchYawRoll();
+	DirectX::XMFLOAT4 GetRotation();
 	DirectX::XMFLOAT3 GetScale();
 	DirectX::XMFLOAT4X4 GetWorldMatrix();
 	DirectX::XMFLOAT4X4 GetWorldInverseTransposeMatrix();
@@ -35,10 +37,14 @@ public:
 
 
 private:
+	void UpdateMatrices();
 	void UpdateVectors();
 
 	DirectX::XMFLOAT3 position;
 	DirectX::XMFLOAT3 scale;
+	// Rotation lives in the quaternion - the angles are only kept so
+	// Rotate() can keep adding to them like before
+	DirectX::XMFLOAT4 rotation;
 	DirectX::XMFLOAT3 pitchYawRoll;
 	DirectX::XMFLOAT3 up;
 	DirectX::XMFLOAT3 forward;
@@ -0,0 +1,767 @@
+#include "TransformSystem.h"
+#include "Transform.h"
+#include "ParallelFor.h"
+#include <chrono>
+
+using namespace DirectX;
+
+// Each 64-bit dirty word covers 16 groups of 4
+#define TRANSFORMS_PER_GROUP 4
+#define GROUPS_PER_DIRTY_WORD 16
+
+// --------------------------------------------------------
+// TransformHandle - just forwards to the system
+// --------------------------------------------------------
+TransformHandle::TransformHandle() :
+	system(0),
+	id(0)
+{
+}
+
+TransformHandle::TransformHandle(TransformSystem* system, unsigned int id) :
+	system(system),
+	id(id)
+{
+}
+
+void TransformHandle::SetPosition(float x, float y, float z) { system->SetPosition(id, x, y, z); }
+void TransformHandle::SetPosition(XMFLOAT3 position) { SetPosition(position.x, position.y, position.z); }
+void TransformHandle::SetRotation(float pitch, float yaw, float roll) { system->SetRotation(id, pitch, yaw, roll); }
+void TransformHandle::SetRotation(XMFLOAT3 rotation) { SetRotation(rotation.x, rotation.y, rotation.z); }
+void TransformHandle::SetRotation(XMFLOAT4 quaternion) { system->SetRotation(id, quaternion); }
+void TransformHandle::SetScale(float x, float y, float z) { system->SetScale(id, x, y, z); }
+void TransformHandle::SetScale(XMFLOAT3 scale) { SetScale(scale.x, scale.y, scale.z); }
+
+void TransformHandle::MoveAbsolute(float x, float y, float z)
+{
+	XMFLOAT3 position = GetPosition();
+	SetPosition(position.x + x, position.y + y, position.z + z);
+}
+
+void TransformHandle::MoveAbsolute(XMFLOAT3 offset)
+{
+	MoveAbsolute(offset.x, offset.y, offset.z);
+}
+
+void TransformHandle::Rotate(float pitch, float yaw, float roll)
+{
+	XMFLOAT3 rotation = GetPitchYawRoll();
+	SetRotation(rotation.x + pitch, rotation.y + yaw, rotation.z + roll);
+}
+
+void TransformHandle::Rotate(XMFLOAT3 rotation)
+{
+	Rotate(rotation.x, rotation.y, rotation.z);
+}
+
+void TransformHandle::Scale(float x, float y, float z)
+{
+	XMFLOAT3 scale = GetScale();
+	SetScale(scale.x * x, scale.y * y, scale.z * z);
+}
+
+void TransformHandle::Scale(XMFLOAT3 scale)
+{
+	Scale(scale.x, scale.y, scale.z);
+}
+
+// Passing null detaches from the current parent
+bool TransformHandle::SetParent(TransformHandle* parent)
+{
+	return system->SetParent(id, parent ? parent->id : TRANSFORM_NO_PARENT);
+}
+
+TransformHandle TransformHandle::GetParent()
+{
+	unsigned int parentID = system->GetParent(id);
+	if (parentID == TRANSFORM_NO_PARENT)
+		return TransformHandle();
+
+	return TransformHandle(system, parentID);
+}
+
+bool TransformHandle::HasParent()
+{
+	return system->GetParent(id) != TRANSFORM_NO_PARENT;
+}
+
+XMFLOAT3 TransformHandle::GetPosition() { return system->GetPosition(id); }
+XMFLOAT3 TransformHandle::GetPitchYawRoll() { return system->GetPitchYawRoll(id); }
+XMFLOAT4 TransformHandle::GetRotation() { return system->GetRotation(id); }
+XMFLOAT3 TransformHandle::GetScale() { return system->GetScale(id); }
+XMFLOAT4X4 TransformHandle::GetWorldMatrix() { return system->GetWorldMatrix(id); }
+XMFLOAT4X4 TransformHandle::GetWorldInverseTransposeMatrix() { return system->GetWorldInverseTransposeMatrix(id); }
+unsigned int TransformHandle::GetID() { return id; }
+
+
+// --------------------------------------------------------
+// TransformSystem
+// --------------------------------------------------------
+TransformSystem::TransformSystem() :
+	count(0),
+	anyDirty(false)
+{
+}
+
+TransformSystem::~TransformSystem()
+{
+}
+
+// --------------------------------------------------------
+// New transforms are roots, so they can always go on the end
+// --------------------------------------------------------
+TransformHandle TransformSystem::Create()
+{
+	unsigned int slot = count++;
+	unsigned int id = (unsigned int)slotOfID.size();
+	slotOfID.push_back(slot);
+	changedFlags.push_back(0);
+
+	// Grow a whole group at a time so the SIMD loads never run off the end
+	if (slot % TRANSFORMS_PER_GROUP == 0)
+	{
+		size_t padded = (size_t)slot + TRANSFORMS_PER_GROUP;
+		positionX.resize(padded, 0.0f);
+		positionY.resize(padded, 0.0f);
+		positionZ.resize(padded, 0.0f);
+		rotation.resize(padded, XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+		pitchYawRoll.resize(padded, XMFLOAT3(0.0f, 0.0f, 0.0f));
+		scaleX.resize(padded, 1.0f);
+		scaleY.resize(padded, 1.0f);
+		scaleZ.resize(padded, 1.0f);
+		parent.resize(padded, TRANSFORM_NO_PARENT);
+		depth.resize(padded, 0);
+		idOfSlot.resize(padded, 0);
+
+		XMFLOAT4X4 identity;
+		XMStoreFloat4x4(&identity, XMMatrixIdentity());
+		local.resize(padded, identity);
+		localInverseTranspose.resize(padded, identity);
+		world.resize(padded, identity);
+		worldInverseTranspose.resize(padded, identity);
+
+		dirty.resize((padded + 63) / 64, 0);
+	}
+
+	idOfSlot[slot] = id;
+	return TransformHandle(this, id);
+}
+
+unsigned int TransformSystem::GetCount()
+{
+	return count;
+}
+
+void TransformSystem::Reserve(unsigned int reserveCount)
+{
+	size_t padded = ((size_t)reserveCount + TRANSFORMS_PER_GROUP - 1) / TRANSFORMS_PER_GROUP * TRANSFORMS_PER_GROUP;
+	positionX.reserve(padded);
+	positionY.reserve(padded);
+	positionZ.reserve(padded);
+	rotation.reserve(padded);
+	pitchYawRoll.reserve(padded);
+	scaleX.reserve(padded);
+	scaleY.reserve(padded);
+	scaleZ.reserve(padded);
+	parent.reserve(padded);
+	depth.reserve(padded);
+	idOfSlot.reserve(padded);
+	slotOfID.reserve(reserveCount);
+	changedFlags.reserve(reserveCount);
+	local.reserve(padded);
+	localInverseTranspose.reserve(padded);
+	world.reserve(padded);
+	worldInverseTranspose.reserve(padded);
+	dirty.reserve((padded + 63) / 64);
+}
+
+void TransformSystem::SetPosition(unsigned int id, float x, float y, float z)
+{
+	unsigned int slot = slotOfID[id];
+	positionX[slot] = x;
+	positionY[slot] = y;
+	positionZ[slot] = z;
+	MarkDirty(slot);
+}
+
+void TransformSystem::SetRotation(unsigned int id, float pitch, float yaw, float roll)
+{
+	unsigned int slot = slotOfID[id];
+	XMStoreFloat4(&rotation[slot], XMQuaternionRotationRollPitchYaw(pitch, yaw, roll));
+	pitchYawRoll[slot] = XMFLOAT3(pitch, yaw, roll);
+	MarkDirty(slot);
+}
+
+// --------------------------------------------------------
+// Sets the rotation directly.  The angles are pulled back out
+// of the rotation matrix, in the same roll, pitch, yaw order
+// as XMQuaternionRotationRollPitchYaw.  Pitch comes back in
+// [-pi/2, pi/2], so they can differ from any angles used to
+// make the quaternion, but they rebuild the same rotation.
+// Straight up or down, yaw & roll spin about the same axis, so
+// roll is taken as 0 and yaw gets all of it.
+// --------------------------------------------------------
+void TransformSystem::SetRotation(unsigned int id, XMFLOAT4 quaternion)
+{
+	unsigned int slot = slotOfID[id];
+	XMVECTOR normalized = XMQuaternionNormalize(XMLoadFloat4(&quaternion));
+	XMStoreFloat4(&rotation[slot], normalized);
+
+	XMFLOAT3X3 r;
+	XMStoreFloat3x3(&r, XMMatrixRotationQuaternion(normalized));
+	float cosPitch = sqrtf(r._31 * r._31 + r._33 * r._33);
+	if (cosPitch < 1e-6f)
+		pitchYawRoll[slot] = XMFLOAT3(r._32 < 0.0f ? XM_PIDIV2 : -XM_PIDIV2, atan2f(-r._13, r._11), 0.0f);
+	else
+		pitchYawRoll[slot] = XMFLOAT3(atan2f(-r._32, cosPitch), atan2f(r._31, r._33), atan2f(r._12, r._22));
+	MarkDirty(slot);
+}
+
+void TransformSystem::SetScale(unsigned int id, float x, float y, float z)
+{
+	unsigned int slot = slotOfID[id];
+	scaleX[slot] = x;
+	scaleY[slot] = y;
+	scaleZ[slot] = z;
+	MarkDirty(slot);
+}
+
+XMFLOAT3 TransformSystem::GetPosition(unsigned int id)
+{
+	unsigned int slot = slotOfID[id];
+	return XMFLOAT3(positionX[slot], positionY[slot], positionZ[slot]);
+}
+
+XMFLOAT3 TransformSystem::GetPitchYawRoll(unsigned int id)
+{
+	return pitchYawRoll[slotOfID[id]];
+}
+
+XMFLOAT4 TransformSystem::GetRotation(unsigned int id)
+{
+	return rotation[slotOfID[id]];
+}
+
+XMFLOAT3 TransformSystem::GetScale(unsigned int id)
+{
+	unsigned int slot = slotOfID[id];
+	return XMFLOAT3(scaleX[slot], scaleY[slot], scaleZ[slot]);
+}
+
+void TransformSystem::MarkDirty(unsigned int slot)
+{
+	dirty[slot / 64] |= 1ull << (slot % 64);
+	anyDirty = true;
+}
+
+bool TransformSystem::IsDirty(unsigned int slot)
+{
+	return (dirty[slot / 64] >> (slot % 64)) & 1;
+}
+
+// --------------------------------------------------------
+// Attaches a transform (and everything under it) to a new
+// parent without re-sorting the whole array.
+//
+// Nothing moves if the new parent already sits in a lower
+// slot.  Otherwise only the slots from the child up to the
+// new parent get shuffled: everything in there that isn't
+// part of the child's subtree slides down, and the subtree
+// goes right after the parent, keeping its own order.
+// --------------------------------------------------------
+bool TransformSystem::SetParent(unsigned int id, unsigned int parentID)
+{
+	unsigned int child = slotOfID[id];
+	unsigned int newParent = parentID == TRANSFORM_NO_PARENT ? TRANSFORM_NO_PARENT : slotOfID[parentID];
+
+	// Can't parent something to itself or anything below it
+	for (unsigned int slot = newParent; slot != TRANSFORM_NO_PARENT; slot = parent[slot])
+	{
+		if (slot == child)
+			return false;
+	}
+
+	// Descendants always come after the child, so one pass finds them all
+	unsigned int newDepth = newParent == TRANSFORM_NO_PARENT ? 0 : depth[newParent] + 1;
+	int depthChange = (int)newDepth - (int)depth[child];
+	std::vector<unsigned char> inSubtree(count - child, 0);
+	inSubtree[0] = 1;
+	depth[child] = newDepth;
+	for (unsigned int slot = child + 1; slot < count; slot++)
+	{
+		if (parent[slot] != TRANSFORM_NO_PARENT && parent[slot] >= child && inSubtree[parent[slot] - child])
+		{
+			inSubtree[slot - child] = 1;
+			depth[slot] += depthChange;
+		}
+	}
+	parent[child] = newParent;
+	MarkDirty(child);
+
+	if (newParent != TRANSFORM_NO_PARENT && newParent > child)
+	{
+		std::vector<unsigned int> order;
+		order.reserve(newParent - child + 1);
+		for (unsigned int slot = child; slot <= newParent; slot++)
+		{
+			if (!inSubtree[slot - child])
+				order.push_back(slot);
+		}
+		for (unsigned int slot = child; slot <= newParent; slot++)
+		{
+			if (inSubtree[slot - child])
+				order.push_back(slot);
+		}
+		MoveSlots(child, order);
+	}
+
+	return true;
+}
+
+unsigned int TransformSystem::GetParent(unsigned int id)
+{
+	unsigned int parentSlot = parent[slotOfID[id]];
+	return parentSlot == TRANSFORM_NO_PARENT ? TRANSFORM_NO_PARENT : idOfSlot[parentSlot];
+}
+
+namespace
+{
+	// Rearranges values[first, first + order.size()) so that new slot
+	// first + i holds what used to be in slot order[i]
+	template<typename T>
+	void Reorder(std::vector<T>& values, unsigned int first, const std::vector<unsigned int>& order)
+	{
+		std::vector<T> old(values.begin() + first, values.begin() + first + order.size());
+		for (size_t i = 0; i < order.size(); i++)
+			values[first + i] = old[order[i] - first];
+	}
+}
+
+// --------------------------------------------------------
+// Applies a reordering of a range of slots to every array,
+// then fixes up parent slots and handle IDs to match
+// --------------------------------------------------------
+void TransformSystem::MoveSlots(unsigned int first, const std::vector<unsigned int>& order)
+{
+	unsigned int last = first + (unsigned int)order.size();
+
+	std::vector<unsigned char> wasDirty(order.size());
+	for (unsigned int i = 0; i < order.size(); i++)
+		wasDirty[i] = IsDirty(order[i]);
+
+	Reorder(positionX, first, order);
+	Reorder(positionY, first, order);
+	Reorder(positionZ, first, order);
+	Reorder(rotation, first, order);
+	Reorder(pitchYawRoll, first, order);
+	Reorder(scaleX, first, order);
+	Reorder(scaleY, first, order);
+	Reorder(scaleZ, first, order);
+	Reorder(parent, first, order);
+	Reorder(depth, first, order);
+	Reorder(idOfSlot, first, order);
+	Reorder(local, first, order);
+	Reorder(localInverseTranspose, first, order);
+	Reorder(world, first, order);
+	Reorder(worldInverseTranspose, first, order);
+
+	for (unsigned int i = 0; i < order.size(); i++)
+	{
+		unsigned int slot = first + i;
+		dirty[slot / 64] &= ~(1ull << (slot % 64));
+		if (wasDirty[i])
+			MarkDirty(slot);
+	}
+
+	// Anything pointing into the moved range needs its new slot
+	std::vector<unsigned int> newSlot(order.size());
+	for (unsigned int i = 0; i < order.size(); i++)
+		newSlot[order[i] - first] = first + i;
+
+	for (unsigned int slot = first; slot < count; slot++)
+	{
+		if (parent[slot] != TRANSFORM_NO_PARENT && parent[slot] >= first && parent[slot] < last)
+			parent[slot] = newSlot[parent[slot] - first];
+	}
+	for (unsigned int slot = first; slot < last; slot++)
+		slotOfID[idOfSlot[slot]] = slot;
+}
+
+// --------------------------------------------------------
+// Brings every matrix up to date:
+//  1. Local matrices for every dirty group, 4 at a time
+//  2. One front-to-back pass marks everything under a dirty
+//     transform, bucketing them by depth
+//  3. World = local * parent's world, one depth at a time,
+//     since each level only reads the one above it
+// --------------------------------------------------------
+void TransformSystem::UpdateMatrices()
+{
+	if (!anyDirty)
+		return;
+
+	// Split by dirty word so no two threads ever touch the same bits
+	ParallelFor(dirty.size(), 16, [&](size_t begin, size_t end)
+	{
+		for (size_t word = begin; word < end; word++)
+		{
+			unsigned long long bits = dirty[word];
+			if (bits == 0)
+				continue;
+
+			for (unsigned int group = 0; group < GROUPS_PER_DIRTY_WORD; group++)
+			{
+				if ((bits >> (group * TRANSFORMS_PER_GROUP)) & 0xF)
+					UpdateGroup((unsigned int)word * GROUPS_PER_DIRTY_WORD + group);
+			}
+		}
+	});
+
+	worldDirty.resize(count);
+	for (std::vector<unsigned int>& level : dirtyByDepth)
+		level.clear();
+
+	for (unsigned int slot = 0; slot < count; slot++)
+	{
+		unsigned int parentSlot = parent[slot];
+		worldDirty[slot] = IsDirty(slot) || (parentSlot != TRANSFORM_NO_PARENT && worldDirty[parentSlot]);
+		if (!worldDirty[slot])
+			continue;
+
+		unsigned int id = idOfSlot[slot];
+		if (!changedFlags[id])
+		{
+			changedFlags[id] = 1;
+			changedIDs.push_back(id);
+		}
+
+		if (depth[slot] >= dirtyByDepth.size())
+			dirtyByDepth.resize(depth[slot] + 1);
+		dirtyByDepth[depth[slot]].push_back(slot);
+	}
+
+	for (const std::vector<unsigned int>& level : dirtyByDepth)
+	{
+		ParallelFor(level.size(), 256, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				unsigned int slot = level[i];
+				unsigned int parentSlot = parent[slot];
+				if (parentSlot == TRANSFORM_NO_PARENT)
+				{
+					world[slot] = local[slot];
+					worldInverseTranspose[slot] = localInverseTranspose[slot];
+					continue;
+				}
+
+				// The inverse transpose of a product is the product of the inverse transposes
+				XMStoreFloat4x4(&world[slot], XMMatrixMultiply(
+					XMLoadFloat4x4(&local[slot]),
+					XMLoadFloat4x4(&world[parentSlot])));
+				XMStoreFloat4x4(&worldInverseTranspose[slot], XMMatrixMultiply(
+					XMLoadFloat4x4(&localInverseTranspose[slot]),
+					XMLoadFloat4x4(&worldInverseTranspose[parentSlot])));
+			}
+		});
+	}
+
+	std::fill(dirty.begin(), dirty.end(), 0);
+	anyDirty = false;
+}
+
+void TransformSystem::TakeChangedIDs(std::vector<unsigned int>& ids)
+{
+	UpdateMatrices();
+
+	ids.clear();
+	ids.swap(changedIDs);
+	for (unsigned int id : ids)
+		changedFlags[id] = 0;
+}
+
+XMFLOAT4X4 TransformSystem::GetWorldMatrix(unsigned int id)
+{
+	UpdateMatrices();
+	return world[slotOfID[id]];
+}
+
+XMFLOAT4X4 TransformSystem::GetWorldInverseTransposeMatrix(unsigned int id)
+{
+	UpdateMatrices();
+	return worldInverseTranspose[slotOfID[id]];
+}
+
+// --------------------------------------------------------
+// Builds the local scale * rotation * translation for the 4
+// transforms in a group, one transform per lane.  Positions &
+// scales are already split by component; the 4 quaternions
+// are transposed the same way, so every matrix element below
+// is one vector holding it for all 4 transforms.  Only the
+// results are transposed back into per-transform rows.
+//
+// The rotation rows are the usual quaternion expansion (what
+// XMMatrixRotationQuaternion does), scaled in place rather
+// than multiplying S, R and T matrices together.  The inverse
+// transpose is done analytically: with rotation rows r and
+// scale s, its rows are r / s, and its last column is
+// -dot(t, r) / s.  No general 4x4 inverse needed.
+// --------------------------------------------------------
+void TransformSystem::UpdateGroup(unsigned int group)
+{
+	size_t first = (size_t)group * TRANSFORMS_PER_GROUP;
+
+	XMMATRIX quaternions = XMMatrixTranspose(XMMATRIX(
+		XMLoadFloat4(&rotation[first]), XMLoadFloat4(&rotation[first + 1]),
+		XMLoadFloat4(&rotation[first + 2]), XMLoadFloat4(&rotation[first + 3])));
+	XMVECTOR x = quaternions.r[0];
+	XMVECTOR y = quaternions.r[1];
+	XMVECTOR z = quaternions.r[2];
+	XMVECTOR w = quaternions.r[3];
+
+	const XMVECTOR one = XMVectorSplatOne();
+	const XMVECTOR two = XMVectorReplicate(2.0f);
+	XMVECTOR xx = XMVectorMultiply(x, x), yy = XMVectorMultiply(y, y), zz = XMVectorMultiply(z, z);
+	XMVECTOR xy = XMVectorMultiply(x, y), xz = XMVectorMultiply(x, z), yz = XMVectorMultiply(y, z);
+	XMVECTOR wx = XMVectorMultiply(w, x), wy = XMVectorMultiply(w, y), wz = XMVectorMultiply(w, z);
+
+	// r[row][column], each for all 4 transforms
+	XMVECTOR r[3][3] = {
+		{ XMVectorNegativeMultiplySubtract(two, XMVectorAdd(yy, zz), one), XMVectorMultiply(two, XMVectorAdd(xy, wz)), XMVectorMultiply(two, XMVectorSubtract(xz, wy)) },
+		{ XMVectorMultiply(two, XMVectorSubtract(xy, wz)), XMVectorNegativeMultiplySubtract(two, XMVectorAdd(xx, zz), one), XMVectorMultiply(two, XMVectorAdd(yz, wx)) },
+		{ XMVectorMultiply(two, XMVectorAdd(xz, wy)), XMVectorMultiply(two, XMVectorSubtract(yz, wx)), XMVectorNegativeMultiplySubtract(two, XMVectorAdd(xx, yy), one) } };
+
+	XMVECTOR translation[3] = {
+		XMLoadFloat4((const XMFLOAT4*)&positionX[first]),
+		XMLoadFloat4((const XMFLOAT4*)&positionY[first]),
+		XMLoadFloat4((const XMFLOAT4*)&positionZ[first]) };
+	XMVECTOR scale[3] = {
+		XMLoadFloat4((const XMFLOAT4*)&scaleX[first]),
+		XMLoadFloat4((const XMFLOAT4*)&scaleY[first]),
+		XMLoadFloat4((const XMFLOAT4*)&scaleZ[first]) };
+
+	for (int row = 0; row < 3; row++)
+	{
+		XMVECTOR inverseScale = XMVectorReciprocal(scale[row]);
+		XMVECTOR rowDotT = XMVectorMultiplyAdd(r[row][0], translation[0],
+			XMVectorMultiplyAdd(r[row][1], translation[1], XMVectorMultiply(r[row][2], translation[2])));
+
+		// Back to one row per transform
+		XMMATRIX localRows = XMMatrixTranspose(XMMATRIX(
+			XMVectorMultiply(r[row][0], scale[row]),
+			XMVectorMultiply(r[row][1], scale[row]),
+			XMVectorMultiply(r[row][2], scale[row]),
+			XMVectorZero()));
+		XMMATRIX inverseRows = XMMatrixTranspose(XMMATRIX(
+			XMVectorMultiply(r[row][0], inverseScale),
+			XMVectorMultiply(r[row][1], inverseScale),
+			XMVectorMultiply(r[row][2], inverseScale),
+			XMVectorNegate(XMVectorMultiply(rowDotT, inverseScale))));
+		for (int lane = 0; lane < TRANSFORMS_PER_GROUP; lane++)
+		{
+			XMStoreFloat4((XMFLOAT4*)local[first + lane].m[row], localRows.r[lane]);
+			XMStoreFloat4((XMFLOAT4*)localInverseTranspose[first + lane].m[row], inverseRows.r[lane]);
+		}
+	}
+
+	XMMATRIX translationRows = XMMatrixTranspose(XMMATRIX(translation[0], translation[1], translation[2], one));
+	for (int lane = 0; lane < TRANSFORMS_PER_GROUP; lane++)
+	{
+		XMStoreFloat4((XMFLOAT4*)local[first + lane].m[3], translationRows.r[lane]);
+		XMStoreFloat4((XMFLOAT4*)localInverseTranspose[first + lane].m[3], g_XMIdentityR3);
+	}
+}
+
+// --------------------------------------------------------
+// Times the per-object Transform path against the batched
+// one for the same random-ish set of transforms
+// --------------------------------------------------------
+TransformBenchmarkResult TransformSystem::Benchmark(unsigned int count)
+{
+	TransformBenchmarkResult result = {};
+	result.Count = count;
+	volatile float sink = 0.0f;
+
+	std::vector<Transform> objects(count);
+	TransformSystem system;
+	system.Reserve(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		float f = (i % 1000) * 0.1f;
+		float angle = (i % 628) * 0.01f; // Keep these small, huge angles lose precision in any form
+		TransformHandle handle = system.Create();
+		handle.SetPosition(f, f * 0.5f, -f);
+		handle.SetRotation(angle, angle * 2.0f, angle * 3.0f);
+		handle.SetScale(1.0f + (i % 3), 1.0f, 2.0f);
+		objects[i].SetPosition(f, f * 0.5f, -f);
+		objects[i].SetRotation(angle, angle * 2.0f, angle * 3.0f);
+		objects[i].SetScale(1.0f + (i % 3), 1.0f, 2.0f);
+	}
+
+	// Reference: how Transform used to build its matrices
+	std::vector<XMFLOAT4X4> reference(count * 2);
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		XMFLOAT3 position = objects[i].GetPosition();
+		XMFLOAT3 rotation = objects[i].GetPitchYawRoll();
+		XMFLOAT3 scale = objects[i].GetScale();
+		XMMATRIX worldMatrix =
+			XMMatrixScaling(scale.x, scale.y, scale.z) *
+			XMMatrixRotationRollPitchYaw(rotation.x, rotation.y, rotation.z) *
+			XMMatrixTranslation(position.x, position.y, position.z);
+		XMStoreFloat4x4(&reference[i * 2], worldMatrix);
+		XMStoreFloat4x4(&reference[i * 2 + 1], XMMatrixInverse(0, XMMatrixTranspose(worldMatrix)));
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	result.EulerInverseMilliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+
+	start = std::chrono::high_resolution_clock::now();
+	for (Transform& transform : objects)
+		sink = sink + transform.GetWorldMatrix()._41;
+	end = std::chrono::high_resolution_clock::now();
+	result.ObjectMilliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+
+	start = std::chrono::high_resolution_clock::now();
+	system.UpdateMatrices();
+	end = std::chrono::high_resolution_clock::now();
+	result.BatchedMilliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+
+	// Relative to the size of each element, so big translations don't dominate
+	for (unsigned int i = 0; i < count; i++)
+	{
+		XMFLOAT4X4 results[4] = {
+			objects[i].GetWorldMatrix(),
+			objects[i].GetWorldInverseTransposeMatrix(),
+			system.world[i],
+			system.worldInverseTranspose[i] };
+		for (int m = 0; m < 4; m++)
+		{
+			const XMFLOAT4X4& expected = reference[i * 2 + m % 2];
+			for (int row = 0; row < 4; row++)
+			{
+				for (int column = 0; column < 4; column++)
+				{
+					float difference = fabsf(results[m].m[row][column] - expected.m[row][column]);
+					result.MaxError = (std::max)(result.MaxError, difference / (std::max)(1.0f, fabsf(expected.m[row][column])));
+				}
+			}
+		}
+	}
+
+	for (unsigned int i = 0; i < count; i += 10)
+		system.SetPosition(i, 0.0f, 0.0f, 0.0f);
+	start = std::chrono::high_resolution_clock::now();
+	system.UpdateMatrices();
+	end = std::chrono::high_resolution_clock::now();
+	result.TenPercentMilliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+
+	sink = sink + system.world[0]._41;
+	return result;
+}
+
+namespace
+{
+	// Largest element difference, relative to the size of each element
+	float MatrixError(const XMFLOAT4X4& result, FXMMATRIX expectedMatrix)
+	{
+		XMFLOAT4X4 expected;
+		XMStoreFloat4x4(&expected, expectedMatrix);
+		float error = 0.0f;
+		for (int row = 0; row < 4; row++)
+		{
+			for (int column = 0; column < 4; column++)
+			{
+				float difference = fabsf(result.m[row][column] - expected.m[row][column]);
+				error = (std::max)(error, difference / (std::max)(1.0f, fabsf(expected.m[row][column])));
+			}
+		}
+		return error;
+	}
+}
+
+// --------------------------------------------------------
+// Runs a spread of angles (negative, past 2pi, straight up &
+// down) through the Euler setters and compares against the
+// matrices the old path built: S * RollPitchYaw * T, and a
+// full XMMatrixInverse for the normal matrix.
+// --------------------------------------------------------
+bool TransformSystem::SelfTest()
+{
+	const float tolerance = 1e-4f;
+	const XMFLOAT3 angles[] = {
+		XMFLOAT3(0.0f, 0.0f, 0.0f),
+		XMFLOAT3(0.3f, -1.2f, 2.5f),
+		XMFLOAT3(-2.0f, 4.0f, -0.7f),
+		XMFLOAT3(XM_PIDIV2, 0.5f, 0.25f),
+		XMFLOAT3(-XM_PIDIV2, -0.5f, 1.0f),
+		XMFLOAT3(7.0f, -9.0f, 3.0f),
+		XMFLOAT3(3.0f, 0.1f, -3.0f) };
+	const unsigned int angleCount = sizeof(angles) / sizeof(angles[0]);
+
+	TransformSystem system;
+	bool passed = true;
+	for (unsigned int i = 0; i < angleCount && passed; i++)
+	{
+		XMFLOAT3 position(i * 1.5f, -2.0f, i * 0.25f);
+		XMFLOAT3 scale(1.0f + i, 0.5f, 2.0f);
+		TransformHandle handle = system.Create();
+		handle.SetPosition(position);
+		handle.SetRotation(angles[i]);
+		handle.SetScale(scale);
+
+		XMMATRIX expected =
+			XMMatrixScaling(scale.x, scale.y, scale.z) *
+			XMMatrixRotationRollPitchYaw(angles[i].x, angles[i].y, angles[i].z) *
+			XMMatrixTranslation(position.x, position.y, position.z);
+		XMMATRIX expectedInverseTranspose = XMMatrixInverse(0, XMMatrixTranspose(expected));
+		passed =
+			MatrixError(handle.GetWorldMatrix(), expected) < tolerance &&
+			MatrixError(handle.GetWorldInverseTransposeMatrix(), expectedInverseTranspose) < tolerance;
+
+		// The quaternion, even unnormalized, gives the same rotation
+		XMFLOAT4 quaternion = handle.GetRotation();
+		TransformHandle direct = system.Create();
+		direct.SetPosition(position);
+		direct.SetRotation(XMFLOAT4(quaternion.x * 3.0f, quaternion.y * 3.0f, quaternion.z * 3.0f, quaternion.w * 3.0f));
+		direct.SetScale(scale);
+		passed = passed && MatrixError(direct.GetWorldMatrix(), expected) < tolerance;
+
+		// And the angles recovered from it may not be the ones set, but are the same rotation
+		TransformHandle roundTrip = system.Create();
+		roundTrip.SetPosition(position);
+		roundTrip.SetRotation(direct.GetPitchYawRoll());
+		roundTrip.SetScale(scale);
+		passed = passed && MatrixError(roundTrip.GetWorldMatrix(), expected) < tolerance;
+	}
+
+	// Rotate() still adds to the angles, and children still follow parents
+	TransformHandle parentHandle = system.Create();
+	TransformHandle childHandle = system.Create();
+	parentHandle.SetRotation(0.2f, 0.4f, 0.0f);
+	parentHandle.Rotate(0.1f, 0.0f, 0.3f);
+	parentHandle.SetPosition(1.0f, 2.0f, 3.0f);
+	childHandle.SetRotation(0.0f, 1.0f, 0.0f);
+	childHandle.SetScale(2.0f, 2.0f, 2.0f);
+	childHandle.SetParent(&parentHandle);
+
+	XMMATRIX parentExpected = XMMatrixRotationRollPitchYaw(0.3f, 0.4f, 0.3f) * XMMatrixTranslation(1.0f, 2.0f, 3.0f);
+	XMMATRIX childExpected = XMMatrixScaling(2.0f, 2.0f, 2.0f) * XMMatrixRotationRollPitchYaw(0.0f, 1.0f, 0.0f) * parentExpected;
+	passed = passed &&
+		MatrixError(parentHandle.GetWorldMatrix(), parentExpected) < tolerance &&
+		MatrixError(childHandle.GetWorldMatrix(), childExpected) < tolerance &&
+		MatrixError(childHandle.GetWorldInverseTransposeMatrix(), XMMatrixInverse(0, XMMatrixTranspose(childExpected))) < tolerance;
+
+	// Small steps, like Game::Update's, carry on past straight up
+	// instead of stalling at pi/2
+	TransformHandle spinning = system.Create();
+	for (int step = 0; step < 400; step++)
+		spinning.Rotate(0.01f, 0.0f, 0.005f);
+	XMFLOAT3 spun = spinning.GetPitchYawRoll();
+	passed = passed &&
+		fabsf(spun.x - 4.0f) < 1e-3f && fabsf(spun.z - 2.0f) < 1e-3f &&
+		MatrixError(spinning.GetWorldMatrix(), XMMatrixRotationRollPitchYaw(spun.x, spun.y, spun.z)) < tolerance &&
+		MatrixError(spinning.GetWorldMatrix(), XMMatrixRotationRollPitchYaw(4.0f, 0.0f, 2.0f)) < 1e-3f;
+
+	return passed;
+}
@@ -0,0 +1,178 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include <memory>
+
+class TransformSystem;
+
+// Parent ID for transforms that are attached to nothing
+#define TRANSFORM_NO_PARENT 0xFFFFFFFF
+
+// --------------------------------------------------------
+// Lightweight reference to one transform in a TransformSystem.
+// Has the same interface as a standalone Transform, so game
+// code doesn't care where the data actually lives.
+// --------------------------------------------------------
+class TransformHandle
+{
+public:
+	TransformHandle();
+	TransformHandle(TransformSystem* system, unsigned int id);
+
+	//setters
+	void SetPosition(float x, float y, float z);
+	void SetPosition(DirectX::XMFLOAT3 position);
+	void SetRotation(float pitch, float yaw, float roll);
+	void SetRotation(DirectX::XMFLOAT3 rotation);
+	void SetRotation(DirectX::XMFLOAT4 quaternion);
+	void SetScale(float x, float y, float z);
+	void SetScale(DirectX::XMFLOAT3 scale);
+
+	//transformers
+	void MoveAbsolute(float x, float y, float z);
+	void MoveAbsolute(DirectX::XMFLOAT3 offset);
+	void Rotate(float pitch, float yaw, float roll);
+	void Rotate(DirectX::XMFLOAT3 rotation);
+	void Scale(float x, float y, float z);
+	void Scale(DirectX::XMFLOAT3 scale);
+
+	// hierarchy - position, rotation & scale become relative to the parent
+	bool SetParent(TransformHandle* parent);
+	TransformHandle GetParent();
+	bool HasParent();
+
+	//getters
+	DirectX::XMFLOAT3 GetPosition();
+	DirectX::XMFLOAT3 GetPitchYawRoll();
+	DirectX::XMFLOAT4 GetRotation();
+	DirectX::XMFLOAT3 GetScale();
+	DirectX::XMFLOAT4X4 GetWorldMatrix();
+	DirectX::XMFLOAT4X4 GetWorldInverseTransposeMatrix();
+
+	unsigned int GetID();
+
+private:
+	TransformSystem* system;
+	unsigned int id;
+};
+
+// Timings from TransformSystem::Benchmark()
+struct TransformBenchmarkResult
+{
+	unsigned int Count;
+	float EulerInverseMilliseconds;	// Euler angles -> matrix, then a full XMMatrixInverse
+	float ObjectMilliseconds;		// One Transform object at a time
+	float BatchedMilliseconds;		// Everything dirty, one UpdateMatrices()
+	float TenPercentMilliseconds;	// Every 10th one dirty
+	float MaxError;					// Largest difference from the Euler/inverse results
+};
+
+// --------------------------------------------------------
+// Stores every transform's components in structure-of-arrays
+// form and rebuilds the world & inverse-transpose matrices of
+// all the dirty ones in one batch.
+//
+// Rotations are stored as quaternions, so a dirty transform
+// gets its rotation matrix from a few multiplies instead of
+// three sin/cos pairs.  The Euler setters convert
+// once, when they're called, and the angles are kept alongside
+// (like Transform does) so Rotate() can keep adding to them
+// without going through the quaternion.  Transforms are processed in
+// groups of 4 that share a nibble of a dirty bitset, one per
+// vector lane, and the groups are spread across every core.
+//
+// Transforms can have parents.  Everything is kept in one flat
+// array where parents always come before their children, so a
+// single front-to-back pass is enough to pass "dirty" down the
+// hierarchy.  World matrices are then built one depth level at
+// a time, each level in parallel.
+//
+// Handles hold a stable ID; the array slot it maps to can move
+// when something gets reparented.
+// --------------------------------------------------------
+class TransformSystem
+{
+public:
+	TransformSystem();
+	~TransformSystem();
+
+	// New transforms start at the origin with no rotation & a scale of 1
+	TransformHandle Create();
+	unsigned int GetCount();
+	void Reserve(unsigned int count);
+
+	void SetPosition(unsigned int id, float x, float y, float z);
+	void SetRotation(unsigned int id, float pitch, float yaw, float roll);
+	void SetRotation(unsigned int id, DirectX::XMFLOAT4 quaternion);
+	void SetScale(unsigned int id, float x, float y, float z);
+	DirectX::XMFLOAT3 GetPosition(unsigned int id);
+	// As set - or, after SetRotation(quaternion), recovered from it
+	DirectX::XMFLOAT3 GetPitchYawRoll(unsigned int id);
+	DirectX::XMFLOAT4 GetRotation(unsigned int id);
+	DirectX::XMFLOAT3 GetScale(unsigned int id);
+
+	// TRANSFORM_NO_PARENT detaches.  Fails (and changes nothing) if it would make a loop.
+	bool SetParent(unsigned int id, unsigned int parentID);
+	unsigned int GetParent(unsigned int id);
+
+	// Rebuilds every dirty matrix
+	void UpdateMatrices();
+
+	// Swaps out the IDs of every transform whose world matrix has been
+	// rebuilt since the last call, each one listed once
+	void TakeChangedIDs(std::vector<unsigned int>& ids);
+
+	// These run UpdateMatrices() first if anything has changed
+	DirectX::XMFLOAT4X4 GetWorldMatrix(unsigned int id);
+	DirectX::XMFLOAT4X4 GetWorldInverseTransposeMatrix(unsigned int id);
+
+	// Times the original Euler/inverse math, the per-object path and the
+	// batched one, and checks that all three agree
+	static TransformBenchmarkResult Benchmark(unsigned int count);
+
+	// Checks the quaternion path against the old Euler one: world &
+	// inverse-transpose matrices from XMMatrixRotationRollPitchYaw and
+	// XMMatrixInverse, Euler round trips, quaternion setters & parents
+	static bool SelfTest();
+
+private:
+	void MarkDirty(unsigned int slot);
+	bool IsDirty(unsigned int slot);
+	void UpdateGroup(unsigned int group);
+	void MoveSlots(unsigned int first, const std::vector<unsigned int>& order);
+
+	unsigned int count;
+	bool anyDirty;
+
+	// Everything below is indexed by slot, padded out to a multiple of 4
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<DirectX::XMFLOAT4> rotation;
+	std::vector<DirectX::XMFLOAT3> pitchYawRoll;	// Only read back, never built from
+	std::vector<float> scaleX, scaleY, scaleZ;
+
+	// Hierarchy - a parent's slot is always lower than its children's
+	std::vector<unsigned int> parent;
+	std::vector<unsigned int> depth;
+
+	// Results - local ones are relative to the parent
+	std::vector<DirectX::XMFLOAT4X4> local;
+	std::vector<DirectX::XMFLOAT4X4> localInverseTranspose;
+	std::vector<DirectX::XMFLOAT4X4> world;
+	std::vector<DirectX::XMFLOAT4X4> worldInverseTranspose;
+
+	// One bit per slot, set when its own components change
+	std::vector<unsigned long long> dirty;
+
+	// Handle IDs never change, slots can
+	std::vector<unsigned int> slotOfID;
+	std::vector<unsigned int> idOfSlot;
+
+	// World matrices rebuilt since TakeChangedIDs(), with a flag per ID
+	// so nothing gets listed twice
+	std::vector<unsigned int> changedIDs;
+	std::vector<unsigned char> changedFlags;
+
+	// Scratch for UpdateMatrices(), kept around to avoid reallocating
+	std::vector<unsigned char> worldDirty;
+	std::vector<std::vector<unsigned int>> dirtyByDepth;
+};
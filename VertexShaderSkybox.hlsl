@@ -1,6 +1,6 @@
 #include "NewInclude.hlsli"
 // Constant buffer defined here
-cbuffer ExternalData : register(b0)
+cbuffer FrameData : register(b0)
 {
     matrix view;
     matrix proj;
@@ -1,15 +1,19 @@
 #include "NewInclude.hlsli"
-// Constant buffer defined here
-cbuffer ExternalData : register(b0)
+// Constant buffers defined here, split by scope (see NewInclude.hlsli)
+cbuffer FrameData : register(b0)
 {
-    matrix world;
     matrix view;
     matrix proj;
-    matrix worldInvTranspose;
     matrix lightView;
     matrix lightProjection;
 }
 
+cbuffer ObjectData : register(b3)
+{
+    matrix world;
+    matrix worldInvTranspose;
+}
+
 // Struct representing a single vertex worth of data
 // - This should match the vertex definition in our C++ code
 // - By "match", I mean the size, order and number of members
@@ -26,6 +30,11 @@ struct VertexShaderInput
     float3 normal : NORMAL; // Normal vectors
     float2 uv : TEXCOORD; // UV Maps
     float3 tangent : TANGENT; // Tangent of texture
+#ifdef INSTANCED
+    // Per-instance matrices from the second vertex buffer, a row per element
+    float4x4 instanceWorld : WORLD_PER_INSTANCE;
+    float4x4 instanceWorldInvTranspose : WORLDINVTRANSPOSE_PER_INSTANCE;
+#endif
 };
 
 // --------------------------------------------------------
@@ -40,7 +49,16 @@ VertexToPixel_NormalMap main(VertexShaderInput input)
 	// Set up output struct
     VertexToPixel_NormalMap output;
 
-    matrix worldViewProjectionMatrix = mul(proj, mul(view, world));
+    // Instanced variants get these from the vertex instead of the constant buffer
+#ifdef INSTANCED
+    matrix worldMatrix = transpose(input.instanceWorld);
+    matrix worldInvTransposeMatrix = transpose(input.instanceWorldInvTranspose);
+#else
+    matrix worldMatrix = world;
+    matrix worldInvTransposeMatrix = worldInvTranspose;
+#endif
+
+    matrix worldViewProjectionMatrix = mul(proj, mul(view, worldMatrix));
 
 	// Here we're essentially passing the input position directly through to the next
 	// stage (rasterizer), though it needs to be a 4-component vector now.  
@@ -53,17 +71,17 @@ VertexToPixel_NormalMap main(VertexShaderInput input)
     output.screenPosition = mul(worldViewProjectionMatrix, float4(input.localPosition, 1.0f));
 	
     output.uv = input.uv;
-    output.worldPosition = mul(world, float4(input.localPosition, 1)).xyz;
+    output.worldPosition = mul(worldMatrix, float4(input.localPosition, 1)).xyz;
 	// move our normal with our model (also handles non-uniform scales)
    // output.normal = mul((float3x3) world, input.normal);
     // this line shows black -> figure out a way to fix this later: 
-    output.normal = mul((float3x3) worldInvTranspose, input.normal);
+    output.normal = mul((float3x3) worldInvTransposeMatrix, input.normal);
 	
-    output.tangent = mul((float3x3) world, input.tangent);
+    output.tangent = mul((float3x3) worldMatrix, input.tangent);
 
 	
 	// shadow stuff
-    matrix shadowWVP = mul(lightProjection, mul(lightView, world));
+    matrix shadowWVP = mul(lightProjection, mul(lightView, worldMatrix));
     output.shadowMapPos = mul(shadowWVP, float4(input.localPosition, 1.0f));
 	
 	// Whatever we return will make its way through the pipeline to the
@@ -0,0 +1,3 @@
+// Same shader, with world matrices coming in per instance
+#define INSTANCED
+#include "VertexShaderWithNormalMaps.hlsl"